@@ -0,0 +1,178 @@
+// SPDX-License-Identifier: MIT
+// Hei Platform Library
+// Copyright © 2017-2026 Quartermind Games, Mark E. Sowden <markelswo@gmail.com>
+// Purpose: Measures block decompression throughput, single threaded vs. every thread.
+
+#include "qmos/public/qm_os.h"
+#include "qmos/public/qm_os_memory.h"
+#include "qmos/public/qm_os_thread.h"
+#include "qmos/public/qm_os_time.h"
+
+#include <plcore/pl.h>
+#include <plcore/pl_filesystem.h>
+#include <plcore/pl_image.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_PATH       "bin/testdata/images"
+#define DEFAULT_ITERATIONS 8
+#define SYNTHETIC_SIZE     2048
+
+static bool is_block_compressed( PLImageFormat format )
+{
+	return format == PL_IMAGEFORMAT_RGB_DXT1 || format == PL_IMAGEFORMAT_RGBA_DXT1 ||
+	       format == PL_IMAGEFORMAT_RGBA_DXT3 || format == PL_IMAGEFORMAT_RGBA_DXT5;
+}
+
+static double get_num_pixels( const QmImage *image )
+{
+	double numPixels = 0.0;
+	for ( unsigned int i = 0; i < image->levels; ++i )
+	{
+		numPixels += ( double ) QM_OS_MAX( image->width >> i, 1U ) * QM_OS_MAX( image->height >> i, 1U );
+	}
+
+	return numPixels;
+}
+
+/**
+ * Fills a full mip chain with random blocks, for when there
+ * aren't any DDS files about to test against.
+ */
+static QmImage *create_synthetic_image( PLImageFormat format, unsigned int size )
+{
+	QmImage *image = PlCreateImage( nullptr, size, size, 0, PL_COLOURFORMAT_RGBA, format );
+	if ( image == nullptr )
+	{
+		return nullptr;
+	}
+
+	unsigned int levels = 1;
+	while ( ( size >> levels ) > 0 )
+	{
+		levels++;
+	}
+
+	qm_os_memory_free( image->data[ 0 ] );
+	qm_os_memory_free( image->data );
+
+	image->levels = levels;
+	image->data   = QM_OS_MEMORY_NEW_( uint8_t *, levels );
+	for ( unsigned int i = 0; i < levels; ++i )
+	{
+		unsigned int levelSize = QM_OS_MAX( size >> i, 1U );
+		unsigned int dataSize  = PlGetImageSize( format, levelSize, levelSize );
+
+		image->data[ i ] = QM_OS_MEMORY_MALLOC_( dataSize );
+		for ( unsigned int j = 0; j < dataSize; ++j )
+		{
+			image->data[ i ][ j ] = ( uint8_t ) rand();
+		}
+	}
+
+	snprintf( image->path, sizeof( image->path ), "synthetic %ux%u (format %d)", size, size, format );
+
+	return image;
+}
+
+/**
+ * Returns the throughput in megapixels per second.
+ */
+static double run_benchmark( const QmImage *image, unsigned int numThreads, unsigned int iterations )
+{
+	double start = qm_os_time_get_seconds();
+	for ( unsigned int i = 0; i < iterations; ++i )
+	{
+		QmImage *decompressed = qm_image_decompress( image, numThreads );
+		if ( decompressed == nullptr )
+		{
+			printf( "Failed to decompress \"%s\": %s\n", image->path, PlGetError() );
+			return 0.0;
+		}
+
+		PlDestroyImage( decompressed );
+	}
+	double elapsed = qm_os_time_get_seconds() - start;
+
+	return ( get_num_pixels( image ) * iterations / 1000000.0 ) / elapsed;
+}
+
+int main( int argc, char **argv )
+{
+	PlInitialize( argc, argv );
+	PlRegisterStandardImageLoaders( PL_IMAGE_FILEFORMAT_DDS );
+
+	const char  *path       = ( argc > 1 ) ? argv[ 1 ] : DEFAULT_PATH;
+	unsigned int iterations = ( argc > 2 ) ? ( unsigned int ) strtoul( argv[ 2 ], nullptr, 10 ) : DEFAULT_ITERATIONS;
+	if ( iterations == 0 )
+	{
+		iterations = 1;
+	}
+
+	unsigned int numPaths;
+	char       **paths = PlScanDirectoryToArray( path, "dds", true, 0, &numPaths );
+
+	QmImage    **images    = QM_OS_MEMORY_NEW_( QmImage *, numPaths + 2 );
+	unsigned int numImages = 0;
+	for ( unsigned int i = 0; i < numPaths; ++i )
+	{
+		QmImage *image = qm_image_load( paths[ i ] );
+		if ( image == nullptr || !is_block_compressed( image->format ) )
+		{
+			PlDestroyImage( image );
+			continue;
+		}
+
+		images[ numImages++ ] = image;
+	}
+	qm_os_memory_free( paths );
+
+	if ( numImages == 0 )
+	{
+		printf( "No block compressed DDS files found in \"%s\", using synthetic images instead\n", path );
+		images[ numImages++ ] = create_synthetic_image( PL_IMAGEFORMAT_RGBA_DXT1, SYNTHETIC_SIZE );
+		images[ numImages++ ] = create_synthetic_image( PL_IMAGEFORMAT_RGBA_DXT5, SYNTHETIC_SIZE );
+	}
+
+	unsigned int numThreads = qm_os_thread_get_available();
+	printf( "%u iterations, 1 vs. %u threads\n\n", iterations, numThreads );
+
+	double totalPixels = 0.0, totalSingle = 0.0, totalMulti = 0.0;
+	for ( unsigned int i = 0; i < numImages; ++i )
+	{
+		const QmImage *image = images[ i ];
+		if ( image == nullptr )
+		{
+			continue;
+		}
+
+		double numPixels = get_num_pixels( image ) * iterations / 1000000.0;
+		double single    = run_benchmark( image, 1, iterations );
+		double multi     = run_benchmark( image, numThreads, iterations );
+		printf( "%s\n\t%ux%u, %u levels: %.1f MPix/s single, %.1f MPix/s threaded (%.2fx)\n",
+		        image->path, image->width, image->height, image->levels, single, multi, ( single > 0.0 ) ? multi / single : 0.0 );
+
+		if ( single > 0.0 && multi > 0.0 )
+		{
+			totalPixels += numPixels;
+			totalSingle += numPixels / single;
+			totalMulti += numPixels / multi;
+		}
+	}
+
+	if ( totalPixels > 0.0 )
+	{
+		printf( "\nOverall: %.1f MPix/s single, %.1f MPix/s threaded\n", totalPixels / totalSingle, totalPixels / totalMulti );
+	}
+
+	for ( unsigned int i = 0; i < numImages; ++i )
+	{
+		PlDestroyImage( images[ i ] );
+	}
+	qm_os_memory_free( images );
+
+	PlShutdown();
+
+	return EXIT_SUCCESS;
+}
@@ -27,36 +27,20 @@
  * 1.3  24 Aug 2013     - Return unused input from blast()
  *                      - Fix test code to correctly report unused input
  *                      - Enable the provision of initial input to blast()
+ * 1.3h 17 Oct 2026     - (Hei) Add blast_stream_init() and blast_stream_next()
+ *                        for pulling the output a window at a time
+ *                      - Move the decoding tables out of decomp() to share them
  */
 
 #include <stddef.h>             /* for NULL */
-#include <setjmp.h>             /* for setjmp(), longjmp(), and jmp_buf */
-#include "blast.h"              /* prototype for blast() */
+#include <string.h>             /* for memset() */
+#include "blast.h"              /* prototype for blast(), state */
 
 #define local static            /* for local function definitions */
 #define MAXBITS 13              /* maximum code length */
 #define MAXWIN 4096             /* maximum window size */
 
-/* input and output state */
-struct state {
-    /* input state */
-    blast_in infun;             /* input function provided by user */
-    void *inhow;                /* opaque information passed to infun() */
-    unsigned char *in;          /* next input location */
-    unsigned left;              /* available input at in */
-    int bitbuf;                 /* bit buffer */
-    int bitcnt;                 /* number of bits in bit buffer */
-
-    /* input limit error return state for bits() and decode() */
-    jmp_buf env;
-
-    /* output state */
-    blast_out outfun;           /* output function provided by user */
-    void *outhow;               /* opaque information passed to outfun() */
-    unsigned next;              /* index of next write location in out[] */
-    int first;                  /* true to check distances (for first 4K) */
-    unsigned char out[MAXWIN];  /* output buffer and sliding window */
-};
+/* input and output state, struct blast_state, is in blast.h */
 
 /*
  * Return need bits from the input stream.  This always leaves less than
@@ -69,7 +53,7 @@ struct state {
  *   buffer, using shift right, and new bytes are appended to the top of the
  *   bit buffer, using shift left.
  */
-local int bits(struct state *s, int need)
+local int bits(struct blast_state *s, int need)
 {
     int val;            /* bit accumulator */
 
@@ -126,7 +110,7 @@ struct huffman {
  *   this ordering, the bits pulled during decoding are inverted to apply the
  *   more "natural" ordering starting with all zeros and incrementing.
  */
-local int decode(struct state *s, struct huffman *h)
+local int decode(struct blast_state *s, struct huffman *h)
 {
     int len;            /* current number of bits in code */
     int code;           /* len bits being decoded */
@@ -241,6 +225,45 @@ local int construct(struct huffman *h, const unsigned char *rep, int n)
     return left;
 }
 
+/*
+ * Decoding tables, shared by decomp() and blast_stream_next().
+ */
+static int virgin = 1;                              /* build tables once */
+static short litcnt[MAXBITS+1], litsym[256];        /* litcode memory */
+static short lencnt[MAXBITS+1], lensym[16];         /* lencode memory */
+static short distcnt[MAXBITS+1], distsym[64];       /* distcode memory */
+static struct huffman litcode = {litcnt, litsym};   /* length code */
+static struct huffman lencode = {lencnt, lensym};   /* length code */
+static struct huffman distcode = {distcnt, distsym};/* distance code */
+    /* bit lengths of literal codes */
+static const unsigned char litlen[] = {
+    11, 124, 8, 7, 28, 7, 188, 13, 76, 4, 10, 8, 12, 10, 12, 10, 8, 23, 8,
+    9, 7, 6, 7, 8, 7, 6, 55, 8, 23, 24, 12, 11, 7, 9, 11, 12, 6, 7, 22, 5,
+    7, 24, 6, 11, 9, 6, 7, 22, 7, 11, 38, 7, 9, 8, 25, 11, 8, 11, 9, 12,
+    8, 12, 5, 38, 5, 38, 5, 11, 7, 5, 6, 21, 6, 10, 53, 8, 7, 24, 10, 27,
+    44, 253, 253, 253, 252, 252, 252, 13, 12, 45, 12, 45, 12, 61, 12, 45,
+    44, 173};
+    /* bit lengths of length codes 0..15 */
+static const unsigned char lenlen[] = {2, 35, 36, 53, 38, 23};
+    /* bit lengths of distance codes 0..63 */
+static const unsigned char distlen[] = {2, 20, 53, 230, 247, 151, 248};
+static const short base[16] = {     /* base for length codes */
+    3, 2, 4, 5, 6, 7, 8, 9, 10, 12, 16, 24, 40, 72, 136, 264};
+static const char extra[16] = {     /* extra bits for length codes */
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8};
+
+
+/* set up decoding tables (once--might not be thread-safe) */
+local void tables(void)
+{
+    if (virgin) {
+        construct(&litcode, litlen, sizeof(litlen));
+        construct(&lencode, lenlen, sizeof(lenlen));
+        construct(&distcode, distlen, sizeof(distlen));
+        virgin = 0;
+    }
+}
+
 /*
  * Decode PKWare Compression Library stream.
  *
@@ -279,7 +302,7 @@ local int construct(struct huffman *h, const unsigned char *rep, int n)
  *   ignoring whether the length is greater than the distance or not implements
  *   this correctly.
  */
-local int decomp(struct state *s)
+local int decomp(struct blast_state *s)
 {
     int lit;            /* true if literals are coded */
     int dict;           /* log2(dictionary size) - 6 */
@@ -288,37 +311,7 @@ local int decomp(struct state *s)
     unsigned dist;      /* distance for copy */
     int copy;           /* copy counter */
     unsigned char *from, *to;   /* copy pointers */
-    static int virgin = 1;                              /* build tables once */
-    static short litcnt[MAXBITS+1], litsym[256];        /* litcode memory */
-    static short lencnt[MAXBITS+1], lensym[16];         /* lencode memory */
-    static short distcnt[MAXBITS+1], distsym[64];       /* distcode memory */
-    static struct huffman litcode = {litcnt, litsym};   /* length code */
-    static struct huffman lencode = {lencnt, lensym};   /* length code */
-    static struct huffman distcode = {distcnt, distsym};/* distance code */
-        /* bit lengths of literal codes */
-    static const unsigned char litlen[] = {
-        11, 124, 8, 7, 28, 7, 188, 13, 76, 4, 10, 8, 12, 10, 12, 10, 8, 23, 8,
-        9, 7, 6, 7, 8, 7, 6, 55, 8, 23, 24, 12, 11, 7, 9, 11, 12, 6, 7, 22, 5,
-        7, 24, 6, 11, 9, 6, 7, 22, 7, 11, 38, 7, 9, 8, 25, 11, 8, 11, 9, 12,
-        8, 12, 5, 38, 5, 38, 5, 11, 7, 5, 6, 21, 6, 10, 53, 8, 7, 24, 10, 27,
-        44, 253, 253, 253, 252, 252, 252, 13, 12, 45, 12, 45, 12, 61, 12, 45,
-        44, 173};
-        /* bit lengths of length codes 0..15 */
-    static const unsigned char lenlen[] = {2, 35, 36, 53, 38, 23};
-        /* bit lengths of distance codes 0..63 */
-    static const unsigned char distlen[] = {2, 20, 53, 230, 247, 151, 248};
-    static const short base[16] = {     /* base for length codes */
-        3, 2, 4, 5, 6, 7, 8, 9, 10, 12, 16, 24, 40, 72, 136, 264};
-    static const char extra[16] = {     /* extra bits for length codes */
-        0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8};
-
-    /* set up decoding tables (once--might not be thread-safe) */
-    if (virgin) {
-        construct(&litcode, litlen, sizeof(litlen));
-        construct(&lencode, lenlen, sizeof(lenlen));
-        construct(&distcode, distlen, sizeof(distlen));
-        virgin = 0;
-    }
+    tables();
 
     /* read header */
     lit = bits(s, 8);
@@ -383,7 +376,7 @@ local int decomp(struct state *s)
 int blast(blast_in infun, void *inhow, blast_out outfun, void *outhow,
           unsigned *left, unsigned char **in)
 {
-    struct state s;             /* input/output state */
+    struct blast_state s;             /* input/output state */
     int err;                    /* return value */
 
     /* initialize input state */
@@ -422,6 +415,121 @@ int blast(blast_in infun, void *inhow, blast_out outfun, void *outhow,
     return err;
 }
 
+/*
+ * Resumable form of decomp(), which returns whenever the window is full,
+ * rather than handing it to outfun(), and picks up where it left off.
+ * A copy that's cut short by the window filling up is carried over.
+ */
+local int decomp_resume(struct blast_stream *bs)
+{
+    struct blast_state *s = &bs->s;
+    int symbol;         /* decoded symbol, extra bits for distance */
+    int copy;           /* copy counter */
+    unsigned char *from, *to;   /* copy pointers */
+
+    /* read header */
+    if (bs->stage == 0) {
+        bs->lit = bits(s, 8);
+        if (bs->lit > 1) return -1;
+        bs->dict = bits(s, 8);
+        if (bs->dict < 4 || bs->dict > 6) return -2;
+        bs->stage = 1;
+    }
+
+    /* the last window has been handed out, so start on the next */
+    if (s->next == MAXWIN) {
+        s->next = 0;
+        s->first = 0;
+        bs->flushed = 0;
+    }
+
+    /* decode literals and length/distance pairs */
+    do {
+        if (bs->len == 0) {
+            if (bits(s, 1)) {
+                /* get length */
+                symbol = decode(s, &lencode);
+                bs->len = base[symbol] + bits(s, extra[symbol]);
+                if (bs->len == 519) {           /* end code */
+                    bs->len = 0;
+                    bs->stage = 2;
+                    return 0;
+                }
+
+                /* get distance */
+                symbol = bs->len == 2 ? 2 : bs->dict;
+                bs->dist = decode(s, &distcode) << symbol;
+                bs->dist += bits(s, symbol);
+                bs->dist++;
+                if (s->first && bs->dist > s->next)
+                    return -3;              /* distance too far back */
+            }
+            else {
+                /* get literal and write it */
+                symbol = bs->lit ? decode(s, &litcode) : bits(s, 8);
+                s->out[s->next++] = symbol;
+                if (s->next == MAXWIN) return 0;
+                continue;
+            }
+        }
+
+        /* copy length bytes from distance bytes back */
+        do {
+            to = s->out + s->next;
+            from = to - bs->dist;
+            copy = MAXWIN;
+            if (s->next < bs->dist) {
+                from += copy;
+                copy = bs->dist;
+            }
+            copy -= s->next;
+            if (copy > bs->len) copy = bs->len;
+            bs->len -= copy;
+            s->next += copy;
+            do {
+                *to++ = *from++;
+            } while (--copy);
+            if (s->next == MAXWIN) return 0;
+        } while (bs->len != 0);
+    } while (1);
+}
+
+/* See comments in blast.h */
+void blast_stream_init(struct blast_stream *bs, blast_in infun, void *inhow)
+{
+    memset(bs, 0, sizeof(*bs));
+    bs->s.infun = infun;
+    bs->s.inhow = inhow;
+    bs->s.first = 1;
+    tables();
+}
+
+/* See comments in blast.h */
+int blast_stream_next(struct blast_stream *bs, unsigned char **out,
+                      unsigned *len)
+{
+    *len = 0;
+
+    /* errors stick, as the state is no good after one */
+    if (bs->err != 0)
+        return bs->err;
+
+    if (bs->stage != 2 && bs->s.next - bs->flushed == 0) {
+        /* return if bits() or decode() tries to read past available input */
+        if (setjmp(bs->s.env) != 0)
+            bs->err = 2;
+        else
+            bs->err = decomp_resume(bs);
+        if (bs->err != 0)
+            return bs->err;
+    }
+
+    *out = bs->s.out + bs->flushed;
+    *len = bs->s.next - bs->flushed;
+    bs->flushed = bs->s.next;
+    return 0;
+}
+
 #ifdef TEST
 /* Example of how to use blast() */
 #include <stdio.h>
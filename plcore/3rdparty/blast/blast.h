@@ -35,6 +35,8 @@
  */
 
 
+#include <setjmp.h>             /* for jmp_buf */
+
 typedef unsigned (*blast_in)(void *how, unsigned char **buf);
 typedef int (*blast_out)(void *how, unsigned char *buf, unsigned len);
 /* Definitions for input/output functions passed to blast().  See below for
@@ -81,3 +83,51 @@ int blast(blast_in infun, void *inhow, blast_out outfun, void *outhow,
  * At the bottom of blast.c is an example program that uses blast() that can be
  * compiled to produce a command-line decompression filter by defining TEST.
  */
+
+
+/* input and output state */
+struct blast_state {
+    /* input state */
+    blast_in infun;             /* input function provided by user */
+    void *inhow;                /* opaque information passed to infun() */
+    unsigned char *in;          /* next input location */
+    unsigned left;              /* available input at in */
+    int bitbuf;                 /* bit buffer */
+    int bitcnt;                 /* number of bits in bit buffer */
+
+    /* input limit error return state for bits() and decode() */
+    jmp_buf env;
+
+    /* output state */
+    blast_out outfun;           /* output function provided by user */
+    void *outhow;               /* opaque information passed to outfun() */
+    unsigned next;              /* index of next write location in out[] */
+    int first;                  /* true to check distances (for first 4K) */
+    unsigned char out[4096];    /* output buffer and sliding window */
+};
+
+/* resumable decompression state (Hei) */
+struct blast_stream {
+    struct blast_state s;
+    unsigned flushed;           /* how much of out[] has been handed back */
+    int stage;                  /* 0 for the header, 1 for data, 2 once done */
+    int lit;                    /* true if literals are coded */
+    int dict;                   /* log2(dictionary size) - 6 */
+    int len;                    /* what's left of a copy cut short */
+    unsigned dist;              /* distance for that copy */
+    int err;                    /* first error hit, if any */
+};
+
+
+void blast_stream_init(struct blast_stream *s, blast_in infun, void *inhow);
+int blast_stream_next(struct blast_stream *s, unsigned char **out,
+                      unsigned *len);
+/* Resumable form of blast(), for pulling the output a window at a time
+ * rather than having it pushed through an output function.  The input
+ * function works as it does for blast().  Each call to blast_stream_next()
+ * decompresses up to the next 4096 bytes, which *out is then set to point
+ * at, valid until the next call, with *len set to how many there are.  A
+ * *len of zero means the end has been reached.  The return codes are those
+ * of blast(), other than 1, which never happens.  Once an error has been
+ * returned, it's returned again for every call after.
+ */
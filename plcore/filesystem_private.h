@@ -7,6 +7,7 @@
 #pragma once
 
 #include <plcore/pl_filesystem.h>
+#include <plcore/pl_package.h>
 
 #ifdef _DEBUG
 #	define FSLog( ... ) PlLogMessage( LOG_LEVEL_FILESYSTEM, __VA_ARGS__ )
@@ -29,4 +30,157 @@ typedef struct QmFsFile
 	time_t timeStamp;
 	FILE  *fptr;
 	bool   isUnmanaged;
+
+	struct QmFsMapping    *mapping;   // released on close, if set
+	struct QmFsCacheEntry *cacheEntry;// released on close, if set
+	struct QmFsStream     *stream;    // destroyed on close, if set
+
+	/* read-ahead for streamed files; the stdio cursor
+	 * always sits at bufferOffset + bufferLength */
+	uint8_t *buffer;
+	size_t   bufferSize;// 0 if disabled
+	size_t   bufferLength;
+	size_t   bufferPos;
+	uint64_t bufferOffset;
 } QmFsFile;
+
+/**
+ * Read-only mapping of a local file, shared between
+ * everything referencing it and unmapped once the
+ * last reference is released.
+ */
+typedef struct QmFsMapping QmFsMapping;
+
+QmFsMapping *qm_fs_mapping_open( const char *path );
+QmFsMapping *qm_fs_mapping_acquire( QmFsMapping *self );
+void         qm_fs_mapping_release( QmFsMapping *self );
+const void  *qm_fs_mapping_get_data( const QmFsMapping *self );
+size_t       qm_fs_mapping_get_size( const QmFsMapping *self );
+
+QmFsFile *qm_fs_file_from_mapping( const char *path, QmFsMapping *mapping, size_t offset, size_t size );
+
+/**
+ * Opens the file without a read-ahead buffer, for handles
+ * that are only ever read from via qm_fs_file_read_at.
+ */
+QmFsFile *qm_fs_file_open_unbuffered_( const char *path );
+
+/**
+ * Source for files whose data is produced as it's read, i.e.
+ * compressed package entries that are inflated on demand.
+ * Seeking backwards restarts the stream and skips forward.
+ */
+typedef struct QmFsStream
+{
+	size_t ( *read )( struct QmFsStream *self, void *dest, size_t size );
+	bool ( *restart )( struct QmFsStream *self );
+	void ( *destroy )( struct QmFsStream *self );
+} QmFsStream;
+
+/**
+ * Creates a file reading from the given stream, which
+ * is then destroyed when the file is closed (or on fail).
+ */
+QmFsFile *qm_fs_file_from_stream( const char *path, QmFsStream *stream, size_t size );
+
+/**
+ * Resolves the virtual path to an entry within a mounted package.
+ * If it doesn't reside in one, null is returned and the local path
+ * is written out instead, if a buffer was provided.
+ */
+QmFsPackage *qm_fs_resolve_path_( const char *path, unsigned int *index, char *localPath, size_t localPathSize );
+
+/**
+ * Ensures the package's shared handle (or mapping) is ready,
+ * so entries can then be loaded from multiple threads.
+ */
+bool qm_fs_package_open_handle_( QmFsPackage *package );
+
+/**
+ * Fetches where the raw data for a package entry lives, if it can be
+ * read directly from a local file, i.e. by the io_uring engine.
+ */
+bool qm_fs_package_get_raw_entry_( QmFsPackage *package, unsigned int index, int *fd, uint64_t *offset, size_t *size );
+
+/**
+ * Decompresses the raw data for a package entry into a new buffer.
+ */
+void *qm_fs_package_decompress_entry_( const QmFsPackageFile *pi, const void *raw );
+
+/**
+ * Cache of decompressed package entries. Files returned by
+ * find and insert reference the cached data, rather than
+ * owning a copy. Insert takes ownership of the given data.
+ */
+typedef struct QmFsCacheEntry QmFsCacheEntry;
+
+void      qm_fs_package_cache_initialize_( void );
+void      qm_fs_package_cache_shutdown_( void );
+uint64_t  qm_fs_package_cache_generate_id_( void );
+void      qm_fs_package_cache_forget_( const QmFsPackage *package );
+QmFsFile *qm_fs_package_cache_find_( const QmFsPackage *package, unsigned int index );
+QmFsFile *qm_fs_package_cache_insert_( const QmFsPackage *package, unsigned int index, void *data );
+void      qm_fs_cache_entry_release_( QmFsCacheEntry *self );
+
+/**
+ * Index of entry names, built once the package has been parsed.
+ */
+void qm_fs_package_build_index_( QmFsPackage *package );
+void qm_fs_package_destroy_index_( QmFsPackage *package );
+
+/**
+ * Opens a package entry as a stream, decompressing it as it's read
+ * rather than all at once. Only stored, deflate and implode entries
+ * are supported.
+ */
+QmFsFile *qm_fs_package_open_stream_( QmFsPackage *package, unsigned int index );
+
+/**
+ * Applies a change to a file within a directory mount to the VFS index,
+ * returning how it appears through the VFS; none if another mount takes
+ * priority for the path. Anything that can't be applied incrementally
+ * raises the rebuild flag, in which case the index should be rebuilt
+ * once all the changes have been applied.
+ */
+QmFsWatchEventType qm_fs_index_apply_change_( QmFsMount *mount, const char *path, QmFsWatchEventType type, bool *rebuild );
+void               qm_fs_index_rebuild_( void );
+
+/**
+ * Calls the given function for every file beneath the path
+ * in the VFS index that's currently served by the mount.
+ */
+void qm_fs_index_enumerate_( const QmFsMount *mount, const char *path, void ( *callback )( const char *path, void *userData ), void *userData );
+
+/**
+ * Snapshots of parsed package tables, so they needn't be parsed again
+ * on the next load. Load returns null if there isn't a snapshot for the
+ * package or it's out of date.
+ */
+QmFsPackage *qm_fs_package_snapshot_load_( const char *path, size_t fileSize, time_t timeStamp );
+void         qm_fs_package_snapshot_save_( QmFsPackage *package, size_t fileSize );
+
+#if defined( PL_IO_URING )
+
+/**
+ * Read engine backed by io_uring, one per worker thread. Only available
+ * on Linux, and only if the kernel allows it; qm_fs_uring_get will
+ * return null otherwise, in which case reads should go via pread.
+ */
+typedef struct QmFsUring QmFsUring;
+
+typedef struct QmFsUringRead
+{
+	int      fd;
+	void    *dest;// if null, the data is only valid for the duration of the callback
+	size_t   size;
+	uint64_t offset;
+	void    *userData;
+} QmFsUringRead;
+
+typedef void ( *QmFsUringCallback )( QmFsUringRead *read, const void *data, bool status );
+
+QmFsUring *qm_fs_uring_get( void );
+void       qm_fs_uring_read( QmFsUring *self, QmFsUringRead *reads, unsigned int numReads, QmFsUringCallback callback );
+void       qm_fs_uring_shutdown( void );
+
+#endif
@@ -97,43 +97,35 @@ QmImage *qm_image_3df_parse( QmFsFile *file ) {
 			return NULL;
 	}
 
-	/* now we can load the actual data in */
-	size_t srcSize = PlGetImageSize( dataFormat, w, h );
-	uint8_t *srcBuf = QM_OS_MEMORY_MALLOC_( srcSize );
-	if ( qm_file_read( file, srcBuf, sizeof( char ), srcSize ) != srcSize ) {
-		qm_os_memory_free( srcBuf );
+	QmImage *image = PlCreateImage( NULL, w, h, 0, PL_COLOURFORMAT_RGBA, PL_IMAGEFORMAT_RGBA8 );
+	if ( image == NULL ) {
 		return NULL;
 	}
 
-	/* convert it... */
-	size_t dstSize = PlGetImageSize( PL_IMAGEFORMAT_RGBA8, w, h );
-	uint8_t *dstBuf = QM_OS_MEMORY_MALLOC_( dstSize );
-	if ( dataFormat != PL_IMAGEFORMAT_RGBA8 ) {
-		switch ( dataFormat ) {
-			case PL_IMAGEFORMAT_RGB5A1: {
-				uint8_t *dstPos = dstBuf;
-				for ( size_t i = 0; i < srcSize; i += 2 ) {
-					dstPos[ PL_RED ] = ( ( srcBuf[ i ] & 124 ) << 1 );
-					dstPos[ PL_GREEN ] = ( ( srcBuf[ i ] & 3 ) << 6 ) | ( ( srcBuf[ i + 1 ] & 224 ) >> 2 );
-					dstPos[ PL_BLUE ] = ( ( srcBuf[ i + 1 ] & 31 ) << 3 );
-					dstPos[ PL_ALPHA ] = ( srcBuf[ i ] & 128 ) ? 0 : 255;
-					dstPos += 4;
-				}
+	/* now we can load the actual data in, and convert it in place */
+	size_t srcSize = PlGetImageSize( dataFormat, w, h );
+	const uint8_t *srcBuf = qm_image_read_payload_( file, srcSize, image->data[ 0 ], image->size );
+	if ( srcBuf == NULL ) {
+		PlDestroyImage( image );
+		return NULL;
+	}
 
-				qm_os_memory_free( srcBuf );
-				break;
-			}
-			default:
-				qm_os_memory_free( dstBuf );
-				dstBuf = srcBuf;
-				break;
+	if ( dataFormat == PL_IMAGEFORMAT_RGB5A1 ) {
+		uint8_t *dstPos = image->data[ 0 ];
+		for ( size_t i = 0; i < srcSize; i += 2 ) {
+			/* both bytes are needed before writing, as the last pixel overlaps */
+			uint8_t hi = srcBuf[ i ];
+			uint8_t lo = srcBuf[ i + 1 ];
+			dstPos[ PL_RED ] = ( ( hi & 124 ) << 1 );
+			dstPos[ PL_GREEN ] = ( ( hi & 3 ) << 6 ) | ( ( lo & 224 ) >> 2 );
+			dstPos[ PL_BLUE ] = ( ( lo & 31 ) << 3 );
+			dstPos[ PL_ALPHA ] = ( hi & 128 ) ? 0 : 255;
+			dstPos += 4;
 		}
+	} else if ( !qm_image_convert_pixels( srcBuf, dataFormat, image->data[ 0 ], PL_IMAGEFORMAT_RGBA8, ( size_t ) w * h ) ) {
+		PlDestroyImage( image );
+		return NULL;
 	}
 
-	QmImage *image = PlCreateImage( dstBuf, w, h, 0, PL_COLOURFORMAT_RGBA, PL_IMAGEFORMAT_RGBA8 );
-
-	/* no longer need this */
-	qm_os_memory_free( dstBuf );
-
 	return image;
 }
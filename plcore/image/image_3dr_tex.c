@@ -1,7 +1,7 @@
 // SPDX-License-Identifier: MIT
 // Copyright © 2017-2024 Mark E Sowden <hogsy@oldtimes-software.com>
 
-#include "plcore/pl_image.h"
+#include "image_private.h"
 #include "qmos/public/qm_os_memory.h"
 
 // Quickly whipped up loader for 3D Realms' TEX format
@@ -41,14 +41,19 @@ QmImage *qm_image_3dr_parse( QmFsFile *file ) {
 	// again, no idea...
 	qm_fs_file_seek( file, 12, QM_FS_SEEK_CUR );
 
+	QmImage *image = PlCreateImage( NULL, width, height, 0, PL_COLOURFORMAT_RGBA, PL_IMAGEFORMAT_RGBA8 );
+	if ( image == NULL ) {
+		return NULL;
+	}
+
 	unsigned int size = width * height;
-	uint16_t *src = QM_OS_MEMORY_NEW_( uint16_t, size );
-	if ( qm_file_read( file, src, sizeof( uint16_t ), size ) != size ) {
-		qm_os_memory_free( src );
+	const uint8_t *src = qm_image_read_payload_( file, size * sizeof( uint16_t ), image->data[ 0 ], image->size );
+	if ( src == NULL ) {
+		PlDestroyImage( image );
 		return NULL;
 	}
 
-	QmMathColour4ub *dst = QM_OS_MEMORY_NEW_( QmMathColour4ub, size );
+	QmMathColour4ub *dst = ( QmMathColour4ub * ) image->data[ 0 ];
 	if ( mode == 0x500 ) {
 		const unsigned int shiftA = 12;
 		const unsigned int shiftR = 8;
@@ -58,10 +63,11 @@ QmImage *qm_image_3dr_parse( QmFsFile *file ) {
 		const unsigned int mask = 15;
 
 		for ( unsigned int i = 0; i < size; i++ ) {
-			dst[ i ].a = ( ( src[ i ] & ( mask << shiftA ) ) >> shiftA ) * 255 / mask;
-			dst[ i ].r = ( ( src[ i ] & ( mask << shiftR ) ) >> shiftR ) * 255 / mask;
-			dst[ i ].g = ( ( src[ i ] & ( mask << shiftG ) ) >> shiftG ) * 255 / mask;
-			dst[ i ].b = ( ( src[ i ] & ( mask << shiftB ) ) >> shiftB ) * 255 / mask;
+			uint16_t c = ( uint16_t ) ( src[ i * 2 ] | ( src[ i * 2 + 1 ] << 8 ) );
+			dst[ i ].a = ( ( c & ( mask << shiftA ) ) >> shiftA ) * 255 / mask;
+			dst[ i ].r = ( ( c & ( mask << shiftR ) ) >> shiftR ) * 255 / mask;
+			dst[ i ].g = ( ( c & ( mask << shiftG ) ) >> shiftG ) * 255 / mask;
+			dst[ i ].b = ( ( c & ( mask << shiftB ) ) >> shiftB ) * 255 / mask;
 		}
 	} else {
 		const unsigned int shiftR = 11;
@@ -73,17 +79,13 @@ QmImage *qm_image_3dr_parse( QmFsFile *file ) {
 		const unsigned int maskB = 31;
 
 		for ( unsigned int i = 0; i < size; i++ ) {
+			uint16_t c = ( uint16_t ) ( src[ i * 2 ] | ( src[ i * 2 + 1 ] << 8 ) );
 			dst[ i ].a = 255;
-			dst[ i ].r = ( ( src[ i ] & ( maskR << shiftR ) ) >> shiftR ) * 255 / maskR;
-			dst[ i ].g = ( ( src[ i ] & ( maskG << shiftG ) ) >> shiftG ) * 255 / maskG;
-			dst[ i ].b = ( ( src[ i ] & ( maskB << shiftB ) ) >> shiftB ) * 255 / maskB;
+			dst[ i ].r = ( ( c & ( maskR << shiftR ) ) >> shiftR ) * 255 / maskR;
+			dst[ i ].g = ( ( c & ( maskG << shiftG ) ) >> shiftG ) * 255 / maskG;
+			dst[ i ].b = ( ( c & ( maskB << shiftB ) ) >> shiftB ) * 255 / maskB;
 		}
 	}
 
-	QmImage *image = PlCreateImage( dst, width, height, 0, PL_COLOURFORMAT_RGBA, PL_IMAGEFORMAT_RGBA8 );
-
-	qm_os_memory_free( src );
-	qm_os_memory_free( dst );
-
 	return image;
 }
@@ -69,22 +69,27 @@ QmImage *qm_image_angel_tex_parse( QmFsFile *file ) {
 			}
 
 			image = PlCreateImage( NULL, header.width, header.height, 0, PL_COLOURFORMAT_RGBA, PL_IMAGEFORMAT_RGBA8 );
+			if ( image == NULL ) {
+				return NULL;
+			}
 
-			uint8_t *pixels = QM_OS_MEMORY_NEW_( uint8_t, numPixels );
-			qm_file_read( file, pixels, sizeof( uint8_t ), numPixels );
+			const uint8_t *pixels = qm_image_read_payload_( file, numPixels, image->data[ 0 ], image->size );
+			if ( pixels == NULL ) {
+				PlDestroyImage( image );
+				return NULL;
+			}
 
+			/* expanded front to back, as the indices may share the buffer, and then flipped */
 			uint8_t *dst = image->data[ 0 ];
-			for ( int y = 0; y < header.height; ++y ) {
-				uint8_t *src = pixels + ( header.height - y - 1 ) * header.width;
-				for ( int x = 0; x < header.width; ++x, ++src ) {
-					*dst++ = palette[ *src ].b;
-					*dst++ = palette[ *src ].g;
-					*dst++ = palette[ *src ].r;
-					*dst++ = palette[ *src ].a;
-				}
+			for ( unsigned int i = 0; i < numPixels; ++i ) {
+				uint8_t index = pixels[ i ];
+				*dst++ = palette[ index ].b;
+				*dst++ = palette[ index ].g;
+				*dst++ = palette[ index ].r;
+				*dst++ = palette[ index ].a;
 			}
 
-			qm_os_memory_free( pixels );
+			PlFlipImageVertical( image );
 			break;
 		}
 	}
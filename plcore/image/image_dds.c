@@ -19,6 +19,7 @@
 #define DDS_MAGIC_BC4S QM_OS_MAGIC_TO_NUM( 'B', 'C', '4', 'S' )
 #define DDS_MAGIC_BC5U QM_OS_MAGIC_TO_NUM( 'B', 'C', '5', 'U' )
 #define DDS_MAGIC_BC5S QM_OS_MAGIC_TO_NUM( 'B', 'C', '5', 'S' )
+#define DDS_MAGIC_DX10 QM_OS_MAGIC_TO_NUM( 'D', 'X', '1', '0' )
 
 #define DDS_HEADER_SIZE    124 /* DDSHeader size minus magic */
 #define DDS_HEADER_PF_SIZE 32
@@ -73,6 +74,56 @@ PL_STATIC_ASSERT( sizeof( DDSHeader ) == 128, "Invalid DDSHeader size!" );
 #define DDS_FLAGS_LINEARSIZE  0x80000
 #define DDS_FLAGS_DEPTH       0x800000
 
+#define DDS_CAPS_COMPLEX 0x8
+#define DDS_CAPS_TEXTURE 0x1000
+#define DDS_CAPS_MIPMAP  0x400000
+
+/* follows the header when the fourCC is DX10 */
+typedef struct DDSHeaderDX10 {
+	uint32_t dxgiFormat;
+	uint32_t resourceDimension;
+	uint32_t miscFlag;
+	uint32_t arraySize;
+	uint32_t miscFlags2;
+} DDSHeaderDX10;
+PL_STATIC_ASSERT( sizeof( DDSHeaderDX10 ) == 20, "Invalid DDSHeaderDX10 size!" );
+
+#define DXGI_FORMAT_BC1_UNORM      71
+#define DXGI_FORMAT_BC1_UNORM_SRGB 72
+#define DXGI_FORMAT_BC2_UNORM      74
+#define DXGI_FORMAT_BC2_UNORM_SRGB 75
+#define DXGI_FORMAT_BC3_UNORM      77
+#define DXGI_FORMAT_BC3_UNORM_SRGB 78
+#define DXGI_FORMAT_BC4_UNORM      80
+#define DXGI_FORMAT_BC5_UNORM      83
+#define DXGI_FORMAT_BC7_UNORM      98
+#define DXGI_FORMAT_BC7_UNORM_SRGB 99
+
+#define DDS_DIMENSION_TEXTURE2D 3
+
+static PLImageFormat GetDX10ImageFormat( const DDSHeaderDX10 *header ) {
+	switch ( header->dxgiFormat ) {
+		case DXGI_FORMAT_BC1_UNORM:
+		case DXGI_FORMAT_BC1_UNORM_SRGB:
+			return PL_IMAGEFORMAT_RGBA_DXT1;
+		case DXGI_FORMAT_BC2_UNORM:
+		case DXGI_FORMAT_BC2_UNORM_SRGB:
+			return PL_IMAGEFORMAT_RGBA_DXT3;
+		case DXGI_FORMAT_BC3_UNORM:
+		case DXGI_FORMAT_BC3_UNORM_SRGB:
+			return PL_IMAGEFORMAT_RGBA_DXT5;
+		case DXGI_FORMAT_BC4_UNORM:
+			return PL_IMAGEFORMAT_R_BC4;
+		case DXGI_FORMAT_BC5_UNORM:
+			return PL_IMAGEFORMAT_RG_BC5;
+		case DXGI_FORMAT_BC7_UNORM:
+		case DXGI_FORMAT_BC7_UNORM_SRGB:
+			return PL_IMAGEFORMAT_RGBA_BC7;
+		default:
+			return PL_IMAGEFORMAT_UNKNOWN;
+	}
+}
+
 static PLImageFormat GetImageFormat( const DDSPixelFormat *pixelFormat ) {
 #define ISBITMASK( r, g, b, a ) ( pixelFormat->rBitMask == ( r ) && pixelFormat->gBitMask == ( g ) && pixelFormat->bBitMask == ( b ) && pixelFormat->aBitMask == ( a ) )
 
@@ -96,6 +147,14 @@ static PLImageFormat GetImageFormat( const DDSPixelFormat *pixelFormat ) {
 			case DDS_MAGIC_DXT5: {
 				return PL_IMAGEFORMAT_RGBA_DXT5;
 			}
+			case DDS_MAGIC_ATI1:
+			case DDS_MAGIC_BC4U: {
+				return PL_IMAGEFORMAT_R_BC4;
+			}
+			case DDS_MAGIC_ATI2:
+			case DDS_MAGIC_BC5U: {
+				return PL_IMAGEFORMAT_RG_BC5;
+			}
 		}
 	} else if ( pixelFormat->flags & DDS_PF_FLAGS_LUMINANCE ) {
 		if ( pixelFormat->rgbBitCount == 8 ) {
@@ -156,24 +215,20 @@ QmImage *qm_image_dds_parse( QmFsFile *file ) {
 	image.height = header.height;
 	image.levels = header.numMipMaps ? header.numMipMaps : 1;
 
-	image.format = GetImageFormat( &header.format );
-	if ( image.format == PL_IMAGEFORMAT_UNKNOWN ) {
-		PlReportBasicError( PL_RESULT_UNSUPPORTED );
-		return NULL;
+	if ( ( header.format.flags & DDS_PF_FLAGS_FOURCC ) && header.format.fourCC == DDS_MAGIC_DX10 ) {
+		DDSHeaderDX10 headerDX10;
+		if ( qm_file_read( file, &headerDX10, sizeof( DDSHeaderDX10 ), 1 ) != 1 ) {
+			return NULL;
+		}
+
+		image.format = GetDX10ImageFormat( &headerDX10 );
+	} else {
+		image.format = GetImageFormat( &header.format );
 	}
 
-	unsigned int bytesPerBlock;
-	switch ( image.format ) {
-		case PL_IMAGEFORMAT_RGBA_DXT1:
-			bytesPerBlock = 8;
-			break;
-		case PL_IMAGEFORMAT_RGBA_DXT3:
-		case PL_IMAGEFORMAT_RGBA_DXT5:
-			bytesPerBlock = 16;
-			break;
-		default:
-			PlReportBasicError( PL_RESULT_UNSUPPORTED );
-			return NULL;
+	if ( image.format == PL_IMAGEFORMAT_UNKNOWN || PlGetImageSize( image.format, 1, 1 ) == 0 ) {
+		PlReportBasicError( PL_RESULT_UNSUPPORTED );
+		return NULL;
 	}
 
 	unsigned int mipW = image.width;
@@ -181,7 +236,7 @@ QmImage *qm_image_dds_parse( QmFsFile *file ) {
 
 	image.data = QM_OS_MEMORY_CALLOC( image.levels, sizeof( uint8_t * ) );
 	for ( unsigned int i = 0; i < image.levels; ++i ) {
-		unsigned int size = ( ( mipW + 3 ) / 4 ) * ( ( mipH + 3 ) / 4 ) * bytesPerBlock;
+		unsigned int size = PlGetImageSize( image.format, mipW, mipH );
 		if ( i == 0 ) {
 			image.size = size;
 		}
@@ -192,8 +247,8 @@ QmImage *qm_image_dds_parse( QmFsFile *file ) {
 			return NULL;
 		}
 
-		mipW /= 2;
-		mipH /= 2;
+		mipW = QM_OS_MAX( mipW / 2, 1U );
+		mipH = QM_OS_MAX( mipH / 2, 1U );
 	}
 
 	QmImage *out = QM_OS_MEMORY_MALLOC_( sizeof( QmImage ) );
@@ -203,3 +258,150 @@ QmImage *qm_image_dds_parse( QmFsFile *file ) {
 
 	return out;
 }
+
+/* Fills in the pixel format for the given image format, returning
+ * false if it's not one that can be stored directly. */
+static bool SetPixelFormat( PLImageFormat format, DDSPixelFormat *pixelFormat, bool *useDX10 ) {
+	*pixelFormat = ( DDSPixelFormat ){ .size = DDS_HEADER_PF_SIZE };
+	*useDX10 = false;
+
+	switch ( format ) {
+		default:
+			return false;
+		case PL_IMAGEFORMAT_RGB_DXT1:
+		case PL_IMAGEFORMAT_RGBA_DXT1:
+			pixelFormat->flags = DDS_PF_FLAGS_FOURCC;
+			pixelFormat->fourCC = DDS_MAGIC_DXT1;
+			break;
+		case PL_IMAGEFORMAT_RGBA_DXT3:
+			pixelFormat->flags = DDS_PF_FLAGS_FOURCC;
+			pixelFormat->fourCC = DDS_MAGIC_DXT3;
+			break;
+		case PL_IMAGEFORMAT_RGBA_DXT5:
+			pixelFormat->flags = DDS_PF_FLAGS_FOURCC;
+			pixelFormat->fourCC = DDS_MAGIC_DXT5;
+			break;
+		case PL_IMAGEFORMAT_R_BC4:
+			pixelFormat->flags = DDS_PF_FLAGS_FOURCC;
+			pixelFormat->fourCC = DDS_MAGIC_ATI1;
+			break;
+		case PL_IMAGEFORMAT_RG_BC5:
+			pixelFormat->flags = DDS_PF_FLAGS_FOURCC;
+			pixelFormat->fourCC = DDS_MAGIC_ATI2;
+			break;
+		case PL_IMAGEFORMAT_RGBA_BC7:
+			pixelFormat->flags = DDS_PF_FLAGS_FOURCC;
+			pixelFormat->fourCC = DDS_MAGIC_DX10;
+			*useDX10 = true;
+			break;
+		case PL_IMAGEFORMAT_R8:
+			pixelFormat->flags = DDS_PF_FLAGS_LUMINANCE;
+			pixelFormat->rgbBitCount = 8;
+			pixelFormat->rBitMask = 0x000000ff;
+			break;
+		case PL_IMAGEFORMAT_RGBA8:
+			pixelFormat->flags = DDS_PF_FORMAT_HINT_RGBA;
+			pixelFormat->rgbBitCount = 32;
+			pixelFormat->rBitMask = 0x000000ff;
+			pixelFormat->gBitMask = 0x0000ff00;
+			pixelFormat->bBitMask = 0x00ff0000;
+			pixelFormat->aBitMask = 0xff000000;
+			break;
+		case PL_IMAGEFORMAT_BGRA8:
+			pixelFormat->flags = DDS_PF_FORMAT_HINT_RGBA;
+			pixelFormat->rgbBitCount = 32;
+			pixelFormat->rBitMask = 0x00ff0000;
+			pixelFormat->gBitMask = 0x0000ff00;
+			pixelFormat->bBitMask = 0x000000ff;
+			pixelFormat->aBitMask = 0xff000000;
+			break;
+		case PL_IMAGEFORMAT_BGRX8:
+			pixelFormat->flags = DDS_PF_FORMAT_HINT_RGB;
+			pixelFormat->rgbBitCount = 32;
+			pixelFormat->rBitMask = 0x00ff0000;
+			pixelFormat->gBitMask = 0x0000ff00;
+			pixelFormat->bBitMask = 0x000000ff;
+			break;
+	}
+
+	return true;
+}
+
+/* Writes out the image, along with all of its levels, as a DDS. Formats DDS
+ * can't store directly are written as RGBA8, and BC7 is written with the
+ * DX10 extension header. Only the image's levels are written, not frames. */
+bool qm_image_dds_write( const QmImage *image, const char *path ) {
+	if ( image->data == NULL || image->levels == 0 ) {
+		PlReportErrorF( PL_RESULT_IMAGEFORMAT, "image has no levels to write" );
+		return false;
+	}
+
+	PLImageFormat format = image->format;
+
+	DDSPixelFormat pixelFormat;
+	bool useDX10;
+	if ( !SetPixelFormat( format, &pixelFormat, &useDX10 ) ) {
+		format = PL_IMAGEFORMAT_RGBA8;
+		SetPixelFormat( format, &pixelFormat, &useDX10 );
+	}
+
+	bool compressed = ( pixelFormat.flags & DDS_PF_FLAGS_FOURCC );
+
+	DDSHeader header = {};
+	header.magic = DDS_MAGIC;
+	header.size = DDS_HEADER_SIZE;
+	header.flags = DDS_FLAGS_CAPS | DDS_FLAGS_HEIGHT | DDS_FLAGS_WIDTH | DDS_FLAGS_PIXELFORMAT;
+	header.flags |= compressed ? DDS_FLAGS_LINEARSIZE : DDS_FLAGS_PITCH;
+	header.height = image->height;
+	header.width = image->width;
+	header.pitchLinear = compressed ? PlGetImageSize( format, image->width, image->height ) : image->width * PlGetImageFormatPixelSize( format );
+	header.format = pixelFormat;
+	header.caps = DDS_CAPS_TEXTURE;
+	if ( image->levels > 1 ) {
+		header.flags |= DDS_FLAGS_MIPMAPCOUNT;
+		header.numMipMaps = image->levels;
+		header.caps |= DDS_CAPS_COMPLEX | DDS_CAPS_MIPMAP;
+	}
+
+	FILE *fp = fopen( path, "wb" );
+	if ( fp == NULL ) {
+		PlReportErrorF( PL_RESULT_FILEWRITE, "failed to open %s", path );
+		return false;
+	}
+
+	bool status = ( fwrite( &header, sizeof( DDSHeader ), 1, fp ) == 1 );
+	if ( status && useDX10 ) {
+		DDSHeaderDX10 headerDX10 = {};
+		headerDX10.dxgiFormat = DXGI_FORMAT_BC7_UNORM;
+		headerDX10.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+		headerDX10.arraySize = 1;
+		status = ( fwrite( &headerDX10, sizeof( DDSHeaderDX10 ), 1, fp ) == 1 );
+	}
+
+	unsigned int mipW = image->width;
+	unsigned int mipH = image->height;
+	for ( unsigned int i = 0; status && i < image->levels; ++i ) {
+		size_t size = PlGetImageSize( format, mipW, mipH );
+		if ( format == image->format ) {
+			status = ( fwrite( image->data[ i ], 1, size, fp ) == size );
+		} else {
+			uint8_t *pixels = QM_OS_MEMORY_MALLOC_( size );
+			status = qm_image_convert_pixels( image->data[ i ], image->format, pixels, format, ( size_t ) mipW * mipH ) &&
+			         fwrite( pixels, 1, size, fp ) == size;
+			qm_os_memory_free( pixels );
+		}
+
+		mipW = QM_OS_MAX( mipW / 2, 1U );
+		mipH = QM_OS_MAX( mipH / 2, 1U );
+	}
+
+	if ( fclose( fp ) != 0 ) {
+		status = false;
+	}
+
+	if ( !status ) {
+		PlReportErrorF( PL_RESULT_FILEWRITE, "failed to write %s", path );
+	}
+
+	return status;
+}
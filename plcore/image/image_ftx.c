@@ -26,19 +26,15 @@ QmImage *qm_image_ftx_parse( QmFsFile *file ) {
 		return NULL;
 	}
 
-	unsigned int size = header.width * header.height * 4;
-	uint8_t *buffer = QM_OS_MEMORY_MALLOC_( size );
-	size_t rSize = qm_file_read( file, buffer, sizeof( uint8_t ), size );
-
-	if ( rSize != size ) {
-		qm_os_memory_free( buffer );
+	QmImage *image = PlCreateImage( NULL, header.width, header.height, 0, PL_COLOURFORMAT_RGBA, PL_IMAGEFORMAT_RGBA8 );
+	if ( image == NULL ) {
 		return NULL;
 	}
 
-	QmImage *image = PlCreateImage( buffer, header.width, header.height, 0, PL_COLOURFORMAT_RGBA, PL_IMAGEFORMAT_RGBA8 );
-
-	/* create image makes a copy of the buffer */
-	qm_os_memory_free( buffer );
+	if ( qm_file_read( file, image->data[ 0 ], sizeof( uint8_t ), image->size ) != image->size ) {
+		PlDestroyImage( image );
+		return NULL;
+	}
 
 	return image;
 }
@@ -52,16 +52,17 @@ QmImage *qm_image_hsm_parse( QmFsFile *file )
 		return nullptr;
 	}
 
-	unsigned int size = width * height * 4;
-	uint8_t     *buf  = QM_OS_MEMORY_NEW_( uint8_t, size );
-	if ( qm_file_read( file, buf, sizeof( uint8_t ), size ) != size )
+	QmImage *image = PlCreateImage( nullptr, width, height, 0, PL_COLOURFORMAT_RGBA, PL_IMAGEFORMAT_RGBA8 );
+	if ( image == nullptr )
 	{
-		qm_os_memory_free( buf );
 		return nullptr;
 	}
 
-	QmImage *image = PlCreateImage( buf, width, height, 0, PL_COLOURFORMAT_RGBA, PL_IMAGEFORMAT_RGBA8 );
+	if ( qm_file_read( file, image->data[ 0 ], sizeof( uint8_t ), image->size ) != image->size )
+	{
+		PlDestroyImage( image );
+		return nullptr;
+	}
 
-	qm_os_memory_free( buf );
 	return image;
 }
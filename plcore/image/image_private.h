@@ -9,3 +9,9 @@
 #include "pl_private.h"
 
 #include <plcore/pl_image.h>
+
+/* pl_image.c */
+const uint8_t *qm_image_read_payload_( QmFsFile *file, size_t size, uint8_t *dst, size_t dstSize );
+
+/* pl_image_s3tc.c */
+bool qm_image_decompress_levels_( QmImage *image, unsigned int numThreads );
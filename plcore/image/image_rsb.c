@@ -32,68 +32,69 @@ QmImage *qm_image_rsb_parse( QmFsFile *file ) {
 		return NULL;
 	}
 
-	QmImage *image = NULL;
-
 	bool hasPalette = false;
 	if ( version == 0 ) {
 		hasPalette = ( bool ) PL_READUINT32( file, false, NULL );
 	}
 
+	Palette palette = {};
+	uint32_t r = 0, g = 0, b = 0, a = 0;
 	if ( hasPalette ) {
-		Palette palette = {};
 		qm_file_read( file, palette, sizeof( RGBA ), 256 );
+	} else {
+		r = PL_READUINT32( file, false, NULL );
+		g = PL_READUINT32( file, false, NULL );
+		b = PL_READUINT32( file, false, NULL );
+		a = PL_READUINT32( file, false, NULL );
+	}
 
-		unsigned int size = width * height;
-		uint8_t *src = QM_OS_MEMORY_NEW_( uint8_t, size );
-		if ( qm_file_read( file, src, sizeof( uint8_t ), size ) == size ) {
-			QmMathColour4ub *dst = QM_OS_MEMORY_NEW_( QmMathColour4ub, size );
-			for ( unsigned int i = 0; i < size; ++i ) {
-				dst[ i ].r = palette[ src[ i ] ].b;
-				dst[ i ].g = palette[ src[ i ] ].g;
-				dst[ i ].b = palette[ src[ i ] ].r;
-				// no idea...
-				dst[ i ].a = ( palette[ src[ i ] ].a == 0 ) ? 255 : 0;
-			}
-
-			image = PlCreateImage( dst, width, height, 0, PL_COLOURFORMAT_RGBA, PL_IMAGEFORMAT_RGBA8 );
+	QmImage *image = PlCreateImage( NULL, width, height, 0, PL_COLOURFORMAT_RGBA, PL_IMAGEFORMAT_RGBA8 );
+	if ( image == NULL ) {
+		return NULL;
+	}
 
-			qm_os_memory_free( dst );
+	/* either way, the pixels are expanded in place */
+	unsigned int size = width * height;
+	QmMathColour4ub *dst = ( QmMathColour4ub * ) image->data[ 0 ];
+	if ( hasPalette ) {
+		const uint8_t *src = qm_image_read_payload_( file, size, image->data[ 0 ], image->size );
+		if ( src == NULL ) {
+			PlDestroyImage( image );
+			return NULL;
 		}
 
-		qm_os_memory_free( src );
+		for ( unsigned int i = 0; i < size; ++i ) {
+			uint8_t index = src[ i ];
+			dst[ i ].r = palette[ index ].b;
+			dst[ i ].g = palette[ index ].g;
+			dst[ i ].b = palette[ index ].r;
+			// no idea...
+			dst[ i ].a = ( palette[ index ].a == 0 ) ? 255 : 0;
+		}
 	} else {
-		uint32_t r = PL_READUINT32( file, false, NULL );
-		uint32_t g = PL_READUINT32( file, false, NULL );
-		uint32_t b = PL_READUINT32( file, false, NULL );
-		uint32_t a = PL_READUINT32( file, false, NULL );
-
-		unsigned int size = width * height;
-		uint16_t *src = QM_OS_MEMORY_NEW_( uint16_t, size );
-		if ( qm_file_read( file, src, sizeof( uint16_t ), size ) == size ) {
-			QmMathColour4ub *dst = QM_OS_MEMORY_NEW_( QmMathColour4ub, size );
-			uint32_t maskR = ( 1 << r ) - 1;
-			uint32_t maskG = ( 1 << g ) - 1;
-			uint32_t maskB = ( 1 << b ) - 1;
-			uint32_t maskA = ( 1 << a ) - 1;
-
-			uint32_t shiftA = r + g + b;
-			uint32_t shiftR = g + b;
-			uint32_t shiftG = b;
-			uint32_t shiftB = 0;
-
-			for ( unsigned int i = 0; i < size; i++ ) {
-				dst[ i ].r = ( ( src[ i ] & ( maskR << shiftR ) ) >> shiftR ) * 255 / maskR;
-				dst[ i ].g = ( ( src[ i ] & ( maskG << shiftG ) ) >> shiftG ) * 255 / maskG;
-				dst[ i ].b = ( ( src[ i ] & ( maskB << shiftB ) ) >> shiftB ) * 255 / maskB;
-				dst[ i ].a = a ? ( ( src[ i ] & ( maskA << shiftA ) ) >> shiftA ) * 255 / maskA : 255;
-			}
-
-			image = PlCreateImage( dst, width, height, 0, PL_COLOURFORMAT_RGBA, PL_IMAGEFORMAT_RGBA8 );
-
-			qm_os_memory_free( dst );
+		const uint8_t *src = qm_image_read_payload_( file, size * sizeof( uint16_t ), image->data[ 0 ], image->size );
+		if ( src == NULL ) {
+			PlDestroyImage( image );
+			return NULL;
 		}
 
-		qm_os_memory_free( src );
+		uint32_t maskR = ( 1 << r ) - 1;
+		uint32_t maskG = ( 1 << g ) - 1;
+		uint32_t maskB = ( 1 << b ) - 1;
+		uint32_t maskA = ( 1 << a ) - 1;
+
+		uint32_t shiftA = r + g + b;
+		uint32_t shiftR = g + b;
+		uint32_t shiftG = b;
+		uint32_t shiftB = 0;
+
+		for ( unsigned int i = 0; i < size; i++ ) {
+			uint16_t c = ( uint16_t ) ( src[ i * 2 ] | ( src[ i * 2 + 1 ] << 8 ) );
+			dst[ i ].r = ( ( c & ( maskR << shiftR ) ) >> shiftR ) * 255 / maskR;
+			dst[ i ].g = ( ( c & ( maskG << shiftG ) ) >> shiftG ) * 255 / maskG;
+			dst[ i ].b = ( ( c & ( maskB << shiftB ) ) >> shiftB ) * 255 / maskB;
+			dst[ i ].a = a ? ( ( c & ( maskA << shiftA ) ) >> shiftA ) * 255 / maskA : 255;
+		}
 	}
 
 	return image;
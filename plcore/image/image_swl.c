@@ -50,6 +50,8 @@ QmImage *qm_image_swl_parse( QmFsFile *fin ) {
 	out->format = PL_IMAGEFORMAT_RGBA8;
 	out->size = PlGetImageSize( out->format, out->width, out->height );
 
+	out->data = QM_OS_MEMORY_CALLOC( out->levels, sizeof( uint8_t * ) );
+
 	unsigned int mip_w = out->width;
 	unsigned int mip_h = out->height;
 	for ( unsigned int i = 0; i < out->levels; ++i ) {
@@ -58,25 +60,24 @@ QmImage *qm_image_swl_parse( QmFsFile *fin ) {
 			mip_h = out->height >> ( i + 1 );
 		}
 
+		size_t level_size = PlGetImageSize( out->format, mip_w, mip_h );
+		out->data[ i ] = QM_OS_MEMORY_CALLOC( level_size, sizeof( uint8_t ) );
+
+		/* indices are expanded in place, front to back */
 		size_t buf_size = mip_w * mip_h;
-		uint8_t *buf = QM_OS_MEMORY_MALLOC_( buf_size );
-		if ( qm_file_read( fin, buf, 1, buf_size ) != buf_size ) {
+		const uint8_t *buf = qm_image_read_payload_( fin, buf_size, out->data[ i ], level_size );
+		if ( buf == nullptr ) {
 			PlDestroyImage( out );
-			qm_os_memory_free( buf );
 			return nullptr;
 		}
 
-		out->data = QM_OS_MEMORY_CALLOC( out->levels, sizeof( uint8_t * ) );
-
-		size_t level_size = PlGetImageSize( out->format, mip_w, mip_h );
-		out->data[ i ] = QM_OS_MEMORY_CALLOC( level_size, sizeof( uint8_t ) );
-
 		/* now we fill in the buf we just allocated,
     	 * by using the palette */
 		for ( size_t j = 0, k = 0; j < buf_size; ++j, k += 4 ) {
-			out->data[ i ][ k ] = palette[ buf[ j ] ].r;
-			out->data[ i ][ k + 1 ] = palette[ buf[ j ] ].g;
-			out->data[ i ][ k + 2 ] = palette[ buf[ j ] ].b;
+			uint8_t index = buf[ j ];
+			out->data[ i ][ k ] = palette[ index ].r;
+			out->data[ i ][ k + 1 ] = palette[ index ].g;
+			out->data[ i ][ k + 2 ] = palette[ index ].b;
 
 			/* the alpha channel appears to be used more like
        * a flag to say "yes this texture will be transparent",
@@ -85,8 +86,6 @@ QmImage *qm_image_swl_parse( QmFsFile *fin ) {
        * because of that we'll just ignore it */
 			out->data[ i ][ k + 3 ] = 255; /*(uint8_t) (255 - palette[buf[j]].a);*/
 		}
-
-		qm_os_memory_free( buf );
 	}
 
 	return out;
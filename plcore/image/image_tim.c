@@ -100,7 +100,7 @@ static bool TIM_ReadFile( QmFsFile *fin, QmImage *out ) {
 	}
 
 	uint16_t *palette = NULL;
-	uint8_t *image_data = NULL;
+	const uint8_t *image_data = NULL;
 
 	TIMHeader header;
 	if ( qm_file_read( fin, &header, sizeof( TIMHeader ), 1 ) != 1 ) {
@@ -130,7 +130,7 @@ static bool TIM_ReadFile( QmFsFile *fin, QmImage *out ) {
 			goto ERR_CLEANUP;
 		}
 
-		if ( qm_file_read( fin, palette, sizeof( uint16_t ), palette_size ) != palette_size ) {
+		if ( qm_fs_file_read_int16_array( fin, ( int16_t * ) palette, palette_size, false ) != palette_size ) {
 			goto UNEXPECTED_EOF;
 		}
 	}
@@ -149,16 +149,7 @@ static bool TIM_ReadFile( QmFsFile *fin, QmImage *out ) {
 		}
 	}
 
-	/* Read in the image data. */
 	size_t image_data_len = image_info.image_size - sizeof( image_info );
-	image_data = QM_OS_MEMORY_MALLOC_( image_data_len );
-	if ( image_data == NULL ) {
-		goto ERR_CLEANUP;
-	}
-
-	if ( qm_file_read( fin, image_data, image_data_len, 1 ) != 1 ) {
-		goto UNEXPECTED_EOF;
-	}
 
 	/* Prepare the metadata and image buffer in the PLImage structure. */
 
@@ -207,14 +198,20 @@ static bool TIM_ReadFile( QmFsFile *fin, QmImage *out ) {
 		goto ERR_CLEANUP;
 	}
 
+	/* Read in the image data, which is expanded in place below. */
+	image_data = qm_image_read_payload_( fin, image_data_len, out->data[ 0 ], out->size );
+	if ( image_data == NULL ) {
+		goto UNEXPECTED_EOF;
+	}
+
 	/* Copy the image data into the PLImage buffer. */
 
 	switch ( type ) {
 		case TIM_TYPE_4BPP: {
-			uint8_t *indata = image_data;
+			const uint8_t *indata = image_data;
 			uint16_t *outdata = ( uint16_t * ) ( out->data[ 0 ] );
 
-			for ( ; indata < ( uint8_t * ) ( image_data + image_data_len ); ++indata ) {
+			for ( ; indata < image_data + image_data_len; ++indata ) {
 				uint8_t p1 = ( *indata & 0x0F );
 				uint8_t p2 = ( *indata & 0xF0 ) >> 4;
 
@@ -231,10 +228,10 @@ static bool TIM_ReadFile( QmFsFile *fin, QmImage *out ) {
 		}
 
 		case TIM_TYPE_8BPP: {
-			uint8_t *indata = image_data;
+			const uint8_t *indata = image_data;
 			uint16_t *outdata = ( uint16_t * ) ( out->data[ 0 ] );
 
-			for ( ; indata < ( uint8_t * ) ( image_data + image_data_len ); ++indata ) {
+			for ( ; indata < image_data + image_data_len; ++indata ) {
 				uint8_t p = *indata;
 
 				if ( p >= palette_size ) {
@@ -249,10 +246,10 @@ static bool TIM_ReadFile( QmFsFile *fin, QmImage *out ) {
 		}
 
 		case TIM_TYPE_16BPP: {
-			uint8_t *indata = image_data;
+			const uint8_t *indata = image_data;
 			uint8_t *outdata = out->data[ 0 ];
 
-			for ( ; indata < ( uint8_t * ) ( image_data + image_data_len ); ++indata ) {
+			for ( ; indata < image_data + image_data_len; ++indata ) {
 				uint16_t colour = ( uint16_t ) ( ( *indata ) + ( ( *indata ) << 8 ) );
 				*( outdata++ ) = ( uint8_t ) ( colour );//(_tim16toRGB51A(colour));
 			}
@@ -266,7 +263,6 @@ static bool TIM_ReadFile( QmFsFile *fin, QmImage *out ) {
 			goto ERR_CLEANUP;
 	}
 
-	qm_os_memory_free( image_data );
 	qm_os_memory_free( palette );
 
 	return true;
@@ -281,7 +277,6 @@ ERR_CLEANUP:
 		qm_os_memory_free( out->data );
 	}
 
-	qm_os_memory_free( image_data );
 	qm_os_memory_free( palette );
 
 	return false;
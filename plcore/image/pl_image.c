@@ -37,25 +37,37 @@
 #	define STB_IMAGE_WRITE_STATIC
 #	include "stb_image.h"
 
-static QmImage *LoadStbImage( QmFsFile *file ) {
-	size_t s = qm_fs_file_get_size( file );
-	if ( s >= INT32_MAX ) {
-		PlReportBasicError( PL_RESULT_FILESIZE );
-		return NULL;
-	}
+static int StbRead( void *user, char *data, int size ) {
+	return ( int ) qm_file_read( ( QmFsFile * ) user, data, sizeof( char ), ( size_t ) size );
+}
 
-	void *tmp = QM_OS_MEMORY_MALLOC_( s );
-	if ( tmp == NULL )
-	{
-		return NULL;
-	}
+static void StbSkip( void *user, int n ) {
+	qm_fs_file_seek( ( QmFsFile * ) user, n, QM_FS_SEEK_CUR );
+}
 
-	qm_file_read( file, tmp, sizeof( char ), s );
+static int StbEof( void *user ) {
+	return qm_fs_file_is_end( ( QmFsFile * ) user );
+}
 
+/* decodes straight out of memory backed files, and streams anything else */
+static QmImage *LoadStbImage( QmFsFile *file ) {
 	int x, y, component;
-	unsigned char *data = stbi_load_from_memory( tmp, ( int ) s, &x, &y, &component, 4 );
+	unsigned char *data;
+
+	const uint8_t *buf = qm_fs_file_get_data( file );
+	if ( buf != NULL ) {
+		int64_t offset = qm_fs_file_get_offset( file );
+		size_t s = qm_fs_file_get_size( file ) - ( size_t ) offset;
+		if ( s >= INT32_MAX ) {
+			PlReportBasicError( PL_RESULT_FILESIZE );
+			return NULL;
+		}
 
-	qm_os_memory_free( tmp );
+		data = stbi_load_from_memory( buf + offset, ( int ) s, &x, &y, &component, 4 );
+	} else {
+		static const stbi_io_callbacks callbacks = { StbRead, StbSkip, StbEof };
+		data = stbi_load_from_callbacks( &callbacks, file, &x, &y, &component, 4 );
+	}
 
 	if ( data == NULL ) {
 		PlReportErrorF( PL_RESULT_FILEREAD, "failed to read in image (%s)", stbi_failure_reason() );
@@ -154,6 +166,40 @@ void PlClearImageLoaders( void ) {
 	numImageLoaders = 0;
 }
 
+/**
+ * Gets hold of the next size bytes of a file for a loader to decode.
+ * Memory backed files are handed back in place, otherwise the bytes are
+ * read into the tail of dst; the buffer the loader is decoding into. That
+ * works so long as it decodes front to back and never writes out less
+ * than it reads in.
+ */
+const uint8_t *qm_image_read_payload_( QmFsFile *file, size_t size, uint8_t *dst, size_t dstSize ) {
+	const uint8_t *data = qm_fs_file_get_data( file );
+	if ( data != NULL ) {
+		int64_t offset = qm_fs_file_get_offset( file );
+		if ( offset < 0 || size > qm_fs_file_get_size( file ) - ( size_t ) offset ) {
+			PlReportErrorF( PL_RESULT_FILEREAD, "unexpected end of file" );
+			return NULL;
+		}
+
+		qm_fs_file_seek( file, offset + ( int64_t ) size, QM_FS_SEEK_SET );
+		return data + offset;
+	}
+
+	if ( size > dstSize ) {
+		PlReportBasicError( PL_RESULT_INVALID_PARM4 );
+		return NULL;
+	}
+
+	uint8_t *tail = dst + ( dstSize - size );
+	if ( qm_file_read( file, tail, sizeof( uint8_t ), size ) != size ) {
+		PlReportErrorF( PL_RESULT_FILEREAD, "unexpected end of file" );
+		return NULL;
+	}
+
+	return tail;
+}
+
 QmImage *PlCreateImage( void *buf, unsigned int w, unsigned int h, unsigned int numFrames, PLColourFormat col, PLImageFormat dat ) {
 	QmImage *image = QM_OS_MEMORY_MALLOC_( sizeof( QmImage ) );
 	if ( image == NULL ) {
@@ -200,7 +246,7 @@ void PlDestroyImage( QmImage *image ) {
 	}
 
 	/* todo: kill this */
-	for ( unsigned int levels = 0; levels < image->levels; ++levels ) {
+	for ( unsigned int levels = 0; image->data != NULL && levels < image->levels; ++levels ) {
 		qm_os_memory_free( image->data[ levels ] );
 	}
 
@@ -233,7 +279,11 @@ QmImage *qm_image_load( const char *path ) {
 		}
 
 		QmImage *image = NULL;
-		QmFsFile *file = qm_fs_file_open( path, false );
+		/* mapped, so loaders can decode straight from it */
+		QmFsFile *file = qm_fs_file_open_mapped( path );
+		if ( file == NULL ) {
+			file = qm_fs_file_open( path, false );
+		}
 		if ( file != NULL ) {
 			image = imageLoaders[ i ].ParseFile( file );
 			PlCloseFile( file );
@@ -279,13 +329,18 @@ bool qm_image_write( const QmImage *image, const char *path, unsigned int qualit
 		return false;
 	}
 
+	/* dds is the only one that can carry compressed data */
+	const char *extension = PlGetFileExtension( path );
+	if ( extension != NULL && !pl_strncasecmp( extension, "dds", 3 ) ) {
+		return qm_image_dds_write( image, path );
+	}
+
 	int comp = ( int ) PlGetNumImageFormatChannels( image->format );
-	if ( comp == 0 ) {
+	if ( comp == 0 || PlGetImageFormatPixelSize( image->format ) != ( unsigned int ) comp ) {
 		PlReportErrorF( PL_RESULT_IMAGEFORMAT, "invalid colour format" );
 		return false;
 	}
 
-	const char *extension = PlGetFileExtension( path );
 	if ( extension != NULL && *extension != '\0' ) {
 		if ( !pl_strncasecmp( extension, "bmp", 3 ) ) {
 			if ( stbi_write_bmp( path, ( int ) image->width, ( int ) image->height, comp, image->data[ 0 ] ) == 1 ) {
@@ -314,204 +369,17 @@ bool qm_image_write( const QmImage *image, const char *path, unsigned int qualit
 	return false;
 }
 
-static bool RGB8toRGBA8( QmImage *image ) {
-	size_t size = PlGetImageSize( PL_IMAGEFORMAT_RGBA8, image->width, image->height );
-	if ( size == 0 ) {
-		return false;
-	}
-
-	typedef struct RGB8 {
-		uint8_t r, g, b;
-	} RGB8;
-	typedef struct RGBA8 {
-		uint8_t r, g, b, a;
-	} RGBA8;
-	size_t num_pixels = image->size / 3;
-
-	RGB8 *src = ( RGB8 * ) image->data[ 0 ];
-	RGBA8 *dst = QM_OS_MEMORY_MALLOC_( size );
-	for ( size_t i = 0; i < num_pixels; ++i ) {
-		dst->r = src->r;
-		dst->g = src->g;
-		dst->b = src->b;
-		dst->a = 255;
-		dst++;
-		src++;
-	}
-
-	qm_os_memory_free( image->data[ 0 ] );
-
-	image->data[ 0 ] = ( uint8_t * ) ( &dst[ 0 ] );
-	image->size = size;
-	image->format = PL_IMAGEFORMAT_RGBA8;
-	image->colour_format = PL_COLOURFORMAT_RGBA;
-
-	return true;
-}
-
-#define scale_5to8( i ) ( ( ( ( double ) ( i ) ) / 31 ) * 255 )
-
-static uint8_t *ImageDataRGB5A1toRGBA8( const uint8_t *src, size_t n_pixels ) {
-	uint8_t *dst = QM_OS_MEMORY_MALLOC_( n_pixels * 4 );
-	if ( dst == NULL ) {
-		return NULL;
-	}
-
-	uint8_t *dp = dst;
-
-	for ( size_t i = 0; i < n_pixels; ++i ) {
-		/* Red */
-		*( dp++ ) = scale_5to8( ( src[ 0 ] & 0xF8 ) >> 3 );
-
-		/* Green */
-		*( dp++ ) = scale_5to8( ( ( src[ 0 ] & 0x07 ) << 2 ) | ( ( src[ 1 ] & 0xC0 ) >> 6 ) );
-
-		/* Blue */
-		*( dp++ ) = scale_5to8( ( src[ 1 ] & 0x3E ) >> 1 );
-
-		/* Alpha */
-		*( dp++ ) = ( src[ 1 ] & 0x01 ) ? 255 : 0;
-
-		src += 2;
-	}
-
-	return dst;
-}
-
-bool PlConvertPixelFormat( QmImage *image, PLImageFormat new_format ) {
-	if ( image->format == new_format ) {
-		return true;
-	}
-
-	switch ( image->format )
-	{
-		case PL_IMAGEFORMAT_RGB8:
-		{
-			QmMathColour3ub *src          = ( QmMathColour3ub * ) image->data[ 0 ];
-			size_t           numSrcPixels = image->size / sizeof( QmMathColour3ub );
-			switch ( new_format )
-			{
-				default:
-					break;
-				case PL_IMAGEFORMAT_RGBA8:
-				{
-					return RGB8toRGBA8( image );
-				}
-				case PL_IMAGEFORMAT_R8:
-				{
-					size_t dstSize = PlGetImageSize( PL_IMAGEFORMAT_R8, image->width, image->height );
-					assert( dstSize != 0 );
-
-					typedef struct R8
-					{
-						uint8_t r;
-					} R8;
-					R8 *dst = QM_OS_MEMORY_MALLOC_( dstSize );
-					for ( size_t i = 0; i < numSrcPixels; ++i )
-					{
-						// only copy the red channel, discard the others
-						// (do we really want to do it this way? alternatively, could combine all channels...)
-						dst[ i ].r = src[ i ].r;
-					}
-
-					qm_os_memory_free( image->data[ 0 ] );
-
-					image->data[ 0 ]     = ( uint8_t * ) dst;
-					image->size          = dstSize;
-					image->format        = PL_IMAGEFORMAT_R8;
-					image->colour_format = PL_COLOURFORMAT_RGB;
-
-					return true;
-				}
-			}
-		}
-		case PL_IMAGEFORMAT_RGBA8:
-		{
-			QmMathColour4ub *src          = ( QmMathColour4ub * ) image->data[ 0 ];
-			size_t           numSrcPixels = image->size / sizeof( QmMathColour4ub );
-			if ( new_format == PL_IMAGEFORMAT_R8 )
-			{
-				size_t dstSize = PlGetImageSize( PL_IMAGEFORMAT_R8, image->width, image->height );
-				assert( dstSize != 0 );
-
-				typedef struct R8
-				{
-					uint8_t r;
-				} R8;
-				R8 *dst = QM_OS_MEMORY_NEW_( R8, dstSize );
-				for ( size_t i = 0; i < numSrcPixels; ++i )
-				{
-					// only copy the red channel, discard the others
-					// (do we really want to do it this way? alternatively, could combine all channels...)
-					dst[ i ].r = src[ i ].r;
-				}
-
-				qm_os_memory_free( image->data[ 0 ] );
-
-				image->data[ 0 ]     = ( uint8_t * ) dst;
-				image->size          = dstSize;
-				image->format        = PL_IMAGEFORMAT_R8;
-				image->colour_format = PL_COLOURFORMAT_RGB;
-
-				return true;
-			}
-		}
-
-		case PL_IMAGEFORMAT_RGB5A1: {
-			if ( new_format == PL_IMAGEFORMAT_RGBA8 ) {
-				uint8_t **levels = QM_OS_MEMORY_CALLOC( image->levels, sizeof( uint8_t * ) );
-
-				/* Make a new copy of each detail level in the new format. */
-
-				unsigned int lw = image->width;
-				unsigned int lh = image->height;
-
-				for ( unsigned int l = 0; l < image->levels; ++l ) {
-					levels[ l ] = ImageDataRGB5A1toRGBA8( image->data[ l ], lw * lh );
-					if ( levels[ l ] == NULL ) {
-						/* Memory allocation failed, ditch any buffers we've created so far. */
-						for ( unsigned int m = 0; m < l; ++m ) {
-							qm_os_memory_free( levels[ m ] );
-						}
-
-						qm_os_memory_free( levels );
-
-						PlReportErrorF( PL_RESULT_MEMORY_ALLOCATION, "couldn't allocate memory for image data" );
-						return false;
-					}
-
-					lw /= 2;
-					lh /= 2;
-				}
-
-				/* Now that all levels have been converted, free and replace the old buffers. */
-
-				for ( unsigned int l = 0; l < image->levels; ++l ) {
-					qm_os_memory_free( image->data[ l ] );
-				}
-
-				qm_os_memory_free( image->data );
-				image->data = levels;
-
-				image->format = new_format;
-				/* TODO: Update colour_format */
-
-				return true;
-			}
-		} break;
-
-		default:
-			break;
-	}
-
-	PlReportErrorF( PL_RESULT_IMAGEFORMAT, "unsupported image format conversion" );
-	return false;
-}
-
 unsigned int PlGetImageSize( PLImageFormat format, unsigned int width, unsigned int height ) {
 	switch ( format ) {
 		case PL_IMAGEFORMAT_RGB_DXT1:
-			return ( width * height ) >> 1;
+		case PL_IMAGEFORMAT_RGBA_DXT1:
+		case PL_IMAGEFORMAT_R_BC4:
+			return ( ( width + 3 ) / 4 ) * ( ( height + 3 ) / 4 ) * 8;
+		case PL_IMAGEFORMAT_RGBA_DXT3:
+		case PL_IMAGEFORMAT_RGBA_DXT5:
+		case PL_IMAGEFORMAT_RG_BC5:
+		case PL_IMAGEFORMAT_RGBA_BC7:
+			return ( ( width + 3 ) / 4 ) * ( ( height + 3 ) / 4 ) * 16;
 		default: {
 			unsigned int bytes = PlGetImageFormatPixelSize( format );
 			return width * height * bytes;
@@ -527,14 +395,19 @@ unsigned int PlGetImageFormatPixelSize( PLImageFormat format ) {
 	switch ( format ) {
 		case PL_IMAGEFORMAT_R8:
 			return 1;
+		case PL_IMAGEFORMAT_RGB4:
 		case PL_IMAGEFORMAT_RGBA4:
+		case PL_IMAGEFORMAT_RGB5:
 		case PL_IMAGEFORMAT_RGB5A1:
 		case PL_IMAGEFORMAT_RGB565:
 			return 2;
 		case PL_IMAGEFORMAT_RGB8:
+		case PL_IMAGEFORMAT_BGR8:
 			return 3;
 		case PL_IMAGEFORMAT_RGBA_DXT1:
 		case PL_IMAGEFORMAT_RGBA8:
+		case PL_IMAGEFORMAT_BGRA8:
+		case PL_IMAGEFORMAT_BGRX8:
 			return 4;
 		case PL_IMAGEFORMAT_RGBA12:
 		case PL_IMAGEFORMAT_RGB16F:
@@ -544,9 +417,9 @@ unsigned int PlGetImageFormatPixelSize( PLImageFormat format ) {
 			return 8;
 
 		case PL_IMAGEFORMAT_RGB32F:
-			return 16;
+			return 12;
 		case PL_IMAGEFORMAT_RGBA32F:
-			return 32;
+			return 16;
 
 		default:
 			return 0;
@@ -559,20 +432,30 @@ unsigned int PlGetImageFormatPixelSize( PLImageFormat format ) {
 unsigned int PlGetNumImageFormatChannels( PLImageFormat format ) {
 	switch ( format ) {
 		case PL_IMAGEFORMAT_R8:
+		case PL_IMAGEFORMAT_R_BC4:
 			return 1;
+		case PL_IMAGEFORMAT_RG_BC5:
+			return 2;
 		case PL_IMAGEFORMAT_RGB4:
 		case PL_IMAGEFORMAT_RGB5:
 		case PL_IMAGEFORMAT_RGB565:
 		case PL_IMAGEFORMAT_RGB8:
+		case PL_IMAGEFORMAT_BGR8:
+		case PL_IMAGEFORMAT_BGRX8:
+		case PL_IMAGEFORMAT_RGB16F:
+		case PL_IMAGEFORMAT_RGB32F:
 		case PL_IMAGEFORMAT_RGB_DXT1:
 		case PL_IMAGEFORMAT_RGB_FXT1:
 			return 3;
 		case PL_IMAGEFORMAT_RGBA4:
 		case PL_IMAGEFORMAT_RGB5A1:
 		case PL_IMAGEFORMAT_RGBA8:
+		case PL_IMAGEFORMAT_BGRA8:
 		case PL_IMAGEFORMAT_RGBA12:
 		case PL_IMAGEFORMAT_RGBA16:
 		case PL_IMAGEFORMAT_RGBA16F:
+		case PL_IMAGEFORMAT_RGBA32F:
+		case PL_IMAGEFORMAT_RGBA_BC7:
 			return 4;
 		default:
 			return 0;
@@ -816,41 +699,3 @@ QmImage *qm_image_crop( QmImage *image, unsigned int newWidth, unsigned int newH
 
 	return newImage;
 }
-
-/////////////////////////////////////////////////////////////////////////////////////
-// S3TC Library Interface
-/////////////////////////////////////////////////////////////////////////////////////
-
-void DecompressBlockBC1( uint32_t x, uint32_t y, uint32_t stride, const uint8_t *blockStorage, unsigned char *image );// DXT1
-void DecompressBlockBC2( uint32_t x, uint32_t y, uint32_t stride, const uint8_t *blockStorage, unsigned char *image );// DXT3
-void DecompressBlockBC3( uint32_t x, uint32_t y, uint32_t stride, const uint8_t *blockStorage, unsigned char *image );// DXT5
-
-void PlBlockDecompressImageDXT1( unsigned int width, unsigned int height, const unsigned char *blockStorage, unsigned char *image ) {
-	const uint32_t stride = width * sizeof( uint32_t );
-	for ( uint32_t j = 0; j < height; j += 4 ) {
-		for ( uint32_t i = 0; i < width; i += 4 ) {
-			DecompressBlockBC1( i, j, stride, blockStorage, image );
-			blockStorage += 8;
-		}
-	}
-}
-
-void PlBlockDecompressImageDXT3( unsigned int width, unsigned int height, const unsigned char *blockStorage, unsigned char *image ) {
-	const uint32_t stride = width * sizeof( uint32_t );
-	for ( uint32_t j = 0; j < height; j += 4 ) {
-		for ( uint32_t i = 0; i < width; i += 4 ) {
-			DecompressBlockBC2( i, j, stride, blockStorage, image );
-			blockStorage += 16;
-		}
-	}
-}
-
-void PlBlockDecompressImageDXT5( unsigned int width, unsigned int height, const unsigned char *blockStorage, unsigned char *image ) {
-	const uint32_t stride = width * sizeof( uint32_t );
-	for ( uint32_t j = 0; j < height; j += 4 ) {
-		for ( uint32_t i = 0; i < width; i += 4 ) {
-			DecompressBlockBC3( i, j, stride, blockStorage, image );
-			blockStorage += 16;
-		}
-	}
-}
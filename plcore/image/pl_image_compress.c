@@ -0,0 +1,1046 @@
+// SPDX-License-Identifier: MIT
+// Hei Platform Library
+// Copyright © 2017-2026 Quartermind Games, Mark E. Sowden <markelswo@gmail.com>
+// Purpose: Block compression (BC1-BC5, BC7) encoder.
+
+#include "image_private.h"
+
+#include "qmos/public/qm_os_memory.h"
+#include "qmos/public/qm_os_thread.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdatomic.h>
+
+/**
+ * Each block is fitted to a line through its colours, taken from their
+ * principal axis or, for the fast preset, their bounding box. The line is
+ * then refined by least squares against the indices it picked, for as long
+ * as that keeps lowering the error. Endpoints are always judged after
+ * quantization, against the same palette a decoder would build from them.
+ *
+ * BC7 only makes use of mode 6; a single RGBA subset with 4-bit indices.
+ * It loses out to a full mode search on blocks with several distinct
+ * colours, but is far quicker and still well ahead of BC3.
+ *
+ * Partial blocks along the edges are padded by repeating the
+ * last row and column.
+ */
+
+#define MIN_BLOCKS_PER_JOB 256
+#define MAX_REFINE_PASSES  8
+
+#define SKIP_INDEX 0xFF
+
+static unsigned int get_block_size( PLImageFormat format )
+{
+	switch ( format )
+	{
+		case PL_IMAGEFORMAT_RGB_DXT1:
+		case PL_IMAGEFORMAT_RGBA_DXT1:
+		case PL_IMAGEFORMAT_R_BC4:
+			return 8;
+		case PL_IMAGEFORMAT_RGBA_DXT3:
+		case PL_IMAGEFORMAT_RGBA_DXT5:
+		case PL_IMAGEFORMAT_RG_BC5:
+		case PL_IMAGEFORMAT_RGBA_BC7:
+			return 16;
+		default:
+			return 0;
+	}
+}
+
+static unsigned int get_refine_passes( QmImageCompressQuality quality )
+{
+	switch ( quality )
+	{
+		case QM_IMAGE_COMPRESS_QUALITY_FAST:
+			return 0;
+		case QM_IMAGE_COMPRESS_QUALITY_NORMAL:
+			return 1;
+		default:
+			return MAX_REFINE_PASSES;
+	}
+}
+
+static inline float clamp_channel( float v )
+{
+	return ( v < 0.0f ) ? 0.0f : ( v > 255.0f ) ? 255.0f : v;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Fitting
+/////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Picks a pair of endpoints spanning the given points, most
+ * significant first, across the first numChannels channels.
+ */
+static void fit_endpoints( const float ( *points )[ 4 ], unsigned int numPoints, unsigned int numChannels, QmImageCompressQuality quality, float e0[ 4 ], float e1[ 4 ] )
+{
+	float min[ 4 ]  = { FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX };
+	float max[ 4 ]  = { -FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	float mean[ 4 ] = {};
+	for ( unsigned int i = 0; i < numPoints; ++i )
+	{
+		for ( unsigned int c = 0; c < numChannels; ++c )
+		{
+			min[ c ] = QM_OS_MIN( min[ c ], points[ i ][ c ] );
+			max[ c ] = QM_OS_MAX( max[ c ], points[ i ][ c ] );
+			mean[ c ] += points[ i ][ c ];
+		}
+	}
+
+	if ( quality == QM_IMAGE_COMPRESS_QUALITY_FAST )
+	{
+		// pulled in a little, as the extremes are rarely all used at once
+		for ( unsigned int c = 0; c < numChannels; ++c )
+		{
+			float inset = ( max[ c ] - min[ c ] ) / 16.0f;
+			e0[ c ]     = max[ c ] - inset;
+			e1[ c ]     = min[ c ] + inset;
+		}
+		return;
+	}
+
+	float covariance[ 4 ][ 4 ] = {};
+	for ( unsigned int c = 0; c < numChannels; ++c )
+	{
+		mean[ c ] /= ( float ) numPoints;
+	}
+	for ( unsigned int i = 0; i < numPoints; ++i )
+	{
+		for ( unsigned int c = 0; c < numChannels; ++c )
+		{
+			for ( unsigned int d = c; d < numChannels; ++d )
+			{
+				covariance[ c ][ d ] += ( points[ i ][ c ] - mean[ c ] ) * ( points[ i ][ d ] - mean[ d ] );
+			}
+		}
+	}
+	for ( unsigned int c = 0; c < numChannels; ++c )
+	{
+		for ( unsigned int d = 0; d < c; ++d )
+		{
+			covariance[ c ][ d ] = covariance[ d ][ c ];
+		}
+	}
+
+	// power iteration, starting from the diagonal of the bounding box
+	float axis[ 4 ] = {};
+	for ( unsigned int c = 0; c < numChannels; ++c )
+	{
+		axis[ c ] = max[ c ] - min[ c ];
+	}
+	for ( unsigned int i = 0; i < 8; ++i )
+	{
+		float next[ 4 ] = {}, largest = 0.0f;
+		for ( unsigned int c = 0; c < numChannels; ++c )
+		{
+			for ( unsigned int d = 0; d < numChannels; ++d )
+			{
+				next[ c ] += covariance[ c ][ d ] * axis[ d ];
+			}
+			largest = QM_OS_MAX( largest, fabsf( next[ c ] ) );
+		}
+
+		if ( largest <= FLT_EPSILON )
+		{
+			break;
+		}
+
+		for ( unsigned int c = 0; c < numChannels; ++c )
+		{
+			axis[ c ] = next[ c ] / largest;
+		}
+	}
+
+	unsigned int minPoint = 0, maxPoint = 0;
+	float        minProjection = FLT_MAX, maxProjection = -FLT_MAX;
+	for ( unsigned int i = 0; i < numPoints; ++i )
+	{
+		float projection = 0.0f;
+		for ( unsigned int c = 0; c < numChannels; ++c )
+		{
+			projection += ( points[ i ][ c ] - mean[ c ] ) * axis[ c ];
+		}
+
+		if ( projection < minProjection )
+		{
+			minProjection = projection;
+			minPoint      = i;
+		}
+		if ( projection > maxProjection )
+		{
+			maxProjection = projection;
+			maxPoint      = i;
+		}
+	}
+
+	memcpy( e0, points[ maxPoint ], sizeof( float ) * 4 );
+	memcpy( e1, points[ minPoint ], sizeof( float ) * 4 );
+}
+
+/**
+ * Solves for the endpoints which best reproduce the points given the
+ * indices they were assigned, where each index sits at the given weight
+ * between the two. Returns false if the indices don't pin down a line.
+ */
+static bool solve_endpoints( const float ( *points )[ 4 ], const uint8_t *indices, unsigned int numPoints, unsigned int numChannels, const float *weights, float e0[ 4 ], float e1[ 4 ] )
+{
+	float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+	float ax[ 4 ] = {}, bx[ 4 ] = {};
+	for ( unsigned int i = 0; i < numPoints; ++i )
+	{
+		if ( indices[ i ] == SKIP_INDEX )
+		{
+			continue;
+		}
+
+		float b = weights[ indices[ i ] ];
+		float a = 1.0f - b;
+		aa += a * a;
+		bb += b * b;
+		ab += a * b;
+		for ( unsigned int c = 0; c < numChannels; ++c )
+		{
+			ax[ c ] += a * points[ i ][ c ];
+			bx[ c ] += b * points[ i ][ c ];
+		}
+	}
+
+	float determinant = aa * bb - ab * ab;
+	if ( fabsf( determinant ) < 1e-6f )
+	{
+		return false;
+	}
+
+	for ( unsigned int c = 0; c < numChannels; ++c )
+	{
+		e0[ c ] = clamp_channel( ( ax[ c ] * bb - bx[ c ] * ab ) / determinant );
+		e1[ c ] = clamp_channel( ( bx[ c ] * aa - ax[ c ] * ab ) / determinant );
+	}
+
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// BC1 Colour
+/////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct ColourFit
+{
+	uint16_t c0, c1;
+	uint8_t  indices[ 16 ];
+	float    error;
+} ColourFit;
+
+static const float FOUR_COLOUR_WEIGHTS[ 4 ]  = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+static const float THREE_COLOUR_WEIGHTS[ 4 ] = { 0.0f, 1.0f, 0.5f, 0.0f };
+
+static inline unsigned int expand5( unsigned int v )
+{
+	unsigned int temp = v * 255 + 16;
+	return ( temp / 32 + temp ) / 32;
+}
+
+static inline unsigned int expand6( unsigned int v )
+{
+	unsigned int temp = v * 255 + 32;
+	return ( temp / 64 + temp ) / 64;
+}
+
+static uint16_t quantize_565( const float c[ 4 ] )
+{
+	unsigned int r = ( unsigned int ) ( c[ 0 ] * 31.0f / 255.0f + 0.5f );
+	unsigned int g = ( unsigned int ) ( c[ 1 ] * 63.0f / 255.0f + 0.5f );
+	unsigned int b = ( unsigned int ) ( c[ 2 ] * 31.0f / 255.0f + 0.5f );
+	return ( uint16_t ) ( ( r << 11 ) | ( g << 5 ) | b );
+}
+
+/**
+ * Assigns each point the closest palette entry. Transparent points always
+ * take index 3, as does anything closest to black when that's allowed.
+ */
+static float evaluate_colour( const float ( *points )[ 4 ], uint16_t transparent, bool fourColour, bool useBlack, uint16_t c0, uint16_t c1, uint8_t *indices )
+{
+	int palette[ 4 ][ 3 ] = {
+	        { expand5( c0 >> 11 ), expand6( ( c0 >> 5 ) & 63 ), expand5( c0 & 31 ) },
+	        { expand5( c1 >> 11 ), expand6( ( c1 >> 5 ) & 63 ), expand5( c1 & 31 ) },
+	};
+	for ( unsigned int c = 0; c < 3; ++c )
+	{
+		if ( fourColour )
+		{
+			palette[ 2 ][ c ] = ( 2 * palette[ 0 ][ c ] + palette[ 1 ][ c ] ) / 3;
+			palette[ 3 ][ c ] = ( palette[ 0 ][ c ] + 2 * palette[ 1 ][ c ] ) / 3;
+		}
+		else
+		{
+			palette[ 2 ][ c ] = ( palette[ 0 ][ c ] + palette[ 1 ][ c ] ) / 2;
+			palette[ 3 ][ c ] = 0;
+		}
+	}
+
+	unsigned int numEntries = ( fourColour || useBlack ) ? 4 : 3;
+
+	float error = 0.0f;
+	for ( unsigned int i = 0; i < 16; ++i )
+	{
+		if ( transparent & ( 1 << i ) )
+		{
+			indices[ i ] = 3;
+			continue;
+		}
+
+		float best = FLT_MAX;
+		for ( unsigned int k = 0; k < numEntries; ++k )
+		{
+			float dr = points[ i ][ 0 ] - ( float ) palette[ k ][ 0 ];
+			float dg = points[ i ][ 1 ] - ( float ) palette[ k ][ 1 ];
+			float db = points[ i ][ 2 ] - ( float ) palette[ k ][ 2 ];
+			float d  = dr * dr + dg * dg + db * db;
+			if ( d < best )
+			{
+				best         = d;
+				indices[ i ] = ( uint8_t ) k;
+			}
+		}
+		error += best;
+	}
+
+	return error;
+}
+
+static void try_colour_endpoints( const float ( *points )[ 4 ], uint16_t transparent, bool fourColour, bool useBlack, const float e0[ 4 ], const float e1[ 4 ], ColourFit *fit )
+{
+	uint16_t c0 = quantize_565( e0 );
+	uint16_t c1 = quantize_565( e1 );
+
+	// the order of the endpoints is what selects the mode
+	if ( ( fourColour && c0 < c1 ) || ( !fourColour && c0 > c1 ) )
+	{
+		uint16_t swap = c0;
+		c0            = c1;
+		c1            = swap;
+	}
+
+	ColourFit candidate = { .c0 = c0, .c1 = c1 };
+	candidate.error     = evaluate_colour( points, transparent, fourColour, useBlack, c0, c1, candidate.indices );
+	if ( candidate.error < fit->error )
+	{
+		*fit = candidate;
+	}
+}
+
+static void fit_colour( const float ( *points )[ 4 ], uint16_t transparent, bool fourColour, bool useBlack, QmImageCompressQuality quality, ColourFit *fit )
+{
+	float        opaque[ 16 ][ 4 ];
+	unsigned int numOpaque = 0;
+	for ( unsigned int i = 0; i < 16; ++i )
+	{
+		if ( !( transparent & ( 1 << i ) ) )
+		{
+			memcpy( opaque[ numOpaque++ ], points[ i ], sizeof( float ) * 4 );
+		}
+	}
+
+	fit->error = FLT_MAX;
+	if ( numOpaque == 0 )
+	{
+		*fit = ( ColourFit ){ .error = 0.0f };
+		memset( fit->indices, 3, sizeof( fit->indices ) );
+		return;
+	}
+
+	float e0[ 4 ], e1[ 4 ];
+	fit_endpoints( ( const float( * )[ 4 ] ) opaque, numOpaque, 3, quality, e0, e1 );
+	try_colour_endpoints( points, transparent, fourColour, useBlack, e0, e1, fit );
+
+	const float *weights = fourColour ? FOUR_COLOUR_WEIGHTS : THREE_COLOUR_WEIGHTS;
+
+	unsigned int passes = get_refine_passes( quality );
+	for ( unsigned int i = 0; i < passes && fit->error > 0.0f; ++i )
+	{
+		// transparent and black points don't lie on the line
+		uint8_t indices[ 16 ];
+		for ( unsigned int j = 0; j < 16; ++j )
+		{
+			indices[ j ] = ( !fourColour && fit->indices[ j ] == 3 ) ? SKIP_INDEX : fit->indices[ j ];
+		}
+
+		if ( !solve_endpoints( points, indices, 16, 3, weights, e0, e1 ) )
+		{
+			break;
+		}
+
+		float error = fit->error;
+		try_colour_endpoints( points, transparent, fourColour, useBlack, e0, e1, fit );
+		if ( fit->error >= error )
+		{
+			break;
+		}
+	}
+}
+
+static void write_colour_block( const ColourFit *fit, uint8_t *dst )
+{
+	dst[ 0 ] = ( uint8_t ) fit->c0;
+	dst[ 1 ] = ( uint8_t ) ( fit->c0 >> 8 );
+	dst[ 2 ] = ( uint8_t ) fit->c1;
+	dst[ 3 ] = ( uint8_t ) ( fit->c1 >> 8 );
+
+	uint32_t codes = 0;
+	for ( unsigned int i = 0; i < 16; ++i )
+	{
+		codes |= ( uint32_t ) fit->indices[ i ] << ( i * 2 );
+	}
+
+	dst[ 4 ] = ( uint8_t ) codes;
+	dst[ 5 ] = ( uint8_t ) ( codes >> 8 );
+	dst[ 6 ] = ( uint8_t ) ( codes >> 16 );
+	dst[ 7 ] = ( uint8_t ) ( codes >> 24 );
+}
+
+/**
+ * With punchThrough set, anything under half alpha is encoded as transparent,
+ * forcing three colour mode. DXT3 and DXT5 blocks are always four colour.
+ */
+static void encode_colour_block( const float ( *points )[ 4 ], bool punchThrough, bool fourColourOnly, QmImageCompressQuality quality, uint8_t *dst )
+{
+	uint16_t transparent = 0;
+	for ( unsigned int i = 0; punchThrough && i < 16; ++i )
+	{
+		if ( points[ i ][ 3 ] < 128.0f )
+		{
+			transparent |= ( uint16_t ) ( 1 << i );
+		}
+	}
+
+	ColourFit fit;
+	if ( transparent != 0 )
+	{
+		fit_colour( points, transparent, false, false, quality, &fit );
+	}
+	else
+	{
+		fit_colour( points, 0, true, false, quality, &fit );
+
+		// three colour mode can win out where a block is mostly two colours, or black
+		if ( quality == QM_IMAGE_COMPRESS_QUALITY_HIGH && !fourColourOnly && fit.error > 0.0f )
+		{
+			ColourFit alternative;
+			fit_colour( points, 0, false, !punchThrough, quality, &alternative );
+			if ( alternative.error < fit.error )
+			{
+				fit = alternative;
+			}
+		}
+	}
+
+	write_colour_block( &fit, dst );
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// BC2/BC4 Alpha
+/////////////////////////////////////////////////////////////////////////////////////
+
+static void encode_explicit_alpha_block( const uint8_t *values, unsigned int stride, uint8_t *dst )
+{
+	for ( unsigned int i = 0; i < 8; ++i )
+	{
+		unsigned int lo = ( values[ ( i * 2 ) * stride ] * 15 + 127 ) / 255;
+		unsigned int hi = ( values[ ( i * 2 + 1 ) * stride ] * 15 + 127 ) / 255;
+		dst[ i ]        = ( uint8_t ) ( lo | ( hi << 4 ) );
+	}
+}
+
+static unsigned int evaluate_alpha( const uint8_t *values, unsigned int stride, unsigned int a0, unsigned int a1, uint8_t *indices )
+{
+	int palette[ 8 ] = { ( int ) a0, ( int ) a1 };
+	if ( a0 > a1 )
+	{
+		for ( unsigned int k = 2; k < 8; ++k )
+		{
+			palette[ k ] = ( int ) ( ( ( 8 - k ) * a0 + ( k - 1 ) * a1 ) / 7 );
+		}
+	}
+	else
+	{
+		for ( unsigned int k = 2; k < 6; ++k )
+		{
+			palette[ k ] = ( int ) ( ( ( 6 - k ) * a0 + ( k - 1 ) * a1 ) / 5 );
+		}
+		palette[ 6 ] = 0;
+		palette[ 7 ] = 255;
+	}
+
+	unsigned int error = 0;
+	for ( unsigned int i = 0; i < 16; ++i )
+	{
+		unsigned int best = UINT32_MAX;
+		for ( unsigned int k = 0; k < 8; ++k )
+		{
+			int          delta    = ( int ) values[ i * stride ] - palette[ k ];
+			unsigned int distance = ( unsigned int ) ( delta * delta );
+			if ( distance < best )
+			{
+				best         = distance;
+				indices[ i ] = ( uint8_t ) k;
+			}
+		}
+		error += best;
+	}
+
+	return error;
+}
+
+/**
+ * Encodes one channel of a block, as used for BC3 alpha, BC4 and BC5.
+ * Both modes are tried, with the six value mode, which has exact 0 and 255,
+ * fitted to whatever lies between. The high preset also nudges the
+ * endpoints inwards, which helps where the extremes are outliers.
+ */
+static void encode_alpha_block( const uint8_t *values, unsigned int stride, QmImageCompressQuality quality, uint8_t *dst )
+{
+	unsigned int min = 255, max = 0, innerMin = 255, innerMax = 0;
+	for ( unsigned int i = 0; i < 16; ++i )
+	{
+		unsigned int v = values[ i * stride ];
+		min            = QM_OS_MIN( min, v );
+		max            = QM_OS_MAX( max, v );
+		if ( v != 0 && v != 255 )
+		{
+			innerMin = QM_OS_MIN( innerMin, v );
+			innerMax = QM_OS_MAX( innerMax, v );
+		}
+	}
+
+	unsigned int a0 = max, a1 = min, error;
+	uint8_t      indices[ 16 ];
+	error = evaluate_alpha( values, stride, a0, a1, indices );
+
+	if ( error > 0 && quality != QM_IMAGE_COMPRESS_QUALITY_FAST )
+	{
+		if ( innerMin > innerMax )
+		{
+			innerMin = innerMax = 0;
+		}
+
+		uint8_t      candidate[ 16 ];
+		unsigned int candidateError = evaluate_alpha( values, stride, innerMin, innerMax, candidate );
+		if ( candidateError < error )
+		{
+			a0    = innerMin;
+			a1    = innerMax;
+			error = candidateError;
+			memcpy( indices, candidate, sizeof( indices ) );
+		}
+	}
+
+	for ( unsigned int d0 = 0; d0 < 4 && error > 0 && quality == QM_IMAGE_COMPRESS_QUALITY_HIGH; ++d0 )
+	{
+		for ( unsigned int d1 = 0; d1 < 4 && min + d1 + d0 < max; ++d1 )
+		{
+			uint8_t      candidate[ 16 ];
+			unsigned int candidateError = evaluate_alpha( values, stride, max - d0, min + d1, candidate );
+			if ( candidateError < error )
+			{
+				a0    = max - d0;
+				a1    = min + d1;
+				error = candidateError;
+				memcpy( indices, candidate, sizeof( indices ) );
+			}
+		}
+	}
+
+	dst[ 0 ] = ( uint8_t ) a0;
+	dst[ 1 ] = ( uint8_t ) a1;
+	for ( unsigned int group = 0; group < 2; ++group )
+	{
+		uint32_t bits = 0;
+		for ( unsigned int i = 0; i < 8; ++i )
+		{
+			bits |= ( uint32_t ) indices[ group * 8 + i ] << ( i * 3 );
+		}
+
+		dst[ 2 + group * 3 ] = ( uint8_t ) bits;
+		dst[ 3 + group * 3 ] = ( uint8_t ) ( bits >> 8 );
+		dst[ 4 + group * 3 ] = ( uint8_t ) ( bits >> 16 );
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// BC7
+/////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct Bc7Fit
+{
+	uint8_t endpoints[ 2 ][ 4 ];// 7 bits apiece
+	uint8_t pBits[ 2 ];
+	uint8_t indices[ 16 ];
+	float   error;
+} Bc7Fit;
+
+static const unsigned int BC7_WEIGHTS[ 16 ] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// the above, over 64
+static const float BC7_FIT_WEIGHTS[ 16 ] = {
+        0.0f, 0.0625f, 0.140625f, 0.203125f, 0.265625f, 0.328125f, 0.40625f, 0.46875f,
+        0.53125f, 0.59375f, 0.671875f, 0.734375f, 0.796875f, 0.859375f, 0.9375f, 1.0f };
+
+static float evaluate_bc7( const float ( *points )[ 4 ], const Bc7Fit *fit, uint8_t *indices )
+{
+	int palette[ 16 ][ 4 ];
+	for ( unsigned int c = 0; c < 4; ++c )
+	{
+		int v0 = ( fit->endpoints[ 0 ][ c ] << 1 ) | fit->pBits[ 0 ];
+		int v1 = ( fit->endpoints[ 1 ][ c ] << 1 ) | fit->pBits[ 1 ];
+		for ( unsigned int k = 0; k < 16; ++k )
+		{
+			palette[ k ][ c ] = ( ( 64 - ( int ) BC7_WEIGHTS[ k ] ) * v0 + ( int ) BC7_WEIGHTS[ k ] * v1 + 32 ) >> 6;
+		}
+	}
+
+	float error = 0.0f;
+	for ( unsigned int i = 0; i < 16; ++i )
+	{
+		float best = FLT_MAX;
+		for ( unsigned int k = 0; k < 16; ++k )
+		{
+			float d = 0.0f;
+			for ( unsigned int c = 0; c < 4; ++c )
+			{
+				float delta = points[ i ][ c ] - ( float ) palette[ k ][ c ];
+				d += delta * delta;
+			}
+
+			if ( d < best )
+			{
+				best         = d;
+				indices[ i ] = ( uint8_t ) k;
+			}
+		}
+		error += best;
+	}
+
+	return error;
+}
+
+/**
+ * Quantizes the endpoints with every combination of p-bits,
+ * keeping whichever turns out best.
+ */
+static void try_bc7_endpoints( const float ( *points )[ 4 ], const float e0[ 4 ], const float e1[ 4 ], Bc7Fit *fit )
+{
+	const float *endpoints[ 2 ] = { e0, e1 };
+	for ( unsigned int p = 0; p < 4; ++p )
+	{
+		Bc7Fit candidate = { .pBits = { p & 1, p >> 1 } };
+		for ( unsigned int e = 0; e < 2; ++e )
+		{
+			for ( unsigned int c = 0; c < 4; ++c )
+			{
+				int q                         = ( int ) ( ( endpoints[ e ][ c ] - ( float ) candidate.pBits[ e ] ) / 2.0f + 0.5f );
+				candidate.endpoints[ e ][ c ] = ( uint8_t ) QM_OS_MIN( QM_OS_MAX( q, 0 ), 127 );
+			}
+		}
+
+		candidate.error = evaluate_bc7( points, &candidate, candidate.indices );
+		if ( candidate.error < fit->error )
+		{
+			*fit = candidate;
+		}
+	}
+}
+
+static void put_bits( uint8_t *dst, unsigned int *position, uint32_t value, unsigned int numBits )
+{
+	for ( unsigned int i = 0; i < numBits; ++i, ++( *position ) )
+	{
+		if ( value & ( 1U << i ) )
+		{
+			dst[ *position >> 3 ] |= ( uint8_t ) ( 1 << ( *position & 7 ) );
+		}
+	}
+}
+
+static void encode_bc7_block( const float ( *points )[ 4 ], QmImageCompressQuality quality, uint8_t *dst )
+{
+	float e0[ 4 ], e1[ 4 ];
+	fit_endpoints( points, 16, 4, quality, e0, e1 );
+
+	Bc7Fit fit = { .error = FLT_MAX };
+	try_bc7_endpoints( points, e0, e1, &fit );
+
+	unsigned int passes = get_refine_passes( quality );
+	for ( unsigned int i = 0; i < passes && fit.error > 0.0f; ++i )
+	{
+		if ( !solve_endpoints( points, fit.indices, 16, 4, BC7_FIT_WEIGHTS, e0, e1 ) )
+		{
+			break;
+		}
+
+		float error = fit.error;
+		try_bc7_endpoints( points, e0, e1, &fit );
+		if ( fit.error >= error )
+		{
+			break;
+		}
+	}
+
+	// the first index drops its top bit, so it has to be in the lower half
+	if ( fit.indices[ 0 ] & 8 )
+	{
+		for ( unsigned int c = 0; c < 4; ++c )
+		{
+			uint8_t swap            = fit.endpoints[ 0 ][ c ];
+			fit.endpoints[ 0 ][ c ] = fit.endpoints[ 1 ][ c ];
+			fit.endpoints[ 1 ][ c ] = swap;
+		}
+
+		uint8_t swap   = fit.pBits[ 0 ];
+		fit.pBits[ 0 ] = fit.pBits[ 1 ];
+		fit.pBits[ 1 ] = swap;
+
+		for ( unsigned int j = 0; j < 16; ++j )
+		{
+			fit.indices[ j ] = 15 - fit.indices[ j ];
+		}
+	}
+
+	memset( dst, 0, 16 );
+
+	unsigned int position = 0;
+	put_bits( dst, &position, 1 << 6, 7 );// mode 6
+	for ( unsigned int c = 0; c < 4; ++c )
+	{
+		put_bits( dst, &position, fit.endpoints[ 0 ][ c ], 7 );
+		put_bits( dst, &position, fit.endpoints[ 1 ][ c ], 7 );
+	}
+	put_bits( dst, &position, fit.pBits[ 0 ], 1 );
+	put_bits( dst, &position, fit.pBits[ 1 ], 1 );
+	for ( unsigned int j = 0; j < 16; ++j )
+	{
+		put_bits( dst, &position, fit.indices[ j ], ( j == 0 ) ? 3 : 4 );
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Jobs
+/////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct EncodeLevel
+{
+	const uint8_t *src;// always RGBA8
+	uint8_t       *dst;
+	unsigned int   width;
+	unsigned int   height;
+} EncodeLevel;
+
+typedef struct EncodeJob
+{
+	const EncodeLevel *level;
+	unsigned int       firstRow;
+	unsigned int       numRows;
+} EncodeJob;
+
+typedef struct EncodeQueue
+{
+	PLImageFormat          format;
+	QmImageCompressQuality quality;
+	const EncodeJob       *jobs;
+	unsigned int           numJobs;
+	atomic_uint            nextJob;
+} EncodeQueue;
+
+static void encode_block( PLImageFormat format, const uint8_t ( *pixels )[ 4 ], QmImageCompressQuality quality, uint8_t *dst )
+{
+	float points[ 16 ][ 4 ];
+	for ( unsigned int i = 0; i < 16; ++i )
+	{
+		for ( unsigned int c = 0; c < 4; ++c )
+		{
+			points[ i ][ c ] = ( float ) pixels[ i ][ c ];
+		}
+	}
+
+	switch ( format )
+	{
+		default:
+			break;
+		case PL_IMAGEFORMAT_RGB_DXT1:
+			encode_colour_block( ( const float( * )[ 4 ] ) points, false, false, quality, dst );
+			break;
+		case PL_IMAGEFORMAT_RGBA_DXT1:
+			encode_colour_block( ( const float( * )[ 4 ] ) points, true, false, quality, dst );
+			break;
+		case PL_IMAGEFORMAT_RGBA_DXT3:
+			encode_explicit_alpha_block( &pixels[ 0 ][ 3 ], 4, dst );
+			encode_colour_block( ( const float( * )[ 4 ] ) points, false, true, quality, dst + 8 );
+			break;
+		case PL_IMAGEFORMAT_RGBA_DXT5:
+			encode_alpha_block( &pixels[ 0 ][ 3 ], 4, quality, dst );
+			encode_colour_block( ( const float( * )[ 4 ] ) points, false, true, quality, dst + 8 );
+			break;
+		case PL_IMAGEFORMAT_R_BC4:
+			encode_alpha_block( &pixels[ 0 ][ 0 ], 4, quality, dst );
+			break;
+		case PL_IMAGEFORMAT_RG_BC5:
+			encode_alpha_block( &pixels[ 0 ][ 0 ], 4, quality, dst );
+			encode_alpha_block( &pixels[ 0 ][ 1 ], 4, quality, dst + 8 );
+			break;
+		case PL_IMAGEFORMAT_RGBA_BC7:
+			encode_bc7_block( ( const float( * )[ 4 ] ) points, quality, dst );
+			break;
+	}
+}
+
+static void encode_rows( PLImageFormat format, QmImageCompressQuality quality, const EncodeLevel *level, unsigned int firstRow, unsigned int numRows )
+{
+	unsigned int blockSize    = get_block_size( format );
+	unsigned int blocksPerRow = ( level->width + 3 ) / 4;
+
+	for ( unsigned int row = firstRow; row < firstRow + numRows; ++row )
+	{
+		uint8_t *dst = level->dst + ( size_t ) row * blocksPerRow * blockSize;
+		for ( unsigned int column = 0; column < blocksPerRow; ++column, dst += blockSize )
+		{
+			uint8_t pixels[ 16 ][ 4 ];
+			for ( unsigned int y = 0; y < 4; ++y )
+			{
+				unsigned int sy = QM_OS_MIN( row * 4 + y, level->height - 1 );
+				for ( unsigned int x = 0; x < 4; ++x )
+				{
+					unsigned int sx = QM_OS_MIN( column * 4 + x, level->width - 1 );
+					memcpy( pixels[ y * 4 + x ], level->src + ( ( size_t ) sy * level->width + sx ) * 4, 4 );
+				}
+			}
+
+			encode_block( format, ( const uint8_t( * )[ 4 ] ) pixels, quality, dst );
+		}
+	}
+}
+
+static void encode_worker( void *userData )
+{
+	EncodeQueue *queue = userData;
+
+	unsigned int i;
+	while ( ( i = atomic_fetch_add( &queue->nextJob, 1 ) ) < queue->numJobs )
+	{
+		const EncodeJob *job = &queue->jobs[ i ];
+		encode_rows( queue->format, queue->quality, job->level, job->firstRow, job->numRows );
+	}
+}
+
+/**
+ * Splits every level into jobs of roughly MIN_BLOCKS_PER_JOB blocks apiece
+ * and works through them, only calling on the shared workers if there's enough to share.
+ */
+static void encode_levels( PLImageFormat format, QmImageCompressQuality quality, const EncodeLevel *levels, unsigned int numLevels, unsigned int numThreads )
+{
+	unsigned int numJobs = 0;
+	for ( unsigned int i = 0; i < numLevels; ++i )
+	{
+		unsigned int blocksPerRow = ( levels[ i ].width + 3 ) / 4;
+		unsigned int rowsPerJob   = QM_OS_MAX( MIN_BLOCKS_PER_JOB / blocksPerRow, 1U );
+		numJobs += ( ( levels[ i ].height + 3 ) / 4 + rowsPerJob - 1 ) / rowsPerJob;
+	}
+
+	if ( numThreads == 0 )
+	{
+		numThreads = qm_os_thread_get_available();
+	}
+	numThreads = QM_OS_MIN( numThreads, numJobs );
+
+	if ( numThreads <= 1 )
+	{
+		for ( unsigned int i = 0; i < numLevels; ++i )
+		{
+			encode_rows( format, quality, &levels[ i ], 0, ( levels[ i ].height + 3 ) / 4 );
+		}
+		return;
+	}
+
+	EncodeJob *jobs = QM_OS_MEMORY_NEW_( EncodeJob, numJobs );
+	numJobs         = 0;
+	for ( unsigned int i = 0; i < numLevels; ++i )
+	{
+		unsigned int blocksPerRow = ( levels[ i ].width + 3 ) / 4;
+		unsigned int numRows      = ( levels[ i ].height + 3 ) / 4;
+		unsigned int rowsPerJob   = QM_OS_MAX( MIN_BLOCKS_PER_JOB / blocksPerRow, 1U );
+		for ( unsigned int row = 0; row < numRows; row += rowsPerJob )
+		{
+			jobs[ numJobs++ ] = ( EncodeJob ){ .level = &levels[ i ], .firstRow = row, .numRows = QM_OS_MIN( rowsPerJob, numRows - row ) };
+		}
+	}
+
+	EncodeQueue queue = { .format = format, .quality = quality, .jobs = jobs, .numJobs = numJobs };
+	atomic_init( &queue.nextJob, 0 );
+
+	QmWorkerGroup *group = qm_worker_group_start_( encode_worker, &queue, numThreads - 1 );
+
+	encode_worker( &queue );
+
+	qm_worker_group_wait_( group );
+	qm_os_memory_free( jobs );
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Public
+/////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Compresses a single level of RGBA8 pixels into blocks of the given
+ * format. Neither the width nor height need be a multiple of 4.
+ * A numThreads of 0 uses every available thread.
+ */
+bool qm_image_compress_pixels( const void *src, unsigned int width, unsigned int height, PLImageFormat format, void *dst, QmImageCompressQuality quality, unsigned int numThreads )
+{
+	if ( get_block_size( format ) == 0 )
+	{
+		PlReportErrorF( PL_RESULT_IMAGEFORMAT, "not a block compressed format" );
+		return false;
+	}
+
+	if ( width == 0 || height == 0 )
+	{
+		return true;
+	}
+
+	EncodeLevel level = { .src = src, .dst = dst, .width = width, .height = height };
+	encode_levels( format, quality, &level, 1, numThreads );
+
+	return true;
+}
+
+typedef struct CompressLevel
+{
+	uint8_t   **data;
+	EncodeLevel level;
+	uint8_t    *pixels;// the level converted to RGBA8, if it wasn't already
+} CompressLevel;
+
+static void add_compress_level( const QmImage *image, uint8_t **data, unsigned int level, CompressLevel *levels, unsigned int *numLevels )
+{
+	if ( *data == nullptr )
+	{
+		return;
+	}
+
+	levels[ ( *numLevels )++ ] = ( CompressLevel ){
+	        .data  = data,
+	        .level = {
+	                  .width  = QM_OS_MAX( image->width >> level, 1U ),
+	                  .height = QM_OS_MAX( image->height >> level, 1U ),
+	                  },
+	};
+}
+
+static void free_compress_levels( CompressLevel *levels, unsigned int numLevels )
+{
+	for ( unsigned int i = 0; i < numLevels; ++i )
+	{
+		qm_os_memory_free( levels[ i ].pixels );
+		qm_os_memory_free( levels[ i ].level.dst );
+	}
+	qm_os_memory_free( levels );
+}
+
+/**
+ * Compresses every level, and frame, of the image into the given block
+ * format, in one go. Sources in other formats are converted to RGBA8 along
+ * the way, and DXT sources are decompressed first. On failure the image is
+ * left in whatever uncompressed state it got to.
+ */
+bool qm_image_compress( QmImage *image, PLImageFormat format, QmImageCompressQuality quality, unsigned int numThreads )
+{
+	if ( image->format == format )
+	{
+		return true;
+	}
+
+	unsigned int blockSize = get_block_size( format );
+	if ( blockSize == 0 )
+	{
+		PlReportErrorF( PL_RESULT_IMAGEFORMAT, "not a block compressed format" );
+		return false;
+	}
+
+	if ( get_block_size( image->format ) != 0 && !qm_image_decompress_levels_( image, numThreads ) )
+	{
+		return false;
+	}
+
+	unsigned int numLevels = ( image->data != nullptr ) ? image->levels : 0;
+	for ( unsigned int i = 0; i < image->numFrames; ++i )
+	{
+		numLevels += image->frames[ i ].numMips;
+	}
+
+	CompressLevel *levels    = QM_OS_MEMORY_NEW_( CompressLevel, numLevels + 1 );
+	unsigned int   numActive = 0;
+	for ( unsigned int i = 0; image->data != nullptr && i < image->levels; ++i )
+	{
+		add_compress_level( image, &image->data[ i ], i, levels, &numActive );
+	}
+	for ( unsigned int i = 0; i < image->numFrames; ++i )
+	{
+		for ( unsigned int j = 0; j < image->frames[ i ].numMips; ++j )
+		{
+			add_compress_level( image, ( uint8_t ** ) &image->frames[ i ].data[ j ], j, levels, &numActive );
+		}
+	}
+
+	EncodeLevel *encodeLevels = QM_OS_MEMORY_NEW_( EncodeLevel, numActive + 1 );
+	for ( unsigned int i = 0; i < numActive; ++i )
+	{
+		EncodeLevel *level     = &levels[ i ].level;
+		size_t       numPixels = ( size_t ) level->width * level->height;
+
+		level->src = *levels[ i ].data;
+		if ( image->format != PL_IMAGEFORMAT_RGBA8 )
+		{
+			levels[ i ].pixels = QM_OS_MEMORY_MALLOC_( numPixels * 4 );
+			if ( levels[ i ].pixels == nullptr || !qm_image_convert_pixels( *levels[ i ].data, image->format, levels[ i ].pixels, PL_IMAGEFORMAT_RGBA8, numPixels ) )
+			{
+				free_compress_levels( levels, numActive );
+				qm_os_memory_free( encodeLevels );
+				return false;
+			}
+
+			level->src = levels[ i ].pixels;
+		}
+
+		level->dst = QM_OS_MEMORY_MALLOC_( PlGetImageSize( format, level->width, level->height ) );
+		if ( level->dst == nullptr )
+		{
+			free_compress_levels( levels, numActive );
+			qm_os_memory_free( encodeLevels );
+
+			PlReportErrorF( PL_RESULT_MEMORY_ALLOCATION, "couldn't allocate memory for image data" );
+			return false;
+		}
+
+		encodeLevels[ i ] = *level;
+	}
+
+	encode_levels( format, quality, encodeLevels, numActive, numThreads );
+
+	for ( unsigned int i = 0; i < numActive; ++i )
+	{
+		qm_os_memory_free( *levels[ i ].data );
+		*levels[ i ].data     = levels[ i ].level.dst;
+		levels[ i ].level.dst = nullptr;
+	}
+
+	free_compress_levels( levels, numActive );
+	qm_os_memory_free( encodeLevels );
+
+	image->format        = format;
+	image->colour_format = ( format == PL_IMAGEFORMAT_RGB_DXT1 || format == PL_IMAGEFORMAT_R_BC4 || format == PL_IMAGEFORMAT_RG_BC5 ) ? PL_COLOURFORMAT_RGB : PL_COLOURFORMAT_RGBA;
+	image->size          = PlGetImageSize( format, image->width, image->height );
+
+	return true;
+}
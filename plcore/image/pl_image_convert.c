@@ -0,0 +1,1268 @@
+// SPDX-License-Identifier: MIT
+// Hei Platform Library
+// Copyright © 2017-2026 Quartermind Games, Mark E. Sowden <markelswo@gmail.com>
+// Purpose: Pixel format conversion.
+
+#include "image_private.h"
+
+#include "qmos/public/qm_os_memory.h"
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || defined( _M_AMD64 )
+#	include <emmintrin.h>
+#	define IMAGE_CONVERT_SSE2
+// avx2 is picked at runtime, so it doesn't need to be enabled for the whole build
+#	if defined( __GNUC__ ) && !defined( _MSC_VER )
+#		include <immintrin.h>
+#		define IMAGE_CONVERT_AVX2
+#	endif
+#elif defined( __ARM_NEON ) || defined( _M_ARM64 )
+#	include <arm_neon.h>
+#	define IMAGE_CONVERT_NEON
+#endif
+
+/**
+ * Every format is unpacked to, and packed from, one of two intermediates;
+ * RGBA8 for anything with 8 bits or fewer per channel and RGBA32F for
+ * everything else. Anything going to or from RGBA8 skips the intermediate
+ * entirely, as that's where most conversions end up, and it's those paths
+ * which get SIMD kernels. The rest go through a small buffer on the stack,
+ * a chunk of pixels at a time.
+ *
+ * Packed 16-bit formats are stored high byte first, so RGB5A1 is
+ * RRRRRGGG GGBBBBBA, matching what the loaders produce. R8 is
+ * treated as a lone red channel, as GL_RED would be.
+ */
+
+#define CHUNK_PIXELS 256
+
+typedef struct PackedLayout
+{
+	uint8_t shift[ 4 ];
+	uint8_t bits[ 4 ];// 0 if the channel isn't present
+} PackedLayout;
+
+static const PackedLayout LAYOUT_RGB4   = { { 8, 4, 0, 0 }, { 4, 4, 4, 0 } };
+static const PackedLayout LAYOUT_RGBA4  = { { 12, 8, 4, 0 }, { 4, 4, 4, 4 } };
+static const PackedLayout LAYOUT_RGB5   = { { 11, 6, 1, 0 }, { 5, 5, 5, 0 } };
+static const PackedLayout LAYOUT_RGB5A1 = { { 11, 6, 1, 0 }, { 5, 5, 5, 1 } };
+static const PackedLayout LAYOUT_RGB565 = { { 11, 5, 0, 0 }, { 5, 6, 5, 0 } };
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Scalar
+/////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Widens a channel to 8 bits by repeating its high bits into the
+ * low ones, so that zero and full intensity map onto 0 and 255.
+ */
+static inline uint8_t expand_channel( unsigned int v, unsigned int bits )
+{
+	if ( bits == 1 )
+	{
+		return v ? 255 : 0;
+	}
+
+	return ( uint8_t ) ( ( v << ( 8 - bits ) ) | ( v >> ( 2 * bits - 8 ) ) );
+}
+
+static void unpack_packed16( const PackedLayout *layout, const uint8_t *src, uint8_t *dst, size_t numPixels )
+{
+	for ( size_t i = 0; i < numPixels; ++i, src += 2, dst += 4 )
+	{
+		unsigned int v = ( src[ 0 ] << 8 ) | src[ 1 ];
+		for ( unsigned int j = 0; j < 4; ++j )
+		{
+			if ( layout->bits[ j ] == 0 )
+			{
+				dst[ j ] = 255;
+				continue;
+			}
+
+			unsigned int c = ( v >> layout->shift[ j ] ) & ( ( 1U << layout->bits[ j ] ) - 1 );
+			dst[ j ]       = expand_channel( c, layout->bits[ j ] );
+		}
+	}
+}
+
+static void pack_packed16( const PackedLayout *layout, const uint8_t *src, uint8_t *dst, size_t numPixels )
+{
+	for ( size_t i = 0; i < numPixels; ++i, src += 4, dst += 2 )
+	{
+		unsigned int v = 0;
+		for ( unsigned int j = 0; j < 4; ++j )
+		{
+			if ( layout->bits[ j ] != 0 )
+			{
+				v |= ( unsigned int ) ( src[ j ] >> ( 8 - layout->bits[ j ] ) ) << layout->shift[ j ];
+			}
+		}
+
+		/* set any bits left over, i.e. so RGB5 reads as opaque RGB5A1 */
+		if ( layout->bits[ 3 ] == 0 && layout->shift[ 2 ] != 0 )
+		{
+			v |= ( 1U << layout->shift[ 2 ] ) - 1;
+		}
+
+		dst[ 0 ] = ( uint8_t ) ( v >> 8 );
+		dst[ 1 ] = ( uint8_t ) v;
+	}
+}
+
+static float half_to_float( uint16_t h )
+{
+	uint32_t sign     = ( uint32_t ) ( h & 0x8000 ) << 16;
+	uint32_t exponent = ( h >> 10 ) & 0x1F;
+	uint32_t mantissa = h & 0x3FF;
+
+	uint32_t bits;
+	if ( exponent == 0 )
+	{
+		if ( mantissa == 0 )
+		{
+			bits = sign;
+		}
+		else
+		{
+			/* subnormal, so normalize it */
+			exponent = 127 - 15 + 1;
+			while ( !( mantissa & 0x400 ) )
+			{
+				mantissa <<= 1;
+				exponent--;
+			}
+			bits = sign | ( exponent << 23 ) | ( ( mantissa & 0x3FF ) << 13 );
+		}
+	}
+	else if ( exponent == 31 )
+	{
+		bits = sign | 0x7F800000 | ( mantissa << 13 );
+	}
+	else
+	{
+		bits = sign | ( ( exponent + 127 - 15 ) << 23 ) | ( mantissa << 13 );
+	}
+
+	float f;
+	memcpy( &f, &bits, sizeof( f ) );
+	return f;
+}
+
+static uint16_t float_to_half( float f )
+{
+	uint32_t bits;
+	memcpy( &bits, &f, sizeof( bits ) );
+
+	uint16_t sign     = ( bits >> 16 ) & 0x8000;
+	uint32_t exponent = ( bits >> 23 ) & 0xFF;
+	uint32_t mantissa = bits & 0x7FFFFF;
+
+	if ( exponent == 0xFF )
+	{
+		return sign | 0x7C00 | ( mantissa ? 0x200 : 0 );
+	}
+
+	int e = ( int ) exponent - 127 + 15;
+	if ( e >= 31 )
+	{
+		return sign | 0x7C00;
+	}
+
+	/* rounding is to nearest even; a carry out of the
+	 * mantissa correctly bumps the exponent along */
+	if ( e <= 0 )
+	{
+		if ( e < -10 )
+		{
+			return sign;
+		}
+
+		mantissa |= 0x800000;
+
+		unsigned int shift = 14 - e;
+		uint32_t     half  = mantissa >> shift;
+		uint32_t     rem   = mantissa & ( ( 1U << shift ) - 1 );
+		uint32_t     mid   = 1U << ( shift - 1 );
+		if ( rem > mid || ( rem == mid && ( half & 1 ) ) )
+		{
+			half++;
+		}
+
+		return sign | ( uint16_t ) half;
+	}
+
+	uint32_t half = ( ( uint32_t ) e << 10 ) | ( mantissa >> 13 );
+	uint32_t rem  = mantissa & 0x1FFF;
+	if ( rem > 0x1000 || ( rem == 0x1000 && ( half & 1 ) ) )
+	{
+		half++;
+	}
+
+	return sign | ( uint16_t ) half;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// AVX2
+/////////////////////////////////////////////////////////////////////////////////////
+
+#if defined( IMAGE_CONVERT_AVX2 )
+
+static bool has_avx2( void )
+{
+	static int supported = -1;
+	if ( supported < 0 )
+	{
+		__builtin_cpu_init();
+		supported = __builtin_cpu_supports( "avx2" ) ? 1 : 0;
+	}
+
+	return supported;
+}
+
+static bool has_f16c( void )
+{
+	static int supported = -1;
+	if ( supported < 0 )
+	{
+		__builtin_cpu_init();
+		supported = ( __builtin_cpu_supports( "avx" ) && __builtin_cpu_supports( "f16c" ) ) ? 1 : 0;
+	}
+
+	return supported;
+}
+
+/**
+ * Eight pixels at a time, four to each lane. Each lane loads
+ * 16 bytes for the 12 it uses, so the loop stops short enough
+ * to never read past the end.
+ */
+__attribute__( ( target( "avx2" ) ) ) static size_t rgb8_to_rgba8_avx2( const uint8_t *src, uint8_t *dst, size_t numPixels, bool swap )
+{
+	const __m256i order = swap ? _mm256_setr_epi8( 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1,
+	                                               2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1 )
+	                           : _mm256_setr_epi8( 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+	                                               0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1 );
+	const __m256i alpha = _mm256_set1_epi32( ( int ) 0xFF000000 );
+
+	size_t i = 0;
+	for ( ; ( i + 8 ) * 3 + 4 <= numPixels * 3; i += 8 )
+	{
+		__m128i lo = _mm_loadu_si128( ( const __m128i * ) ( src + i * 3 ) );
+		__m128i hi = _mm_loadu_si128( ( const __m128i * ) ( src + i * 3 + 12 ) );
+		__m256i v  = _mm256_inserti128_si256( _mm256_castsi128_si256( lo ), hi, 1 );
+		_mm256_storeu_si256( ( __m256i * ) ( dst + i * 4 ), _mm256_or_si256( _mm256_shuffle_epi8( v, order ), alpha ) );
+	}
+
+	return i;
+}
+
+/**
+ * The reverse of the above; each lane is squeezed down to 12 bytes and
+ * stored 16 at a time, with the next store overwriting the excess.
+ */
+__attribute__( ( target( "avx2" ) ) ) static size_t rgba8_to_rgb8_avx2( const uint8_t *src, uint8_t *dst, size_t numPixels, bool swap )
+{
+	const __m256i order = swap ? _mm256_setr_epi8( 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+	                                               2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1 )
+	                           : _mm256_setr_epi8( 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+	                                               0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1 );
+
+	size_t i = 0;
+	for ( ; ( i + 8 ) * 3 + 4 <= numPixels * 3; i += 8 )
+	{
+		__m256i v = _mm256_shuffle_epi8( _mm256_loadu_si256( ( const __m256i * ) ( src + i * 4 ) ), order );
+		_mm_storeu_si128( ( __m128i * ) ( dst + i * 3 ), _mm256_castsi256_si128( v ) );
+		_mm_storeu_si128( ( __m128i * ) ( dst + i * 3 + 12 ), _mm256_extracti128_si256( v, 1 ) );
+	}
+
+	return i;
+}
+
+__attribute__( ( target( "avx,f16c" ) ) ) static size_t halves_to_floats_f16c( const uint8_t *src, float *dst, size_t count )
+{
+	size_t i = 0;
+	for ( ; i + 8 <= count; i += 8 )
+	{
+		__m128i h = _mm_loadu_si128( ( const __m128i * ) ( src + i * 2 ) );
+		_mm256_storeu_ps( dst + i, _mm256_cvtph_ps( h ) );
+	}
+
+	return i;
+}
+
+__attribute__( ( target( "avx,f16c" ) ) ) static size_t floats_to_halves_f16c( const float *src, uint8_t *dst, size_t count )
+{
+	size_t i = 0;
+	for ( ; i + 8 <= count; i += 8 )
+	{
+		__m128i h = _mm256_cvtps_ph( _mm256_loadu_ps( src + i ), _MM_FROUND_TO_NEAREST_INT );
+		_mm_storeu_si128( ( __m128i * ) ( dst + i * 2 ), h );
+	}
+
+	return i;
+}
+
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////
+// SSE2
+/////////////////////////////////////////////////////////////////////////////////////
+
+#if defined( IMAGE_CONVERT_SSE2 )
+
+static size_t rgb8_to_rgba8_simd( const uint8_t *src, uint8_t *dst, size_t numPixels, bool swap )
+{
+#	if defined( IMAGE_CONVERT_AVX2 )
+	if ( has_avx2() )
+	{
+		return rgb8_to_rgba8_avx2( src, dst, numPixels, swap );
+	}
+#	endif
+
+	/* there's no byte shuffle before ssse3, so leave it to the scalar path */
+	return 0;
+}
+
+static size_t rgba8_to_rgb8_simd( const uint8_t *src, uint8_t *dst, size_t numPixels, bool swap )
+{
+#	if defined( IMAGE_CONVERT_AVX2 )
+	if ( has_avx2() )
+	{
+		return rgba8_to_rgb8_avx2( src, dst, numPixels, swap );
+	}
+#	endif
+
+	return 0;
+}
+
+/**
+ * Swaps red and blue over, four pixels at a time, by
+ * swapping the 16-bit halves of the red/blue pairs.
+ */
+static size_t swap_rb_simd( const uint8_t *src, uint8_t *dst, size_t numPixels, bool setAlpha )
+{
+	const __m128i rbMask = _mm_set1_epi32( 0x00FF00FF );
+	const __m128i alpha  = _mm_set1_epi32( setAlpha ? ( int ) 0xFF000000 : 0 );
+
+	size_t i = 0;
+	for ( ; i + 4 <= numPixels; i += 4 )
+	{
+		__m128i v  = _mm_loadu_si128( ( const __m128i * ) ( src + i * 4 ) );
+		__m128i rb = _mm_and_si128( v, rbMask );
+		__m128i ga = _mm_andnot_si128( rbMask, v );
+		rb         = _mm_shufflelo_epi16( rb, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+		rb         = _mm_shufflehi_epi16( rb, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+		_mm_storeu_si128( ( __m128i * ) ( dst + i * 4 ), _mm_or_si128( _mm_or_si128( rb, ga ), alpha ) );
+	}
+
+	return i;
+}
+
+static size_t rgba8_to_r8_simd( const uint8_t *src, uint8_t *dst, size_t numPixels )
+{
+	const __m128i mask = _mm_set1_epi32( 0xFF );
+
+	size_t i = 0;
+	for ( ; i + 16 <= numPixels; i += 16 )
+	{
+		__m128i a = _mm_and_si128( _mm_loadu_si128( ( const __m128i * ) ( src + i * 4 ) ), mask );
+		__m128i b = _mm_and_si128( _mm_loadu_si128( ( const __m128i * ) ( src + i * 4 + 16 ) ), mask );
+		__m128i c = _mm_and_si128( _mm_loadu_si128( ( const __m128i * ) ( src + i * 4 + 32 ) ), mask );
+		__m128i d = _mm_and_si128( _mm_loadu_si128( ( const __m128i * ) ( src + i * 4 + 48 ) ), mask );
+		_mm_storeu_si128( ( __m128i * ) ( dst + i ), _mm_packus_epi16( _mm_packs_epi32( a, b ), _mm_packs_epi32( c, d ) ) );
+	}
+
+	return i;
+}
+
+/**
+ * Eight pixels at a time; each channel is pulled out into its own 16-bit
+ * lanes, widened, and then the lot interleaved back together as RGBA8.
+ */
+static size_t unpack_packed16_simd( const PackedLayout *layout, const uint8_t *src, uint8_t *dst, size_t numPixels )
+{
+	__m128i shift[ 4 ], mask[ 4 ], left[ 4 ], right[ 4 ];
+	for ( unsigned int j = 0; j < 4; ++j )
+	{
+		unsigned int bits = layout->bits[ j ];
+		shift[ j ]        = _mm_cvtsi32_si128( layout->shift[ j ] );
+		mask[ j ]         = _mm_set1_epi16( ( short ) ( ( 1U << bits ) - 1 ) );
+		left[ j ]         = _mm_cvtsi32_si128( ( bits > 1 ) ? 8 - bits : 0 );
+		right[ j ]        = _mm_cvtsi32_si128( ( bits > 1 ) ? 2 * bits - 8 : 0 );
+	}
+
+	const __m128i full = _mm_set1_epi16( 255 );
+	const __m128i zero = _mm_setzero_si128();
+
+	size_t i = 0;
+	for ( ; i + 8 <= numPixels; i += 8 )
+	{
+		__m128i v = _mm_loadu_si128( ( const __m128i * ) ( src + i * 2 ) );
+		v         = _mm_or_si128( _mm_slli_epi16( v, 8 ), _mm_srli_epi16( v, 8 ) );
+
+		__m128i c[ 4 ];
+		for ( unsigned int j = 0; j < 4; ++j )
+		{
+			if ( layout->bits[ j ] == 0 )
+			{
+				c[ j ] = full;
+				continue;
+			}
+
+			__m128i x = _mm_and_si128( _mm_srl_epi16( v, shift[ j ] ), mask[ j ] );
+			if ( layout->bits[ j ] == 1 )
+			{
+				c[ j ] = _mm_and_si128( _mm_sub_epi16( zero, x ), full );
+			}
+			else
+			{
+				c[ j ] = _mm_or_si128( _mm_sll_epi16( x, left[ j ] ), _mm_srl_epi16( x, right[ j ] ) );
+			}
+		}
+
+		__m128i rg = _mm_or_si128( c[ 0 ], _mm_slli_epi16( c[ 1 ], 8 ) );
+		__m128i ba = _mm_or_si128( c[ 2 ], _mm_slli_epi16( c[ 3 ], 8 ) );
+		_mm_storeu_si128( ( __m128i * ) ( dst + i * 4 ), _mm_unpacklo_epi16( rg, ba ) );
+		_mm_storeu_si128( ( __m128i * ) ( dst + i * 4 + 16 ), _mm_unpackhi_epi16( rg, ba ) );
+	}
+
+	return i;
+}
+
+static size_t bytes_to_floats_simd( const uint8_t *src, float *dst, size_t count )
+{
+	const __m128i zero  = _mm_setzero_si128();
+	const __m128  scale = _mm_set1_ps( 1.0f / 255.0f );
+
+	size_t i = 0;
+	for ( ; i + 16 <= count; i += 16 )
+	{
+		__m128i v  = _mm_loadu_si128( ( const __m128i * ) ( src + i ) );
+		__m128i lo = _mm_unpacklo_epi8( v, zero );
+		__m128i hi = _mm_unpackhi_epi8( v, zero );
+		_mm_storeu_ps( dst + i, _mm_mul_ps( _mm_cvtepi32_ps( _mm_unpacklo_epi16( lo, zero ) ), scale ) );
+		_mm_storeu_ps( dst + i + 4, _mm_mul_ps( _mm_cvtepi32_ps( _mm_unpackhi_epi16( lo, zero ) ), scale ) );
+		_mm_storeu_ps( dst + i + 8, _mm_mul_ps( _mm_cvtepi32_ps( _mm_unpacklo_epi16( hi, zero ) ), scale ) );
+		_mm_storeu_ps( dst + i + 12, _mm_mul_ps( _mm_cvtepi32_ps( _mm_unpackhi_epi16( hi, zero ) ), scale ) );
+	}
+
+	return i;
+}
+
+/**
+ * Clamping comes for free from the saturating packs,
+ * and the conversion itself rounds to nearest.
+ */
+static size_t floats_to_bytes_simd( const float *src, uint8_t *dst, size_t count )
+{
+	const __m128 scale = _mm_set1_ps( 255.0f );
+
+	size_t i = 0;
+	for ( ; i + 16 <= count; i += 16 )
+	{
+		__m128i a = _mm_cvtps_epi32( _mm_mul_ps( _mm_loadu_ps( src + i ), scale ) );
+		__m128i b = _mm_cvtps_epi32( _mm_mul_ps( _mm_loadu_ps( src + i + 4 ), scale ) );
+		__m128i c = _mm_cvtps_epi32( _mm_mul_ps( _mm_loadu_ps( src + i + 8 ), scale ) );
+		__m128i d = _mm_cvtps_epi32( _mm_mul_ps( _mm_loadu_ps( src + i + 12 ), scale ) );
+		_mm_storeu_si128( ( __m128i * ) ( dst + i ), _mm_packus_epi16( _mm_packs_epi32( a, b ), _mm_packs_epi32( c, d ) ) );
+	}
+
+	return i;
+}
+
+static size_t halves_to_floats_simd( const uint8_t *src, float *dst, size_t count )
+{
+#	if defined( IMAGE_CONVERT_AVX2 )
+	if ( has_f16c() )
+	{
+		return halves_to_floats_f16c( src, dst, count );
+	}
+#	endif
+
+	return 0;
+}
+
+static size_t floats_to_halves_simd( const float *src, uint8_t *dst, size_t count )
+{
+#	if defined( IMAGE_CONVERT_AVX2 )
+	if ( has_f16c() )
+	{
+		return floats_to_halves_f16c( src, dst, count );
+	}
+#	endif
+
+	return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// NEON
+/////////////////////////////////////////////////////////////////////////////////////
+
+#elif defined( IMAGE_CONVERT_NEON )
+
+static size_t rgb8_to_rgba8_simd( const uint8_t *src, uint8_t *dst, size_t numPixels, bool swap )
+{
+	size_t i = 0;
+	for ( ; i + 16 <= numPixels; i += 16 )
+	{
+		uint8x16x3_t v = vld3q_u8( src + i * 3 );
+		uint8x16x4_t o;
+		o.val[ 0 ] = swap ? v.val[ 2 ] : v.val[ 0 ];
+		o.val[ 1 ] = v.val[ 1 ];
+		o.val[ 2 ] = swap ? v.val[ 0 ] : v.val[ 2 ];
+		o.val[ 3 ] = vdupq_n_u8( 255 );
+		vst4q_u8( dst + i * 4, o );
+	}
+
+	return i;
+}
+
+static size_t rgba8_to_rgb8_simd( const uint8_t *src, uint8_t *dst, size_t numPixels, bool swap )
+{
+	size_t i = 0;
+	for ( ; i + 16 <= numPixels; i += 16 )
+	{
+		uint8x16x4_t v = vld4q_u8( src + i * 4 );
+		uint8x16x3_t o;
+		o.val[ 0 ] = swap ? v.val[ 2 ] : v.val[ 0 ];
+		o.val[ 1 ] = v.val[ 1 ];
+		o.val[ 2 ] = swap ? v.val[ 0 ] : v.val[ 2 ];
+		vst3q_u8( dst + i * 3, o );
+	}
+
+	return i;
+}
+
+static size_t swap_rb_simd( const uint8_t *src, uint8_t *dst, size_t numPixels, bool setAlpha )
+{
+	size_t i = 0;
+	for ( ; i + 16 <= numPixels; i += 16 )
+	{
+		uint8x16x4_t v = vld4q_u8( src + i * 4 );
+		uint8x16_t   r = v.val[ 2 ];
+		v.val[ 2 ]     = v.val[ 0 ];
+		v.val[ 0 ]     = r;
+		if ( setAlpha )
+		{
+			v.val[ 3 ] = vdupq_n_u8( 255 );
+		}
+		vst4q_u8( dst + i * 4, v );
+	}
+
+	return i;
+}
+
+static size_t rgba8_to_r8_simd( const uint8_t *src, uint8_t *dst, size_t numPixels )
+{
+	size_t i = 0;
+	for ( ; i + 16 <= numPixels; i += 16 )
+	{
+		vst1q_u8( dst + i, vld4q_u8( src + i * 4 ).val[ 0 ] );
+	}
+
+	return i;
+}
+
+static size_t unpack_packed16_simd( const PackedLayout *layout, const uint8_t *src, uint8_t *dst, size_t numPixels )
+{
+	size_t i = 0;
+	for ( ; i + 8 <= numPixels; i += 8 )
+	{
+		uint16x8_t v = vreinterpretq_u16_u8( vrev16q_u8( vld1q_u8( src + i * 2 ) ) );
+
+		uint8x8x4_t o;
+		for ( unsigned int j = 0; j < 4; ++j )
+		{
+			int bits = layout->bits[ j ];
+			if ( bits == 0 )
+			{
+				o.val[ j ] = vdup_n_u8( 255 );
+				continue;
+			}
+
+			uint16x8_t x = vandq_u16( vshlq_u16( v, vdupq_n_s16( -( int16_t ) layout->shift[ j ] ) ), vdupq_n_u16( ( 1U << bits ) - 1 ) );
+			if ( bits == 1 )
+			{
+				x = vmulq_n_u16( x, 255 );
+			}
+			else
+			{
+				x = vorrq_u16( vshlq_u16( x, vdupq_n_s16( 8 - bits ) ), vshlq_u16( x, vdupq_n_s16( -( 2 * bits - 8 ) ) ) );
+			}
+
+			o.val[ j ] = vmovn_u16( x );
+		}
+
+		vst4_u8( dst + i * 4, o );
+	}
+
+	return i;
+}
+
+static size_t bytes_to_floats_simd( const uint8_t *src, float *dst, size_t count )
+{
+	const float32x4_t scale = vdupq_n_f32( 1.0f / 255.0f );
+
+	size_t i = 0;
+	for ( ; i + 8 <= count; i += 8 )
+	{
+		uint16x8_t v = vmovl_u8( vld1_u8( src + i ) );
+		vst1q_f32( dst + i, vmulq_f32( vcvtq_f32_u32( vmovl_u16( vget_low_u16( v ) ) ), scale ) );
+		vst1q_f32( dst + i + 4, vmulq_f32( vcvtq_f32_u32( vmovl_u16( vget_high_u16( v ) ) ), scale ) );
+	}
+
+	return i;
+}
+
+/**
+ * Negatives saturate to zero on the conversion to unsigned,
+ * and the narrowing saturates anything over.
+ */
+static size_t floats_to_bytes_simd( const float *src, uint8_t *dst, size_t count )
+{
+	const float32x4_t scale = vdupq_n_f32( 255.0f );
+	const float32x4_t half  = vdupq_n_f32( 0.5f );
+
+	size_t i = 0;
+	for ( ; i + 8 <= count; i += 8 )
+	{
+		uint32x4_t a = vcvtq_u32_f32( vmlaq_f32( half, vld1q_f32( src + i ), scale ) );
+		uint32x4_t b = vcvtq_u32_f32( vmlaq_f32( half, vld1q_f32( src + i + 4 ), scale ) );
+		vst1_u8( dst + i, vqmovn_u16( vcombine_u16( vqmovn_u32( a ), vqmovn_u32( b ) ) ) );
+	}
+
+	return i;
+}
+
+#	if defined( __aarch64__ )
+
+static size_t halves_to_floats_simd( const uint8_t *src, float *dst, size_t count )
+{
+	size_t i = 0;
+	for ( ; i + 4 <= count; i += 4 )
+	{
+		vst1q_f32( dst + i, vcvt_f32_f16( vreinterpret_f16_u8( vld1_u8( src + i * 2 ) ) ) );
+	}
+
+	return i;
+}
+
+static size_t floats_to_halves_simd( const float *src, uint8_t *dst, size_t count )
+{
+	size_t i = 0;
+	for ( ; i + 4 <= count; i += 4 )
+	{
+		vst1_u8( dst + i * 2, vreinterpret_u8_f16( vcvt_f16_f32( vld1q_f32( src + i ) ) ) );
+	}
+
+	return i;
+}
+
+#	else
+
+static size_t halves_to_floats_simd( const uint8_t *, float *, size_t ) { return 0; }
+static size_t floats_to_halves_simd( const float *, uint8_t *, size_t ) { return 0; }
+
+#	endif
+
+#else
+
+static size_t rgb8_to_rgba8_simd( const uint8_t *, uint8_t *, size_t, bool ) { return 0; }
+static size_t rgba8_to_rgb8_simd( const uint8_t *, uint8_t *, size_t, bool ) { return 0; }
+static size_t swap_rb_simd( const uint8_t *, uint8_t *, size_t, bool ) { return 0; }
+static size_t rgba8_to_r8_simd( const uint8_t *, uint8_t *, size_t ) { return 0; }
+static size_t unpack_packed16_simd( const PackedLayout *, const uint8_t *, uint8_t *, size_t ) { return 0; }
+static size_t bytes_to_floats_simd( const uint8_t *, float *, size_t ) { return 0; }
+static size_t floats_to_bytes_simd( const float *, uint8_t *, size_t ) { return 0; }
+static size_t halves_to_floats_simd( const uint8_t *, float *, size_t ) { return 0; }
+static size_t floats_to_halves_simd( const float *, uint8_t *, size_t ) { return 0; }
+
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Formats
+/////////////////////////////////////////////////////////////////////////////////////
+
+static void unpack_r8( const uint8_t *src, uint8_t *dst, size_t numPixels )
+{
+	for ( size_t i = 0; i < numPixels; ++i, dst += 4 )
+	{
+		dst[ 0 ] = src[ i ];
+		dst[ 1 ] = 0;
+		dst[ 2 ] = 0;
+		dst[ 3 ] = 255;
+	}
+}
+
+static void pack_r8( const uint8_t *src, uint8_t *dst, size_t numPixels )
+{
+	size_t i = rgba8_to_r8_simd( src, dst, numPixels );
+	for ( ; i < numPixels; ++i )
+	{
+		dst[ i ] = src[ i * 4 ];
+	}
+}
+
+static void rgb8_to_rgba8( const uint8_t *src, uint8_t *dst, size_t numPixels, bool swap )
+{
+	size_t i = rgb8_to_rgba8_simd( src, dst, numPixels, swap );
+	for ( src += i * 3, dst += i * 4; i < numPixels; ++i, src += 3, dst += 4 )
+	{
+		dst[ 0 ] = src[ swap ? 2 : 0 ];
+		dst[ 1 ] = src[ 1 ];
+		dst[ 2 ] = src[ swap ? 0 : 2 ];
+		dst[ 3 ] = 255;
+	}
+}
+
+static void rgba8_to_rgb8( const uint8_t *src, uint8_t *dst, size_t numPixels, bool swap )
+{
+	size_t i = rgba8_to_rgb8_simd( src, dst, numPixels, swap );
+	for ( src += i * 4, dst += i * 3; i < numPixels; ++i, src += 4, dst += 3 )
+	{
+		uint8_t r = src[ swap ? 2 : 0 ];
+		uint8_t g = src[ 1 ];
+		uint8_t b = src[ swap ? 0 : 2 ];
+		dst[ 0 ]  = r;
+		dst[ 1 ]  = g;
+		dst[ 2 ]  = b;
+	}
+}
+
+static void swap_rb( const uint8_t *src, uint8_t *dst, size_t numPixels, bool setAlpha )
+{
+	size_t i = swap_rb_simd( src, dst, numPixels, setAlpha );
+	for ( src += i * 4, dst += i * 4; i < numPixels; ++i, src += 4, dst += 4 )
+	{
+		uint8_t r = src[ 2 ];
+		uint8_t b = src[ 0 ];
+		dst[ 0 ]  = r;
+		dst[ 1 ]  = src[ 1 ];
+		dst[ 2 ]  = b;
+		dst[ 3 ]  = setAlpha ? 255 : src[ 3 ];
+	}
+}
+
+static void unpack_rgb8( const uint8_t *src, uint8_t *dst, size_t numPixels ) { rgb8_to_rgba8( src, dst, numPixels, false ); }
+static void pack_rgb8( const uint8_t *src, uint8_t *dst, size_t numPixels ) { rgba8_to_rgb8( src, dst, numPixels, false ); }
+static void unpack_bgr8( const uint8_t *src, uint8_t *dst, size_t numPixels ) { rgb8_to_rgba8( src, dst, numPixels, true ); }
+static void pack_bgr8( const uint8_t *src, uint8_t *dst, size_t numPixels ) { rgba8_to_rgb8( src, dst, numPixels, true ); }
+static void swap_bgra8( const uint8_t *src, uint8_t *dst, size_t numPixels ) { swap_rb( src, dst, numPixels, false ); }
+static void swap_bgrx8( const uint8_t *src, uint8_t *dst, size_t numPixels ) { swap_rb( src, dst, numPixels, true ); }
+
+static void copy_rgba8( const uint8_t *src, uint8_t *dst, size_t numPixels )
+{
+	if ( src != dst )
+	{
+		memmove( dst, src, numPixels * 4 );
+	}
+}
+
+static void unpack_rgba12( const uint8_t *src, float *dst, size_t numPixels )
+{
+	for ( size_t i = 0; i < numPixels; ++i, src += 6, dst += 4 )
+	{
+		uint64_t v = 0;
+		for ( unsigned int j = 0; j < 6; ++j )
+		{
+			v |= ( uint64_t ) src[ j ] << ( j * 8 );
+		}
+
+		for ( unsigned int j = 0; j < 4; ++j )
+		{
+			dst[ j ] = ( float ) ( ( v >> ( j * 12 ) ) & 0xFFF ) / 4095.0f;
+		}
+	}
+}
+
+static inline unsigned int quantize( float v, unsigned int max )
+{
+	if ( !( v > 0.0f ) )
+	{
+		return 0;
+	}
+
+	return ( v >= 1.0f ) ? max : ( unsigned int ) ( v * ( float ) max + 0.5f );
+}
+
+static void pack_rgba12( float *src, uint8_t *dst, size_t numPixels )
+{
+	for ( size_t i = 0; i < numPixels; ++i, src += 4, dst += 6 )
+	{
+		uint64_t v = 0;
+		for ( unsigned int j = 0; j < 4; ++j )
+		{
+			v |= ( uint64_t ) quantize( src[ j ], 0xFFF ) << ( j * 12 );
+		}
+
+		for ( unsigned int j = 0; j < 6; ++j )
+		{
+			dst[ j ] = ( uint8_t ) ( v >> ( j * 8 ) );
+		}
+	}
+}
+
+static void unpack_rgba16( const uint8_t *src, float *dst, size_t numPixels )
+{
+	for ( size_t i = 0; i < numPixels * 4; ++i, src += 2 )
+	{
+		uint16_t v;
+		memcpy( &v, src, sizeof( v ) );
+		dst[ i ] = ( float ) v / 65535.0f;
+	}
+}
+
+static void pack_rgba16( float *src, uint8_t *dst, size_t numPixels )
+{
+	for ( size_t i = 0; i < numPixels * 4; ++i, dst += 2 )
+	{
+		uint16_t v = ( uint16_t ) quantize( src[ i ], 0xFFFF );
+		memcpy( dst, &v, sizeof( v ) );
+	}
+}
+
+static void halves_to_floats( const uint8_t *src, float *dst, size_t count )
+{
+	size_t i = halves_to_floats_simd( src, dst, count );
+	for ( ; i < count; ++i )
+	{
+		uint16_t h;
+		memcpy( &h, src + i * 2, sizeof( h ) );
+		dst[ i ] = half_to_float( h );
+	}
+}
+
+static void floats_to_halves( const float *src, uint8_t *dst, size_t count )
+{
+	size_t i = floats_to_halves_simd( src, dst, count );
+	for ( ; i < count; ++i )
+	{
+		uint16_t h = float_to_half( src[ i ] );
+		memcpy( dst + i * 2, &h, sizeof( h ) );
+	}
+}
+
+/**
+ * Spreads tightly packed RGB floats out to RGBA, working
+ * backwards so that it can be done in place.
+ */
+static void spread_rgb_floats( float *data, size_t numPixels )
+{
+	for ( size_t i = numPixels; i-- > 0; )
+	{
+		float r             = data[ i * 3 ];
+		float g             = data[ i * 3 + 1 ];
+		float b             = data[ i * 3 + 2 ];
+		data[ i * 4 ]       = r;
+		data[ i * 4 + 1 ]   = g;
+		data[ i * 4 + 2 ]   = b;
+		data[ i * 4 + 3 ]   = 1.0f;
+	}
+}
+
+static void compact_rgba_floats( float *data, size_t numPixels )
+{
+	for ( size_t i = 0; i < numPixels; ++i )
+	{
+		data[ i * 3 ]     = data[ i * 4 ];
+		data[ i * 3 + 1 ] = data[ i * 4 + 1 ];
+		data[ i * 3 + 2 ] = data[ i * 4 + 2 ];
+	}
+}
+
+static void unpack_rgb16f( const uint8_t *src, float *dst, size_t numPixels )
+{
+	halves_to_floats( src, dst, numPixels * 3 );
+	spread_rgb_floats( dst, numPixels );
+}
+
+static void pack_rgb16f( float *src, uint8_t *dst, size_t numPixels )
+{
+	compact_rgba_floats( src, numPixels );
+	floats_to_halves( src, dst, numPixels * 3 );
+}
+
+static void unpack_rgba16f( const uint8_t *src, float *dst, size_t numPixels ) { halves_to_floats( src, dst, numPixels * 4 ); }
+static void pack_rgba16f( float *src, uint8_t *dst, size_t numPixels ) { floats_to_halves( src, dst, numPixels * 4 ); }
+
+static void unpack_rgb32f( const uint8_t *src, float *dst, size_t numPixels )
+{
+	memcpy( dst, src, numPixels * 3 * sizeof( float ) );
+	spread_rgb_floats( dst, numPixels );
+}
+
+static void pack_rgb32f( float *src, uint8_t *dst, size_t numPixels )
+{
+	compact_rgba_floats( src, numPixels );
+	memmove( dst, src, numPixels * 3 * sizeof( float ) );
+}
+
+static void unpack_rgba32f( const uint8_t *src, float *dst, size_t numPixels ) { memcpy( dst, src, numPixels * 4 * sizeof( float ) ); }
+static void pack_rgba32f( float *src, uint8_t *dst, size_t numPixels ) { memmove( dst, src, numPixels * 4 * sizeof( float ) ); }
+
+static void bytes_to_floats( const uint8_t *src, float *dst, size_t count )
+{
+	size_t i = bytes_to_floats_simd( src, dst, count );
+	for ( ; i < count; ++i )
+	{
+		dst[ i ] = ( float ) src[ i ] * ( 1.0f / 255.0f );
+	}
+}
+
+static void floats_to_bytes( const float *src, uint8_t *dst, size_t count )
+{
+	size_t i = floats_to_bytes_simd( src, dst, count );
+	for ( ; i < count; ++i )
+	{
+		dst[ i ] = ( uint8_t ) quantize( src[ i ], 255 );
+	}
+}
+
+typedef struct PixelFormat
+{
+	const PackedLayout *packed;
+
+	/* to and from RGBA8 */
+	void ( *Unpack )( const uint8_t *src, uint8_t *dst, size_t numPixels );
+	void ( *Pack )( const uint8_t *src, uint8_t *dst, size_t numPixels );
+
+	/* to and from RGBA32F; the source may be trashed on pack */
+	void ( *UnpackFloat )( const uint8_t *src, float *dst, size_t numPixels );
+	void ( *PackFloat )( float *src, uint8_t *dst, size_t numPixels );
+} PixelFormat;
+
+static const PixelFormat pixelFormats[] = {
+        [PL_IMAGEFORMAT_R8]      = {.Unpack = unpack_r8, .Pack = pack_r8},
+        [PL_IMAGEFORMAT_RGB4]    = {.packed = &LAYOUT_RGB4},
+        [PL_IMAGEFORMAT_RGBA4]   = {.packed = &LAYOUT_RGBA4},
+        [PL_IMAGEFORMAT_RGB5]    = {.packed = &LAYOUT_RGB5},
+        [PL_IMAGEFORMAT_RGB5A1]  = {.packed = &LAYOUT_RGB5A1},
+        [PL_IMAGEFORMAT_RGB565]  = {.packed = &LAYOUT_RGB565},
+        [PL_IMAGEFORMAT_RGB8]    = {.Unpack = unpack_rgb8, .Pack = pack_rgb8},
+        [PL_IMAGEFORMAT_BGR8]    = {.Unpack = unpack_bgr8, .Pack = pack_bgr8},
+        [PL_IMAGEFORMAT_RGBA8]   = {.Unpack = copy_rgba8, .Pack = copy_rgba8},
+        [PL_IMAGEFORMAT_BGRA8]   = {.Unpack = swap_bgra8, .Pack = swap_bgra8},
+        [PL_IMAGEFORMAT_BGRX8]   = {.Unpack = swap_bgrx8, .Pack = swap_bgrx8},
+        [PL_IMAGEFORMAT_RGBA12]  = {.UnpackFloat = unpack_rgba12, .PackFloat = pack_rgba12},
+        [PL_IMAGEFORMAT_RGBA16]  = {.UnpackFloat = unpack_rgba16, .PackFloat = pack_rgba16},
+        [PL_IMAGEFORMAT_RGB16F]  = {.UnpackFloat = unpack_rgb16f, .PackFloat = pack_rgb16f},
+        [PL_IMAGEFORMAT_RGBA16F] = {.UnpackFloat = unpack_rgba16f, .PackFloat = pack_rgba16f},
+        [PL_IMAGEFORMAT_RGB32F]  = {.UnpackFloat = unpack_rgb32f, .PackFloat = pack_rgb32f},
+        [PL_IMAGEFORMAT_RGBA32F] = {.UnpackFloat = unpack_rgba32f, .PackFloat = pack_rgba32f},
+};
+
+static const PixelFormat *get_pixel_format( PLImageFormat format )
+{
+	if ( ( unsigned int ) format >= QM_OS_ARRAY_ELEMENTS( pixelFormats ) )
+	{
+		return nullptr;
+	}
+
+	const PixelFormat *pixelFormat = &pixelFormats[ format ];
+	if ( pixelFormat->packed == nullptr && pixelFormat->Unpack == nullptr && pixelFormat->UnpackFloat == nullptr )
+	{
+		return nullptr;
+	}
+
+	return pixelFormat;
+}
+
+static void unpack( const PixelFormat *format, const uint8_t *src, uint8_t *dst, size_t numPixels )
+{
+	if ( format->packed != nullptr )
+	{
+		size_t i = unpack_packed16_simd( format->packed, src, dst, numPixels );
+		unpack_packed16( format->packed, src + i * 2, dst + i * 4, numPixels - i );
+		return;
+	}
+
+	format->Unpack( src, dst, numPixels );
+}
+
+static void pack( const PixelFormat *format, const uint8_t *src, uint8_t *dst, size_t numPixels )
+{
+	if ( format->packed != nullptr )
+	{
+		pack_packed16( format->packed, src, dst, numPixels );
+		return;
+	}
+
+	format->Pack( src, dst, numPixels );
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Converts a run of pixels from one format to another. The destination
+ * may be the same as the source, provided the destination format isn't
+ * any larger per pixel.
+ */
+bool qm_image_convert_pixels( const void *src, PLImageFormat srcFormat, void *dst, PLImageFormat dstFormat, size_t numPixels )
+{
+	const PixelFormat *from = get_pixel_format( srcFormat );
+	const PixelFormat *to   = get_pixel_format( dstFormat );
+	if ( from == nullptr || to == nullptr )
+	{
+		PlReportErrorF( PL_RESULT_IMAGEFORMAT, "unsupported image format conversion" );
+		return false;
+	}
+
+	const uint8_t *s = src;
+	uint8_t       *d = dst;
+
+	if ( srcFormat == dstFormat )
+	{
+		if ( s != d )
+		{
+			memmove( d, s, numPixels * PlGetImageFormatPixelSize( srcFormat ) );
+		}
+		return true;
+	}
+
+	size_t srcPixelSize = PlGetImageFormatPixelSize( srcFormat );
+	size_t dstPixelSize = PlGetImageFormatPixelSize( dstFormat );
+
+	bool precise = ( from->UnpackFloat != nullptr || to->PackFloat != nullptr );
+	if ( !precise )
+	{
+		if ( dstFormat == PL_IMAGEFORMAT_RGBA8 )
+		{
+			unpack( from, s, d, numPixels );
+			return true;
+		}
+		else if ( srcFormat == PL_IMAGEFORMAT_RGBA8 )
+		{
+			pack( to, s, d, numPixels );
+			return true;
+		}
+
+		uint8_t scratch[ CHUNK_PIXELS * 4 ];
+		for ( size_t i = 0; i < numPixels; i += CHUNK_PIXELS )
+		{
+			size_t n = QM_OS_MIN( ( size_t ) CHUNK_PIXELS, numPixels - i );
+			unpack( from, s + i * srcPixelSize, scratch, n );
+			pack( to, scratch, d + i * dstPixelSize, n );
+		}
+
+		return true;
+	}
+
+	float   scratch[ CHUNK_PIXELS * 4 ];
+	uint8_t scratch8[ CHUNK_PIXELS * 4 ];
+	for ( size_t i = 0; i < numPixels; i += CHUNK_PIXELS )
+	{
+		size_t         n  = QM_OS_MIN( ( size_t ) CHUNK_PIXELS, numPixels - i );
+		const uint8_t *sp = s + i * srcPixelSize;
+		uint8_t       *dp = d + i * dstPixelSize;
+
+		if ( from->UnpackFloat != nullptr )
+		{
+			from->UnpackFloat( sp, scratch, n );
+		}
+		else if ( srcFormat == PL_IMAGEFORMAT_RGBA8 )
+		{
+			bytes_to_floats( sp, scratch, n * 4 );
+		}
+		else
+		{
+			unpack( from, sp, scratch8, n );
+			bytes_to_floats( scratch8, scratch, n * 4 );
+		}
+
+		if ( to->PackFloat != nullptr )
+		{
+			to->PackFloat( scratch, dp, n );
+		}
+		else if ( dstFormat == PL_IMAGEFORMAT_RGBA8 )
+		{
+			floats_to_bytes( scratch, dp, n * 4 );
+		}
+		else
+		{
+			floats_to_bytes( scratch, scratch8, n * 4 );
+			pack( to, scratch8, dp, n );
+		}
+	}
+
+	return true;
+}
+
+static void get_level_size( const QmImage *image, unsigned int level, unsigned int *width, unsigned int *height )
+{
+	*width  = QM_OS_MAX( image->width >> level, 1U );
+	*height = QM_OS_MAX( image->height >> level, 1U );
+}
+
+/**
+ * Converts the given level of an image into the buffer provided,
+ * leaving the image itself untouched.
+ */
+bool qm_image_convert_to_buffer( const QmImage *image, unsigned int frame, unsigned int level, PLImageFormat newFormat, void *dst, size_t dstSize )
+{
+	const uint8_t *src;
+	if ( image->numFrames > 0 )
+	{
+		if ( frame >= image->numFrames || level >= image->frames[ frame ].numMips )
+		{
+			PlReportErrorF( PL_RESULT_MEMORY_EOA, "invalid frame or level" );
+			return false;
+		}
+
+		src = image->frames[ frame ].data[ level ];
+	}
+	else
+	{
+		if ( level >= image->levels )
+		{
+			PlReportErrorF( PL_RESULT_MEMORY_EOA, "invalid level" );
+			return false;
+		}
+
+		src = image->data[ level ];
+	}
+
+	unsigned int width, height;
+	get_level_size( image, level, &width, &height );
+
+	size_t size = PlGetImageSize( newFormat, width, height );
+	if ( size == 0 || dstSize < size )
+	{
+		PlReportErrorF( PL_RESULT_MEMORY_EOA, "destination is too small for the converted image (%zu < %zu)", dstSize, size );
+		return false;
+	}
+
+	return qm_image_convert_pixels( src, image->format, dst, newFormat, ( size_t ) width * height );
+}
+
+static PLColourFormat get_colour_format( PLImageFormat format )
+{
+	switch ( format )
+	{
+		case PL_IMAGEFORMAT_BGR8:
+			return PL_COLOURFORMAT_BGR;
+		case PL_IMAGEFORMAT_BGRA8:
+		case PL_IMAGEFORMAT_BGRX8:
+			return PL_COLOURFORMAT_BGRA;
+		default:
+			return ( PlGetNumImageFormatChannels( format ) == 4 ) ? PL_COLOURFORMAT_RGBA : PL_COLOURFORMAT_RGB;
+	}
+}
+
+typedef struct ConvertLevel
+{
+	uint8_t **data;
+	size_t    numPixels;
+	uint8_t  *newData;
+} ConvertLevel;
+
+/**
+ * Converts every level, and frame, of the image to the new format. Where
+ * the new format is no larger, each level is converted in place; otherwise
+ * new buffers are allocated up front, so a failure leaves it as it was.
+ */
+bool PlConvertPixelFormat( QmImage *image, PLImageFormat new_format )
+{
+	if ( image->format == new_format )
+	{
+		return true;
+	}
+
+	// block compressed sources are decompressed first, then converted as usual
+	if ( get_pixel_format( image->format ) == nullptr && get_pixel_format( new_format ) != nullptr && qm_image_decompress_levels_( image, 0 ) )
+	{
+		if ( image->format == new_format )
+		{
+			return true;
+		}
+	}
+
+	if ( get_pixel_format( image->format ) == nullptr || get_pixel_format( new_format ) == nullptr )
+	{
+		PlReportErrorF( PL_RESULT_IMAGEFORMAT, "unsupported image format conversion" );
+		return false;
+	}
+
+	size_t srcPixelSize = PlGetImageFormatPixelSize( image->format );
+	size_t dstPixelSize = PlGetImageFormatPixelSize( new_format );
+
+	unsigned int numLevels = ( image->data != nullptr ) ? image->levels : 0;
+	for ( unsigned int i = 0; i < image->numFrames; ++i )
+	{
+		numLevels += image->frames[ i ].numMips;
+	}
+
+	ConvertLevel *levels    = QM_OS_MEMORY_NEW_( ConvertLevel, numLevels + 1 );
+	unsigned int  numActive = 0;
+	for ( unsigned int i = 0; image->data != nullptr && i < image->levels; ++i )
+	{
+		unsigned int width, height;
+		get_level_size( image, i, &width, &height );
+		levels[ numActive++ ] = ( ConvertLevel ){ .data = &image->data[ i ], .numPixels = ( size_t ) width * height };
+	}
+	for ( unsigned int i = 0; i < image->numFrames; ++i )
+	{
+		for ( unsigned int j = 0; j < image->frames[ i ].numMips; ++j )
+		{
+			unsigned int width, height;
+			get_level_size( image, j, &width, &height );
+			levels[ numActive++ ] = ( ConvertLevel ){ .data = ( uint8_t ** ) &image->frames[ i ].data[ j ], .numPixels = ( size_t ) width * height };
+		}
+	}
+
+	if ( dstPixelSize > srcPixelSize )
+	{
+		for ( unsigned int i = 0; i < numActive; ++i )
+		{
+			levels[ i ].newData = QM_OS_MEMORY_MALLOC_( levels[ i ].numPixels * dstPixelSize );
+			if ( levels[ i ].newData != nullptr )
+			{
+				continue;
+			}
+
+			for ( unsigned int j = 0; j < i; ++j )
+			{
+				qm_os_memory_free( levels[ j ].newData );
+			}
+			qm_os_memory_free( levels );
+
+			PlReportErrorF( PL_RESULT_MEMORY_ALLOCATION, "couldn't allocate memory for image data" );
+			return false;
+		}
+	}
+
+	for ( unsigned int i = 0; i < numActive; ++i )
+	{
+		ConvertLevel *level = &levels[ i ];
+		if ( *level->data == nullptr )
+		{
+			qm_os_memory_free( level->newData );
+			continue;
+		}
+
+		if ( level->newData != nullptr )
+		{
+			qm_image_convert_pixels( *level->data, image->format, level->newData, new_format, level->numPixels );
+			qm_os_memory_free( *level->data );
+			*level->data = level->newData;
+			continue;
+		}
+
+		qm_image_convert_pixels( *level->data, image->format, *level->data, new_format, level->numPixels );
+		if ( dstPixelSize < srcPixelSize )
+		{
+			uint8_t *data = qm_os_memory_realloc( *level->data, level->numPixels * dstPixelSize );
+			if ( data != nullptr )
+			{
+				*level->data = data;
+			}
+		}
+	}
+
+	qm_os_memory_free( levels );
+
+	image->format        = new_format;
+	image->colour_format = get_colour_format( new_format );
+	image->size          = PlGetImageSize( new_format, image->width, image->height );
+
+	return true;
+}
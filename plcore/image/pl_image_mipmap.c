@@ -0,0 +1,784 @@
+// SPDX-License-Identifier: MIT
+// Hei Platform Library
+// Copyright © 2017-2026 Quartermind Games, Mark E. Sowden <markelswo@gmail.com>
+// Purpose: Mipmap chain generation.
+
+#include "image_private.h"
+
+#include "qmos/public/qm_os_memory.h"
+#include "qmos/public/qm_os_thread.h"
+
+#include <math.h>
+#include <stdatomic.h>
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || defined( _M_AMD64 )
+#	include <emmintrin.h>
+#	define IMAGE_MIPMAP_SSE2
+#elif defined( __ARM_NEON ) || defined( _M_ARM64 )
+#	include <arm_neon.h>
+#	define IMAGE_MIPMAP_NEON
+#endif
+
+/**
+ * Each level is filtered down from the one before it, which is kept
+ * around as linear RGBA32F so nothing is lost to quantization along the
+ * way. The base level is only ever read a row at a time, converted as
+ * it's needed, so there's never a float copy of the whole thing.
+ *
+ * Filtering is separable; a row of output first sums its source rows
+ * together, four channels to a vector, and then that's reduced down
+ * across. The weights for each axis are worked out once per level, by
+ * averaging the kernel over the footprint of each source pixel, which
+ * also takes care of odd sizes. Edges are clamped.
+ *
+ * Rows are shared out between the shared workers along with the
+ * calling thread, a level at a time.
+ */
+
+#define MIN_PIXELS_PER_JOB 16384
+#define FILTER_SAMPLES     8
+
+#define KAISER_WIDTH 3.0f
+#define KAISER_ALPHA 4.0f
+
+#define LANCZOS_WIDTH 3.0f
+
+#define SRGB_TABLE_SIZE 4096
+#define COVERAGE_BINS   4096
+
+typedef struct MipFilter
+{
+	float support;// in destination pixels, either side
+	float ( *Evaluate )( float x );
+} MipFilter;
+
+static float evaluate_box( float x )
+{
+	return ( fabsf( x ) <= 0.5f ) ? 1.0f : 0.0f;
+}
+
+static float sinc( float x )
+{
+	if ( fabsf( x ) < 1e-6f )
+	{
+		return 1.0f;
+	}
+
+	x *= QM_MATH_PI;
+	return sinf( x ) / x;
+}
+
+static float bessel_i0( float x )
+{
+	float sum = 1.0f, term = 1.0f;
+	for ( unsigned int i = 1; i < 32 && term > sum * 1e-8f; ++i )
+	{
+		float t = x / ( 2.0f * ( float ) i );
+		term *= t * t;
+		sum += term;
+	}
+
+	return sum;
+}
+
+static float evaluate_kaiser( float x )
+{
+	float t = x / KAISER_WIDTH;
+	if ( t * t >= 1.0f )
+	{
+		return 0.0f;
+	}
+
+	return sinc( x ) * bessel_i0( KAISER_ALPHA * sqrtf( 1.0f - t * t ) ) / bessel_i0( KAISER_ALPHA );
+}
+
+static float evaluate_lanczos( float x )
+{
+	if ( fabsf( x ) >= LANCZOS_WIDTH )
+	{
+		return 0.0f;
+	}
+
+	return sinc( x ) * sinc( x / LANCZOS_WIDTH );
+}
+
+static const MipFilter mipFilters[] = {
+        [QM_IMAGE_MIPMAP_FILTER_BOX]     = {0.5f,          evaluate_box    },
+        [QM_IMAGE_MIPMAP_FILTER_KAISER]  = { KAISER_WIDTH,  evaluate_kaiser },
+        [QM_IMAGE_MIPMAP_FILTER_LANCZOS] = { LANCZOS_WIDTH, evaluate_lanczos},
+};
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Weights
+/////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct FilterTaps
+{
+	unsigned int *first;
+	unsigned int *count;
+	float        *weights;// maxTaps to each destination pixel
+	unsigned int  maxTaps;
+} FilterTaps;
+
+static void free_taps( FilterTaps *taps )
+{
+	qm_os_memory_free( taps->first );
+	qm_os_memory_free( taps->count );
+	qm_os_memory_free( taps->weights );
+	*taps = ( FilterTaps ){};
+}
+
+static bool build_taps( FilterTaps *taps, const MipFilter *filter, unsigned int srcSize, unsigned int dstSize )
+{
+	float scale   = ( float ) srcSize / ( float ) dstSize;
+	float support = filter->support * scale;
+
+	taps->maxTaps = ( unsigned int ) ceilf( support * 2.0f ) + 2;
+	taps->first   = QM_OS_MEMORY_NEW_( unsigned int, dstSize );
+	taps->count   = QM_OS_MEMORY_NEW_( unsigned int, dstSize );
+	taps->weights = QM_OS_MEMORY_NEW_( float, ( size_t ) dstSize * taps->maxTaps );
+	if ( taps->first == nullptr || taps->count == nullptr || taps->weights == nullptr )
+	{
+		free_taps( taps );
+		PlReportErrorF( PL_RESULT_MEMORY_ALLOCATION, "couldn't allocate memory for filter weights" );
+		return false;
+	}
+
+	for ( unsigned int i = 0; i < dstSize; ++i )
+	{
+		float *weights = &taps->weights[ ( size_t ) i * taps->maxTaps ];
+
+		// nothing to filter if this axis is already as small as it gets
+		if ( srcSize == dstSize )
+		{
+			taps->first[ i ] = i;
+			taps->count[ i ] = 1;
+			weights[ 0 ]     = 1.0f;
+			continue;
+		}
+
+		float center = ( ( float ) i + 0.5f ) * scale;
+		int   left   = ( int ) floorf( center - support );
+		int   right  = ( int ) ceilf( center + support ) - 1;
+		int   low    = QM_OS_MAX( left, 0 );
+		int   high   = QM_OS_MIN( right, ( int ) srcSize - 1 );
+
+		taps->first[ i ] = ( unsigned int ) low;
+		taps->count[ i ] = ( unsigned int ) ( high - low + 1 );
+
+		float total = 0.0f;
+		for ( int j = left; j <= right; ++j )
+		{
+			float weight = 0.0f;
+			for ( unsigned int s = 0; s < FILTER_SAMPLES; ++s )
+			{
+				float x = ( float ) j + ( ( float ) s + 0.5f ) / FILTER_SAMPLES;
+				weight += filter->Evaluate( ( x - center ) / scale );
+			}
+			weight /= FILTER_SAMPLES;
+
+			weights[ QM_OS_MIN( QM_OS_MAX( j, low ), high ) - low ] += weight;
+			total += weight;
+		}
+
+		if ( total != 0.0f )
+		{
+			for ( unsigned int k = 0; k < taps->count[ i ]; ++k )
+			{
+				weights[ k ] /= total;
+			}
+		}
+	}
+
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Kernels
+/////////////////////////////////////////////////////////////////////////////////////
+
+static inline void madd_row( float *dst, const float *src, float weight, size_t count )
+{
+	size_t i = 0;
+#if defined( IMAGE_MIPMAP_SSE2 )
+	__m128 w = _mm_set1_ps( weight );
+	for ( ; i + 8 <= count; i += 8 )
+	{
+		_mm_storeu_ps( dst + i, _mm_add_ps( _mm_loadu_ps( dst + i ), _mm_mul_ps( _mm_loadu_ps( src + i ), w ) ) );
+		_mm_storeu_ps( dst + i + 4, _mm_add_ps( _mm_loadu_ps( dst + i + 4 ), _mm_mul_ps( _mm_loadu_ps( src + i + 4 ), w ) ) );
+	}
+#elif defined( IMAGE_MIPMAP_NEON )
+	for ( ; i + 8 <= count; i += 8 )
+	{
+		vst1q_f32( dst + i, vmlaq_n_f32( vld1q_f32( dst + i ), vld1q_f32( src + i ), weight ) );
+		vst1q_f32( dst + i + 4, vmlaq_n_f32( vld1q_f32( dst + i + 4 ), vld1q_f32( src + i + 4 ), weight ) );
+	}
+#endif
+	for ( ; i < count; ++i )
+	{
+		dst[ i ] += src[ i ] * weight;
+	}
+}
+
+static inline void filter_pixel( float *dst, const float *src, const float *weights, unsigned int count )
+{
+#if defined( IMAGE_MIPMAP_SSE2 )
+	__m128 sum = _mm_setzero_ps();
+	for ( unsigned int k = 0; k < count; ++k )
+	{
+		sum = _mm_add_ps( sum, _mm_mul_ps( _mm_loadu_ps( src + k * 4 ), _mm_set1_ps( weights[ k ] ) ) );
+	}
+	_mm_storeu_ps( dst, sum );
+#elif defined( IMAGE_MIPMAP_NEON )
+	float32x4_t sum = vdupq_n_f32( 0.0f );
+	for ( unsigned int k = 0; k < count; ++k )
+	{
+		sum = vmlaq_n_f32( sum, vld1q_f32( src + k * 4 ), weights[ k ] );
+	}
+	vst1q_f32( dst, sum );
+#else
+	float sum[ 4 ] = {};
+	for ( unsigned int k = 0; k < count; ++k )
+	{
+		for ( unsigned int c = 0; c < 4; ++c )
+		{
+			sum[ c ] += src[ k * 4 + c ] * weights[ k ];
+		}
+	}
+	memcpy( dst, sum, sizeof( sum ) );
+#endif
+}
+
+/**
+ * Piecewise linear lookup into one of the sRGB tables,
+ * which covers 0 to 1 and clamps anything outside.
+ */
+static inline float lookup_srgb( const float *table, float v )
+{
+	v = QM_OS_MIN( QM_OS_MAX( v, 0.0f ), 1.0f ) * SRGB_TABLE_SIZE;
+
+	unsigned int i = ( unsigned int ) v;
+	if ( i >= SRGB_TABLE_SIZE )
+	{
+		return table[ SRGB_TABLE_SIZE ];
+	}
+
+	return table[ i ] + ( table[ i + 1 ] - table[ i ] ) * ( v - ( float ) i );
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Passes
+/////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct MipContext MipContext;
+
+typedef struct MipScratch
+{
+	float *row;      // a row of the source level, summed down the vertical taps
+	float *cache;    // rows of the base level, converted to linear
+	int   *cacheRows;// which row is in each slot of the above
+} MipScratch;
+
+typedef struct MipWorker
+{
+	MipContext *context;
+	MipScratch  scratch;
+} MipWorker;
+
+struct MipContext
+{
+	PLImageFormat format;
+	unsigned int  pixelSize;
+	bool          srgb;
+	float         alphaScale;
+
+	float toLinear[ SRGB_TABLE_SIZE + 1 ];
+	float fromLinear[ SRGB_TABLE_SIZE + 1 ];
+
+	// source, either the base level in its own format, or the last level produced
+	const uint8_t *base;
+	const float   *src;
+	unsigned int   srcWidth, srcHeight;
+
+	float       *dst;
+	uint8_t     *out;
+	unsigned int dstWidth, dstHeight;
+
+	FilterTaps horizontal, vertical;
+	unsigned int cacheSize;
+
+	void ( *RunRow )( MipContext *context, MipScratch *scratch, unsigned int row );
+	unsigned int numRows, rowsPerJob, numJobs;
+	atomic_uint  nextJob;
+	atomic_uint  nextWorker;// scratch handed to the next worker to start
+
+	MipWorker   *workers;
+	unsigned int numWorkers;
+};
+
+static void load_base_row( const MipContext *context, unsigned int row, float *dst )
+{
+	const uint8_t *src = context->base + ( size_t ) row * context->srcWidth * context->pixelSize;
+	qm_image_convert_pixels( src, context->format, dst, PL_IMAGEFORMAT_RGBA32F, context->srcWidth );
+
+	if ( context->srgb )
+	{
+		for ( unsigned int x = 0; x < context->srcWidth; ++x, dst += 4 )
+		{
+			dst[ 0 ] = lookup_srgb( context->toLinear, dst[ 0 ] );
+			dst[ 1 ] = lookup_srgb( context->toLinear, dst[ 1 ] );
+			dst[ 2 ] = lookup_srgb( context->toLinear, dst[ 2 ] );
+		}
+	}
+}
+
+static const float *get_source_row( const MipContext *context, MipScratch *scratch, unsigned int row )
+{
+	if ( context->base == nullptr )
+	{
+		return context->src + ( size_t ) row * context->srcWidth * 4;
+	}
+
+	// no two taps of the same output row can share a slot, and neighbouring output rows overlap
+	unsigned int slot  = row % context->cacheSize;
+	float       *cache = scratch->cache + ( size_t ) slot * context->srcWidth * 4;
+	if ( scratch->cacheRows[ slot ] != ( int ) row )
+	{
+		load_base_row( context, row, cache );
+		scratch->cacheRows[ slot ] = ( int ) row;
+	}
+
+	return cache;
+}
+
+static void filter_row( MipContext *context, MipScratch *scratch, unsigned int row )
+{
+	size_t       rowSize = ( size_t ) context->srcWidth * 4;
+	unsigned int first   = context->vertical.first[ row ];
+	unsigned int count   = context->vertical.count[ row ];
+	const float *weights = &context->vertical.weights[ ( size_t ) row * context->vertical.maxTaps ];
+
+	memset( scratch->row, 0, rowSize * sizeof( float ) );
+	for ( unsigned int k = 0; k < count; ++k )
+	{
+		madd_row( scratch->row, get_source_row( context, scratch, first + k ), weights[ k ], rowSize );
+	}
+
+	const FilterTaps *taps = &context->horizontal;
+
+	float *dst = context->dst + ( size_t ) row * context->dstWidth * 4;
+	for ( unsigned int x = 0; x < context->dstWidth; ++x, dst += 4 )
+	{
+		filter_pixel( dst, scratch->row + ( size_t ) taps->first[ x ] * 4, &taps->weights[ ( size_t ) x * taps->maxTaps ], taps->count[ x ] );
+	}
+}
+
+static void store_row( MipContext *context, MipScratch *scratch, unsigned int row )
+{
+	const float *src = context->dst + ( size_t ) row * context->dstWidth * 4;
+	float       *dst = scratch->row;
+	for ( unsigned int x = 0; x < context->dstWidth; ++x, src += 4, dst += 4 )
+	{
+		for ( unsigned int c = 0; c < 3; ++c )
+		{
+			dst[ c ] = context->srgb ? lookup_srgb( context->fromLinear, src[ c ] ) : QM_OS_MAX( src[ c ], 0.0f );
+		}
+
+		dst[ 3 ] = QM_OS_MAX( src[ 3 ], 0.0f );
+		if ( context->alphaScale != 1.0f )
+		{
+			dst[ 3 ] = QM_OS_MIN( dst[ 3 ] * context->alphaScale, 1.0f );
+		}
+	}
+
+	uint8_t *out = context->out + ( size_t ) row * context->dstWidth * context->pixelSize;
+	qm_image_convert_pixels( scratch->row, PL_IMAGEFORMAT_RGBA32F, out, context->format, context->dstWidth );
+}
+
+static void mip_worker( void *userData )
+{
+	MipWorker  *worker  = userData;
+	MipContext *context = worker->context;
+
+	unsigned int i;
+	while ( ( i = atomic_fetch_add( &context->nextJob, 1 ) ) < context->numJobs )
+	{
+		unsigned int firstRow = i * context->rowsPerJob;
+		unsigned int lastRow  = QM_OS_MIN( firstRow + context->rowsPerJob, context->numRows );
+		for ( unsigned int row = firstRow; row < lastRow; ++row )
+		{
+			context->RunRow( context, &worker->scratch, row );
+		}
+	}
+}
+
+static void mip_worker_job( void *userData )
+{
+	MipContext *context = userData;
+	mip_worker( &context->workers[ atomic_fetch_add( &context->nextWorker, 1 ) ] );
+}
+
+/**
+ * Runs the given function over every row of the destination
+ * level, spreading the rows out between the workers.
+ */
+static void run_rows( MipContext *context, void ( *RunRow )( MipContext *, MipScratch *, unsigned int ) )
+{
+	context->RunRow     = RunRow;
+	context->numRows    = context->dstHeight;
+	context->rowsPerJob = QM_OS_MAX( MIN_PIXELS_PER_JOB / context->dstWidth, 1U );
+	context->numJobs    = ( context->numRows + context->rowsPerJob - 1 ) / context->rowsPerJob;
+	atomic_init( &context->nextJob, 0 );
+	atomic_init( &context->nextWorker, 1 );
+
+	unsigned int   numWorkers = QM_OS_MIN( context->numWorkers, context->numJobs );
+	QmWorkerGroup *group      = qm_worker_group_start_( mip_worker_job, context, numWorkers - 1 );
+
+	mip_worker( &context->workers[ 0 ] );
+
+	qm_worker_group_wait_( group );
+}
+
+/**
+ * Finds how much the alpha of the level needs scaling by, so the same
+ * share of it passes the cutoff as did on the base level. Where there's
+ * a range that'd do, whatever's nearest to leaving it alone is used.
+ */
+static float get_coverage_scale( const MipContext *context, float alphaCutoff, float coverage )
+{
+	unsigned int *bins = QM_OS_MEMORY_NEW_( unsigned int, COVERAGE_BINS );
+	if ( bins == nullptr )
+	{
+		return 1.0f;
+	}
+
+	size_t numPixels = ( size_t ) context->dstWidth * context->dstHeight;
+	for ( size_t i = 0; i < numPixels; ++i )
+	{
+		float alpha = QM_OS_MIN( QM_OS_MAX( context->dst[ i * 4 + 3 ], 0.0f ), 1.0f );
+		bins[ QM_OS_MIN( ( unsigned int ) ( alpha * COVERAGE_BINS ), COVERAGE_BINS - 1U ) ]++;
+	}
+
+	// the pixel which needs to pass, and the one after it which mustn't
+	size_t target = ( size_t ) lrintf( coverage * ( float ) numPixels );
+	float  passLow = 1.0f, failHigh = 0.0f;
+
+	size_t total = 0;
+	int    bin   = COVERAGE_BINS - 1;
+	for ( ; bin >= 0 && total + bins[ bin ] < target; --bin )
+	{
+		total += bins[ bin ];
+	}
+	if ( target > 0 && bin >= 0 )
+	{
+		passLow = ( float ) bin / COVERAGE_BINS;
+		total += bins[ bin ];
+	}
+	if ( total > target || target == 0 )
+	{
+		failHigh = ( float ) ( bin + 1 ) / COVERAGE_BINS;
+	}
+	else
+	{
+		while ( --bin >= 0 && bins[ bin ] == 0 ) {}
+		failHigh = ( bin >= 0 ) ? ( float ) ( bin + 1 ) / COVERAGE_BINS : 0.0f;
+	}
+
+	qm_os_memory_free( bins );
+
+	float scale = 1.0f;
+	if ( target > 0 && passLow > 0.0f )
+	{
+		scale = QM_OS_MAX( scale, alphaCutoff / passLow );
+	}
+	if ( target < numPixels && failHigh > 0.0f )
+	{
+		scale = QM_OS_MIN( scale, alphaCutoff / failHigh );
+	}
+
+	return scale;
+}
+
+static float get_base_coverage( MipContext *context, float alphaCutoff )
+{
+	float *row = context->workers[ 0 ].scratch.row;
+
+	size_t numPassed = 0;
+	for ( unsigned int y = 0; y < context->srcHeight; ++y )
+	{
+		load_base_row( context, y, row );
+		for ( unsigned int x = 0; x < context->srcWidth; ++x )
+		{
+			numPassed += ( row[ x * 4 + 3 ] >= alphaCutoff );
+		}
+	}
+
+	return ( float ) numPassed / ( ( float ) context->srcWidth * ( float ) context->srcHeight );
+}
+
+/**
+ * Produces levels 1 onwards from the base level, given in data[ 0 ].
+ */
+static bool generate_chain( MipContext *context, const MipFilter *filter, uint8_t **data, unsigned int width, unsigned int height, unsigned int numLevels, float alphaCutoff )
+{
+	context->base      = data[ 0 ];
+	context->src       = nullptr;
+	context->srcWidth  = width;
+	context->srcHeight = height;
+
+	float coverage = ( alphaCutoff > 0.0f ) ? get_base_coverage( context, alphaCutoff ) : 0.0f;
+
+	float *src = nullptr;
+	for ( unsigned int level = 1; level < numLevels; ++level )
+	{
+		context->dstWidth  = QM_OS_MAX( width >> level, 1U );
+		context->dstHeight = QM_OS_MAX( height >> level, 1U );
+		context->dst       = QM_OS_MEMORY_NEW_( float, ( size_t ) context->dstWidth * context->dstHeight * 4 );
+		data[ level ]      = QM_OS_MEMORY_MALLOC_( PlGetImageSize( context->format, context->dstWidth, context->dstHeight ) );
+		if ( context->dst == nullptr || data[ level ] == nullptr ||
+		     !build_taps( &context->horizontal, filter, context->srcWidth, context->dstWidth ) ||
+		     !build_taps( &context->vertical, filter, context->srcHeight, context->dstHeight ) )
+		{
+			free_taps( &context->horizontal );
+			free_taps( &context->vertical );
+			qm_os_memory_free( context->dst );
+			qm_os_memory_free( src );
+
+			/* cleared, so the caller doesn't go freeing it again */
+			qm_os_memory_free( data[ level ] );
+			data[ level ] = nullptr;
+
+			PlReportErrorF( PL_RESULT_MEMORY_ALLOCATION, "couldn't allocate memory for image data" );
+			return false;
+		}
+
+		run_rows( context, filter_row );
+
+		free_taps( &context->horizontal );
+		free_taps( &context->vertical );
+
+		context->alphaScale = ( alphaCutoff > 0.0f ) ? get_coverage_scale( context, alphaCutoff, coverage ) : 1.0f;
+		context->out        = data[ level ];
+		run_rows( context, store_row );
+
+		qm_os_memory_free( src );
+		src = context->dst;
+
+		context->base      = nullptr;
+		context->src       = src;
+		context->srcWidth  = context->dstWidth;
+		context->srcHeight = context->dstHeight;
+	}
+
+	qm_os_memory_free( src );
+
+	return true;
+}
+
+static void free_workers( MipContext *context )
+{
+	for ( unsigned int i = 0; i < context->numWorkers; ++i )
+	{
+		qm_os_memory_free( context->workers[ i ].scratch.row );
+		qm_os_memory_free( context->workers[ i ].scratch.cache );
+		qm_os_memory_free( context->workers[ i ].scratch.cacheRows );
+	}
+
+	qm_os_memory_free( context->workers );
+}
+
+static bool create_workers( MipContext *context, const MipFilter *filter, unsigned int width, unsigned int height, unsigned int numThreads )
+{
+	if ( numThreads == 0 )
+	{
+		numThreads = qm_os_thread_get_available();
+	}
+
+	// no point in any more workers than there are jobs for the first level
+	unsigned int numJobs = ( unsigned int ) QM_OS_MAX( ( ( size_t ) width * height / 4 ) / MIN_PIXELS_PER_JOB, ( size_t ) 1 );
+	numThreads           = QM_OS_MAX( QM_OS_MIN( numThreads, numJobs ), 1U );
+
+	// the base level is the largest source, and has the widest taps going down
+	unsigned int dstHeight = QM_OS_MAX( height >> 1, 1U );
+	float        support   = filter->support * ( float ) height / ( float ) dstHeight;
+	context->cacheSize     = ( unsigned int ) ceilf( support * 2.0f ) + 2;
+
+	context->numWorkers = numThreads;
+	context->workers    = QM_OS_MEMORY_NEW_( MipWorker, numThreads );
+	if ( context->workers == nullptr )
+	{
+		context->numWorkers = 0;
+		free_workers( context );
+		PlReportErrorF( PL_RESULT_MEMORY_ALLOCATION, "couldn't allocate memory for workers" );
+		return false;
+	}
+
+	size_t rowSize = ( size_t ) width * 4;
+	for ( unsigned int i = 0; i < numThreads; ++i )
+	{
+		MipScratch *scratch = &context->workers[ i ].scratch;
+		scratch->row        = QM_OS_MEMORY_NEW_( float, rowSize );
+		scratch->cache      = QM_OS_MEMORY_NEW_( float, rowSize * context->cacheSize );
+		scratch->cacheRows  = QM_OS_MEMORY_NEW_( int, context->cacheSize );
+		if ( scratch->row == nullptr || scratch->cache == nullptr || scratch->cacheRows == nullptr )
+		{
+			free_workers( context );
+			PlReportErrorF( PL_RESULT_MEMORY_ALLOCATION, "couldn't allocate memory for workers" );
+			return false;
+		}
+
+		context->workers[ i ].context = context;
+	}
+
+	return true;
+}
+
+static void reset_cache( MipContext *context )
+{
+	for ( unsigned int i = 0; i < context->numWorkers; ++i )
+	{
+		for ( unsigned int j = 0; j < context->cacheSize; ++j )
+		{
+			context->workers[ i ].scratch.cacheRows[ j ] = -1;
+		}
+	}
+}
+
+static bool generate_frame( MipContext *context, const MipFilter *filter, uint8_t ***data, unsigned int numMips, unsigned int width, unsigned int height, unsigned int numLevels, float alphaCutoff )
+{
+	uint8_t **levels = QM_OS_MEMORY_NEW_( uint8_t *, numLevels );
+	if ( levels == nullptr )
+	{
+		PlReportErrorF( PL_RESULT_MEMORY_ALLOCATION, "couldn't allocate memory for image data" );
+		return false;
+	}
+
+	levels[ 0 ] = ( *data )[ 0 ];
+
+	reset_cache( context );
+	if ( !generate_chain( context, filter, levels, width, height, numLevels, alphaCutoff ) )
+	{
+		for ( unsigned int i = 1; i < numLevels; ++i )
+		{
+			qm_os_memory_free( levels[ i ] );
+		}
+		qm_os_memory_free( levels );
+		return false;
+	}
+
+	for ( unsigned int i = 1; i < numMips; ++i )
+	{
+		qm_os_memory_free( ( *data )[ i ] );
+	}
+	qm_os_memory_free( *data );
+
+	*data = levels;
+
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Public
+/////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Replaces any existing mips with a full chain, down to 1x1, generated
+ * from the base level of every frame. Block compressed images are
+ * decompressed first and left as RGBA8; they can be compressed again
+ * once the chain is complete.
+ *
+ * With QM_IMAGE_MIPMAP_SRGB, colour is filtered in linear space, leaving
+ * alpha alone. An alphaCutoff above 0 rescales the alpha of each level
+ * so the same share of pixels pass an alpha test at that value as do on
+ * the base level. A numThreads of 0 uses every available thread.
+ */
+bool qm_image_generate_mipmaps( QmImage *image, QmImageMipmapFilter filter, unsigned int flags, float alphaCutoff, unsigned int numThreads )
+{
+	if ( ( unsigned int ) filter >= QM_OS_ARRAY_ELEMENTS( mipFilters ) )
+	{
+		PlReportErrorF( PL_RESULT_INVALID_PARM2, "invalid filter" );
+		return false;
+	}
+
+	if ( image->width == 0 || image->height == 0 )
+	{
+		PlReportErrorF( PL_RESULT_INVALID_PARM1, "image has no size" );
+		return false;
+	}
+
+	if ( PlGetImageFormatPixelSize( image->format ) == 0 && !qm_image_decompress_levels_( image, numThreads ) )
+	{
+		return false;
+	}
+
+	unsigned int numLevels = 1;
+	while ( ( QM_OS_MAX( image->width, image->height ) >> numLevels ) > 0 )
+	{
+		numLevels++;
+	}
+
+	MipContext *context = QM_OS_MEMORY_NEW( MipContext );
+	if ( context == nullptr )
+	{
+		PlReportErrorF( PL_RESULT_MEMORY_ALLOCATION, "couldn't allocate memory for context" );
+		return false;
+	}
+
+	context->format    = image->format;
+	context->pixelSize = PlGetImageFormatPixelSize( image->format );
+	context->srgb      = ( flags & QM_IMAGE_MIPMAP_SRGB );
+	if ( context->srgb )
+	{
+		for ( unsigned int i = 0; i <= SRGB_TABLE_SIZE; ++i )
+		{
+			float v                  = ( float ) i / SRGB_TABLE_SIZE;
+			context->toLinear[ i ]   = ( v <= 0.04045f ) ? v / 12.92f : powf( ( v + 0.055f ) / 1.055f, 2.4f );
+			context->fromLinear[ i ] = ( v <= 0.0031308f ) ? v * 12.92f : 1.055f * powf( v, 1.0f / 2.4f ) - 0.055f;
+		}
+	}
+
+	if ( !PlImageHasAlpha( image ) )
+	{
+		alphaCutoff = 0.0f;
+	}
+
+	const MipFilter *mipFilter = &mipFilters[ filter ];
+	if ( !create_workers( context, mipFilter, image->width, image->height, numThreads ) )
+	{
+		qm_os_memory_free( context );
+		return false;
+	}
+
+	bool status = true;
+	if ( image->data != nullptr && image->data[ 0 ] != nullptr )
+	{
+		status = generate_frame( context, mipFilter, &image->data, image->levels, image->width, image->height, numLevels, alphaCutoff );
+		if ( status )
+		{
+			image->levels = numLevels;
+		}
+	}
+	for ( unsigned int i = 0; status && i < image->numFrames; ++i )
+	{
+		if ( image->frames[ i ].numMips == 0 || image->frames[ i ].data[ 0 ] == nullptr )
+		{
+			continue;
+		}
+
+		status = generate_frame( context, mipFilter, ( uint8_t *** ) &image->frames[ i ].data, image->frames[ i ].numMips, image->width, image->height, numLevels, alphaCutoff );
+		if ( status )
+		{
+			image->frames[ i ].numMips = numLevels;
+		}
+	}
+
+	free_workers( context );
+	qm_os_memory_free( context );
+
+	if ( status )
+	{
+		image->levels = numLevels;
+	}
+
+	return status;
+}
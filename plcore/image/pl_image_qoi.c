@@ -13,26 +13,145 @@
 #define QOI_IMPLEMENTATION
 #include "3rdparty/qoi.h"
 
-QmImage *qm_image_qoi_parse( QmFsFile *file ) {
-	QmImage *image = NULL;
-
-	int size = ( int ) qm_fs_file_get_size( file );
-	uint8_t *buf = QM_OS_MEMORY_NEW_( uint8_t, size + 1 );
-	if ( qm_file_read( file, buf, sizeof( uint8_t ), size ) == size ) {
-		qoi_desc desc;
-		uint8_t *dstBuf = qoi_decode( buf, size, &desc, 0 );
-		if ( dstBuf == NULL ) {
-			PlReportErrorF( PL_RESULT_FILEREAD, "failed to decode qoi image" );
-			return NULL;
+/**
+ * Pixels are decoded straight out of memory backed files, otherwise
+ * the file is pulled through a small buffer as the decoder needs it.
+ */
+
+#define QOI_READ_CHUNK 4096
+
+typedef struct QoiReader {
+	QmFsFile *file;
+	const uint8_t *pos, *end;
+	size_t remaining; /* left to read from the file */
+	uint8_t buffer[ QOI_READ_CHUNK ];
+} QoiReader;
+
+static bool QoiRefill( QoiReader *reader ) {
+	size_t size = ( reader->remaining < QOI_READ_CHUNK ) ? reader->remaining : QOI_READ_CHUNK;
+	if ( size == 0 || qm_file_read( reader->file, reader->buffer, sizeof( uint8_t ), size ) != size ) {
+		return false;
+	}
+
+	reader->remaining -= size;
+	reader->pos = reader->buffer;
+	reader->end = reader->buffer + size;
+	return true;
+}
+
+static inline bool QoiReadByte( QoiReader *reader, uint8_t *out ) {
+	if ( reader->pos == reader->end && !QoiRefill( reader ) ) {
+		return false;
+	}
+
+	*out = *reader->pos++;
+	return true;
+}
+
+static bool QoiReadUInt32( QoiReader *reader, uint32_t *out ) {
+	*out = 0;
+	for ( unsigned int i = 0; i < 4; ++i ) {
+		uint8_t b;
+		if ( !QoiReadByte( reader, &b ) ) {
+			return false;
+		}
+		*out = ( *out << 8 ) | b;
+	}
+
+	return true;
+}
+
+/* as with the reference decoder, running out of data early repeats the last pixel */
+static void QoiDecode( QoiReader *reader, uint8_t *dst, size_t numPixels, unsigned int channels ) {
+	qoi_rgba_t index[ 64 ] = {};
+	qoi_rgba_t px = { .rgba = { .r = 0, .g = 0, .b = 0, .a = 255 } };
+
+	unsigned int run = 0;
+	for ( size_t i = 0; i < numPixels; ++i, dst += channels ) {
+		uint8_t b1;
+		if ( run > 0 ) {
+			run--;
+		} else if ( QoiReadByte( reader, &b1 ) ) {
+			uint8_t b2 = 0;
+			if ( b1 == QOI_OP_RGB ) {
+				QoiReadByte( reader, &px.rgba.r );
+				QoiReadByte( reader, &px.rgba.g );
+				QoiReadByte( reader, &px.rgba.b );
+			} else if ( b1 == QOI_OP_RGBA ) {
+				QoiReadByte( reader, &px.rgba.r );
+				QoiReadByte( reader, &px.rgba.g );
+				QoiReadByte( reader, &px.rgba.b );
+				QoiReadByte( reader, &px.rgba.a );
+			} else if ( ( b1 & QOI_MASK_2 ) == QOI_OP_INDEX ) {
+				px = index[ b1 ];
+			} else if ( ( b1 & QOI_MASK_2 ) == QOI_OP_DIFF ) {
+				px.rgba.r += ( ( b1 >> 4 ) & 0x03 ) - 2;
+				px.rgba.g += ( ( b1 >> 2 ) & 0x03 ) - 2;
+				px.rgba.b += ( b1 & 0x03 ) - 2;
+			} else if ( ( b1 & QOI_MASK_2 ) == QOI_OP_LUMA ) {
+				QoiReadByte( reader, &b2 );
+				int vg = ( b1 & 0x3f ) - 32;
+				px.rgba.r += vg - 8 + ( ( b2 >> 4 ) & 0x0f );
+				px.rgba.g += vg;
+				px.rgba.b += vg - 8 + ( b2 & 0x0f );
+			} else if ( ( b1 & QOI_MASK_2 ) == QOI_OP_RUN ) {
+				run = ( b1 & 0x3f );
+			}
+
+			index[ QOI_COLOR_HASH( px ) % 64 ] = px;
+		}
+
+		dst[ 0 ] = px.rgba.r;
+		dst[ 1 ] = px.rgba.g;
+		dst[ 2 ] = px.rgba.b;
+		if ( channels == 4 ) {
+			dst[ 3 ] = px.rgba.a;
 		}
+	}
+}
 
-		image = PlCreateImage( dstBuf, desc.width, desc.height, 0, PL_COLOURFORMAT_RGBA,
-		                       ( desc.channels == 4 ) ? PL_IMAGEFORMAT_RGBA8 : PL_IMAGEFORMAT_RGB8 );
+QmImage *qm_image_qoi_parse( QmFsFile *file ) {
+	QoiReader *reader = QM_OS_MEMORY_NEW( QoiReader );
+	if ( reader == NULL ) {
+		return NULL;
+	}
+
+	reader->file = file;
+
+	int64_t offset = qm_fs_file_get_offset( file );
+	size_t size = qm_fs_file_get_size( file ) - ( size_t ) offset;
+
+	const uint8_t *data = qm_fs_file_get_data( file );
+	if ( data != NULL ) {
+		reader->pos = data + offset;
+		reader->end = reader->pos + size;
+	} else {
+		reader->remaining = size;
+	}
+
+	uint32_t magic, width, height;
+	uint8_t channels, colourSpace;
+	if ( !QoiReadUInt32( reader, &magic ) || !QoiReadUInt32( reader, &width ) || !QoiReadUInt32( reader, &height ) ||
+	     !QoiReadByte( reader, &channels ) || !QoiReadByte( reader, &colourSpace ) ) {
+		qm_os_memory_free( reader );
+		PlReportErrorF( PL_RESULT_FILEREAD, "failed to read qoi header" );
+		return NULL;
+	}
+
+	if ( magic != QOI_MAGIC || width == 0 || height == 0 || channels < 3 || channels > 4 || colourSpace > 1 ||
+	     height >= QOI_PIXELS_MAX / width ) {
+		qm_os_memory_free( reader );
+		PlReportErrorF( PL_RESULT_FILEREAD, "failed to decode qoi image" );
+		return NULL;
+	}
 
-		qm_os_memory_free( dstBuf );
+	QmImage *image = PlCreateImage( NULL, width, height, 0, PL_COLOURFORMAT_RGBA,
+	                                ( channels == 4 ) ? PL_IMAGEFORMAT_RGBA8 : PL_IMAGEFORMAT_RGB8 );
+	if ( image != NULL ) {
+		QoiDecode( reader, image->data[ 0 ], ( size_t ) width * height, channels );
 	}
 
-	qm_os_memory_free( buf );
+	qm_os_memory_free( reader );
 
 	return image;
 }
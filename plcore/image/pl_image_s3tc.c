@@ -0,0 +1,887 @@
+// SPDX-License-Identifier: MIT
+// Hei Platform Library
+// Copyright © 2017-2026 Quartermind Games, Mark E. Sowden <markelswo@gmail.com>
+// Purpose: S3TC (BC1/BC2/BC3) block decompression.
+
+#include "image_private.h"
+
+#include "qmos/public/qm_os_memory.h"
+#include "qmos/public/qm_os_thread.h"
+
+#include <stdatomic.h>
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || defined( _M_AMD64 )
+#	include <emmintrin.h>
+#	define IMAGE_S3TC_SSE2
+// avx2 is picked at runtime, so it doesn't need to be enabled for the whole build
+#	if defined( __GNUC__ ) && !defined( _MSC_VER )
+#		include <immintrin.h>
+#		define IMAGE_S3TC_AVX2
+#	endif
+#elif defined( __ARM_NEON ) || defined( _M_ARM64 )
+#	include <arm_neon.h>
+#	define IMAGE_S3TC_NEON
+#endif
+
+/**
+ * Blocks are decoded a run at a time. The endpoints of every block in a run
+ * are first expanded into palettes together, eight blocks to a vector, and
+ * then each block's pixels are looked up from its palette and written out.
+ *
+ * Output matches the reference decoder in 3rdparty/decompress.c exactly;
+ * DXT1 and DXT3 honour the three colour mode, where the last entry is opaque
+ * black, while DXT5 is always four colour.
+ *
+ * Larger images are split into rows of blocks, which are shared out
+ * between the shared workers along with the calling thread.
+ */
+
+#define RUN_BLOCKS         8
+#define MIN_BLOCKS_PER_JOB 1024
+
+typedef enum BlockType
+{
+	BLOCK_TYPE_BC1,
+	BLOCK_TYPE_BC2,
+	BLOCK_TYPE_BC3,
+} BlockType;
+
+typedef struct BlockRun
+{
+	uint32_t colours[ RUN_BLOCKS ][ 4 ];
+	uint32_t codes[ RUN_BLOCKS ];
+	uint8_t  alphas[ RUN_BLOCKS ][ 16 ];
+} BlockRun;
+
+static inline unsigned int get_block_size( BlockType type )
+{
+	return ( type == BLOCK_TYPE_BC1 ) ? 8 : 16;
+}
+
+static bool get_block_type( PLImageFormat format, BlockType *type )
+{
+	switch ( format )
+	{
+		case PL_IMAGEFORMAT_RGB_DXT1:
+		case PL_IMAGEFORMAT_RGBA_DXT1:
+			*type = BLOCK_TYPE_BC1;
+			return true;
+		case PL_IMAGEFORMAT_RGBA_DXT3:
+			*type = BLOCK_TYPE_BC2;
+			return true;
+		case PL_IMAGEFORMAT_RGBA_DXT5:
+			*type = BLOCK_TYPE_BC3;
+			return true;
+		default:
+			return false;
+	}
+}
+
+static inline uint16_t read_u16( const uint8_t *src )
+{
+	return ( uint16_t ) ( src[ 0 ] | ( src[ 1 ] << 8 ) );
+}
+
+static inline uint32_t read_u32( const uint8_t *src )
+{
+	return ( uint32_t ) src[ 0 ] | ( ( uint32_t ) src[ 1 ] << 8 ) | ( ( uint32_t ) src[ 2 ] << 16 ) | ( ( uint32_t ) src[ 3 ] << 24 );
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Scalar
+/////////////////////////////////////////////////////////////////////////////////////
+
+static inline uint32_t pack_colour( unsigned int r, unsigned int g, unsigned int b, unsigned int a )
+{
+	return r | ( g << 8 ) | ( b << 16 ) | ( a << 24 );
+}
+
+static inline unsigned int expand5( unsigned int v )
+{
+	unsigned int temp = v * 255 + 16;
+	return ( temp / 32 + temp ) / 32;
+}
+
+static inline unsigned int expand6( unsigned int v )
+{
+	unsigned int temp = v * 255 + 32;
+	return ( temp / 64 + temp ) / 64;
+}
+
+static unsigned int decode_palettes_scalar( BlockType type, const uint8_t *blocks, unsigned int numBlocks, BlockRun *run )
+{
+	unsigned int blockSize = get_block_size( type );
+	unsigned int alpha     = ( type == BLOCK_TYPE_BC1 ) ? 255 : 0;
+	for ( unsigned int i = 0; i < numBlocks; ++i )
+	{
+		const uint8_t *colourBlock = blocks + i * blockSize + ( blockSize - 8 );
+
+		unsigned int c0 = read_u16( colourBlock );
+		unsigned int c1 = read_u16( colourBlock + 2 );
+
+		unsigned int r0 = expand5( c0 >> 11 ), g0 = expand6( ( c0 >> 5 ) & 63 ), b0 = expand5( c0 & 31 );
+		unsigned int r1 = expand5( c1 >> 11 ), g1 = expand6( ( c1 >> 5 ) & 63 ), b1 = expand5( c1 & 31 );
+
+		uint32_t *colours = run->colours[ i ];
+		colours[ 0 ]      = pack_colour( r0, g0, b0, alpha );
+		colours[ 1 ]      = pack_colour( r1, g1, b1, alpha );
+		if ( type == BLOCK_TYPE_BC3 || c0 > c1 )
+		{
+			colours[ 2 ] = pack_colour( ( 2 * r0 + r1 ) / 3, ( 2 * g0 + g1 ) / 3, ( 2 * b0 + b1 ) / 3, alpha );
+			colours[ 3 ] = pack_colour( ( r0 + 2 * r1 ) / 3, ( g0 + 2 * g1 ) / 3, ( b0 + 2 * b1 ) / 3, alpha );
+		}
+		else
+		{
+			colours[ 2 ] = pack_colour( ( r0 + r1 ) / 2, ( g0 + g1 ) / 2, ( b0 + b1 ) / 2, alpha );
+			colours[ 3 ] = pack_colour( 0, 0, 0, alpha );
+		}
+	}
+
+	return numBlocks;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// SSE2
+/////////////////////////////////////////////////////////////////////////////////////
+
+#if defined( IMAGE_S3TC_SSE2 )
+
+static inline __m128i expand5_sse2( __m128i v )
+{
+	__m128i temp = _mm_add_epi16( _mm_mullo_epi16( v, _mm_set1_epi16( 255 ) ), _mm_set1_epi16( 16 ) );
+	return _mm_srli_epi16( _mm_add_epi16( _mm_srli_epi16( temp, 5 ), temp ), 5 );
+}
+
+static inline __m128i expand6_sse2( __m128i v )
+{
+	__m128i temp = _mm_add_epi16( _mm_mullo_epi16( v, _mm_set1_epi16( 255 ) ), _mm_set1_epi16( 32 ) );
+	return _mm_srli_epi16( _mm_add_epi16( _mm_srli_epi16( temp, 6 ), temp ), 6 );
+}
+
+/**
+ * Exact for anything up to 3 * 255; 0xAAAB / 2^17 sits just above a third.
+ */
+static inline __m128i div3_sse2( __m128i v )
+{
+	return _mm_srli_epi16( _mm_mulhi_epu16( v, _mm_set1_epi16( ( short ) 0xAAAB ) ), 1 );
+}
+
+static inline __m128i select_sse2( __m128i mask, __m128i a, __m128i b )
+{
+	return _mm_or_si128( _mm_and_si128( mask, a ), _mm_andnot_si128( mask, b ) );
+}
+
+/**
+ * Takes each of the four palette entries, spread across eight blocks, and
+ * writes them back out as a four entry palette per block.
+ */
+static inline void store_palettes_sse2( BlockRun *run, const __m128i rg[ 4 ], const __m128i ba[ 4 ] )
+{
+	for ( unsigned int half = 0; half < 2; ++half )
+	{
+		__m128i c[ 4 ];
+		for ( unsigned int k = 0; k < 4; ++k )
+		{
+			c[ k ] = ( half == 0 ) ? _mm_unpacklo_epi16( rg[ k ], ba[ k ] ) : _mm_unpackhi_epi16( rg[ k ], ba[ k ] );
+		}
+
+		__m128i t0 = _mm_unpacklo_epi32( c[ 0 ], c[ 1 ] );
+		__m128i t1 = _mm_unpacklo_epi32( c[ 2 ], c[ 3 ] );
+		__m128i t2 = _mm_unpackhi_epi32( c[ 0 ], c[ 1 ] );
+		__m128i t3 = _mm_unpackhi_epi32( c[ 2 ], c[ 3 ] );
+
+		uint32_t( *colours )[ 4 ] = &run->colours[ half * 4 ];
+		_mm_storeu_si128( ( __m128i * ) colours[ 0 ], _mm_unpacklo_epi64( t0, t1 ) );
+		_mm_storeu_si128( ( __m128i * ) colours[ 1 ], _mm_unpackhi_epi64( t0, t1 ) );
+		_mm_storeu_si128( ( __m128i * ) colours[ 2 ], _mm_unpacklo_epi64( t2, t3 ) );
+		_mm_storeu_si128( ( __m128i * ) colours[ 3 ], _mm_unpackhi_epi64( t2, t3 ) );
+	}
+}
+
+static unsigned int decode_palettes_sse2( BlockType type, const uint8_t *blocks, unsigned int numBlocks, BlockRun *run )
+{
+	if ( numBlocks < RUN_BLOCKS )
+	{
+		return 0;
+	}
+
+	unsigned int blockSize = get_block_size( type );
+
+	uint16_t endpoints[ 2 ][ RUN_BLOCKS ];
+	for ( unsigned int i = 0; i < RUN_BLOCKS; ++i )
+	{
+		const uint8_t *colourBlock = blocks + i * blockSize + ( blockSize - 8 );
+		endpoints[ 0 ][ i ]        = read_u16( colourBlock );
+		endpoints[ 1 ][ i ]        = read_u16( colourBlock + 2 );
+	}
+
+	__m128i c0 = _mm_loadu_si128( ( const __m128i * ) endpoints[ 0 ] );
+	__m128i c1 = _mm_loadu_si128( ( const __m128i * ) endpoints[ 1 ] );
+
+	__m128i mask5 = _mm_set1_epi16( 31 );
+	__m128i mask6 = _mm_set1_epi16( 63 );
+
+	__m128i r0 = expand5_sse2( _mm_srli_epi16( c0, 11 ) );
+	__m128i g0 = expand6_sse2( _mm_and_si128( _mm_srli_epi16( c0, 5 ), mask6 ) );
+	__m128i b0 = expand5_sse2( _mm_and_si128( c0, mask5 ) );
+	__m128i r1 = expand5_sse2( _mm_srli_epi16( c1, 11 ) );
+	__m128i g1 = expand6_sse2( _mm_and_si128( _mm_srli_epi16( c1, 5 ), mask6 ) );
+	__m128i b1 = expand5_sse2( _mm_and_si128( c1, mask5 ) );
+
+	// no unsigned compare before sse4.1, so flip the sign bits
+	__m128i fourColour;
+	if ( type == BLOCK_TYPE_BC3 )
+	{
+		fourColour = _mm_set1_epi16( -1 );
+	}
+	else
+	{
+		__m128i sign = _mm_set1_epi16( ( short ) 0x8000 );
+		fourColour   = _mm_cmpgt_epi16( _mm_xor_si128( c0, sign ), _mm_xor_si128( c1, sign ) );
+	}
+
+	__m128i r2 = select_sse2( fourColour, div3_sse2( _mm_add_epi16( _mm_add_epi16( r0, r0 ), r1 ) ), _mm_srli_epi16( _mm_add_epi16( r0, r1 ), 1 ) );
+	__m128i g2 = select_sse2( fourColour, div3_sse2( _mm_add_epi16( _mm_add_epi16( g0, g0 ), g1 ) ), _mm_srli_epi16( _mm_add_epi16( g0, g1 ), 1 ) );
+	__m128i b2 = select_sse2( fourColour, div3_sse2( _mm_add_epi16( _mm_add_epi16( b0, b0 ), b1 ) ), _mm_srli_epi16( _mm_add_epi16( b0, b1 ), 1 ) );
+	__m128i r3 = _mm_and_si128( fourColour, div3_sse2( _mm_add_epi16( _mm_add_epi16( r1, r1 ), r0 ) ) );
+	__m128i g3 = _mm_and_si128( fourColour, div3_sse2( _mm_add_epi16( _mm_add_epi16( g1, g1 ), g0 ) ) );
+	__m128i b3 = _mm_and_si128( fourColour, div3_sse2( _mm_add_epi16( _mm_add_epi16( b1, b1 ), b0 ) ) );
+
+	__m128i alpha = _mm_set1_epi16( ( type == BLOCK_TYPE_BC1 ) ? ( short ) 0xFF00 : 0 );
+
+	const __m128i rg[ 4 ] = {
+	        _mm_or_si128( r0, _mm_slli_epi16( g0, 8 ) ),
+	        _mm_or_si128( r1, _mm_slli_epi16( g1, 8 ) ),
+	        _mm_or_si128( r2, _mm_slli_epi16( g2, 8 ) ),
+	        _mm_or_si128( r3, _mm_slli_epi16( g3, 8 ) ),
+	};
+	const __m128i ba[ 4 ] = {
+	        _mm_or_si128( b0, alpha ),
+	        _mm_or_si128( b1, alpha ),
+	        _mm_or_si128( b2, alpha ),
+	        _mm_or_si128( b3, alpha ),
+	};
+	store_palettes_sse2( run, rg, ba );
+
+	return RUN_BLOCKS;
+}
+
+static void write_block_sse2( const uint32_t colours[ 4 ], uint32_t codes, const uint8_t *alphas, uint8_t *dst, size_t stride )
+{
+	for ( unsigned int y = 0; y < 4; ++y, codes >>= 8 )
+	{
+		__m128i row = _mm_setr_epi32( ( int ) colours[ codes & 3 ], ( int ) colours[ ( codes >> 2 ) & 3 ],
+		                              ( int ) colours[ ( codes >> 4 ) & 3 ], ( int ) colours[ ( codes >> 6 ) & 3 ] );
+		if ( alphas != nullptr )
+		{
+			__m128i a = _mm_cvtsi32_si128( ( int ) read_u32( alphas + y * 4 ) );
+			a         = _mm_unpacklo_epi8( a, _mm_setzero_si128() );
+			a         = _mm_unpacklo_epi16( a, _mm_setzero_si128() );
+			row       = _mm_or_si128( row, _mm_slli_epi32( a, 24 ) );
+		}
+
+		_mm_storeu_si128( ( __m128i * ) ( dst + y * stride ), row );
+	}
+}
+
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////
+// AVX2
+/////////////////////////////////////////////////////////////////////////////////////
+
+#if defined( IMAGE_S3TC_AVX2 )
+
+static bool has_avx2( void )
+{
+	static int supported = -1;
+	if ( supported < 0 )
+	{
+		__builtin_cpu_init();
+		supported = __builtin_cpu_supports( "avx2" ) ? 1 : 0;
+	}
+
+	return supported;
+}
+
+/**
+ * Two rows at a time; each 2-bit code is turned into the byte offsets
+ * of its palette entry, which a shuffle then pulls out of the palette.
+ */
+__attribute__( ( target( "avx2" ) ) ) static void write_block_avx2( const uint32_t colours[ 4 ], uint32_t codes, const uint8_t *alphas, uint8_t *dst, size_t stride )
+{
+	__m256i palette = _mm256_broadcastsi128_si256( _mm_loadu_si128( ( const __m128i * ) colours ) );
+	__m256i shifts  = _mm256_setr_epi32( 0, 2, 4, 6, 8, 10, 12, 14 );
+	__m256i offsets = _mm256_set1_epi32( 0x03020100 );
+	__m256i spread  = _mm256_set1_epi32( 0x04040404 );
+	__m256i mask    = _mm256_set1_epi32( 3 );
+
+	for ( unsigned int y = 0; y < 4; y += 2 )
+	{
+		__m256i indices = _mm256_srlv_epi32( _mm256_set1_epi32( ( int ) ( codes >> ( y * 8 ) ) ), shifts );
+		indices         = _mm256_add_epi32( _mm256_mullo_epi32( _mm256_and_si256( indices, mask ), spread ), offsets );
+
+		__m256i rows = _mm256_shuffle_epi8( palette, indices );
+		if ( alphas != nullptr )
+		{
+			__m256i a = _mm256_cvtepu8_epi32( _mm_loadl_epi64( ( const __m128i * ) ( alphas + y * 4 ) ) );
+			rows      = _mm256_or_si256( rows, _mm256_slli_epi32( a, 24 ) );
+		}
+
+		_mm_storeu_si128( ( __m128i * ) ( dst + y * stride ), _mm256_castsi256_si128( rows ) );
+		_mm_storeu_si128( ( __m128i * ) ( dst + ( y + 1 ) * stride ), _mm256_extracti128_si256( rows, 1 ) );
+	}
+}
+
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////
+// NEON
+/////////////////////////////////////////////////////////////////////////////////////
+
+#if defined( IMAGE_S3TC_NEON )
+
+static inline uint16x8_t expand5_neon( uint16x8_t v )
+{
+	uint16x8_t temp = vaddq_u16( vmulq_n_u16( v, 255 ), vdupq_n_u16( 16 ) );
+	return vshrq_n_u16( vsraq_n_u16( temp, temp, 5 ), 5 );
+}
+
+static inline uint16x8_t expand6_neon( uint16x8_t v )
+{
+	uint16x8_t temp = vaddq_u16( vmulq_n_u16( v, 255 ), vdupq_n_u16( 32 ) );
+	return vshrq_n_u16( vsraq_n_u16( temp, temp, 6 ), 6 );
+}
+
+static inline uint16x8_t div3_neon( uint16x8_t v )
+{
+	uint32x4_t lo = vmull_n_u16( vget_low_u16( v ), 0xAAAB );
+	uint32x4_t hi = vmull_n_u16( vget_high_u16( v ), 0xAAAB );
+	return vshrq_n_u16( vcombine_u16( vshrn_n_u32( lo, 16 ), vshrn_n_u32( hi, 16 ) ), 1 );
+}
+
+static unsigned int decode_palettes_neon( BlockType type, const uint8_t *blocks, unsigned int numBlocks, BlockRun *run )
+{
+	if ( numBlocks < RUN_BLOCKS )
+	{
+		return 0;
+	}
+
+	unsigned int blockSize = get_block_size( type );
+
+	uint16_t endpoints[ 2 ][ RUN_BLOCKS ];
+	for ( unsigned int i = 0; i < RUN_BLOCKS; ++i )
+	{
+		const uint8_t *colourBlock = blocks + i * blockSize + ( blockSize - 8 );
+		endpoints[ 0 ][ i ]        = read_u16( colourBlock );
+		endpoints[ 1 ][ i ]        = read_u16( colourBlock + 2 );
+	}
+
+	uint16x8_t c0 = vld1q_u16( endpoints[ 0 ] );
+	uint16x8_t c1 = vld1q_u16( endpoints[ 1 ] );
+
+	uint16x8_t mask5 = vdupq_n_u16( 31 );
+	uint16x8_t mask6 = vdupq_n_u16( 63 );
+
+	uint16x8_t r0 = expand5_neon( vshrq_n_u16( c0, 11 ) );
+	uint16x8_t g0 = expand6_neon( vandq_u16( vshrq_n_u16( c0, 5 ), mask6 ) );
+	uint16x8_t b0 = expand5_neon( vandq_u16( c0, mask5 ) );
+	uint16x8_t r1 = expand5_neon( vshrq_n_u16( c1, 11 ) );
+	uint16x8_t g1 = expand6_neon( vandq_u16( vshrq_n_u16( c1, 5 ), mask6 ) );
+	uint16x8_t b1 = expand5_neon( vandq_u16( c1, mask5 ) );
+
+	uint16x8_t fourColour = ( type == BLOCK_TYPE_BC3 ) ? vdupq_n_u16( 0xFFFF ) : vcgtq_u16( c0, c1 );
+
+	uint16x8_t r2 = vbslq_u16( fourColour, div3_neon( vaddq_u16( vaddq_u16( r0, r0 ), r1 ) ), vhaddq_u16( r0, r1 ) );
+	uint16x8_t g2 = vbslq_u16( fourColour, div3_neon( vaddq_u16( vaddq_u16( g0, g0 ), g1 ) ), vhaddq_u16( g0, g1 ) );
+	uint16x8_t b2 = vbslq_u16( fourColour, div3_neon( vaddq_u16( vaddq_u16( b0, b0 ), b1 ) ), vhaddq_u16( b0, b1 ) );
+	uint16x8_t r3 = vandq_u16( fourColour, div3_neon( vaddq_u16( vaddq_u16( r1, r1 ), r0 ) ) );
+	uint16x8_t g3 = vandq_u16( fourColour, div3_neon( vaddq_u16( vaddq_u16( g1, g1 ), g0 ) ) );
+	uint16x8_t b3 = vandq_u16( fourColour, div3_neon( vaddq_u16( vaddq_u16( b1, b1 ), b0 ) ) );
+
+	uint8x8_t alpha = vdup_n_u8( ( type == BLOCK_TYPE_BC1 ) ? 255 : 0 );
+
+	// interleaving on store does the transpose for us
+	const uint16x8_t r[ 4 ] = { r0, r1, r2, r3 };
+	const uint16x8_t g[ 4 ] = { g0, g1, g2, g3 };
+	const uint16x8_t b[ 4 ] = { b0, b1, b2, b3 };
+	for ( unsigned int k = 0; k < 4; ++k )
+	{
+		uint8_t     entries[ RUN_BLOCKS * 4 ];
+		uint8x8x4_t channels = { { vmovn_u16( r[ k ] ), vmovn_u16( g[ k ] ), vmovn_u16( b[ k ] ), alpha } };
+		vst4_u8( entries, channels );
+		for ( unsigned int i = 0; i < RUN_BLOCKS; ++i )
+		{
+			memcpy( &run->colours[ i ][ k ], &entries[ i * 4 ], sizeof( uint32_t ) );
+		}
+	}
+
+	return RUN_BLOCKS;
+}
+
+static void write_block_neon( const uint32_t colours[ 4 ], uint32_t codes, const uint8_t *alphas, uint8_t *dst, size_t stride )
+{
+	uint8x16_t palette = vld1q_u8( ( const uint8_t * ) colours );
+	for ( unsigned int y = 0; y < 4; ++y, codes >>= 8 )
+	{
+		uint32x4_t indices = vdupq_n_u32( codes & 0xFF );
+		indices            = vandq_u32( vshlq_u32( indices, ( int32x4_t ){ 0, -2, -4, -6 } ), vdupq_n_u32( 3 ) );
+		indices            = vmlaq_n_u32( vdupq_n_u32( 0x03020100 ), indices, 0x04040404 );
+
+		uint8x16_t row = vqtbl1q_u8( palette, vreinterpretq_u8_u32( indices ) );
+		if ( alphas != nullptr )
+		{
+			uint32x4_t a = vmovl_u16( vget_low_u16( vmovl_u8( vcreate_u8( read_u32( alphas + y * 4 ) ) ) ) );
+			row          = vorrq_u8( row, vreinterpretq_u8_u32( vshlq_n_u32( a, 24 ) ) );
+		}
+
+		vst1q_u8( dst + y * stride, row );
+	}
+}
+
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Blocks
+/////////////////////////////////////////////////////////////////////////////////////
+
+static void write_block_scalar( const uint32_t colours[ 4 ], uint32_t codes, const uint8_t *alphas, uint8_t *dst, size_t stride )
+{
+	for ( unsigned int y = 0; y < 4; ++y )
+	{
+		uint32_t row[ 4 ];
+		for ( unsigned int x = 0; x < 4; ++x, codes >>= 2 )
+		{
+			row[ x ] = colours[ codes & 3 ];
+			if ( alphas != nullptr )
+			{
+				row[ x ] |= ( uint32_t ) alphas[ y * 4 + x ] << 24;
+			}
+		}
+
+		memcpy( dst + y * stride, row, sizeof( row ) );
+	}
+}
+
+static void write_block( const uint32_t colours[ 4 ], uint32_t codes, const uint8_t *alphas, uint8_t *dst, size_t stride )
+{
+#if defined( IMAGE_S3TC_AVX2 )
+	if ( has_avx2() )
+	{
+		write_block_avx2( colours, codes, alphas, dst, stride );
+		return;
+	}
+#endif
+#if defined( IMAGE_S3TC_SSE2 )
+	write_block_sse2( colours, codes, alphas, dst, stride );
+#elif defined( IMAGE_S3TC_NEON )
+	write_block_neon( colours, codes, alphas, dst, stride );
+#else
+	write_block_scalar( colours, codes, alphas, dst, stride );
+#endif
+}
+
+static void decode_alphas( BlockType type, const uint8_t *block, uint8_t *alphas )
+{
+	if ( type == BLOCK_TYPE_BC2 )
+	{
+		for ( unsigned int i = 0; i < 8; ++i )
+		{
+			alphas[ i * 2 ]     = ( block[ i ] & 0xF ) * 17;
+			alphas[ i * 2 + 1 ] = ( block[ i ] >> 4 ) * 17;
+		}
+		return;
+	}
+
+	unsigned int a0 = block[ 0 ];
+	unsigned int a1 = block[ 1 ];
+
+	uint8_t palette[ 8 ] = { ( uint8_t ) a0, ( uint8_t ) a1 };
+	if ( a0 > a1 )
+	{
+		for ( unsigned int k = 2; k < 8; ++k )
+		{
+			palette[ k ] = ( uint8_t ) ( ( ( 8 - k ) * a0 + ( k - 1 ) * a1 ) / 7 );
+		}
+	}
+	else
+	{
+		for ( unsigned int k = 2; k < 6; ++k )
+		{
+			palette[ k ] = ( uint8_t ) ( ( ( 6 - k ) * a0 + ( k - 1 ) * a1 ) / 5 );
+		}
+		palette[ 6 ] = 0;
+		palette[ 7 ] = 255;
+	}
+
+	// two groups of eight 3-bit indices
+	for ( unsigned int group = 0; group < 2; ++group )
+	{
+		const uint8_t *src     = block + 2 + group * 3;
+		uint32_t       indices = src[ 0 ] | ( src[ 1 ] << 8 ) | ( src[ 2 ] << 16 );
+		for ( unsigned int i = 0; i < 8; ++i, indices >>= 3 )
+		{
+			alphas[ group * 8 + i ] = palette[ indices & 7 ];
+		}
+	}
+}
+
+static void decode_run( BlockType type, const uint8_t *blocks, unsigned int numBlocks, BlockRun *run )
+{
+	unsigned int decoded = 0;
+#if defined( IMAGE_S3TC_SSE2 )
+	decoded = decode_palettes_sse2( type, blocks, numBlocks, run );
+#elif defined( IMAGE_S3TC_NEON )
+	decoded = decode_palettes_neon( type, blocks, numBlocks, run );
+#endif
+	if ( decoded < numBlocks )
+	{
+		decode_palettes_scalar( type, blocks, numBlocks, run );
+	}
+
+	unsigned int blockSize = get_block_size( type );
+	for ( unsigned int i = 0; i < numBlocks; ++i )
+	{
+		const uint8_t *block = blocks + i * blockSize;
+		run->codes[ i ]      = read_u32( block + blockSize - 4 );
+		if ( type != BLOCK_TYPE_BC1 )
+		{
+			decode_alphas( type, block, run->alphas[ i ] );
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Jobs
+/////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct DecompressLevel
+{
+	const uint8_t *src;
+	uint8_t       *dst;
+	unsigned int   width;
+	unsigned int   height;
+} DecompressLevel;
+
+typedef struct DecompressJob
+{
+	const DecompressLevel *level;
+	unsigned int           firstRow;
+	unsigned int           numRows;
+} DecompressJob;
+
+typedef struct DecompressQueue
+{
+	BlockType            type;
+	const DecompressJob *jobs;
+	unsigned int         numJobs;
+	atomic_uint          nextJob;
+} DecompressQueue;
+
+static void decompress_rows( BlockType type, const DecompressLevel *level, unsigned int firstRow, unsigned int numRows )
+{
+	unsigned int blockSize    = get_block_size( type );
+	unsigned int blocksPerRow = ( level->width + 3 ) / 4;
+	size_t       stride       = ( size_t ) level->width * 4;
+
+	BlockRun run;
+	for ( unsigned int row = firstRow; row < firstRow + numRows; ++row )
+	{
+		const uint8_t *blocks = level->src + ( size_t ) row * blocksPerRow * blockSize;
+		unsigned int   y      = row * 4;
+		for ( unsigned int column = 0; column < blocksPerRow; column += RUN_BLOCKS )
+		{
+			unsigned int numBlocks = QM_OS_MIN( blocksPerRow - column, ( unsigned int ) RUN_BLOCKS );
+			decode_run( type, blocks + ( size_t ) column * blockSize, numBlocks, &run );
+
+			for ( unsigned int i = 0; i < numBlocks; ++i )
+			{
+				const uint8_t *alphas = ( type == BLOCK_TYPE_BC1 ) ? nullptr : run.alphas[ i ];
+				unsigned int   x      = ( column + i ) * 4;
+				uint8_t       *dst    = level->dst + y * stride + x * 4;
+				if ( x + 4 <= level->width && y + 4 <= level->height )
+				{
+					write_block( run.colours[ i ], run.codes[ i ], alphas, dst, stride );
+					continue;
+				}
+
+				// partial blocks along the edges are decoded aside, then clipped
+				uint8_t      pixels[ 4 * 4 * 4 ];
+				unsigned int w = QM_OS_MIN( level->width - x, 4U );
+				unsigned int h = QM_OS_MIN( level->height - y, 4U );
+				write_block_scalar( run.colours[ i ], run.codes[ i ], alphas, pixels, 4 * 4 );
+				for ( unsigned int j = 0; j < h; ++j )
+				{
+					memcpy( dst + j * stride, pixels + j * 4 * 4, w * 4 );
+				}
+			}
+		}
+	}
+}
+
+static void decompress_worker( void *userData )
+{
+	DecompressQueue *queue = userData;
+
+	unsigned int i;
+	while ( ( i = atomic_fetch_add( &queue->nextJob, 1 ) ) < queue->numJobs )
+	{
+		const DecompressJob *job = &queue->jobs[ i ];
+		decompress_rows( queue->type, job->level, job->firstRow, job->numRows );
+	}
+}
+
+/**
+ * Splits every level into jobs of roughly MIN_BLOCKS_PER_JOB blocks apiece
+ * and works through them, only calling on the shared workers if there's enough to share.
+ */
+static void decompress_levels( BlockType type, const DecompressLevel *levels, unsigned int numLevels, unsigned int numThreads )
+{
+	unsigned int numJobs = 0;
+	for ( unsigned int i = 0; i < numLevels; ++i )
+	{
+		unsigned int blocksPerRow = ( levels[ i ].width + 3 ) / 4;
+		unsigned int rowsPerJob   = QM_OS_MAX( MIN_BLOCKS_PER_JOB / blocksPerRow, 1U );
+		numJobs += ( ( levels[ i ].height + 3 ) / 4 + rowsPerJob - 1 ) / rowsPerJob;
+	}
+
+	if ( numThreads == 0 )
+	{
+		numThreads = qm_os_thread_get_available();
+	}
+	numThreads = QM_OS_MIN( numThreads, numJobs );
+
+	if ( numThreads <= 1 )
+	{
+		for ( unsigned int i = 0; i < numLevels; ++i )
+		{
+			decompress_rows( type, &levels[ i ], 0, ( levels[ i ].height + 3 ) / 4 );
+		}
+		return;
+	}
+
+	DecompressJob *jobs = QM_OS_MEMORY_NEW_( DecompressJob, numJobs );
+	numJobs             = 0;
+	for ( unsigned int i = 0; i < numLevels; ++i )
+	{
+		unsigned int blocksPerRow = ( levels[ i ].width + 3 ) / 4;
+		unsigned int numRows      = ( levels[ i ].height + 3 ) / 4;
+		unsigned int rowsPerJob   = QM_OS_MAX( MIN_BLOCKS_PER_JOB / blocksPerRow, 1U );
+		for ( unsigned int row = 0; row < numRows; row += rowsPerJob )
+		{
+			jobs[ numJobs++ ] = ( DecompressJob ){ .level = &levels[ i ], .firstRow = row, .numRows = QM_OS_MIN( rowsPerJob, numRows - row ) };
+		}
+	}
+
+	DecompressQueue queue = { .type = type, .jobs = jobs, .numJobs = numJobs };
+	atomic_init( &queue.nextJob, 0 );
+
+	QmWorkerGroup *group = qm_worker_group_start_( decompress_worker, &queue, numThreads - 1 );
+
+	decompress_worker( &queue );
+
+	qm_worker_group_wait_( group );
+	qm_os_memory_free( jobs );
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Public
+/////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Decompresses a single level of blocks into RGBA8, tightly packed at
+ * the given width and height, neither of which need be a multiple of 4.
+ * A numThreads of 0 uses every available thread.
+ */
+bool qm_image_decompress_blocks( PLImageFormat format, unsigned int width, unsigned int height, const void *blocks, void *dst, unsigned int numThreads )
+{
+	BlockType type;
+	if ( !get_block_type( format, &type ) )
+	{
+		PlReportErrorF( PL_RESULT_IMAGEFORMAT, "not a block compressed format" );
+		return false;
+	}
+
+	if ( width == 0 || height == 0 )
+	{
+		return true;
+	}
+
+	DecompressLevel level = { .src = blocks, .dst = dst, .width = width, .height = height };
+	decompress_levels( type, &level, 1, numThreads );
+
+	return true;
+}
+
+typedef struct TargetLevel
+{
+	uint8_t       **data;
+	DecompressLevel level;
+} TargetLevel;
+
+static void add_target_level( const QmImage *image, uint8_t **data, unsigned int level, TargetLevel *targets, unsigned int *numTargets )
+{
+	if ( *data == nullptr )
+	{
+		return;
+	}
+
+	targets[ ( *numTargets )++ ] = ( TargetLevel ){
+	        .data  = data,
+	        .level = {
+	                  .src    = *data,
+	                  .width  = QM_OS_MAX( image->width >> level, 1U ),
+	                  .height = QM_OS_MAX( image->height >> level, 1U ),
+	                  },
+	};
+}
+
+/**
+ * Decompresses every level, and frame, of the image into new RGBA8
+ * buffers, all in one go. On success the old data is freed.
+ */
+bool qm_image_decompress_levels_( QmImage *image, unsigned int numThreads )
+{
+	BlockType type;
+	if ( !get_block_type( image->format, &type ) )
+	{
+		PlReportErrorF( PL_RESULT_IMAGEFORMAT, "not a block compressed format" );
+		return false;
+	}
+
+	unsigned int numLevels = ( image->data != nullptr ) ? image->levels : 0;
+	for ( unsigned int i = 0; i < image->numFrames; ++i )
+	{
+		numLevels += image->frames[ i ].numMips;
+	}
+
+	TargetLevel *targets    = QM_OS_MEMORY_NEW_( TargetLevel, numLevels + 1 );
+	unsigned int numTargets = 0;
+	for ( unsigned int i = 0; image->data != nullptr && i < image->levels; ++i )
+	{
+		add_target_level( image, &image->data[ i ], i, targets, &numTargets );
+	}
+	for ( unsigned int i = 0; i < image->numFrames; ++i )
+	{
+		for ( unsigned int j = 0; j < image->frames[ i ].numMips; ++j )
+		{
+			add_target_level( image, ( uint8_t ** ) &image->frames[ i ].data[ j ], j, targets, &numTargets );
+		}
+	}
+
+	DecompressLevel *levels = QM_OS_MEMORY_NEW_( DecompressLevel, numTargets + 1 );
+	for ( unsigned int i = 0; i < numTargets; ++i )
+	{
+		DecompressLevel *level = &targets[ i ].level;
+		level->dst             = QM_OS_MEMORY_MALLOC_( ( size_t ) level->width * level->height * 4 );
+		if ( level->dst == nullptr )
+		{
+			for ( unsigned int j = 0; j < i; ++j )
+			{
+				qm_os_memory_free( targets[ j ].level.dst );
+			}
+			qm_os_memory_free( levels );
+			qm_os_memory_free( targets );
+
+			PlReportErrorF( PL_RESULT_MEMORY_ALLOCATION, "couldn't allocate memory for image data" );
+			return false;
+		}
+
+		levels[ i ] = *level;
+	}
+
+	decompress_levels( type, levels, numTargets, numThreads );
+
+	for ( unsigned int i = 0; i < numTargets; ++i )
+	{
+		qm_os_memory_free( *targets[ i ].data );
+		*targets[ i ].data = targets[ i ].level.dst;
+	}
+
+	qm_os_memory_free( levels );
+	qm_os_memory_free( targets );
+
+	image->format        = PL_IMAGEFORMAT_RGBA8;
+	image->colour_format = PL_COLOURFORMAT_RGBA;
+	image->size          = PlGetImageSize( image->format, image->width, image->height );
+
+	return true;
+}
+
+/**
+ * Returns a new RGBA8 copy of a block compressed image, with
+ * the whole mip chain decompressed in a single pass.
+ */
+QmImage *qm_image_decompress( const QmImage *image, unsigned int numThreads )
+{
+	BlockType type;
+	if ( !get_block_type( image->format, &type ) )
+	{
+		PlReportErrorF( PL_RESULT_IMAGEFORMAT, "not a block compressed format" );
+		return nullptr;
+	}
+
+	if ( image->data == nullptr || image->levels == 0 )
+	{
+		PlReportErrorF( PL_RESULT_IMAGEFORMAT, "image has no data to decompress" );
+		return nullptr;
+	}
+
+	QmImage *newImage       = QM_OS_MEMORY_NEW( QmImage );
+	*newImage               = *image;
+	newImage->frames        = nullptr;
+	newImage->numFrames     = 0;
+	newImage->format        = PL_IMAGEFORMAT_RGBA8;
+	newImage->colour_format = PL_COLOURFORMAT_RGBA;
+	newImage->size          = PlGetImageSize( newImage->format, newImage->width, newImage->height );
+	newImage->data          = QM_OS_MEMORY_NEW_( uint8_t *, image->levels );
+
+	DecompressLevel *levels    = QM_OS_MEMORY_NEW_( DecompressLevel, image->levels );
+	unsigned int     numActive = 0;
+	for ( unsigned int i = 0; i < image->levels; ++i )
+	{
+		if ( image->data[ i ] == nullptr )
+		{
+			continue;
+		}
+
+		unsigned int width  = QM_OS_MAX( image->width >> i, 1U );
+		unsigned int height = QM_OS_MAX( image->height >> i, 1U );
+
+		newImage->data[ i ] = QM_OS_MEMORY_MALLOC_( ( size_t ) width * height * 4 );
+		if ( newImage->data[ i ] == nullptr )
+		{
+			qm_os_memory_free( levels );
+			PlDestroyImage( newImage );
+
+			PlReportErrorF( PL_RESULT_MEMORY_ALLOCATION, "couldn't allocate memory for image data" );
+			return nullptr;
+		}
+
+		levels[ numActive++ ] = ( DecompressLevel ){ .src = image->data[ i ], .dst = newImage->data[ i ], .width = width, .height = height };
+	}
+
+	decompress_levels( type, levels, numActive, numThreads );
+
+	qm_os_memory_free( levels );
+
+	return newImage;
+}
+
+/* these predate threading, so callers may well be decoding several
+ * images at once themselves; stick to the calling thread */
+
+void PlBlockDecompressImageDXT1( unsigned int width, unsigned int height, const unsigned char *blockStorage, unsigned char *image )
+{
+	qm_image_decompress_blocks( PL_IMAGEFORMAT_RGBA_DXT1, width, height, blockStorage, image, 1 );
+}
+
+void PlBlockDecompressImageDXT3( unsigned int width, unsigned int height, const unsigned char *blockStorage, unsigned char *image )
+{
+	qm_image_decompress_blocks( PL_IMAGEFORMAT_RGBA_DXT3, width, height, blockStorage, image, 1 );
+}
+
+void PlBlockDecompressImageDXT5( unsigned int width, unsigned int height, const unsigned char *blockStorage, unsigned char *image )
+{
+	qm_image_decompress_blocks( PL_IMAGEFORMAT_RGBA_DXT5, width, height, blockStorage, image, 1 );
+}
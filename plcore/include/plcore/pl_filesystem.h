@@ -201,6 +201,13 @@ bool PlLocalPathExists( const char *path );
 bool PlPathExists( const char *path );
 
 void PlScanDirectory( const char *path, const char *extension, void ( *Function )( const char *, void * ), bool recursive, void *userData );
+void PlScanDirectoryEx( const char *path, const char *extension, void ( *Function )( const char *, void * ), bool recursive, unsigned int numThreads, void *userData );
+
+/**
+ * Collects the results of a scan into a null terminated array.
+ * The array is a single allocation; free it with qm_os_memory_free.
+ */
+char **PlScanDirectoryToArray( const char *path, const char *extension, bool recursive, unsigned int numThreads, unsigned int *numPaths );
 
 bool PlCreateDirectory( const char *path );
 bool PlCreatePath( const char *path );
@@ -227,6 +234,16 @@ QmFsFile *qm_fs_file_from_stdio( FILE *stdio, const char *source );
 
 QmFsFile *qm_fs_file_open_local( const char *path, bool cache );
 
+/**
+ * Maps the specified local file into memory, read-only. The data is
+ * paged in on demand and shared with any other process mapping the
+ * same file, so this is the preferred way to open very large files.
+ *
+ * @param path		Path to the file you want to open.
+ * @return			Returns handle to the file instance.
+ */
+QmFsFile *qm_fs_file_open_local_mapped( const char *path );
+
 /**
  * Opens the specified file via the VFS.
  *
@@ -236,8 +253,42 @@ QmFsFile *qm_fs_file_open_local( const char *path, bool cache );
  */
 QmFsFile *qm_fs_file_open( const char *path, bool cache );
 
+/**
+ * Opens the specified file via the VFS, mapping it into memory
+ * when it resides in a mounted directory. Files within packages
+ * are loaded as usual, or point into the package's mapping if
+ * it has one.
+ *
+ * @param path		Path to the file you want to open.
+ * @return			Returns handle to the file instance.
+ */
+QmFsFile *qm_fs_file_open_mapped( const char *path );
+
 void PlCloseFile( QmFsFile *ptr );
 
+#	define QM_FS_FILE_DEFAULT_BUFFER_SIZE 65536
+
+/**
+ * Sets the size of the read-ahead buffer given to files that are
+ * streamed from disk (i.e. opened without caching) from now on.
+ * Passing 0 disables buffering for any files opened afterwards.
+ *
+ * @param size	Size of the buffer in bytes.
+ */
+void qm_fs_set_default_buffer_size( size_t size );
+
+/**
+ * Changes the size of the read-ahead buffer for a streamed file.
+ * Small reads are then served from a block read in advance,
+ * rather than each going to stdio. Passing 0 disables it.
+ * Has no effect on files that are cached or mapped.
+ *
+ * @param self	Pointer to the file handle.
+ * @param size	Size of the buffer in bytes.
+ * @return		False if the file's position couldn't be restored.
+ */
+bool qm_fs_file_set_buffer_size( QmFsFile *self, size_t size );
+
 bool qm_fs_copy_file( const char *path, const char *dest );
 bool PlWriteFile( const char *path, const void *buf, size_t length );
 
@@ -290,6 +341,18 @@ int64_t qm_fs_file_get_offset( const QmFsFile *self );
 
 size_t qm_file_read( QmFsFile *ptr, void *dest, size_t size, size_t count );
 
+/**
+ * Reads from the given offset without using or moving the file's current
+ * position, so multiple threads can read from the same handle at once.
+ *
+ * @param self		Pointer to the file handle.
+ * @param dest		Buffer to read into.
+ * @param size		Number of bytes to read.
+ * @param offset	Offset into the file to start reading from.
+ * @return			Number of bytes read, which is short on error or at the end of the file.
+ */
+size_t qm_fs_file_read_at( QmFsFile *self, void *dest, size_t size, PLFileOffset offset );
+
 int8_t  qm_fs_file_read_int8( QmFsFile *self, bool *status );
 int16_t qm_fs_file_read_int16( QmFsFile *self, bool big_endian, bool *status );
 int32_t qm_fs_file_read_int32( QmFsFile *self, bool big_endian, bool *status );
@@ -303,6 +366,21 @@ int64_t qm_fs_file_read_int64( QmFsFile *self, bool big_endian, bool *status );
 float  qm_fs_file_read_float( QmFsFile *ptr, bool big_endian, bool *status );
 double qm_fs_file_read_double( QmFsFile *ptr, bool big_endian, bool *status );
 
+/**
+ * Reads an array of values in one go, converting the
+ * whole block from the given endianness afterwards.
+ *
+ * @param self			Pointer to the file handle.
+ * @param dest			Array to read into.
+ * @param count			Number of values to read.
+ * @param big_endian	Whether the values are stored as big endian.
+ * @return				Number of values read, short on error or at the end of the file.
+ */
+size_t qm_fs_file_read_int16_array( QmFsFile *self, int16_t *dest, size_t count, bool big_endian );
+size_t qm_fs_file_read_int32_array( QmFsFile *self, int32_t *dest, size_t count, bool big_endian );
+size_t qm_fs_file_read_int64_array( QmFsFile *self, int64_t *dest, size_t count, bool big_endian );
+size_t qm_fs_file_read_float_array( QmFsFile *self, float *dest, size_t count, bool big_endian );
+
 char *qm_fs_file_read_string( QmFsFile *ptr, char *str, size_t size );
 
 bool qm_fs_file_seek( QmFsFile *ptr, PLFileOffset pos, QmFsSeek seek );
@@ -321,11 +399,27 @@ QmFsMount *qm_fs_mount_location( const char *path );
 
 void PlClearMountedLocation( QmFsMount *location );
 
+/**
+ * Everything mounted is indexed up front, and paths are resolved from
+ * that alone, so changes made to a mounted directory afterwards aren't
+ * seen unless the mount is being watched, or this is called.
+ */
+void qm_fs_rescan_mounted_locations( void );
+
 /**
  * Clear all of the mounted locations
  */
 void qm_fs_clear_mounted_locations();
 
+/**
+ * In overlay mode, mounts are merged into a single view whenever they
+ * change, and lookups and scans are served from that alone. Earlier
+ * mounts sit above later ones, and can hide what's beneath them with
+ * '.wh.<name>' whiteouts, or a '.wh..wh..opq' marker for a directory.
+ */
+void qm_fs_set_overlay_enabled( bool enabled );
+bool qm_fs_is_overlay_enabled( void );
+
 QmFsMountType qm_fs_mount_get_type( const QmFsMount *self );
 const char   *qm_fs_mount_get_path( const QmFsMount *self );
 
@@ -340,9 +434,116 @@ QmFsMount *PlGetMountLocationForPath( const char *path );
 
 /****/
 
-void        PlClearFileAliases( void );
-void        PlAddFileAlias( const char *alias, const char *target );
-const char *PlGetPathForAlias( const char *alias );
+void         PlClearFileAliases( void );
+void         PlAddFileAlias( const char *alias, const char *target );
+const char  *PlGetPathForAlias( const char *alias );
+unsigned int PlGetNumFileAliases( void );
+unsigned int PlLoadFileAliases( const char *path );
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Asynchronous Loading
+// Requests are serviced by a pool of worker threads, created on the first request.
+// Mounts and aliases must not be changed while requests are in flight.
+/////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct QmFsRequest QmFsRequest;
+
+/**
+ * Called on a worker thread once the request has completed. The callback
+ * takes ownership of the file, which is null if the load failed.
+ */
+typedef void ( *QmFsRequestCallback )( const char *path, QmFsFile *file, void *userData );
+
+/**
+ * Queues up a batch of files to be loaded via the VFS. Requests for files
+ * that reside in the same package are coalesced into a single job, which
+ * reads them in the order they're stored.
+ *
+ * @param paths		Virtual paths of the files to load.
+ * @param numPaths	Number of paths.
+ * @param priority	Batches with a higher priority are serviced first.
+ * @param callback	Optional, called as each file completes.
+ * @param userData	Passed to the callback.
+ * @param requests	Optional, receives a request per path which must be released.
+ * @return			True if the batch was queued.
+ */
+bool qm_fs_request_files( const char **paths, unsigned int numPaths, int priority, QmFsRequestCallback callback, void *userData, QmFsRequest **requests );
+
+/**
+ * Queues up a single file to be loaded via the VFS.
+ * @return Request that must be released, otherwise null on fail.
+ */
+QmFsRequest *qm_fs_request_file( const char *path, int priority, QmFsRequestCallback callback, void *userData );
+
+bool qm_fs_request_is_done( const QmFsRequest *self );
+
+/**
+ * Blocks until the request has completed, and hands over the file.
+ * Returns null if the load failed, or if a callback took the file.
+ */
+QmFsFile *qm_fs_request_wait( QmFsRequest *self );
+
+/**
+ * Releases the request. It's safe to release a request that's still in flight.
+ */
+void qm_fs_request_release( QmFsRequest *self );
+
+/**
+ * Blocks until every queued request has completed.
+ */
+void qm_fs_request_flush( void );
+
+/**
+ * Completes any outstanding requests and destroys the worker pool.
+ */
+void qm_fs_request_shutdown( void );
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Change Notification
+// Directory mounts can be watched for changes, which are gathered up and
+// delivered to subscribers whenever qm_fs_watch_poll is called, so it's
+// safe to touch the VFS from within a callback. Only available on Linux.
+/////////////////////////////////////////////////////////////////////////////////////
+
+typedef enum QmFsWatchEventType
+{
+	QM_FS_WATCH_EVENT_NONE,
+	QM_FS_WATCH_EVENT_ADDED,
+	QM_FS_WATCH_EVENT_MODIFIED,
+	QM_FS_WATCH_EVENT_REMOVED,
+	QM_FS_WATCH_EVENT_OVERFLOW,// changes were missed, so anything may have changed
+} QmFsWatchEventType;
+
+typedef struct QmFsWatchEvent
+{
+	QmFsWatchEventType type;
+	const char        *path;// virtual path
+	QmFsMount         *mount;
+} QmFsWatchEvent;
+
+typedef struct QmFsWatch QmFsWatch;
+
+/**
+ * Called with every change under the subscribed prefix since the last
+ * poll. Changes are coalesced, so there's at most one event per path,
+ * and they describe what's seen through the VFS; i.e. a file changing
+ * in a mount that's overridden by another isn't reported.
+ */
+typedef void ( *QmFsWatchCallback )( const QmFsWatchEvent *events, unsigned int numEvents, void *userData );
+
+bool qm_fs_mount_watch( QmFsMount *mount );
+void qm_fs_mount_unwatch( QmFsMount *mount );
+
+QmFsWatch *qm_fs_watch_subscribe( const char *prefix, QmFsWatchCallback callback, void *userData );
+void       qm_fs_watch_unsubscribe( QmFsWatch *self );
+
+/**
+ * Picks up any pending changes, updates the VFS index to match,
+ * and passes them on to subscribers. Doesn't block.
+ * @return Number of changes picked up.
+ */
+unsigned int qm_fs_watch_poll( void );
+void         qm_fs_watch_shutdown( void );
 
 /////////////////////////////////////////////////////////////////////////////////////
 // New API
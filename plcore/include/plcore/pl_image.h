@@ -96,9 +96,38 @@ typedef enum PLImageFormat
 	PL_IMAGEFORMAT_RGBA_DXT3,
 	PL_IMAGEFORMAT_RGBA_DXT5,
 
-	PL_IMAGEFORMAT_RGB_FXT1
+	PL_IMAGEFORMAT_RGB_FXT1,
+
+	PL_IMAGEFORMAT_R_BC4,
+	PL_IMAGEFORMAT_RG_BC5,
+	PL_IMAGEFORMAT_RGBA_BC7,
 } PLImageFormat;
 
+/**
+ * Trades encoding speed for error when compressing into block formats.
+ */
+typedef enum QmImageCompressQuality
+{
+	QM_IMAGE_COMPRESS_QUALITY_FAST,  // bounding box endpoints, as is
+	QM_IMAGE_COMPRESS_QUALITY_NORMAL,// principal axis endpoints, refined once
+	QM_IMAGE_COMPRESS_QUALITY_HIGH,  // refined until it stops improving, and every mode tried
+} QmImageCompressQuality;
+
+/**
+ * Filters used to downsample each level of a mipmap chain.
+ */
+typedef enum QmImageMipmapFilter
+{
+	QM_IMAGE_MIPMAP_FILTER_BOX,    // 2x2 average, quickest
+	QM_IMAGE_MIPMAP_FILTER_KAISER, // kaiser windowed sinc, sharp with little ringing
+	QM_IMAGE_MIPMAP_FILTER_LANCZOS,// lanczos3, sharpest
+} QmImageMipmapFilter;
+
+enum
+{
+	QM_OS_BIT_FLAG( QM_IMAGE_MIPMAP_SRGB, 0 ),// colour is stored as sRGB, so filter it in linear space
+};
+
 /* todo: deprecate this */
 typedef enum PLColourFormat
 {
@@ -177,6 +206,8 @@ QmImage *qm_image_parse( QmFsFile *file );
 bool     qm_image_write( const QmImage *image, const char *path, unsigned int quality );
 
 bool PlConvertPixelFormat( QmImage *image, PLImageFormat new_format );
+bool qm_image_convert_pixels( const void *src, PLImageFormat srcFormat, void *dst, PLImageFormat dstFormat, size_t numPixels );
+bool qm_image_convert_to_buffer( const QmImage *image, unsigned int frame, unsigned int level, PLImageFormat newFormat, void *dst, size_t dstSize );
 
 void qm_image_invert_colour( QmImage *image );
 void PlClearImageAlpha( QmImage *image );
@@ -210,6 +241,14 @@ void PlBlockDecompressImageDXT1( unsigned int width, unsigned int height, const
 void PlBlockDecompressImageDXT3( unsigned int width, unsigned int height, const unsigned char *blockStorage, unsigned char *image );
 void PlBlockDecompressImageDXT5( unsigned int width, unsigned int height, const unsigned char *blockStorage, unsigned char *image );
 
+bool     qm_image_decompress_blocks( PLImageFormat format, unsigned int width, unsigned int height, const void *blocks, void *dst, unsigned int numThreads );
+QmImage *qm_image_decompress( const QmImage *image, unsigned int numThreads );
+
+bool qm_image_compress_pixels( const void *src, unsigned int width, unsigned int height, PLImageFormat format, void *dst, QmImageCompressQuality quality, unsigned int numThreads );
+bool qm_image_compress( QmImage *image, PLImageFormat format, QmImageCompressQuality quality, unsigned int numThreads );
+
+bool qm_image_generate_mipmaps( QmImage *image, QmImageMipmapFilter filter, unsigned int flags, float alphaCutoff, unsigned int numThreads );
+
 QmImage *qm_image_3df_parse( QmFsFile *file );
 QmImage *qm_image_ftx_parse( QmFsFile *file );
 QmImage *qm_image_tim_parse( QmFsFile *file );
@@ -223,6 +262,7 @@ QmImage *qm_image_angel_tex_parse( QmFsFile *file );
 QmImage *qm_image_dtx_parse( QmFsFile *file );
 
 bool qm_image_qoi_write( const QmImage *image, const char *path );
+bool qm_image_dds_write( const QmImage *image, const char *path );
 
 #endif
 
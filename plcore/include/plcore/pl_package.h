@@ -27,6 +27,14 @@ typedef struct QmFsPackage
 	struct
 	{
 		void *( *LoadFile )( QmFsFile *package, QmFsPackageFile *index );
+		bool ( *ResolveFile )( struct QmFsPackage *package, QmFsPackageFile *index );// fills in offsets the parser left unresolved
+		QmFsFile                *file;           // handle shared by every load, opened on first use
+		struct QmOsMutex        *fileMutex;      // guards opening and closing the shared handle
+		struct QmFsMapping      *mapping;        // set if the package has been mapped into memory
+		time_t                   timeStamp;      // of the package on disk
+		uint64_t                 cacheId;        // unique to this handle, identifies its entries in the cache
+		struct QmFsPackageIndex *index;          // for looking up entries by name
+		bool                     caseInsensitive;// names are matched regardless of case
 	} internal;
 } QmFsPackage;
 
@@ -67,10 +75,61 @@ QmFsPackage *PlCreatePackageHandle( const char *path, unsigned int tableSize, vo
 QmFsPackage *PlLoadPackage( const char *path );
 QmFsFile    *PlLoadPackageFile( QmFsPackage *package, const char *path );
 QmFsFile    *PlLoadPackageFileByIndex( QmFsPackage *package, unsigned int index );
+QmFsFile    *PlStreamPackageFile( QmFsPackage *package, const char *path );
+QmFsFile    *PlStreamPackageFileByIndex( QmFsPackage *package, unsigned int index );
 void         PlDestroyPackage( QmFsPackage *package );
 void         PlExtractPackage( QmFsPackage *package, const char *path );
 
+/**
+ * Invoked as each entry is extracted; return false to cancel.
+ */
+typedef bool ( *PLPackageExtractCallback )( const QmFsPackage *package, unsigned int index, bool status, unsigned int numDone, void *userData );
+
+enum
+{
+	QM_OS_BIT_FLAG( PL_PACKAGE_EXTRACT_ABORT_ON_ERROR, 0 ),// stop at the first failure, rather than skipping over it
+};
+
+unsigned int PlExtractPackageEx( QmFsPackage *package, const char *path, unsigned int numThreads, unsigned int flags, PLPackageExtractCallback callback, void *userData );
+
+bool PlMapPackage( QmFsPackage *package );
+void PlSetPackageMappingEnabled( bool enabled );
+
+typedef struct PLPackageCacheStats
+{
+	uint64_t     hits;
+	uint64_t     misses;
+	uint64_t     evictions;
+	unsigned int numEntries;
+	size_t       numBytes;
+} PLPackageCacheStats;
+
+/* compressed entries are kept around once decompressed,
+ * so loading them again doesn't need to inflate them */
+void                PlSetPackageCacheBudget( size_t numBytes );
+void                PlClearPackageCache( void );
+PLPackageCacheStats PlGetPackageCacheStats( void );
+
+/**
+ * Identifies a format by the bytes at the start of the file, so the
+ * right loader can be picked without having to attempt a full parse.
+ */
+typedef struct PLPackageSignature
+{
+	unsigned int offset;     // where the magic resides
+	unsigned int length;     // number of bytes to compare, 0 if there's no signature
+	const char  *magic[ 2 ]; // either of which identifies the format
+	size_t       minSize;    // smallest the file could be
+} PLPackageSignature;
+
+/* parsed tables are written out to the given directory, and pulled
+ * back in on the next load if the package hasn't changed since */
+void        PlSetPackageSnapshotDirectory( const char *path );
+const char *PlGetPackageSnapshotDirectory( void );
+void        PlDeletePackageSnapshot( const char *path );
+
 void         PlRegisterPackageLoader( const char *ext, QmFsPackage *( *LoadFunction )( const char *path ), QmFsPackage *( *ParseFunction )( QmFsFile * ) );
+void         PlRegisterPackageLoaderEx( const char *ext, QmFsPackage *( *LoadFunction )( const char *path ), QmFsPackage *( *ParseFunction )( QmFsFile * ), const PLPackageSignature *signature );
 void         PlRegisterStandardPackageLoaders( unsigned int flags );
 void         PlClearPackageLoaders( void );
 const char **PlGetSupportedPackageFormats( unsigned int *numElements );
@@ -79,6 +138,12 @@ const char  *PlGetPackagePath( const QmFsPackage *package );
 unsigned int PlGetPackageTableSize( const QmFsPackage *package );
 int          PlGetPackageTableIndex( const QmFsPackage *package, const char *indexName );
 
+void PlSetPackageCaseInsensitive( QmFsPackage *package, bool caseInsensitive );
+
+typedef void ( *PLPackageEnumerateCallback )( const QmFsPackage *package, unsigned int index, void *userData );
+
+unsigned int PlEnumeratePackageFiles( const QmFsPackage *package, const char *prefix, PLPackageEnumerateCallback callback, void *userData );
+
 const char *PlGetPackageFileName( const QmFsPackage *package, unsigned int index );
 
 QmFsPackage *PlLoadZipPackage( const char *path );
@@ -87,26 +152,30 @@ QmFsPackage *PlParseZipPackage( QmFsFile *file );
 QmFsPackage *PlParseVppPackage( QmFsFile *file );
 QmFsPackage *PlParseVenomPakPackage( QmFsFile *file );
 
-#if 0// Write API - excluded for now...
+/////////////////////////////////////////////////////////////////////////////////////
+// Write API
+/////////////////////////////////////////////////////////////////////////////////////
 
-enum {
+enum
+{
 	PL_PACKAGE_WRITE_FORMAT_ALL = 0,
 
-	PL_BITFLAG( PL_PACKAGE_WRITE_FORMAT_BIN_FRESH, 0 ),
+	QM_OS_BIT_FLAG( PL_PACKAGE_WRITE_FORMAT_ZIP, 0 ),
+	QM_OS_BIT_FLAG( PL_PACKAGE_WRITE_FORMAT_PAK_QUAKE, 1 ),
 };
 
-#	define PL_PACKAGE_FORMAT_TAG_BIN_FRESH "fresh.bin"
+#define PL_PACKAGE_FORMAT_TAG_ZIP       "zip"
+#define PL_PACKAGE_FORMAT_TAG_PAK_QUAKE "pak"
 
-#	define PL_PACKAGE_WRITE_ENABLED
+#define PL_PACKAGE_WRITE_ENABLED
 
 typedef bool ( *PLWritePackageFunction )( QmFsPackage *package, const char *path );
 
-void PlRegisterPackageWriter( const char *formatTag, PLWritePackageFunction writeFunction );
-void PlRegisterStandardPackageWriters( unsigned int flags );
-void PlClearPackageWriters( void );
+void             PlRegisterPackageWriter( const char *formatTag, PLWritePackageFunction writeFunction );
+void             PlRegisterStandardPackageWriters( unsigned int flags );
+void             PlClearPackageWriters( void );
+void             PlSetPackageWriterThreads( unsigned int numThreads );
 QmFsPackageFile *PlAppendPackageFromFile( QmFsPackage *package, const char *source, const char *filename, PLCompressionType compressionType );
-bool PlWritePackage( QmFsPackage *package, const char *path, const char *formatTag );
-
-#endif
+bool             PlWritePackage( QmFsPackage *package, const char *path, const char *formatTag );
 
 PL_EXTERN_C_END
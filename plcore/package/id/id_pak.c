@@ -5,6 +5,7 @@
 #include "../package_private.h"
 
 #include "qmos/public/qm_os.h"
+#include "qmos/public/qm_os_memory.h"
 
 #define PAK_MAGIC QM_OS_MAGIC_TO_NUM( 'P', 'A', 'C', 'K' )
 
@@ -26,7 +27,7 @@ QmFsPackage *PlParsePakPackage_( QmFsFile *file ) {
 	}
 
 	uint32_t tocSize = qm_fs_file_read_int32( file, false, NULL );
-	if ( tocSize == 0 || tocSize + tocOffset >= fileSize ) {
+	if ( tocSize == 0 || tocSize + tocOffset > fileSize ) {
 		PlReportErrorF( PL_RESULT_FILEERR, "invalid table size: %u\n", tocSize );
 		return NULL;
 	}
@@ -45,3 +46,93 @@ QmFsPackage *PlParsePakPackage_( QmFsFile *file ) {
 
 	return package;
 }
+
+/****************************************
+ * Writer
+ ****************************************/
+
+typedef struct PakWriter {
+	FILE *fp;
+	uint32_t offset;
+	uint8_t *table;
+} PakWriter;
+
+static void PutPak32( uint8_t *p, uint32_t v ) {
+	p[ 0 ] = ( uint8_t ) v;
+	p[ 1 ] = ( uint8_t ) ( v >> 8 );
+	p[ 2 ] = ( uint8_t ) ( v >> 16 );
+	p[ 3 ] = ( uint8_t ) ( v >> 24 );
+}
+
+static bool WritePakEntry( QmFsPackage *package, unsigned int index, const QmFsPackageWriteEntry *entry, void *userData ) {
+	PakWriter *writer = userData;
+
+	const char *name = package->files[ index ].name;
+	if ( strlen( name ) >= PAK_INDEX_FILENAME_LENGTH ) {
+		PlReportErrorF( PL_RESULT_FILEPATH, "name is too long for pak (%s)", name );
+		return false;
+	}
+
+	if ( entry->size > INT32_MAX - writer->offset ) {
+		PlReportErrorF( PL_RESULT_FILESIZE, "pak is too large" );
+		return false;
+	}
+
+	uint8_t *p = &writer->table[ index * PAK_INDEX_LENGTH ];
+	strncpy( ( char * ) p, name, PAK_INDEX_FILENAME_LENGTH );
+	PutPak32( p + PAK_INDEX_FILENAME_LENGTH, writer->offset );
+	PutPak32( p + PAK_INDEX_FILENAME_LENGTH + 4, ( uint32_t ) entry->size );
+
+	if ( fwrite( entry->data, 1, entry->size, writer->fp ) != entry->size ) {
+		PlReportErrorF( PL_RESULT_FILEWRITE, "failed to write to pak" );
+		return false;
+	}
+
+	writer->offset += ( uint32_t ) entry->size;
+	return true;
+}
+
+/**
+ * Writes the package out as a Quake PAK. The format has no
+ * support for compression, so everything is stored.
+ */
+bool PlWritePakPackage_( QmFsPackage *package, const char *path ) {
+	PakWriter writer = {};
+	writer.fp = fopen( path, "wb" );
+	if ( writer.fp == NULL ) {
+		PlReportErrorF( PL_RESULT_FILEWRITE, "failed to open %s", path );
+		return false;
+	}
+
+	/* header is filled in once we know where the table ends up */
+	uint8_t header[ 12 ] = {};
+	bool status = ( fwrite( header, 1, sizeof( header ), writer.fp ) == sizeof( header ) );
+
+	size_t tableSize = ( size_t ) package->numFiles * PAK_INDEX_LENGTH;
+	writer.table = QM_OS_MEMORY_NEW_( uint8_t, tableSize + 1 );
+	writer.offset = sizeof( header );
+
+	status = status && qm_fs_package_write_entries_( package, false, WritePakEntry, &writer );
+	if ( status && tableSize > INT32_MAX - writer.offset ) {
+		PlReportErrorF( PL_RESULT_FILESIZE, "pak is too large" );
+		status = false;
+	}
+
+	if ( status ) {
+		PutPak32( header, PAK_MAGIC );
+		PutPak32( header + 4, writer.offset );
+		PutPak32( header + 8, ( uint32_t ) tableSize );
+
+		status = fwrite( writer.table, 1, tableSize, writer.fp ) == tableSize &&
+		         fseek( writer.fp, 0, SEEK_SET ) == 0 &&
+		         fwrite( header, 1, sizeof( header ), writer.fp ) == sizeof( header );
+		if ( !status ) {
+			PlReportErrorF( PL_RESULT_FILEWRITE, "failed to write to pak" );
+		}
+	}
+
+	qm_os_memory_free( writer.table );
+	qm_fs_fclose( &writer.fp );
+
+	return status;
+}
@@ -10,6 +10,11 @@
 #include "../3rdparty/blast/blast.h"
 #include "qmos/public/qm_os_memory.h"
 #include "qmos/public/qm_os_string.h"
+#include "qmos/public/qm_os_thread.h"
+
+#include <plcore/pl_hashtable.h>
+
+#include <stdatomic.h>
 
 /****************************************
  * Generic Loader
@@ -68,6 +73,88 @@ static int Inflate( unsigned char *dst, uint32_t *dstLength, const unsigned char
 	return mz_inflateEnd( &stream );
 }
 
+/**
+ * Decompresses the given package entry from the source buffer,
+ * returning a newly allocated buffer on success.
+ */
+static void *DecompressPackageFile( const uint8_t *src, const QmFsPackageFile *pi )
+{
+	switch ( pi->compressionType )
+	{
+		default:
+		{
+			PlReportErrorF( PL_RESULT_UNSUPPORTED, "unsupported compression type for packages" );
+			return nullptr;
+		}
+		case PL_COMPRESSION_DEFLATE:
+		case PL_COMPRESSION_GZIP:
+		{
+			uint8_t *decompressedPtr    = QM_OS_MEMORY_NEW_( uint8_t, pi->size );
+			uint32_t uncompressedLength = ( uint32_t ) pi->size;
+			int      status             = Inflate( decompressedPtr, &uncompressedLength, src, ( unsigned long ) pi->compressedSize, ( pi->compressionType == PL_COMPRESSION_GZIP ) );
+			if ( status != Z_OK )
+			{
+				qm_os_memory_free( decompressedPtr );
+				PlReportErrorF( PL_RESULT_FILEERR, "failed to decompress buffer (%s)", zError( status ) );
+				return nullptr;
+			}
+
+			return decompressedPtr;
+		}
+		case PL_COMPRESSION_IMPLODE:
+		{
+			uint8_t *decompressedPtr    = QM_OS_MEMORY_NEW_( uint8_t, pi->size );
+			uint32_t uncompressedLength = ( uint32_t ) pi->size;
+			BlstUser in                 = {
+			                                 .buffer = ( uint8_t * ) src,
+			                                 .length = ( unsigned int ) pi->compressedSize,
+                         },
+			         out = {
+			                 .buffer    = decompressedPtr,
+			                 .length    = 0,
+			                 .maxLength = uncompressedLength,
+			         };
+			int status = blast( BlstCbIn, &in, BlstCbOut, &out, nullptr, nullptr );
+			if ( status != 0 )
+			{
+				const char *errmsg;
+				switch ( status )
+				{
+					case 2:
+						errmsg = "ran out of input before completing decompression";
+						break;
+					case 1:
+						errmsg = "output error before completing decompression";
+						break;
+					case -1:
+						errmsg = "literal flag not zero or one";
+						break;
+					case -2:
+						errmsg = "dictionary size not in 4..6";
+						break;
+					case -3:
+						errmsg = "distance is too far back";
+						break;
+					default:
+						errmsg = "unknown error when decompressing buffer";
+						break;
+				}
+
+				qm_os_memory_free( decompressedPtr );
+				PlReportErrorF( PL_RESULT_FILEREAD, "%s (%d)", errmsg, status );
+				return nullptr;
+			}
+
+			return decompressedPtr;
+		}
+		case PL_COMPRESSION_LZRW1:
+		{
+			size_t uncompressedLength = pi->size;
+			return PlDecompress_LZRW1( src, pi->compressedSize, &uncompressedLength );
+		}
+	}
+}
+
 /**
  * Generic loader for package files, since this is unlikely to change
  * in most cases.
@@ -76,104 +163,72 @@ static void *LoadGenericPackageFile( QmFsFile *fh, QmFsPackageFile *pi )
 {
 	FunctionStart();
 
-	if ( !qm_fs_file_seek( fh, pi->offset, QM_FS_SEEK_SET ) )
+	/* the handle is shared, so read without touching its position */
+	size_t   size    = ( pi->compressionType != PL_COMPRESSION_NONE ) ? pi->compressedSize : pi->size;
+	uint8_t *dataPtr = QM_OS_MEMORY_NEW_( uint8_t, size );
+	if ( qm_fs_file_read_at( fh, dataPtr, size, ( PLFileOffset ) pi->offset ) != size )
 	{
+		qm_os_memory_free( dataPtr );
 		return nullptr;
 	}
 
-	size_t   size    = ( pi->compressionType != PL_COMPRESSION_NONE ) ? pi->compressedSize : pi->size;
-	uint8_t *dataPtr = QM_OS_MEMORY_NEW_( uint8_t, size );
-	if ( qm_file_read( fh, dataPtr, sizeof( uint8_t ), size ) != size )
+	if ( pi->compressionType == PL_COMPRESSION_NONE )
 	{
-		qm_os_memory_free( dataPtr );
+		return dataPtr;
+	}
+
+	void *decompressedPtr = DecompressPackageFile( dataPtr, pi );
+	qm_os_memory_free( dataPtr );
+
+	return decompressedPtr;
+}
+
+/**
+ * Fetches where the raw data for an entry sits within the
+ * package's mapping, ensuring it doesn't run off the end.
+ */
+static const uint8_t *GetMappedPackageFileData( const QmFsPackage *package, const QmFsPackageFile *pi )
+{
+	size_t size = ( pi->compressionType != PL_COMPRESSION_NONE ) ? pi->compressedSize : pi->size;
+	if ( pi->offset > qm_fs_mapping_get_size( package->internal.mapping ) ||
+	     size > qm_fs_mapping_get_size( package->internal.mapping ) - pi->offset )
+	{
+		PlReportErrorF( PL_RESULT_FILESIZE, "entry lies outside of package (%s)", pi->name );
 		return nullptr;
 	}
 
-	if ( pi->compressionType != PL_COMPRESSION_NONE )
+	return ( const uint8_t * ) qm_fs_mapping_get_data( package->internal.mapping ) + pi->offset;
+}
+
+/**
+ * Loads an entry from a mapped package. Stored entries point
+ * straight into the mapping, and hold a reference on it so they
+ * can outlive the package.
+ */
+static QmFsFile *LoadMappedPackageFile( QmFsPackage *package, unsigned int index )
+{
+	FunctionStart();
+
+	const QmFsPackageFile *pi = &package->files[ index ];
+
+	const uint8_t *src = GetMappedPackageFileData( package, pi );
+	if ( src == nullptr )
 	{
-		switch ( pi->compressionType )
-		{
-			default:
-			{
-				PlReportErrorF( PL_RESULT_UNSUPPORTED, "unsupported compression type for packages" );
-				qm_os_memory_free( dataPtr );
-				return nullptr;
-			}
-			case PL_COMPRESSION_DEFLATE:
-			case PL_COMPRESSION_GZIP:
-			{
-				uint8_t *decompressedPtr    = QM_OS_MEMORY_NEW_( uint8_t, pi->size );
-				uint32_t uncompressedLength = ( uint32_t ) pi->size;
-				int      status             = Inflate( decompressedPtr, &uncompressedLength, dataPtr, ( unsigned long ) pi->compressedSize, ( pi->compressionType == PL_COMPRESSION_GZIP ) );
-				qm_os_memory_free( dataPtr );
-				dataPtr = decompressedPtr;
-				if ( status != Z_OK )
-				{
-					qm_os_memory_free( dataPtr );
-					PlReportErrorF( PL_RESULT_FILEERR, "failed to decompress buffer (%s)", zError( status ) );
-					return nullptr;
-				}
-				break;
-			}
-			case PL_COMPRESSION_IMPLODE:
-			{
-				uint8_t *decompressedPtr    = QM_OS_MEMORY_NEW_( uint8_t, pi->size );
-				uint32_t uncompressedLength = ( uint32_t ) pi->size;
-				BlstUser in                 = {
-				                                 .buffer = dataPtr,
-				                                 .length = ( unsigned int ) size,
-                         },
-				         out = {
-				                 .buffer    = decompressedPtr,
-				                 .length    = 0,
-				                 .maxLength = uncompressedLength,
-				         };
-				int status = blast( BlstCbIn, &in, BlstCbOut, &out, nullptr, nullptr );
-				qm_os_memory_free( dataPtr );
-				dataPtr = decompressedPtr;
-				if ( status != 0 )
-				{
-					const char *errmsg;
-					switch ( status )
-					{
-						case 2:
-							errmsg = "ran out of input before completing decompression";
-							break;
-						case 1:
-							errmsg = "output error before completing decompression";
-							break;
-						case -1:
-							errmsg = "literal flag not zero or one";
-							break;
-						case -2:
-							errmsg = "dictionary size not in 4..6";
-							break;
-						case -3:
-							errmsg = "distance is too far back";
-							break;
-						default:
-							errmsg = "unknown error when decompressing buffer";
-							break;
-					}
-
-					qm_os_memory_free( dataPtr );
-					PlReportErrorF( PL_RESULT_FILEREAD, "%s (%d)", errmsg, status );
-					return nullptr;
-				}
-				break;
-			}
-			case PL_COMPRESSION_LZRW1:
-			{
-				size_t uncompressedLength = pi->size;
-				void  *decompressedPtr    = PlDecompress_LZRW1( dataPtr, pi->compressedSize, &uncompressedLength );
-				qm_os_memory_free( dataPtr );
-				dataPtr = decompressedPtr;
-				break;
-			}
-		}
+		return nullptr;
+	}
+
+	if ( pi->compressionType == PL_COMPRESSION_NONE )
+	{
+		return qm_fs_file_from_mapping( pi->name, package->internal.mapping, ( size_t ) pi->offset, pi->size );
+	}
+
+	void *dataPtr = DecompressPackageFile( src, pi );
+	if ( dataPtr == nullptr )
+	{
+		return nullptr;
 	}
 
-	return dataPtr;
+	return qm_fs_package_cache_insert_( package, index, dataPtr );
 }
 
 /****************************************
@@ -197,6 +252,8 @@ QmFsPackage *PlCreatePackageHandle( const char *path, unsigned int tableSize, vo
 
 	package->numFiles = package->maxFiles = tableSize;
 	package->files                              = QM_OS_MEMORY_NEW_( QmFsPackageFile, tableSize );
+	package->internal.fileMutex                 = qm_os_mutex_create();
+	package->internal.cacheId                   = qm_fs_package_cache_generate_id_();
 
 	package->path = qm_os_string_alloc( "%s", path );
 
@@ -212,6 +269,13 @@ void PlDestroyPackage( QmFsPackage *package )
 		return;
 	}
 
+	qm_fs_package_cache_forget_( package );
+
+	PlCloseFile( package->internal.file );
+	qm_os_memory_free( package->internal.fileMutex );
+	qm_fs_mapping_release( package->internal.mapping );
+	qm_fs_package_destroy_index_( package );
+
 	qm_os_memory_free( package->files );
 	qm_os_memory_free( package->path );
 	qm_os_memory_free( package );
@@ -222,47 +286,286 @@ void plWritePackage(QmFsPackage *package) {
 }
 #endif
 
-void PlExtractPackage( QmFsPackage *package, const char *path )
+/****************************************
+ * Extraction
+ ****************************************/
+
+/* entries at least this large are streamed out in chunks,
+ * rather than being held in memory all at once */
+#define EXTRACT_STREAM_THRESHOLD ( 16U * 1024U * 1024U )
+#define EXTRACT_CHUNK_SIZE       ( 256U * 1024U )
+
+typedef struct PackageExtractor
+{
+	QmFsPackage                 *package;
+	const char                  *path;
+	unsigned int                 flags;
+	PLPackageExtractCallback     callback;
+	void                        *userData;
+
+	atomic_uint next;// next entry to be picked up
+	atomic_bool cancelled;
+
+	QmOsMutex   *mutex;// serialises the callback
+	unsigned int numDone;
+	unsigned int numExtracted;
+} PackageExtractor;
+
+static void GetExtractPath( const PackageExtractor *self, const char *name, char *dst, size_t dstSize )
+{
+	snprintf( dst, dstSize, PlPathEndsInSlash( self->path ) ? "%s%s" : "%s/%s", self->path, name );
+}
+
+/**
+ * Creates each unique directory up front, so the
+ * workers needn't walk the same paths repeatedly.
+ */
+static bool CreateExtractDirectories( const PackageExtractor *self )
 {
-	for ( unsigned int i = 0; i < package->numFiles; ++i )
+	bool abortOnError = ( self->flags & PL_PACKAGE_EXTRACT_ABORT_ON_ERROR );
+
+	bool status = PlCreatePath( self->path );
+	if ( !status && abortOnError )
 	{
-		/* create the file dir first */
-		PLPath subPath;
-		snprintf( subPath, sizeof( subPath ), "%s", package->files[ i ].name );
-		unsigned int l = ( unsigned int ) strlen( subPath );
-		for ( unsigned int j = l; j > 0; --j )
+		return false;
+	}
+
+	PLHashTable *created = PlCreateHashTable();
+
+	for ( unsigned int i = 0; i < self->package->numFiles; ++i )
+	{
+		const char *name  = self->package->files[ i ].name;
+		const char *slash = nullptr;
+		for ( const char *c = name; *c != '\0'; ++c )
 		{
-			if ( subPath[ j ] != '\\' && subPath[ j ] != '/' )
-				continue;
+			if ( *c == '\\' || *c == '/' )
+			{
+				slash = c;
+			}
+		}
 
-			subPath[ j ] = '\0';
-			break;
+		if ( slash == nullptr )
+		{
+			continue;
+		}
+
+		size_t length = ( size_t ) ( slash - name );
+		if ( PlLookupHashTableUserData( created, name, length ) != nullptr )
+		{
+			continue;
 		}
+
+		PLPath subPath;
+		snprintf( subPath, sizeof( subPath ), "%.*s", ( int ) length, name );
+
 		PLPath writePath;
-		snprintf( writePath, sizeof( writePath ), PlPathEndsInSlash( path ) ? "%s%s" : "%s/%s", path, subPath );
+		GetExtractPath( self, subPath, writePath, sizeof( writePath ) );
+		/* otherwise, anything in there will just fail to be written */
 		if ( !PlCreatePath( writePath ) )
 		{
-			//FSLog( "Failed to create path: %s\n", PlGetError() );
-			continue;
+			status = false;
+			if ( abortOnError )
+			{
+				break;
+			}
 		}
 
-		QmFsFile *file = PlLoadPackageFileByIndex( package, i );
-		if ( file == nullptr )
+		PlInsertHashTableNode( created, name, length, ( void * ) name );
+	}
+
+	PlDestroyHashTable( created );
+
+	return status;
+}
+
+static bool WriteExtractedStream( QmFsFile *file, const char *path )
+{
+	FILE *fp = fopen( path, "wb" );
+	if ( fp == nullptr )
+	{
+		PlReportErrorF( PL_RESULT_FILEWRITE, "failed to open %s", path );
+		return false;
+	}
+
+	uint8_t *chunk  = QM_OS_MEMORY_NEW_( uint8_t, EXTRACT_CHUNK_SIZE );
+	bool     status = true;
+
+	size_t remaining = qm_fs_file_get_size( file );
+	while ( remaining > 0 )
+	{
+		size_t size = qm_file_read( file, chunk, 1, QM_OS_MIN( remaining, ( size_t ) EXTRACT_CHUNK_SIZE ) );
+		if ( size == 0 )
 		{
-			//FSLog( "Failed to load package file: %s\n", PlGetError() );
-			continue;
+			PlReportErrorF( PL_RESULT_FILEREAD, "failed to read %s", qm_fs_file_get_path( file ) );
+			status = false;
+			break;
 		}
-		const void *p = qm_fs_file_get_data( file );
 
-		/* now write it out */
-		snprintf( writePath, sizeof( writePath ), PlPathEndsInSlash( path ) ? "%s%s" : "%s/%s", path, package->files[ i ].name );
-		if ( !PlWriteFile( writePath, p, package->files[ i ].size ) )
+		if ( fwrite( chunk, 1, size, fp ) != size )
+		{
+			PlReportErrorF( PL_RESULT_FILEWRITE, "failed to write entirety of file" );
+			status = false;
+			break;
+		}
+
+		remaining -= size;
+	}
+
+	qm_os_memory_free( chunk );
+	qm_fs_fclose( &fp );
+
+	return status;
+}
+
+/**
+ * Large entries are streamed out, and everything else is decompressed
+ * in one go. Neither goes via the cache, as we won't be back for them.
+ */
+static bool ExtractPackageFile( PackageExtractor *self, unsigned int index )
+{
+	QmFsPackage           *package = self->package;
+	const QmFsPackageFile *pi      = &package->files[ index ];
+
+	PLPath writePath;
+	GetExtractPath( self, pi->name, writePath, sizeof( writePath ) );
+
+	if ( pi->compressionType == PL_COMPRESSION_NONE || pi->size >= EXTRACT_STREAM_THRESHOLD )
+	{
+		QmFsFile *file = ( pi->size >= EXTRACT_STREAM_THRESHOLD ) ? PlStreamPackageFileByIndex( package, index )
+		                                                          : PlLoadPackageFileByIndex( package, index );
+		if ( file == nullptr )
 		{
-			//FSLog( "Failed to write package file: %s\n", PlGetError() );
+			return false;
 		}
 
+		const void *data   = qm_fs_file_get_data( file );
+		bool        status = ( data != nullptr ) ? PlWriteFile( writePath, data, pi->size )
+		                                         : WriteExtractedStream( file, writePath );
+
 		PlCloseFile( file );
+
+		return status;
+	}
+
+	if ( !qm_fs_package_resolve_file_( package, index ) )
+	{
+		return false;
 	}
+
+	void *data;
+	if ( package->internal.mapping != nullptr )
+	{
+		const uint8_t *src = GetMappedPackageFileData( package, pi );
+		data               = ( src != nullptr ) ? DecompressPackageFile( src, pi ) : nullptr;
+	}
+	else
+	{
+		data = package->internal.LoadFile( package->internal.file, &package->files[ index ] );
+	}
+
+	if ( data == nullptr )
+	{
+		return false;
+	}
+
+	bool status = PlWriteFile( writePath, data, pi->size );
+	qm_os_memory_free( data );
+
+	return status;
+}
+
+static void ExtractPackageJob( void *userData )
+{
+	PackageExtractor *self = userData;
+
+	unsigned int index;
+	while ( !atomic_load( &self->cancelled ) && ( index = atomic_fetch_add( &self->next, 1 ) ) < self->package->numFiles )
+	{
+		bool status = ExtractPackageFile( self, index );
+
+		qm_os_mutex_lock( self->mutex );
+
+		self->numDone++;
+		if ( status )
+		{
+			self->numExtracted++;
+		}
+		else if ( self->flags & PL_PACKAGE_EXTRACT_ABORT_ON_ERROR )
+		{
+			atomic_store( &self->cancelled, true );
+		}
+
+		if ( self->callback != nullptr && !atomic_load( &self->cancelled ) &&
+		     !self->callback( self->package, index, status, self->numDone, self->userData ) )
+		{
+			atomic_store( &self->cancelled, true );
+		}
+
+		qm_os_mutex_unlock( self->mutex );
+	}
+}
+
+/**
+ * Extracts every entry in the package to the given location, spread
+ * across the requested number of threads (0 to use as many as are
+ * available). The callback is invoked after each entry, one at a
+ * time but from any thread, and returning false cancels anything
+ * that hasn't been started yet. Entries that fail are skipped over,
+ * unless PL_PACKAGE_EXTRACT_ABORT_ON_ERROR is set, in which case the
+ * first failure cancels the rest.
+ * Returns the number of entries successfully written out.
+ */
+unsigned int PlExtractPackageEx( QmFsPackage *package, const char *path, unsigned int numThreads, unsigned int flags, PLPackageExtractCallback callback, void *userData )
+{
+	PackageExtractor self = {
+	        .package  = package,
+	        .path     = path,
+	        .flags    = flags,
+	        .callback = callback,
+	        .userData = userData,
+	};
+
+	if ( !CreateExtractDirectories( &self ) && ( flags & PL_PACKAGE_EXTRACT_ABORT_ON_ERROR ) )
+	{
+		return 0;
+	}
+
+	if ( !qm_fs_package_open_handle_( package ) )
+	{
+		return 0;
+	}
+
+	if ( numThreads == 0 )
+	{
+		numThreads = qm_os_thread_get_available();
+	}
+
+	/* custom loaders read via the shared handle's cursor */
+	if ( package->internal.LoadFile != LoadGenericPackageFile )
+	{
+		numThreads = 1;
+	}
+
+	numThreads = QM_OS_MAX( QM_OS_MIN( numThreads, package->numFiles ), 1U );
+
+	self.mutex = qm_os_mutex_create();
+	atomic_init( &self.next, 0 );
+	atomic_init( &self.cancelled, false );
+
+	QmWorkerGroup *group = qm_worker_group_start_( ExtractPackageJob, &self, numThreads - 1 );
+
+	ExtractPackageJob( &self );
+
+	qm_worker_group_wait_( group );
+
+	qm_os_memory_free( self.mutex );
+
+	return self.numExtracted;
+}
+
+void PlExtractPackage( QmFsPackage *package, const char *path )
+{
+	PlExtractPackageEx( package, path, 1, 0, nullptr, nullptr );
 }
 
 /////////////////////////////////////////////////////////////
@@ -272,14 +575,27 @@ typedef struct PLPackageLoader
 	const char *ext;
 	QmFsPackage *( *LoadFunction )( const char *path );
 	QmFsPackage *( *ParseFunction )( QmFsFile *file );
+	PLPackageSignature signature;
 } PLPackageLoader;
 
+/* amount read from the start of a file to identify it */
+#define PACKAGE_PROBE_SIZE 4096
+
 static PLPackageLoader package_loaders[ MAX_OBJECT_INTERFACES ] = {};
 static unsigned int    num_package_loaders                      = 0;
 
+static bool mapPackages = false;
+
 void PlInitPackageSubSystem( void )
 {
 	PlClearPackageLoaders();
+	qm_fs_package_cache_initialize_();
+}
+
+void PlShutdownPackageSubSystem( void )
+{
+	PlClearPackageWriters();
+	qm_fs_package_cache_shutdown_();
 }
 
 /**
@@ -306,10 +622,30 @@ void PlClearPackageLoaders( void )
 
 void PlRegisterPackageLoader( const char *ext, QmFsPackage *( *LoadFunction )( const char * ), QmFsPackage *( *ParseFunction )( QmFsFile * ) )
 {
-	package_loaders[ num_package_loaders ].ext           = ext;
-	package_loaders[ num_package_loaders ].LoadFunction  = LoadFunction;
-	package_loaders[ num_package_loaders ].ParseFunction = ParseFunction;
-	num_package_loaders++;
+	PlRegisterPackageLoaderEx( ext, LoadFunction, ParseFunction, nullptr );
+}
+
+/**
+ * Registers a loader along with the signature that identifies its format.
+ * Files matching the signature are handed straight to the parser, even if
+ * they don't have the expected extension. Those that don't match are only
+ * passed to it if they have the expected extension, once everything else
+ * has been tried, as the parser may know better. Loaders without a
+ * signature are tried in turn by extension, as before.
+ */
+void PlRegisterPackageLoaderEx( const char *ext, QmFsPackage *( *LoadFunction )( const char * ), QmFsPackage *( *ParseFunction )( QmFsFile * ), const PLPackageSignature *signature )
+{
+	if ( num_package_loaders >= MAX_OBJECT_INTERFACES )
+	{
+		PlReportErrorF( PL_RESULT_MEMORY_EOA, "too many package loaders registered" );
+		return;
+	}
+
+	PLPackageLoader *loader = &package_loaders[ num_package_loaders++ ];
+	loader->ext             = ext;
+	loader->LoadFunction    = LoadFunction;
+	loader->ParseFunction   = ParseFunction;
+	loader->signature       = ( signature != nullptr ) ? *signature : ( PLPackageSignature ) {};
 }
 
 void PlRegisterStandardPackageLoaders( unsigned int flags )
@@ -319,43 +655,52 @@ void PlRegisterStandardPackageLoaders( unsigned int flags )
 		unsigned int flag;
 		const char  *extension;
 		QmFsPackage *( *parseFunction )( QmFsFile *file );
+		PLPackageSignature signature;
 	} PackageLoader;
 
+	/* offset, length, magic(s), minimum size; a zip starting with its end
+	 * record is empty, which the parser accepts as such */
+#define ZIP_SIGNATURE   { 0, 4, { "PK\3\4", "PK\5\6" }, 22 }
+#define VENOM_SIGNATURE { 0, 15, { "VENOMBINPAK1.0\n" }, 19 }
+
 	static const PackageLoader loaders[] = {
-	        {PL_PACKAGE_LOAD_FORMAT_ZIP,         "zip",   PlParseZipPackage      },
-	        {PL_PACKAGE_LOAD_FORMAT_ZIP,         "pak",   PlParseZipPackage      },
-	        {PL_PACKAGE_LOAD_FORMAT_ZIP,         "pk3",   PlParseZipPackage      },
-	        {PL_PACKAGE_LOAD_FORMAT_ZIP,         "pk4",   PlParseZipPackage      },
-	        {PL_PACKAGE_LOAD_FORMAT_ZIP,         "cache", PlParseZipPackage      },
-	        {PL_PACKAGE_LOAD_FORMAT_WAD_DOOM,    "wad",   PlParseWadPackage_     },
-	        {PL_PACKAGE_LOAD_FORMAT_WAD_QUAKE,   "wad",   PlParseQWadPackage_    },
-	        {PL_PACKAGE_LOAD_FORMAT_MAD_GREMLIN, "mad",   PlParseMadPackage_     },
-	        {PL_PACKAGE_LOAD_FORMAT_MAD_GREMLIN, "mtd",   PlParseMadPackage_     },
-	        {PL_PACKAGE_LOAD_FORMAT_PAK_QUAKE,   "pak",   PlParsePakPackage_     },
-	        {PL_PACKAGE_LOAD_FORMAT_BIN_FRESH,   "bin",   PlParseFreshBinPackage_},
-	        {PL_PACKAGE_LOAD_FORMAT_DFS,         "dfs",   PlParseDfsPackage_     },
-	        {PL_PACKAGE_LOAD_FORMAT_VPK_VTMB,    "vpk",   PlParseVpkPackage_     },
-	        {PL_PACKAGE_LOAD_FORMAT_GRP,         "grp",   PlParseGrpPackage_     },
-	        {PL_PACKAGE_LOAD_FORMAT_VPP,         "vpp",   PlParseVppPackage      },
-	        {PL_PACKAGE_LOAD_FORMAT_OPK,         "opk",   PlParseOpkPackage_     },
-	        {PL_PACKAGE_LOAD_FORMAT_INU,         "inu",   PlParseInuPackage_     },
-	        {PL_PACKAGE_LOAD_FORMAT_ALL_ACCLAIM, "all",   PlParseAllPackage_     },
-	        {PL_PACKAGE_LOAD_FORMAT_AFS,         "afs",   PlParseAfsPackage_     },
-	        {PL_PACKAGE_LOAD_FORMAT_AHF,         "ahf",   PlParseAhfPackage_     },
-	        {PL_PACKAGE_LOAD_FORMAT_DAT_ANGEL,   "dat",   PlParseAngelDatPackage_},
-	        {PL_PACKAGE_LOAD_FORMAT_HAL,         "hal",   PlParseHalPackage_     },
-	        {PL_PACKAGE_LOAD_FORMAT_DAT_ICE3D,   "dat",   PlParseIce3DDatPackage_},
+	        {PL_PACKAGE_LOAD_FORMAT_ZIP,         "zip",   PlParseZipPackage,       ZIP_SIGNATURE                               },
+	        {PL_PACKAGE_LOAD_FORMAT_ZIP,         "pak",   PlParseZipPackage,       ZIP_SIGNATURE                               },
+	        {PL_PACKAGE_LOAD_FORMAT_ZIP,         "pk3",   PlParseZipPackage,       ZIP_SIGNATURE                               },
+	        {PL_PACKAGE_LOAD_FORMAT_ZIP,         "pk4",   PlParseZipPackage,       ZIP_SIGNATURE                               },
+	        {PL_PACKAGE_LOAD_FORMAT_ZIP,         "cache", PlParseZipPackage,       ZIP_SIGNATURE                               },
+	        {PL_PACKAGE_LOAD_FORMAT_WAD_DOOM,    "wad",   PlParseWadPackage_,      { 0, 4, { "IWAD", "PWAD" }, 12 }            },
+	        {PL_PACKAGE_LOAD_FORMAT_WAD_QUAKE,   "wad",   PlParseQWadPackage_,     { 0, 4, { "WAD2", "WAD3" }, 12 }            },
+	        {PL_PACKAGE_LOAD_FORMAT_MAD_GREMLIN, "mad",   PlParseMadPackage_,      {}                                          },
+	        {PL_PACKAGE_LOAD_FORMAT_MAD_GREMLIN, "mtd",   PlParseMadPackage_,      {}                                          },
+	        {PL_PACKAGE_LOAD_FORMAT_PAK_QUAKE,   "pak",   PlParsePakPackage_,      { 0, 4, { "PACK" }, 12 }                    },
+	        {PL_PACKAGE_LOAD_FORMAT_BIN_FRESH,   "bin",   PlParseFreshBinPackage_, { 0, 8, { "DATA    " }, 16 }                },
+	        {PL_PACKAGE_LOAD_FORMAT_DFS,         "dfs",   PlParseDfsPackage_,      { 0, 4, { "SFDX" }, 4 }                     },
+	        {PL_PACKAGE_LOAD_FORMAT_VPK_VTMB,    "vpk",   PlParseVpkPackage_,      {}                                          },
+	        {PL_PACKAGE_LOAD_FORMAT_GRP,         "grp",   PlParseGrpPackage_,      { 0, 12, { "KenSilverman" }, 16 }           },
+	        {PL_PACKAGE_LOAD_FORMAT_VPP,         "vpp",   PlParseVppPackage,       { 0, 4, { "\xce\x0a\x89\x51" }, 2048 }    },
+	        {PL_PACKAGE_LOAD_FORMAT_OPK,         "opk",   PlParseOpkPackage_,      { 0, 4, { "\x71\x6e\x00\x00" }, 20 }      },
+	        {PL_PACKAGE_LOAD_FORMAT_INU,         "inu",   PlParseInuPackage_,      { 0, 4, { "\x72\x10\xea\xf4" }, 4 }       },
+	        {PL_PACKAGE_LOAD_FORMAT_ALL_ACCLAIM, "all",   PlParseAllPackage_,      {}                                          },
+	        {PL_PACKAGE_LOAD_FORMAT_AFS,         "afs",   PlParseAfsPackage_,      {}                                          },
+	        {PL_PACKAGE_LOAD_FORMAT_AHF,         "ahf",   PlParseAhfPackage_,      { 0, 4, { "AHFF" }, 4 }                     },
+	        {PL_PACKAGE_LOAD_FORMAT_DAT_ANGEL,   "dat",   PlParseAngelDatPackage_, { 0, 4, { "DAVE", "Dave" }, 4 }             },
+	        {PL_PACKAGE_LOAD_FORMAT_HAL,         "hal",   PlParseHalPackage_,      { 0, 4, { "APUK" }, 4 }                     },
+	        {PL_PACKAGE_LOAD_FORMAT_DAT_ICE3D,   "dat",   PlParseIce3DDatPackage_, {}                                          },
 #if ( RAR_SUPPORTED == 1 )
-	        {PL_PACKAGE_LOAD_FORMAT_RAR,         "rar",   PlParseRarPackage_     },
+	        {PL_PACKAGE_LOAD_FORMAT_RAR,         "rar",   PlParseRarPackage_,      { 0, 4, { "Rar!" }, 7 }                     },
 #endif
-	        {PL_PACKAGE_LOAD_FORMAT_FRD_PAK,     "pak",   PlParseFrdPakPackage_  },
+	        {PL_PACKAGE_LOAD_FORMAT_FRD_PAK,     "pak",   PlParseFrdPakPackage_,   { 0, 4, { "P5CK" }, 4 }                     },
 
-	        {PL_PACKAGE_LOAD_FORMAT_PAK_VENOM,   "bpak0", PlParseVenomPakPackage },
-	        {PL_PACKAGE_LOAD_FORMAT_PAK_VENOM,   "bpak1", PlParseVenomPakPackage },
-	        {PL_PACKAGE_LOAD_FORMAT_PAK_VENOM,   "bpak2", PlParseVenomPakPackage },
-	        {PL_PACKAGE_LOAD_FORMAT_PAK_VENOM,   "bpak3", PlParseVenomPakPackage },
+	        {PL_PACKAGE_LOAD_FORMAT_PAK_VENOM,   "bpak0", PlParseVenomPakPackage,  VENOM_SIGNATURE                             },
+	        {PL_PACKAGE_LOAD_FORMAT_PAK_VENOM,   "bpak1", PlParseVenomPakPackage,  VENOM_SIGNATURE                             },
+	        {PL_PACKAGE_LOAD_FORMAT_PAK_VENOM,   "bpak2", PlParseVenomPakPackage,  VENOM_SIGNATURE                             },
+	        {PL_PACKAGE_LOAD_FORMAT_PAK_VENOM,   "bpak3", PlParseVenomPakPackage,  VENOM_SIGNATURE                             },
 	};
 
+#undef ZIP_SIGNATURE
+#undef VENOM_SIGNATURE
+
 	for ( unsigned int i = 0; i < QM_OS_ARRAY_ELEMENTS( loaders ); ++i )
 	{
 		if ( flags != PL_PACKAGE_LOAD_FORMAT_ALL && !( flags & loaders[ i ].flag ) )
@@ -363,10 +708,38 @@ void PlRegisterStandardPackageLoaders( unsigned int flags )
 			continue;
 		}
 
-		PlRegisterPackageLoader( loaders[ i ].extension, nullptr, loaders[ i ].parseFunction );
+		PlRegisterPackageLoaderEx( loaders[ i ].extension, nullptr, loaders[ i ].parseFunction, &loaders[ i ].signature );
 	}
 }
 
+static bool is_extension_match( const char *ext, const char *loaderExt )
+{
+	if ( PL_INVALID_STRING( ext ) || PL_INVALID_STRING( loaderExt ) )
+	{
+		return PL_INVALID_STRING( ext ) && PL_INVALID_STRING( loaderExt );
+	}
+
+	return ( pl_strcasecmp( ext, loaderExt ) == 0 );
+}
+
+static bool is_signature_match( const PLPackageSignature *signature, const uint8_t *header, size_t headerSize, size_t fileSize )
+{
+	if ( fileSize < signature->minSize || ( size_t ) signature->offset + signature->length > headerSize )
+	{
+		return false;
+	}
+
+	for ( unsigned int i = 0; i < QM_OS_ARRAY_ELEMENTS( signature->magic ); ++i )
+	{
+		if ( signature->magic[ i ] != nullptr && memcmp( &header[ signature->offset ], signature->magic[ i ], signature->length ) == 0 )
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
 QmFsPackage *PlLoadPackage( const char *path )
 {
 	FunctionStart();
@@ -374,31 +747,17 @@ QmFsPackage *PlLoadPackage( const char *path )
 	const char *ext = PlGetFileExtension( path );
 	for ( unsigned int i = 0; i < num_package_loaders; ++i )
 	{
-		if ( package_loaders[ i ].LoadFunction == nullptr )
+		if ( package_loaders[ i ].LoadFunction == nullptr || !is_extension_match( ext, package_loaders[ i ].ext ) )
 		{
 			continue;
 		}
 
-		if ( !PL_INVALID_STRING( ext ) && !PL_INVALID_STRING( package_loaders[ i ].ext ) )
-		{
-			if ( pl_strncasecmp( ext, package_loaders[ i ].ext, sizeof( package_loaders[ i ].ext ) ) == 0 )
-			{
-				QmFsPackage *package = package_loaders[ i ].LoadFunction( path );
-				if ( package != nullptr )
-				{
-					package->path = qm_os_string_alloc( "%s", path );
-					return package;
-				}
-			}
-		}
-		else if ( PL_INVALID_STRING( ext ) && PL_INVALID_STRING( package_loaders[ i ].ext ) )
+		QmFsPackage *package = package_loaders[ i ].LoadFunction( path );
+		if ( package != nullptr )
 		{
-			QmFsPackage *package = package_loaders[ i ].LoadFunction( path );
-			if ( package != nullptr )
-			{
-				package->path = qm_os_string_alloc( "%s", path );
-				return package;
-			}
+			package->path = qm_os_string_alloc( "%s", path );
+			qm_fs_package_build_index_( package );
+			return package;
 		}
 	}
 
@@ -410,38 +769,81 @@ QmFsPackage *PlLoadPackage( const char *path )
 		return nullptr;
 	}
 
-	QmFsPackage *package = nullptr;
-	for ( unsigned int i = 0; i < num_package_loaders; ++i )
+	size_t fileSize  = qm_fs_file_get_size( file );
+	time_t timeStamp = qm_fs_file_get_timestamp( file );
+
+	/* if it's been parsed before, and not changed since, the table can
+	 * be pulled straight from the snapshot rather than parsed again */
+	QmFsPackage *package      = qm_fs_package_snapshot_load_( qm_fs_file_get_path( file ), fileSize, timeStamp );
+	bool         fromSnapshot = ( package != nullptr );
+
+	/* grab the start of the file, so we can pick out the format up front */
+	uint8_t header[ PACKAGE_PROBE_SIZE ];
+	size_t  headerSize = ( !fromSnapshot && fileSize > 0 ) ? qm_fs_file_read_at( file, header, QM_OS_MIN( fileSize, sizeof( header ) ), 0 ) : 0;
+
+	/* anything that can be identified by its signature goes first,
+	 * with those registered for the extension taking priority */
+	for ( unsigned int pass = 0; pass < 2 && package == nullptr; ++pass )
 	{
-		if ( package_loaders[ i ].ParseFunction == nullptr )
+		for ( unsigned int i = 0; i < num_package_loaders; ++i )
 		{
-			continue;
-		}
+			const PLPackageLoader *loader = &package_loaders[ i ];
+			if ( loader->ParseFunction == nullptr || loader->signature.length == 0 )
+			{
+				continue;
+			}
 
-		if ( !PL_INVALID_STRING( ext ) && !PL_INVALID_STRING( package_loaders[ i ].ext ) )
-		{
-			if ( pl_strncasecmp( ext, package_loaders[ i ].ext, sizeof( package_loaders[ i ].ext ) ) == 0 )
+			if ( is_extension_match( ext, loader->ext ) != ( pass == 0 ) ||
+			     !is_signature_match( &loader->signature, header, headerSize, fileSize ) )
 			{
-				package = package_loaders[ i ].ParseFunction( file );
-				if ( package != nullptr )
-				{
-					break;
-				}
+				continue;
 			}
-		}
-		else if ( PL_INVALID_STRING( ext ) && PL_INVALID_STRING( package_loaders[ i ].ext ) )
-		{
-			package = package_loaders[ i ].ParseFunction( file );
-			if ( package != nullptr )
+
+			qm_fs_file_rewind( file );
+			if ( ( package = loader->ParseFunction( file ) ) != nullptr )
 			{
 				break;
 			}
 		}
+	}
+
+	/* and then fall back to trying anything registered for the extension that
+	 * hasn't already been tried, as the parser has the final say; a zip can
+	 * have something prepended to it, i.e. a self-extractor */
+	for ( unsigned int i = 0; i < num_package_loaders && package == nullptr; ++i )
+	{
+		const PLPackageLoader *loader = &package_loaders[ i ];
+		if ( loader->ParseFunction == nullptr || !is_extension_match( ext, loader->ext ) ||
+		     ( loader->signature.length != 0 && is_signature_match( &loader->signature, header, headerSize, fileSize ) ) )
+		{
+			continue;
+		}
 
 		qm_fs_file_rewind( file );
+		package = loader->ParseFunction( file );
+	}
+
+	if ( package != nullptr )
+	{
+		package->internal.timeStamp = timeStamp;
+		qm_fs_package_build_index_( package );
 	}
 
-	PlCloseFile( file );
+	/* hang onto the handle, as it'll be used for loading from the package */
+	if ( package != nullptr && package->internal.file == nullptr && strcmp( package->path, qm_fs_file_get_path( file ) ) == 0 )
+	{
+		package->internal.file = file;
+
+		/* only the generic loader's tables can be reproduced from a snapshot */
+		if ( !fromSnapshot && package->internal.LoadFile == LoadGenericPackageFile )
+		{
+			qm_fs_package_snapshot_save_( package, fileSize );
+		}
+	}
+	else
+	{
+		PlCloseFile( file );
+	}
 
 	if ( package != nullptr && *package->path == '\0' )
 	{
@@ -453,9 +855,150 @@ QmFsPackage *PlLoadPackage( const char *path )
 		PlReportBasicError( PL_RESULT_UNSUPPORTED );
 	}
 
+	/* failing to map isn't fatal, we'll just fall back to reading */
+	if ( package != nullptr && mapPackages )
+	{
+		PlMapPackage( package );
+	}
+
 	return package;
 }
 
+/**
+ * Sets whether or not packages should be mapped into memory
+ * on load. Only affects packages loaded afterwards.
+ */
+void PlSetPackageMappingEnabled( bool enabled )
+{
+	mapPackages = enabled;
+}
+
+/**
+ * Maps the package into memory, so stored entries can be handed
+ * out without any allocation or copy. Entries keep the mapping
+ * alive, so they can safely outlive the package.
+ */
+bool PlMapPackage( QmFsPackage *package )
+{
+	if ( package->internal.mapping != nullptr )
+	{
+		return true;
+	}
+
+	/* custom loaders may pull their data from elsewhere */
+	if ( package->internal.LoadFile != LoadGenericPackageFile )
+	{
+		PlReportErrorF( PL_RESULT_UNSUPPORTED, "package uses a custom loader, can't be mapped" );
+		return false;
+	}
+
+	package->internal.mapping = qm_fs_mapping_open( package->path );
+	if ( package->internal.mapping == nullptr )
+	{
+		return false;
+	}
+
+	if ( package->internal.timeStamp == 0 )
+	{
+		package->internal.timeStamp = qm_fs_get_local_file_timestamp( package->path );
+	}
+
+	/* everything is served from the mapping now */
+	qm_os_mutex_lock( package->internal.fileMutex );
+	PlCloseFile( package->internal.file );
+	package->internal.file = nullptr;
+	qm_os_mutex_unlock( package->internal.fileMutex );
+
+	return true;
+}
+
+bool qm_fs_package_open_handle_( QmFsPackage *package )
+{
+	/* entries are loaded from several threads at once (async loads,
+	 * parallel extraction), so only one of them gets to open it */
+	qm_os_mutex_lock( package->internal.fileMutex );
+
+	bool status = true;
+	if ( package->internal.mapping == nullptr && package->internal.file == nullptr )
+	{
+		/* the package keeps a single handle open for its lifetime,
+		 * and entries are read from it by offset, so there's no
+		 * need to reopen the archive for every entry */
+		package->internal.file = qm_fs_file_open( package->path, false );
+		if ( package->internal.file == nullptr )
+		{
+			status = false;
+		}
+		else if ( package->internal.timeStamp == 0 )
+		{
+			package->internal.timeStamp = qm_fs_file_get_timestamp( package->internal.file );
+		}
+	}
+
+	qm_os_mutex_unlock( package->internal.fileMutex );
+
+	return status;
+}
+
+bool qm_fs_package_resolve_file_( QmFsPackage *package, unsigned int index )
+{
+	if ( package->internal.ResolveFile == nullptr )
+	{
+		return true;
+	}
+
+	/* the resolver reads from the shared handle, if not mapped */
+	if ( !qm_fs_package_open_handle_( package ) )
+	{
+		return false;
+	}
+
+	/* offsets are only ever read after coming through here, so
+	 * the lock also ensures the resolved offset is visible */
+	qm_os_mutex_lock( package->internal.fileMutex );
+
+	bool             status = true;
+	QmFsPackageFile *pi     = &package->files[ index ];
+	if ( pi->offset & PL_PACKAGE_OFFSET_UNRESOLVED )
+	{
+		status = package->internal.ResolveFile( package, pi );
+	}
+
+	qm_os_mutex_unlock( package->internal.fileMutex );
+
+	return status;
+}
+
+bool qm_fs_package_get_raw_entry_( QmFsPackage *package, unsigned int index, int *fd, uint64_t *offset, size_t *size )
+{
+	/* only entries read by the generic loader, straight from a local file */
+	if ( package->internal.LoadFile != LoadGenericPackageFile || package->internal.mapping != nullptr ||
+	     package->internal.file == nullptr || package->internal.file->fptr == nullptr )
+	{
+		return false;
+	}
+
+	if ( !qm_fs_package_resolve_file_( package, index ) )
+	{
+		return false;
+	}
+
+	const QmFsPackageFile *pi = &package->files[ index ];
+
+	*fd     = fileno( package->internal.file->fptr );
+	*offset = pi->offset;
+	*size   = ( pi->compressionType != PL_COMPRESSION_NONE ) ? pi->compressedSize : pi->size;
+
+	return true;
+}
+
+void *qm_fs_package_decompress_entry_( const QmFsPackageFile *pi, const void *raw )
+{
+	FunctionStart();
+
+	return DecompressPackageFile( raw, pi );
+}
+
 QmFsFile *PlLoadPackageFileByIndex( QmFsPackage *package, unsigned int index )
 {
 	if ( index >= package->numFiles )
@@ -464,18 +1007,37 @@ QmFsFile *PlLoadPackageFileByIndex( QmFsPackage *package, unsigned int index )
 		return nullptr;
 	}
 
-	/* load in the package */
-	QmFsFile *packageFile = qm_fs_file_open( package->path, false );
-	if ( packageFile == nullptr )
+	/* compressed entries are worth holding onto, so they needn't be inflated again */
+	bool isCompressed = ( package->files[ index ].compressionType != PL_COMPRESSION_NONE );
+	if ( isCompressed )
+	{
+		QmFsFile *file = qm_fs_package_cache_find_( package, index );
+		if ( file != nullptr )
+		{
+			return file;
+		}
+	}
+
+	if ( !qm_fs_package_open_handle_( package ) || !qm_fs_package_resolve_file_( package, index ) )
 	{
 		return nullptr;
 	}
 
+	if ( package->internal.mapping != nullptr )
+	{
+		return LoadMappedPackageFile( package, index );
+	}
+
 	QmFsFile *file = nullptr;
 
-	uint8_t *dataPtr = package->internal.LoadFile( packageFile, &package->files[ index ] );
+	uint8_t *dataPtr = package->internal.LoadFile( package->internal.file, &package->files[ index ] );
 	if ( dataPtr != nullptr )
 	{
+		if ( isCompressed )
+		{
+			return qm_fs_package_cache_insert_( package, index, dataPtr );
+		}
+
 		file = qm_fs_file_from_memory(
 		        package->files[ index ].name,
 		        dataPtr,
@@ -483,8 +1045,6 @@ QmFsFile *PlLoadPackageFileByIndex( QmFsPackage *package, unsigned int index )
 		        QM_FS_FILE_OWNERSHIP_TYPE_OWNER );
 	}
 
-	PlCloseFile( packageFile );
-
 	return file;
 }
 
@@ -496,18 +1056,81 @@ QmFsFile *PlLoadPackageFile( QmFsPackage *package, const char *path )
 		return nullptr;
 	}
 
-	for ( unsigned int i = 0; i < package->numFiles; ++i )
+	int i = PlGetPackageTableIndex( package, path );
+	if ( i < 0 )
+	{
+		PlReportErrorF( PL_RESULT_INVALID_PARM2, "failed to find file in package" );
+		return nullptr;
+	}
+
+	return PlLoadPackageFileByIndex( package, ( unsigned int ) i );
+}
+
+/**
+ * Opens the given entry so that it's decompressed as it's read,
+ * rather than all in one go, keeping memory usage down for large
+ * entries. Falls back to loading it in full if the entry is already
+ * cached, mapped or uses a compression type that can't be streamed.
+ */
+QmFsFile *PlStreamPackageFileByIndex( QmFsPackage *package, unsigned int index )
+{
+	if ( index >= package->numFiles )
+	{
+		PlReportBasicError( PL_RESULT_INVALID_PARM2 );
+		return nullptr;
+	}
+
+	const QmFsPackageFile *pi = &package->files[ index ];
+
+	bool canStream;
+	switch ( pi->compressionType )
+	{
+		default:
+			canStream = false;
+			break;
+		case PL_COMPRESSION_NONE:
+			/* mapped entries are already zero-copy */
+			canStream = ( package->internal.mapping == nullptr );
+			break;
+		case PL_COMPRESSION_DEFLATE:
+		case PL_COMPRESSION_GZIP:
+		case PL_COMPRESSION_IMPLODE:
+			canStream = true;
+			break;
+	}
+
+	if ( !canStream || package->internal.LoadFile != LoadGenericPackageFile )
+	{
+		return PlLoadPackageFileByIndex( package, index );
+	}
+
+	if ( pi->compressionType != PL_COMPRESSION_NONE )
 	{
-		if ( strcmp( path, package->files[ i ].name ) != 0 )
+		QmFsFile *file = qm_fs_package_cache_find_( package, index );
+		if ( file != nullptr )
 		{
-			continue;
+			return file;
 		}
+	}
 
-		return PlLoadPackageFileByIndex( package, i );
+	if ( !qm_fs_package_resolve_file_( package, index ) )
+	{
+		return nullptr;
+	}
+
+	return qm_fs_package_open_stream_( package, index );
+}
+
+QmFsFile *PlStreamPackageFile( QmFsPackage *package, const char *path )
+{
+	int i = PlGetPackageTableIndex( package, path );
+	if ( i < 0 )
+	{
+		PlReportErrorF( PL_RESULT_INVALID_PARM2, "failed to find file in package" );
+		return nullptr;
 	}
 
-	PlReportErrorF( PL_RESULT_INVALID_PARM2, "failed to find file in package" );
-	return nullptr;
+	return PlStreamPackageFileByIndex( package, ( unsigned int ) i );
 }
 
 const char *PlGetPackagePath( const QmFsPackage *package )
@@ -530,22 +1153,3 @@ unsigned int PlGetPackageTableSize( const QmFsPackage *package )
 {
 	return package->numFiles;
 }
-
-int PlGetPackageTableIndex( const QmFsPackage *package, const char *indexName )
-{
-	FunctionStart();
-
-	for ( unsigned int i = 0; i < package->numFiles; ++i )
-	{
-		if ( strcmp( indexName, package->files[ i ].name ) != 0 )
-		{
-			continue;
-		}
-
-		return ( int ) i;
-	}
-
-	PlReportBasicError( PL_RESULT_INVALID_PARM2 );
-
-	return -1;
-}
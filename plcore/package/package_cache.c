@@ -0,0 +1,334 @@
+// SPDX-License-Identifier: MIT
+// Hei Platform Library
+// Copyright © 2017-2026 Quartermind Games, Mark E. Sowden <markelswo@gmail.com>
+// Purpose: Cache of decompressed package entries.
+
+#include <stdatomic.h>
+
+#include "package_private.h"
+#include "filesystem_private.h"
+
+#include "qmos/public/qm_os_memory.h"
+#include "qmos/public/qm_os_thread.h"
+
+#include <plcore/pl_hashtable.h>
+
+/**
+ * Entries are keyed by the id handed to the package when it was created
+ * and the index of the entry. Ids are never reused, so packages opened
+ * from memory or streams, which have no path or timestamp to tell them
+ * apart, never see each other's data, and neither does a package that's
+ * been reloaded after changing on disk. A package's entries are dropped
+ * when it's destroyed. Files handed out hold a reference on the entry,
+ * so it stays valid even after it's been evicted.
+ */
+
+#define PACKAGE_CACHE_DEFAULT_BUDGET ( 64U * 1024U * 1024U )
+
+typedef struct QmFsCacheEntry
+{
+	atomic_int refs;
+	void      *data;
+	size_t     size;
+	uint64_t   packageId;
+
+	PLHashTableNode       *node;// null once evicted
+	struct QmFsCacheEntry *prev;
+	struct QmFsCacheEntry *next;
+} QmFsCacheEntry;
+
+static QmOsMutex   *cacheMutex;
+static PLHashTable *cacheTable;
+static size_t       cacheBudget = PACKAGE_CACHE_DEFAULT_BUDGET;
+
+/* most recently used at the front */
+static QmFsCacheEntry *cacheFront;
+static QmFsCacheEntry *cacheBack;
+
+static PLPackageCacheStats cacheStats;
+
+static atomic_uint_least64_t nextPackageId = 1;
+
+static size_t generate_key( const QmFsPackage *package, unsigned int index, char *dst, size_t dstSize )
+{
+	int length = snprintf( dst, dstSize, "%llx|%u", ( unsigned long long ) package->internal.cacheId, index );
+	if ( length < 0 || ( size_t ) length >= dstSize )
+	{
+		return 0;
+	}
+
+	return ( size_t ) length;
+}
+
+void qm_fs_cache_entry_release_( QmFsCacheEntry *self )
+{
+	if ( self == nullptr || atomic_fetch_sub( &self->refs, 1 ) != 1 )
+	{
+		return;
+	}
+
+	qm_os_memory_free( self->data );
+	qm_os_memory_free( self );
+}
+
+static void unlink_entry( QmFsCacheEntry *entry )
+{
+	if ( entry->prev != nullptr )
+	{
+		entry->prev->next = entry->next;
+	}
+	else
+	{
+		cacheFront = entry->next;
+	}
+
+	if ( entry->next != nullptr )
+	{
+		entry->next->prev = entry->prev;
+	}
+	else
+	{
+		cacheBack = entry->prev;
+	}
+
+	entry->prev = entry->next = nullptr;
+}
+
+static void push_front_entry( QmFsCacheEntry *entry )
+{
+	entry->next = cacheFront;
+	if ( cacheFront != nullptr )
+	{
+		cacheFront->prev = entry;
+	}
+	cacheFront = entry;
+
+	if ( cacheBack == nullptr )
+	{
+		cacheBack = entry;
+	}
+}
+
+static void evict_entry( QmFsCacheEntry *entry )
+{
+	unlink_entry( entry );
+
+	PlDestroyHashTableNode( entry->node );
+	entry->node = nullptr;
+
+	cacheStats.numEntries--;
+	cacheStats.numBytes -= entry->size;
+
+	qm_fs_cache_entry_release_( entry );
+}
+
+/**
+ * Drops the least recently used entries until there's
+ * room for the given number of bytes.
+ */
+static void trim_cache( size_t size )
+{
+	while ( cacheBack != nullptr && cacheStats.numBytes + size > cacheBudget )
+	{
+		evict_entry( cacheBack );
+		cacheStats.evictions++;
+	}
+}
+
+static QmFsFile *open_entry( QmFsCacheEntry *entry, const QmFsPackageFile *pi )
+{
+	QmFsFile *file = qm_fs_file_from_memory( pi->name, entry->data, entry->size, QM_FS_FILE_OWNERSHIP_TYPE_UNMANAGED );
+	if ( file == nullptr )
+	{
+		return nullptr;
+	}
+
+	atomic_fetch_add( &entry->refs, 1 );
+	file->cacheEntry = entry;
+
+	return file;
+}
+
+uint64_t qm_fs_package_cache_generate_id_( void )
+{
+	return atomic_fetch_add( &nextPackageId, 1 );
+}
+
+/**
+ * Drops everything cached for the given package,
+ * as nothing will be able to ask for it again.
+ */
+void qm_fs_package_cache_forget_( const QmFsPackage *package )
+{
+	if ( cacheMutex == nullptr )
+	{
+		return;
+	}
+
+	qm_os_mutex_lock( cacheMutex );
+	QmFsCacheEntry *entry = cacheFront;
+	while ( entry != nullptr )
+	{
+		QmFsCacheEntry *next = entry->next;
+		if ( entry->packageId == package->internal.cacheId )
+		{
+			evict_entry( entry );
+		}
+		entry = next;
+	}
+	qm_os_mutex_unlock( cacheMutex );
+}
+
+void qm_fs_package_cache_initialize_( void )
+{
+	if ( cacheMutex != nullptr )
+	{
+		return;
+	}
+
+	cacheMutex = qm_os_mutex_create();
+	cacheTable = PlCreateHashTable();
+}
+
+void qm_fs_package_cache_shutdown_( void )
+{
+	if ( cacheMutex == nullptr )
+	{
+		return;
+	}
+
+	PlClearPackageCache();
+
+	PlDestroyHashTable( cacheTable );
+	qm_os_memory_free( cacheMutex );
+
+	cacheTable = nullptr;
+	cacheMutex = nullptr;
+}
+
+QmFsFile *qm_fs_package_cache_find_( const QmFsPackage *package, unsigned int index )
+{
+	if ( cacheMutex == nullptr || cacheBudget == 0 )
+	{
+		return nullptr;
+	}
+
+	char   key[ 64 ];
+	size_t keySize = generate_key( package, index, key, sizeof( key ) );
+	if ( keySize == 0 )
+	{
+		return nullptr;
+	}
+
+	qm_os_mutex_lock( cacheMutex );
+
+	QmFsFile       *file  = nullptr;
+	QmFsCacheEntry *entry = PlLookupHashTableUserData( cacheTable, key, keySize );
+	if ( entry != nullptr )
+	{
+		unlink_entry( entry );
+		push_front_entry( entry );
+
+		file = open_entry( entry, &package->files[ index ] );
+		cacheStats.hits++;
+	}
+	else
+	{
+		cacheStats.misses++;
+	}
+
+	qm_os_mutex_unlock( cacheMutex );
+
+	return file;
+}
+
+QmFsFile *qm_fs_package_cache_insert_( const QmFsPackage *package, unsigned int index, void *data )
+{
+	const QmFsPackageFile *pi = &package->files[ index ];
+
+	char   key[ 64 ];
+	size_t keySize = generate_key( package, index, key, sizeof( key ) );
+	if ( cacheMutex == nullptr || keySize == 0 || pi->size == 0 || pi->size > cacheBudget )
+	{
+		return qm_fs_file_from_memory( pi->name, data, pi->size, QM_FS_FILE_OWNERSHIP_TYPE_OWNER );
+	}
+
+	qm_os_mutex_lock( cacheMutex );
+
+	/* someone else may have beaten us to it */
+	QmFsCacheEntry *entry = PlLookupHashTableUserData( cacheTable, key, keySize );
+	if ( entry != nullptr )
+	{
+		qm_os_memory_free( data );
+	}
+	else
+	{
+		trim_cache( pi->size );
+
+		entry            = QM_OS_MEMORY_NEW( QmFsCacheEntry );
+		entry->data      = data;
+		entry->size      = pi->size;
+		entry->packageId = package->internal.cacheId;
+		entry->node      = PlInsertHashTableNode( cacheTable, key, keySize, entry );
+		atomic_init( &entry->refs, 1 );
+
+		push_front_entry( entry );
+
+		cacheStats.numEntries++;
+		cacheStats.numBytes += entry->size;
+	}
+
+	QmFsFile *file = open_entry( entry, pi );
+
+	qm_os_mutex_unlock( cacheMutex );
+
+	return file;
+}
+
+/**
+ * Sets the maximum number of bytes the cache can hold onto.
+ * Anything over the new budget is evicted straight away,
+ * and 0 disables the cache.
+ */
+void PlSetPackageCacheBudget( size_t numBytes )
+{
+	if ( cacheMutex == nullptr )
+	{
+		cacheBudget = numBytes;
+		return;
+	}
+
+	qm_os_mutex_lock( cacheMutex );
+	cacheBudget = numBytes;
+	trim_cache( 0 );
+	qm_os_mutex_unlock( cacheMutex );
+}
+
+void PlClearPackageCache( void )
+{
+	if ( cacheMutex == nullptr )
+	{
+		return;
+	}
+
+	qm_os_mutex_lock( cacheMutex );
+	while ( cacheBack != nullptr )
+	{
+		evict_entry( cacheBack );
+	}
+	qm_os_mutex_unlock( cacheMutex );
+}
+
+PLPackageCacheStats PlGetPackageCacheStats( void )
+{
+	if ( cacheMutex == nullptr )
+	{
+		return cacheStats;
+	}
+
+	qm_os_mutex_lock( cacheMutex );
+	PLPackageCacheStats stats = cacheStats;
+	qm_os_mutex_unlock( cacheMutex );
+
+	return stats;
+}
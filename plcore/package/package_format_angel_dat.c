@@ -46,12 +46,12 @@ QmFsPackage *PlParseAngelDatPackage_( QmFsFile *file ) {
 	/* toc is always padded to 2048 bytes */
 	qm_fs_file_seek( file, 2048, QM_FS_SEEK_SET );
 
+	/* each index is just four 32-bit values, so pull them all in at once */
 	AngelDATIndex *indices = QM_OS_MEMORY_NEW_( AngelDATIndex, header.tocIndices );
-	for ( unsigned int i = 0; i < header.tocIndices; ++i ) {
-		indices[ i ].nameOffset = PL_READUINT32( file, false, NULL );
-		indices[ i ].offset = PL_READUINT32( file, false, NULL );
-		indices[ i ].size = PL_READUINT32( file, false, NULL );
-		indices[ i ].compressedSize = PL_READUINT32( file, false, NULL );
+	size_t numValues = header.tocIndices * ( sizeof( AngelDATIndex ) / sizeof( uint32_t ) );
+	if ( qm_fs_file_read_int32_array( file, ( int32_t * ) indices, numValues, false ) != numValues ) {
+		qm_os_memory_free( indices );
+		return NULL;
 	}
 
 	/* and now seek to the string table */
@@ -105,12 +105,14 @@ QmFsPackage *PlParseFrdPakPackage_( QmFsFile *file ) {
 	// see if there's a checksum to name file
 	PLHashTable *nameTable = populate_name_table( file );
 
+	/* the indices are just 32-bit values, so pull them all in at once */
+	Pak5Index *indices = QM_OS_MEMORY_NEW_( Pak5Index, numFiles );
+	size_t numValues = qm_fs_file_read_int32_array( file, ( int32_t * ) indices, numFiles * ( sizeof( Pak5Index ) / sizeof( uint32_t ) ), false );
+	unsigned int numIndices = ( unsigned int ) ( numValues / ( sizeof( Pak5Index ) / sizeof( uint32_t ) ) );
+
 	unsigned int i;
-	for ( i = 0; i < numFiles; ++i ) {
-		Pak5Index index;
-		if ( qm_file_read( file, &index, sizeof( Pak5Index ), 1 ) != 1 ) {
-			break;
-		}
+	for ( i = 0; i < numIndices; ++i ) {
+		const Pak5Index index = indices[ i ];
 		if ( index.offset == 0 || index.offset >= qm_fs_file_get_size( file ) ) {
 			PlReportErrorF( PL_RESULT_FILETYPE, "invalid file (%u) offset (%u)", i, index.offset );
 			break;
@@ -128,6 +130,7 @@ QmFsPackage *PlParseFrdPakPackage_( QmFsFile *file ) {
 	}
 
 	PlDestroyHashTableEx( nameTable, qm_os_memory_free );
+	qm_os_memory_free( indices );
 
 	if ( i != numFiles ) {
 		PlDestroyPackage( package );
@@ -4,14 +4,32 @@
 #include <plcore/pl_linkedlist.h>
 
 #include "package_private.h"
+#include "filesystem_private.h"
 #include "qmos/public/qm_os_memory.h"
 
 /*
- * todo:
- * 	- zip64 support is currently missing
+ * The table is built from the central directory at the end of the
+ * archive, which is pulled in with a single read. Only if that can't
+ * be found do we fall back to walking each local header in turn.
+ *
+ * The central directory doesn't tell us the size of each local header's
+ * extra field, which can differ, so where an entry's data starts is only
+ * resolved from its local header the first time the entry is accessed.
  */
 
-#define ZIP_FILE_MAGIC QM_OS_MAGIC_TO_NUM( 'P', 'K', '\3', '\4' )
+#define ZIP_FILE_MAGIC        QM_OS_MAGIC_TO_NUM( 'P', 'K', '\3', '\4' )
+#define ZIP_CENTRAL_MAGIC     QM_OS_MAGIC_TO_NUM( 'P', 'K', '\1', '\2' )
+#define ZIP_END_MAGIC         QM_OS_MAGIC_TO_NUM( 'P', 'K', '\5', '\6' )
+#define ZIP64_END_MAGIC       QM_OS_MAGIC_TO_NUM( 'P', 'K', '\6', '\6' )
+#define ZIP64_LOCATOR_MAGIC   QM_OS_MAGIC_TO_NUM( 'P', 'K', '\6', '\7' )
+#define ZIP64_EXTRA_ID        0x0001
+
+#define ZIP_LOCAL_HEADER_SIZE   30
+#define ZIP_CENTRAL_HEADER_SIZE 46
+#define ZIP_END_SIZE            22
+#define ZIP64_LOCATOR_SIZE      20
+#define ZIP64_END_SIZE          56
+#define ZIP_MAX_COMMENT_SIZE    UINT16_MAX
 
 #define ZIP_EXCLUDE_DIRS
 
@@ -73,9 +91,305 @@ static bool ParseZipFileHeader( QmFsFile *file, ZipFileHeader *header ) {
 	return true;
 }
 
+static uint16_t GetZip16( const uint8_t *p ) {
+	return ( uint16_t ) ( p[ 0 ] | ( p[ 1 ] << 8 ) );
+}
+
+static uint32_t GetZip32( const uint8_t *p ) {
+	return ( uint32_t ) p[ 0 ] | ( ( uint32_t ) p[ 1 ] << 8 ) | ( ( uint32_t ) p[ 2 ] << 16 ) | ( ( uint32_t ) p[ 3 ] << 24 );
+}
+
+static uint64_t GetZip64( const uint8_t *p ) {
+	return ( uint64_t ) GetZip32( p ) | ( ( uint64_t ) GetZip32( p + 4 ) << 32 );
+}
+
+static uint8_t *PutZip16( uint8_t *p, uint16_t v ) {
+	p[ 0 ] = ( uint8_t ) v;
+	p[ 1 ] = ( uint8_t ) ( v >> 8 );
+	return p + 2;
+}
+
+static uint8_t *PutZip32( uint8_t *p, uint32_t v ) {
+	return PutZip16( PutZip16( p, ( uint16_t ) v ), ( uint16_t ) ( v >> 16 ) );
+}
+
+static uint8_t *PutZip64( uint8_t *p, uint64_t v ) {
+	return PutZip32( PutZip32( p, ( uint32_t ) v ), ( uint32_t ) ( v >> 32 ) );
+}
+
+static PLCompressionType GetZipCompressionType( uint16_t compression ) {
+	switch ( compression ) {
+		case ZIP_COMPRESSION_DEFLATED:
+			/* zip stores raw deflate streams, without the zlib wrapper */
+			return PL_COMPRESSION_GZIP;
+		case ZIP_COMPRESSION_IMPLODED:
+			return PL_COMPRESSION_IMPLODE;
+		case ZIP_COMPRESSION_NONE:
+			return PL_COMPRESSION_NONE;
+		default:
+			return PL_COMPRESSION_UNKNOWN;
+	}
+}
+
+typedef struct ZipDirectory {
+	uint64_t numEntries;
+	uint64_t size;
+	uint64_t offset;
+	uint64_t bias; /* bytes prepended to the archive, i.e. self-extractors */
+} ZipDirectory;
+
+/**
+ * Locates the central directory via the end record, and its
+ * ZIP64 counterpart if the archive needs one.
+ */
+static bool FindZipDirectory( QmFsFile *file, ZipDirectory *directory ) {
+	size_t fileSize = qm_fs_file_get_size( file );
+	if ( fileSize < ZIP_END_SIZE ) {
+		return false;
+	}
+
+	/* the end record is followed by a comment of up to 64KB,
+	 * so scan back through the tail for its signature */
+	size_t tailSize = QM_OS_MIN( fileSize, ( size_t ) ( ZIP_END_SIZE + ZIP_MAX_COMMENT_SIZE + ZIP64_LOCATOR_SIZE ) );
+	uint64_t tailOffset = fileSize - tailSize;
+
+	uint8_t *tail = QM_OS_MEMORY_NEW_( uint8_t, tailSize );
+	if ( qm_fs_file_read_at( file, tail, tailSize, ( PLFileOffset ) tailOffset ) != tailSize ) {
+		qm_os_memory_free( tail );
+		return false;
+	}
+
+	const uint8_t *end = NULL;
+	for ( size_t i = tailSize - ZIP_END_SIZE + 1; i-- > 0; ) {
+		if ( GetZip32( &tail[ i ] ) == ZIP_END_MAGIC && i + ZIP_END_SIZE + GetZip16( &tail[ i + 20 ] ) <= tailSize ) {
+			end = &tail[ i ];
+			break;
+		}
+	}
+
+	if ( end == NULL ) {
+		qm_os_memory_free( tail );
+		return false;
+	}
+
+	uint64_t endOffset = tailOffset + ( uint64_t ) ( end - tail );
+	directory->numEntries = GetZip16( end + 10 );
+	directory->size = GetZip32( end + 12 );
+	directory->offset = GetZip32( end + 16 );
+
+	bool isZip64 = ( directory->numEntries == UINT16_MAX || directory->size == UINT32_MAX || directory->offset == UINT32_MAX );
+	if ( isZip64 && end - tail >= ZIP64_LOCATOR_SIZE && GetZip32( end - ZIP64_LOCATOR_SIZE ) == ZIP64_LOCATOR_MAGIC ) {
+		uint64_t end64Offset = GetZip64( end - ZIP64_LOCATOR_SIZE + 8 );
+
+		uint8_t end64[ ZIP64_END_SIZE ];
+		if ( qm_fs_file_read_at( file, end64, sizeof( end64 ), ( PLFileOffset ) end64Offset ) != sizeof( end64 ) ||
+		     GetZip32( end64 ) != ZIP64_END_MAGIC ) {
+			PlReportErrorF( PL_RESULT_FILEREAD, "invalid zip64 end of central directory record" );
+			qm_os_memory_free( tail );
+			return false;
+		}
+
+		directory->numEntries = GetZip64( end64 + 32 );
+		directory->size = GetZip64( end64 + 40 );
+		directory->offset = GetZip64( end64 + 48 );
+
+		/* the directory sits before the zip64 record rather than the end record */
+		endOffset = end64Offset;
+	}
+
+	qm_os_memory_free( tail );
+
+	if ( directory->offset + directory->size > endOffset ) {
+		PlReportErrorF( PL_RESULT_FILEREAD, "invalid central directory size/offset" );
+		return false;
+	}
+
+	directory->bias = endOffset - ( directory->offset + directory->size );
+
+	return true;
+}
+
+/**
+ * Fills in where the entry's data starts, from its local header.
+ */
+bool PlResolveZipFile_( QmFsPackage *package, QmFsPackageFile *pi ) {
+	uint64_t headerOffset = pi->offset & ~PL_PACKAGE_OFFSET_UNRESOLVED;
+
+	uint8_t header[ ZIP_LOCAL_HEADER_SIZE ];
+	size_t archiveSize;
+	if ( package->internal.mapping != NULL ) {
+		archiveSize = qm_fs_mapping_get_size( package->internal.mapping );
+		if ( headerOffset > archiveSize || sizeof( header ) > archiveSize - headerOffset ) {
+			PlReportErrorF( PL_RESULT_FILEREAD, "invalid local header for %s", pi->name );
+			return false;
+		}
+
+		memcpy( header, ( const uint8_t * ) qm_fs_mapping_get_data( package->internal.mapping ) + headerOffset, sizeof( header ) );
+	} else {
+		archiveSize = qm_fs_file_get_size( package->internal.file );
+		if ( qm_fs_file_read_at( package->internal.file, header, sizeof( header ), ( PLFileOffset ) headerOffset ) != sizeof( header ) ) {
+			PlReportErrorF( PL_RESULT_FILEREAD, "invalid local header for %s", pi->name );
+			return false;
+		}
+	}
+
+	if ( GetZip32( header ) != ZIP_FILE_MAGIC ) {
+		PlReportErrorF( PL_RESULT_FILEREAD, "invalid local header for %s", pi->name );
+		return false;
+	}
+
+	uint64_t offset = headerOffset + ZIP_LOCAL_HEADER_SIZE + GetZip16( header + 26 ) + GetZip16( header + 28 );
+
+	size_t size = ( pi->compressionType != PL_COMPRESSION_NONE ) ? pi->compressedSize : pi->size;
+	if ( offset > archiveSize || size > archiveSize - offset ) {
+		PlReportErrorF( PL_RESULT_FILESIZE, "entry lies outside of archive (%s)", pi->name );
+		return false;
+	}
+
+	pi->offset = offset;
+	return true;
+}
+
+/**
+ * Pulls in the entry sizes and local header offset from a zip64 extra
+ * field; each is only present if the corresponding field was maxed out.
+ */
+static void ParseZip64Extra( const uint8_t *extra, uint16_t extraSize, uint64_t *uncompressedSize, uint64_t *compressedSize, uint64_t *offset ) {
+	while ( extraSize >= 4 ) {
+		uint16_t id = GetZip16( extra );
+		uint16_t size = GetZip16( extra + 2 );
+		if ( size > extraSize - 4 ) {
+			return;
+		}
+
+		if ( id == ZIP64_EXTRA_ID ) {
+			const uint8_t *p = extra + 4;
+			const uint8_t *e = p + size;
+			uint64_t *fields[] = { uncompressedSize, compressedSize, offset };
+			for ( unsigned int i = 0; i < QM_OS_ARRAY_ELEMENTS( fields ); ++i ) {
+				if ( *fields[ i ] != UINT32_MAX ) {
+					continue;
+				}
+
+				if ( p + 8 > e ) {
+					return;
+				}
+
+				*fields[ i ] = GetZip64( p );
+				p += 8;
+			}
+			return;
+		}
+
+		extra += 4 + size;
+		extraSize -= 4 + size;
+	}
+}
+
+static QmFsPackage *ParseZipCentralDirectory( QmFsFile *file, const ZipDirectory *directory ) {
+	if ( directory->numEntries > UINT32_MAX || directory->size > SIZE_MAX ||
+	     directory->numEntries * ZIP_CENTRAL_HEADER_SIZE > directory->size ) {
+		PlReportErrorF( PL_RESULT_FILEREAD, "invalid number of entries in central directory" );
+		return NULL;
+	}
+
+	/* the whole directory in one go */
+	size_t size = ( size_t ) directory->size;
+	uint8_t *buffer = QM_OS_MEMORY_NEW_( uint8_t, size + 1 );
+	if ( qm_fs_file_read_at( file, buffer, size, ( PLFileOffset ) ( directory->offset + directory->bias ) ) != size ) {
+		qm_os_memory_free( buffer );
+		return NULL;
+	}
+
+	QmFsPackage *package = PlCreatePackageHandle( qm_fs_file_get_path( file ), ( unsigned int ) directory->numEntries, NULL );
+	package->internal.ResolveFile = PlResolveZipFile_;
+
+	unsigned int numFiles = 0;
+	bool failed = false;
+	const uint8_t *p = buffer;
+	const uint8_t *end = buffer + size;
+	for ( uint64_t i = 0; i < directory->numEntries; ++i ) {
+		if ( end - p < ZIP_CENTRAL_HEADER_SIZE || GetZip32( p ) != ZIP_CENTRAL_MAGIC ) {
+			PlReportErrorF( PL_RESULT_FILEREAD, "invalid central directory header (%u)", ( unsigned int ) i );
+			failed = true;
+			break;
+		}
+
+		uint16_t compression = GetZip16( p + 10 );
+		uint64_t compressedSize = GetZip32( p + 20 );
+		uint64_t uncompressedSize = GetZip32( p + 24 );
+		uint16_t nameSize = GetZip16( p + 28 );
+		uint16_t extraSize = GetZip16( p + 30 );
+		uint16_t commentSize = GetZip16( p + 32 );
+		uint64_t offset = GetZip32( p + 42 );
+
+		const uint8_t *name = p + ZIP_CENTRAL_HEADER_SIZE;
+		const uint8_t *extra = name + nameSize;
+		if ( ( size_t ) ( end - name ) < ( size_t ) nameSize + extraSize + commentSize ) {
+			PlReportErrorF( PL_RESULT_FILEREAD, "invalid central directory header (%u)", ( unsigned int ) i );
+			failed = true;
+			break;
+		}
+
+		p = extra + extraSize + commentSize;
+
+#if defined( ZIP_EXCLUDE_DIRS )
+		if ( nameSize == 0 || name[ nameSize - 1 ] == '/' || name[ nameSize - 1 ] == '\\' ) {
+			continue;
+		}
+#endif
+
+		ParseZip64Extra( extra, extraSize, &uncompressedSize, &compressedSize, &offset );
+		if ( uncompressedSize > SIZE_MAX || compressedSize > SIZE_MAX ) {
+			PlReportErrorF( PL_RESULT_FILESIZE, "entry is too large (%u)", ( unsigned int ) i );
+			failed = true;
+			break;
+		}
+
+		QmFsPackageFile *pi = &package->files[ numFiles ];
+		snprintf( pi->name, sizeof( pi->name ), "%.*s", ( int ) nameSize, ( const char * ) name );
+		pi->size = ( size_t ) uncompressedSize;
+		pi->compressedSize = ( size_t ) compressedSize;
+		pi->compressionType = GetZipCompressionType( compression );
+
+		/* points at the local header until the entry is first accessed */
+		offset += directory->bias;
+		if ( offset >= PL_PACKAGE_OFFSET_UNRESOLVED ) {
+			PlReportErrorF( PL_RESULT_FILESIZE, "invalid local header offset (%u)", ( unsigned int ) i );
+			failed = true;
+			break;
+		}
+
+		pi->offset = offset | PL_PACKAGE_OFFSET_UNRESOLVED;
+		numFiles++;
+	}
+
+	qm_os_memory_free( buffer );
+
+	/* an archive holding nothing but directories is
+	 * still valid, it just comes back empty */
+	package->numFiles = numFiles;
+	if ( failed ) {
+		PlDestroyPackage( package );
+		return NULL;
+	}
+
+	return package;
+}
+
 QmFsPackage *PlParseZipPackage( QmFsFile *file ) {
-	/* check this first, just to be sure it's indicated
-	 * that it's actually a zip file */
+	/* the end record is what identifies a zip, as the archive
+	 * may have something prepended to it, i.e. self-extractors */
+	ZipDirectory directory;
+	if ( FindZipDirectory( file, &directory ) ) {
+		return ParseZipCentralDirectory( file, &directory );
+	}
+
+	/* no central directory, so it's likely been truncated; if it
+	 * at least starts like a zip, see what we can recover from
+	 * the local headers */
+	qm_fs_file_rewind( file );
+
 	uint32_t magic = qm_fs_file_read_int32( file, false, NULL );
 	if ( magic != ZIP_FILE_MAGIC ) {
 		PlReportErrorF( PL_RESULT_FILETYPE, "invalid magic: %X", magic );
@@ -119,20 +433,7 @@ QmFsPackage *PlParseZipPackage( QmFsFile *file ) {
 
 		snprintf( package->files[ i ].name, sizeof( package->files[ i ].name ), "%s", store->name );
 
-		switch ( store->compression ) {
-			case ZIP_COMPRESSION_DEFLATED:
-				package->files[ i ].compressionType = PL_COMPRESSION_DEFLATE;
-				break;
-			case ZIP_COMPRESSION_IMPLODED:
-				package->files[ i ].compressionType = PL_COMPRESSION_IMPLODE;
-				break;
-			case ZIP_COMPRESSION_NONE:
-				package->files[ i ].compressionType = PL_COMPRESSION_NONE;
-				break;
-			default:
-				package->files[ i ].compressionType = PL_COMPRESSION_UNKNOWN;
-				break;
-		}
+		package->files[ i ].compressionType = GetZipCompressionType( store->compression );
 
 		qm_os_memory_free( store->name );
 		qm_os_memory_free( store->extra );
@@ -156,3 +457,205 @@ QmFsPackage *PlLoadZipPackage( const char *path ) {
 	PlCloseFile( file );
 	return package;
 }
+
+/****************************************
+ * Writer
+ ****************************************/
+
+/* entries aren't timestamped, so output is reproducible; 1980-01-01 */
+#define ZIP_WRITE_DATE 0x0021
+
+#define ZIP_VERSION_DEFAULT 20
+#define ZIP_VERSION_ZIP64   45
+
+typedef struct ZipWriteEntry {
+	uint64_t offset; /* of the local header */
+	uint64_t size;
+	uint64_t compressedSize;
+	uint32_t crc;
+	bool deflated;
+} ZipWriteEntry;
+
+typedef struct ZipWriter {
+	FILE *fp;
+	uint64_t offset;
+	ZipWriteEntry *entries;
+} ZipWriter;
+
+static bool WriteZipData( ZipWriter *writer, const void *data, size_t size ) {
+	if ( fwrite( data, 1, size, writer->fp ) != size ) {
+		PlReportErrorF( PL_RESULT_FILEWRITE, "failed to write to zip" );
+		return false;
+	}
+
+	writer->offset += size;
+	return true;
+}
+
+static void GetZipWriteName( const QmFsPackageFile *pi, char *dst, size_t dstSize ) {
+	snprintf( dst, dstSize, "%s", pi->name );
+	for ( char *c = dst; *c != '\0'; ++c ) {
+		if ( *c == '\\' ) {
+			*c = '/';
+		}
+	}
+}
+
+static bool WriteZipEntry( QmFsPackage *package, unsigned int index, const QmFsPackageWriteEntry *entry, void *userData ) {
+	ZipWriter *writer = userData;
+
+	ZipWriteEntry *we = &writer->entries[ index ];
+	we->offset = writer->offset;
+	we->size = entry->size;
+	we->compressedSize = entry->compressedSize;
+	we->crc = entry->crc;
+	we->deflated = entry->deflated;
+
+	PLPath name;
+	GetZipWriteName( &package->files[ index ], name, sizeof( name ) );
+	size_t nameSize = strlen( name );
+
+	bool isZip64 = ( we->size >= UINT32_MAX || we->compressedSize >= UINT32_MAX );
+
+	uint8_t header[ ZIP_LOCAL_HEADER_SIZE + 20 ];
+	uint8_t *p = PutZip32( header, ZIP_FILE_MAGIC );
+	p = PutZip16( p, isZip64 ? ZIP_VERSION_ZIP64 : ZIP_VERSION_DEFAULT );
+	p = PutZip16( p, 0 );
+	p = PutZip16( p, we->deflated ? ZIP_COMPRESSION_DEFLATED : ZIP_COMPRESSION_NONE );
+	p = PutZip16( p, 0 );
+	p = PutZip16( p, ZIP_WRITE_DATE );
+	p = PutZip32( p, we->crc );
+	p = PutZip32( p, isZip64 ? UINT32_MAX : ( uint32_t ) we->compressedSize );
+	p = PutZip32( p, isZip64 ? UINT32_MAX : ( uint32_t ) we->size );
+	p = PutZip16( p, ( uint16_t ) nameSize );
+	p = PutZip16( p, isZip64 ? 20 : 0 );
+
+	bool status = WriteZipData( writer, header, ( size_t ) ( p - header ) ) && WriteZipData( writer, name, nameSize );
+	if ( status && isZip64 ) {
+		p = PutZip16( header, ZIP64_EXTRA_ID );
+		p = PutZip16( p, 16 );
+		p = PutZip64( p, we->size );
+		p = PutZip64( p, we->compressedSize );
+		status = WriteZipData( writer, header, ( size_t ) ( p - header ) );
+	}
+
+	return status && WriteZipData( writer, entry->data, entry->compressedSize );
+}
+
+static bool WriteZipCentralDirectory( ZipWriter *writer, const QmFsPackage *package ) {
+	uint64_t directoryOffset = writer->offset;
+
+	for ( unsigned int i = 0; i < package->numFiles; ++i ) {
+		const ZipWriteEntry *we = &writer->entries[ i ];
+
+		PLPath name;
+		GetZipWriteName( &package->files[ i ], name, sizeof( name ) );
+		size_t nameSize = strlen( name );
+
+		/* only the fields that overflow go into the extra field */
+		uint8_t extra[ 28 ];
+		uint8_t *e = extra + 4;
+		if ( we->size >= UINT32_MAX ) {
+			e = PutZip64( e, we->size );
+		}
+		if ( we->compressedSize >= UINT32_MAX ) {
+			e = PutZip64( e, we->compressedSize );
+		}
+		if ( we->offset >= UINT32_MAX ) {
+			e = PutZip64( e, we->offset );
+		}
+
+		uint16_t extraSize = ( e != extra + 4 ) ? ( uint16_t ) ( e - extra ) : 0;
+		PutZip16( PutZip16( extra, ZIP64_EXTRA_ID ), ( uint16_t ) ( extraSize - 4 ) );
+
+		uint16_t version = ( extraSize > 0 ) ? ZIP_VERSION_ZIP64 : ZIP_VERSION_DEFAULT;
+
+		uint8_t header[ ZIP_CENTRAL_HEADER_SIZE ];
+		uint8_t *p = PutZip32( header, ZIP_CENTRAL_MAGIC );
+		p = PutZip16( p, version );
+		p = PutZip16( p, version );
+		p = PutZip16( p, 0 );
+		p = PutZip16( p, we->deflated ? ZIP_COMPRESSION_DEFLATED : ZIP_COMPRESSION_NONE );
+		p = PutZip16( p, 0 );
+		p = PutZip16( p, ZIP_WRITE_DATE );
+		p = PutZip32( p, we->crc );
+		p = PutZip32( p, ( uint32_t ) QM_OS_MIN( we->compressedSize, ( uint64_t ) UINT32_MAX ) );
+		p = PutZip32( p, ( uint32_t ) QM_OS_MIN( we->size, ( uint64_t ) UINT32_MAX ) );
+		p = PutZip16( p, ( uint16_t ) nameSize );
+		p = PutZip16( p, extraSize );
+		p = PutZip16( p, 0 ); /* comment */
+		p = PutZip16( p, 0 ); /* disk */
+		p = PutZip16( p, 0 ); /* internal attributes */
+		p = PutZip32( p, 0 ); /* external attributes */
+		PutZip32( p, ( uint32_t ) QM_OS_MIN( we->offset, ( uint64_t ) UINT32_MAX ) );
+
+		if ( !WriteZipData( writer, header, sizeof( header ) ) ||
+		     !WriteZipData( writer, name, nameSize ) ||
+		     !WriteZipData( writer, extra, extraSize ) ) {
+			return false;
+		}
+	}
+
+	uint64_t directorySize = writer->offset - directoryOffset;
+	uint64_t numEntries = package->numFiles;
+
+	if ( numEntries >= UINT16_MAX || directorySize >= UINT32_MAX || directoryOffset >= UINT32_MAX ) {
+		uint64_t end64Offset = writer->offset;
+
+		uint8_t end64[ ZIP64_END_SIZE + ZIP64_LOCATOR_SIZE ];
+		uint8_t *p = PutZip32( end64, ZIP64_END_MAGIC );
+		p = PutZip64( p, ZIP64_END_SIZE - 12 );
+		p = PutZip16( p, ZIP_VERSION_ZIP64 );
+		p = PutZip16( p, ZIP_VERSION_ZIP64 );
+		p = PutZip32( p, 0 );
+		p = PutZip32( p, 0 );
+		p = PutZip64( p, numEntries );
+		p = PutZip64( p, numEntries );
+		p = PutZip64( p, directorySize );
+		p = PutZip64( p, directoryOffset );
+
+		p = PutZip32( p, ZIP64_LOCATOR_MAGIC );
+		p = PutZip32( p, 0 );
+		p = PutZip64( p, end64Offset );
+		PutZip32( p, 1 );
+
+		if ( !WriteZipData( writer, end64, sizeof( end64 ) ) ) {
+			return false;
+		}
+	}
+
+	uint8_t end[ ZIP_END_SIZE ];
+	uint8_t *p = PutZip32( end, ZIP_END_MAGIC );
+	p = PutZip16( p, 0 );
+	p = PutZip16( p, 0 );
+	p = PutZip16( p, ( uint16_t ) QM_OS_MIN( numEntries, ( uint64_t ) UINT16_MAX ) );
+	p = PutZip16( p, ( uint16_t ) QM_OS_MIN( numEntries, ( uint64_t ) UINT16_MAX ) );
+	p = PutZip32( p, ( uint32_t ) QM_OS_MIN( directorySize, ( uint64_t ) UINT32_MAX ) );
+	p = PutZip32( p, ( uint32_t ) QM_OS_MIN( directoryOffset, ( uint64_t ) UINT32_MAX ) );
+	PutZip16( p, 0 );
+
+	return WriteZipData( writer, end, sizeof( end ) );
+}
+
+/**
+ * Writes the package out as a zip. Entries flagged for deflate or
+ * gzip compression are deflated, unless that doesn't save anything.
+ */
+bool PlWriteZipPackage_( QmFsPackage *package, const char *path ) {
+	ZipWriter writer = {};
+	writer.fp = fopen( path, "wb" );
+	if ( writer.fp == NULL ) {
+		PlReportErrorF( PL_RESULT_FILEWRITE, "failed to open %s", path );
+		return false;
+	}
+
+	writer.entries = QM_OS_MEMORY_NEW_( ZipWriteEntry, package->numFiles + 1 );
+
+	bool status = qm_fs_package_write_entries_( package, true, WriteZipEntry, &writer ) &&
+	              WriteZipCentralDirectory( &writer, package );
+
+	qm_os_memory_free( writer.entries );
+	qm_fs_fclose( &writer.fp );
+
+	return status;
+}
@@ -0,0 +1,227 @@
+// SPDX-License-Identifier: MIT
+// Hei Platform Library
+// Copyright © 2017-2026 Quartermind Games, Mark E. Sowden <markelswo@gmail.com>
+// Purpose: Name lookup index for package entries.
+
+#include <ctype.h>
+
+#include "package_private.h"
+#include "filesystem_private.h"
+
+#include "qmos/public/qm_os_memory.h"
+
+#include <plcore/pl_hashtable.h>
+
+/**
+ * Each package keeps a hash of its entry names, for exact lookups, and
+ * a copy of the table sorted by name, so entries sharing a prefix sit
+ * together and can be enumerated without visiting everything else.
+ * Where there are duplicate names, the first entry wins, same as the
+ * linear search this replaces.
+ */
+
+typedef struct QmFsPackageIndexEntry
+{
+	const char  *name;
+	unsigned int index;
+} QmFsPackageIndexEntry;
+
+typedef struct QmFsPackageIndex
+{
+	PLHashTable           *table;// name -> index + 1
+	QmFsPackageIndexEntry *sorted;
+	unsigned int           numFiles;
+	bool                   caseInsensitive;
+} QmFsPackageIndex;
+
+static size_t generate_key( const QmFsPackageIndex *index, const char *name, char *dst, size_t dstSize )
+{
+	size_t length = 0;
+	for ( ; name[ length ] != '\0' && length < dstSize - 1; ++length )
+	{
+		dst[ length ] = index->caseInsensitive ? ( char ) tolower( ( unsigned char ) name[ length ] ) : name[ length ];
+	}
+
+	dst[ length ] = '\0';
+	return length;
+}
+
+static int compare_entries( const void *a, const void *b )
+{
+	int r = strcmp( ( ( const QmFsPackageIndexEntry * ) a )->name, ( ( const QmFsPackageIndexEntry * ) b )->name );
+	return ( r != 0 ) ? r : ( int ) ( ( const QmFsPackageIndexEntry * ) a )->index - ( int ) ( ( const QmFsPackageIndexEntry * ) b )->index;
+}
+
+static int compare_entries_nocase( const void *a, const void *b )
+{
+	int r = pl_strcasecmp( ( ( const QmFsPackageIndexEntry * ) a )->name, ( ( const QmFsPackageIndexEntry * ) b )->name );
+	return ( r != 0 ) ? r : ( int ) ( ( const QmFsPackageIndexEntry * ) a )->index - ( int ) ( ( const QmFsPackageIndexEntry * ) b )->index;
+}
+
+void qm_fs_package_destroy_index_( QmFsPackage *package )
+{
+	QmFsPackageIndex *index = package->internal.index;
+	if ( index == nullptr )
+	{
+		return;
+	}
+
+	PlDestroyHashTable( index->table );
+	qm_os_memory_free( index->sorted );
+	qm_os_memory_free( index );
+
+	package->internal.index = nullptr;
+}
+
+/**
+ * (Re)builds the index for the package. This needs to be done
+ * whenever the table changes, otherwise lookups will fall back
+ * to searching through every entry.
+ */
+void qm_fs_package_build_index_( QmFsPackage *package )
+{
+	qm_fs_package_destroy_index_( package );
+
+	QmFsPackageIndex *index = QM_OS_MEMORY_NEW( QmFsPackageIndex );
+	index->table            = PlCreateHashTable();
+	index->sorted           = QM_OS_MEMORY_NEW_( QmFsPackageIndexEntry, package->numFiles + 1 );
+	index->numFiles         = package->numFiles;
+	index->caseInsensitive  = package->internal.caseInsensitive;
+
+	for ( unsigned int i = 0; i < package->numFiles; ++i )
+	{
+		index->sorted[ i ].name  = package->files[ i ].name;
+		index->sorted[ i ].index = i;
+
+		char   key[ sizeof( PLPath ) ];
+		size_t keySize = generate_key( index, package->files[ i ].name, key, sizeof( key ) );
+		if ( PlLookupHashTableNode( index->table, key, keySize ) != nullptr )
+		{
+			continue;
+		}
+
+		PlInsertHashTableNode( index->table, key, keySize, ( void * ) ( uintptr_t ) ( i + 1 ) );
+	}
+
+	qsort( index->sorted, package->numFiles, sizeof( QmFsPackageIndexEntry ), index->caseInsensitive ? compare_entries_nocase : compare_entries );
+
+	package->internal.index = index;
+}
+
+/**
+ * Sets whether names are matched regardless of case, which some of the
+ * DOS-era formats may want. Packages match exactly unless asked otherwise.
+ * This rebuilds the index.
+ */
+void PlSetPackageCaseInsensitive( QmFsPackage *package, bool caseInsensitive )
+{
+	package->internal.caseInsensitive = caseInsensitive;
+	qm_fs_package_build_index_( package );
+}
+
+static bool is_index_valid( const QmFsPackage *package )
+{
+	const QmFsPackageIndex *index = package->internal.index;
+	return ( index != nullptr && index->numFiles == package->numFiles );
+}
+
+int PlGetPackageTableIndex( const QmFsPackage *package, const char *indexName )
+{
+	FunctionStart();
+
+	if ( is_index_valid( package ) )
+	{
+		const QmFsPackageIndex *index = package->internal.index;
+
+		char   key[ sizeof( PLPath ) ];
+		size_t keySize = generate_key( index, indexName, key, sizeof( key ) );
+
+		uintptr_t i = ( uintptr_t ) PlLookupHashTableUserData( index->table, key, keySize );
+		if ( i != 0 )
+		{
+			return ( int ) ( i - 1 );
+		}
+	}
+	else
+	{
+		for ( unsigned int i = 0; i < package->numFiles; ++i )
+		{
+			int r = package->internal.caseInsensitive ? pl_strcasecmp( indexName, package->files[ i ].name )
+			                                          : strcmp( indexName, package->files[ i ].name );
+			if ( r != 0 )
+			{
+				continue;
+			}
+
+			return ( int ) i;
+		}
+	}
+
+	PlReportBasicError( PL_RESULT_INVALID_PARM2 );
+
+	return -1;
+}
+
+/**
+ * Calls the given function for every entry whose name begins with the
+ * prefix, in name order. Returns the number of entries visited.
+ */
+unsigned int PlEnumeratePackageFiles( const QmFsPackage *package, const char *prefix, PLPackageEnumerateCallback callback, void *userData )
+{
+	size_t prefixLength = ( prefix != nullptr ) ? strlen( prefix ) : 0;
+	bool   nocase       = package->internal.caseInsensitive;
+
+	if ( !is_index_valid( package ) )
+	{
+		unsigned int numVisited = 0;
+		for ( unsigned int i = 0; i < package->numFiles; ++i )
+		{
+			const char *name = package->files[ i ].name;
+			if ( prefixLength > 0 && ( nocase ? pl_strncasecmp( name, prefix, prefixLength ) : strncmp( name, prefix, prefixLength ) ) != 0 )
+			{
+				continue;
+			}
+
+			callback( package, i, userData );
+			numVisited++;
+		}
+
+		return numVisited;
+	}
+
+	const QmFsPackageIndex *index = package->internal.index;
+
+	/* find the first entry that isn't ordered before the prefix */
+	unsigned int lower = 0, upper = index->numFiles;
+	if ( prefixLength > 0 )
+	{
+		while ( lower < upper )
+		{
+			unsigned int middle = lower + ( upper - lower ) / 2;
+			const char  *name   = index->sorted[ middle ].name;
+			if ( ( nocase ? pl_strcasecmp( name, prefix ) : strcmp( name, prefix ) ) < 0 )
+			{
+				lower = middle + 1;
+			}
+			else
+			{
+				upper = middle;
+			}
+		}
+	}
+
+	unsigned int numVisited = 0;
+	for ( unsigned int i = lower; i < index->numFiles; ++i )
+	{
+		const char *name = index->sorted[ i ].name;
+		if ( prefixLength > 0 && ( nocase ? pl_strncasecmp( name, prefix, prefixLength ) : strncmp( name, prefix, prefixLength ) ) != 0 )
+		{
+			break;
+		}
+
+		callback( package, index->sorted[ i ].index, userData );
+		numVisited++;
+	}
+
+	return numVisited;
+}
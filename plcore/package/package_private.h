@@ -11,6 +11,22 @@
 
 PL_EXTERN_C
 
+/**
+ * Set on an entry's offset if the parser left it for the package's
+ * ResolveFile function to fill in, the first time it's accessed.
+ */
+#define PL_PACKAGE_OFFSET_UNRESOLVED ( UINT64_C( 1 ) << 63 )
+
+/**
+ * Ensures the entry's offset has been resolved, before it's read.
+ */
+bool qm_fs_package_resolve_file_( QmFsPackage *package, unsigned int index );
+
+/**
+ * Resolver for ZIP entries, which are left pointing at their local header.
+ */
+bool PlResolveZipFile_( QmFsPackage *package, QmFsPackageFile *pi );
+
 QmFsPackage *PlParseDfsPackage_( QmFsFile *file );
 
 QmFsPackage *PlParseWadPackage_( QmFsFile *file );
@@ -38,4 +54,30 @@ QmFsPackage *PlParseRarPackage_( QmFsFile *file );
 
 #endif
 
+bool PlWriteZipPackage_( QmFsPackage *package, const char *path );
+bool PlWritePakPackage_( QmFsPackage *package, const char *path );
+
+/**
+ * An entry that's been loaded from its source, and possibly
+ * deflated, ready to be written out to the package.
+ */
+typedef struct QmFsPackageWriteEntry
+{
+	void    *data;
+	size_t   size;          // of the source
+	size_t   compressedSize;// of data, same as size if stored
+	uint32_t crc;           // of the source
+	bool     deflated;      // raw deflate, otherwise stored
+	bool     status;
+	bool     done;
+} QmFsPackageWriteEntry;
+
+typedef bool ( *QmFsPackageWriteFunction )( QmFsPackage *package, unsigned int index, const QmFsPackageWriteEntry *entry, void *userData );
+
+/**
+ * Prepares each entry of the package across worker threads, handing
+ * them to the given function one at a time in table order.
+ */
+bool qm_fs_package_write_entries_( QmFsPackage *package, bool allowCompression, QmFsPackageWriteFunction function, void *userData );
+
 PL_EXTERN_C_END
@@ -0,0 +1,340 @@
+// SPDX-License-Identifier: MIT
+// Hei Platform Library
+// Copyright © 2017-2026 Quartermind Games, Mark E. Sowden <markelswo@gmail.com>
+// Purpose: On-disk snapshots of parsed package tables.
+
+#include "package_private.h"
+#include "filesystem_private.h"
+
+#include "qmos/public/qm_os_memory.h"
+
+#include <stdatomic.h>
+
+#if defined( _MSC_VER )
+#	include <process.h>
+#	define SNAPSHOT_GETPID _getpid
+#else
+#	include <unistd.h>
+#	define SNAPSHOT_GETPID getpid
+#endif
+
+/**
+ * Parsing the table of some formats means a great many small reads, so
+ * once a package has been parsed its table is written out to the snapshot
+ * directory. The next time the same package is loaded, provided its size
+ * and timestamp haven't changed, the snapshot is mapped in and the table
+ * is filled straight from that instead. That's still a copy of each record
+ * into the package's table, which owns it, but it's a single pass over
+ * memory, rather than parsing the package again.
+ *
+ * Entries that ZIP leaves to be resolved on access are stored that way,
+ * and picked up by the same resolver once loaded, so saving doesn't cost
+ * a read of every local header.
+ *
+ * Each package gets a snapshot of its own, named after a hash of its
+ * path. The full path is stored too, so a collision is just a miss.
+ *
+ * Layout is native, as snapshots aren't expected to move between
+ * machines; the magic will fail to match if they do.
+ *
+ *  header
+ *  path, nul terminated and padded to 8 bytes
+ *  records[ numFiles ]
+ *  names, each nul terminated
+ */
+
+#define SNAPSHOT_MAGIC     QM_OS_MAGIC_TO_NUM( 'P', 'L', 'I', 'X' )
+#define SNAPSHOT_VERSION   1
+#define SNAPSHOT_EXTENSION "pidx"
+
+enum
+{
+	QM_OS_BIT_FLAG( SNAPSHOT_FLAG_CASE_INSENSITIVE, 0 ),
+	QM_OS_BIT_FLAG( SNAPSHOT_FLAG_ZIP_OFFSETS, 1 ),/* unresolved offsets are for PlResolveZipFile_ */
+};
+
+typedef struct SnapshotHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t fileSize;
+	int64_t  timeStamp;
+	uint32_t numFiles;
+	uint32_t flags;
+	uint32_t pathSize;// including terminator and padding
+	uint32_t namesSize;
+} SnapshotHeader;
+
+typedef struct SnapshotRecord
+{
+	uint64_t offset;
+	uint64_t size;
+	uint64_t compressedSize;
+	uint32_t compressionType;
+	uint32_t name;// offset into names
+} SnapshotRecord;
+
+PL_STATIC_ASSERT( sizeof( SnapshotHeader ) == 40, "unexpected snapshot header size" );
+PL_STATIC_ASSERT( sizeof( SnapshotRecord ) == 32, "unexpected snapshot record size" );
+
+static PLPath      snapshotDirectory = "";
+static atomic_uint numSnapshotSaves;// for naming temporary files
+
+/**
+ * Sets where package snapshots are kept, creating it if need be.
+ * Passing null, or an empty string, disables them.
+ */
+void PlSetPackageSnapshotDirectory( const char *path )
+{
+	if ( PL_INVALID_STRING( path ) )
+	{
+		*snapshotDirectory = '\0';
+		return;
+	}
+
+	if ( !PlCreatePath( path ) )
+	{
+		*snapshotDirectory = '\0';
+		return;
+	}
+
+	snprintf( snapshotDirectory, sizeof( snapshotDirectory ), "%s", path );
+}
+
+const char *PlGetPackageSnapshotDirectory( void )
+{
+	return ( *snapshotDirectory != '\0' ) ? snapshotDirectory : nullptr;
+}
+
+static bool get_snapshot_path( const char *path, char *dst, size_t dstSize )
+{
+	uint64_t hash = PlGenerateHashFNV1( path, strlen( path ) );
+
+	int r = snprintf( dst, dstSize, "%s/%016llx." SNAPSHOT_EXTENSION, snapshotDirectory, ( unsigned long long ) hash );
+	return ( r > 0 && ( size_t ) r < dstSize );
+}
+
+static size_t get_path_size( const char *path )
+{
+	return ( strlen( path ) + 1 + 7 ) & ~( size_t ) 7;
+}
+
+/**
+ * Returns a new package for the given path, filled from its snapshot,
+ * or null if there's no snapshot or it's stale. Entries are loaded via
+ * the generic loader, as only packages using that are ever snapshotted.
+ */
+QmFsPackage *qm_fs_package_snapshot_load_( const char *path, size_t fileSize, time_t timeStamp )
+{
+	if ( *snapshotDirectory == '\0' || timeStamp == 0 )
+	{
+		return nullptr;
+	}
+
+	PLPath snapshotPath;
+	if ( !get_snapshot_path( path, snapshotPath, sizeof( snapshotPath ) ) || !qm_fs_check_local_file_exists( snapshotPath ) )
+	{
+		return nullptr;
+	}
+
+	QmFsMapping *mapping = qm_fs_mapping_open( snapshotPath );
+	if ( mapping == nullptr )
+	{
+		return nullptr;
+	}
+
+	const uint8_t *data = qm_fs_mapping_get_data( mapping );
+	size_t         size = qm_fs_mapping_get_size( mapping );
+
+	const SnapshotHeader *header = ( const SnapshotHeader * ) data;
+	if ( size < sizeof( SnapshotHeader ) ||
+	     header->magic != SNAPSHOT_MAGIC ||
+	     header->version != SNAPSHOT_VERSION ||
+	     header->fileSize != fileSize ||
+	     header->timeStamp != ( int64_t ) timeStamp ||
+	     header->pathSize != get_path_size( path ) )
+	{
+		qm_fs_mapping_release( mapping );
+		return nullptr;
+	}
+
+	/* make sure it all fits before we go poking about in it */
+	uint64_t expectedSize = sizeof( SnapshotHeader ) + ( uint64_t ) header->pathSize +
+	                        ( uint64_t ) header->numFiles * sizeof( SnapshotRecord ) + header->namesSize;
+	if ( expectedSize != size )
+	{
+		qm_fs_mapping_release( mapping );
+		return nullptr;
+	}
+
+	const char *storedPath = ( const char * ) ( data + sizeof( SnapshotHeader ) );
+	if ( strcmp( storedPath, path ) != 0 )
+	{
+		qm_fs_mapping_release( mapping );
+		return nullptr;
+	}
+
+	const SnapshotRecord *records = ( const SnapshotRecord * ) ( storedPath + header->pathSize );
+	const char           *names   = ( const char * ) ( records + header->numFiles );
+
+	QmFsPackage *package = PlCreatePackageHandle( path, header->numFiles, nullptr );
+	for ( unsigned int i = 0; i < header->numFiles; ++i )
+	{
+		const SnapshotRecord *record = &records[ i ];
+		if ( record->name >= header->namesSize || memchr( names + record->name, '\0', header->namesSize - record->name ) == nullptr )
+		{
+			PlDestroyPackage( package );
+			qm_fs_mapping_release( mapping );
+			return nullptr;
+		}
+
+		const char *name       = names + record->name;
+		size_t      nameLength = strlen( name );
+		if ( nameLength >= sizeof( PLPath ) )
+		{
+			PlDestroyPackage( package );
+			qm_fs_mapping_release( mapping );
+			return nullptr;
+		}
+
+		QmFsPackageFile *pi = &package->files[ i ];
+		memcpy( pi->name, name, nameLength + 1 );
+		pi->offset          = record->offset;
+		pi->size            = ( size_t ) record->size;
+		pi->compressedSize  = ( size_t ) record->compressedSize;
+		pi->compressionType = ( PLCompressionType ) record->compressionType;
+	}
+
+	package->internal.caseInsensitive = ( header->flags & SNAPSHOT_FLAG_CASE_INSENSITIVE ) != 0;
+	if ( header->flags & SNAPSHOT_FLAG_ZIP_OFFSETS )
+	{
+		package->internal.ResolveFile = PlResolveZipFile_;
+	}
+	package->internal.timeStamp       = timeStamp;
+
+	qm_fs_mapping_release( mapping );
+
+	return package;
+}
+
+/**
+ * Writes out a snapshot of the package's table. It's written under
+ * a temporary name first, so a snapshot is never seen half written.
+ * Failing to write one isn't an error as far as the caller's concerned.
+ */
+void qm_fs_package_snapshot_save_( QmFsPackage *package, size_t fileSize )
+{
+	if ( *snapshotDirectory == '\0' || package->internal.timeStamp == 0 )
+	{
+		return;
+	}
+
+	/* ZIP offsets can be left for its resolver to pick up after loading,
+	 * but there's no way to say which resolver anything else needs, so
+	 * those have to be resolved now */
+	bool zipOffsets = ( package->internal.ResolveFile == PlResolveZipFile_ );
+	if ( package->internal.ResolveFile != nullptr && !zipOffsets )
+	{
+		for ( unsigned int i = 0; i < package->numFiles; ++i )
+		{
+			if ( !qm_fs_package_resolve_file_( package, i ) )
+			{
+				return;
+			}
+		}
+	}
+
+	PLPath snapshotPath;
+	if ( !get_snapshot_path( package->path, snapshotPath, sizeof( snapshotPath ) ) )
+	{
+		return;
+	}
+
+	size_t namesSize = 0;
+	for ( unsigned int i = 0; i < package->numFiles; ++i )
+	{
+		namesSize += strlen( package->files[ i ].name ) + 1;
+	}
+
+	if ( namesSize > UINT32_MAX )
+	{
+		return;
+	}
+
+	size_t pathSize = get_path_size( package->path );
+	size_t size     = sizeof( SnapshotHeader ) + pathSize + package->numFiles * sizeof( SnapshotRecord ) + namesSize;
+
+	uint8_t *buffer = QM_OS_MEMORY_NEW_( uint8_t, size );
+
+	SnapshotHeader *header = ( SnapshotHeader * ) buffer;
+	header->magic          = SNAPSHOT_MAGIC;
+	header->version        = SNAPSHOT_VERSION;
+	header->fileSize       = fileSize;
+	header->timeStamp      = ( int64_t ) package->internal.timeStamp;
+	header->numFiles       = package->numFiles;
+	header->flags          = ( package->internal.caseInsensitive ? SNAPSHOT_FLAG_CASE_INSENSITIVE : 0 ) |
+	                         ( zipOffsets ? SNAPSHOT_FLAG_ZIP_OFFSETS : 0 );
+	header->pathSize       = ( uint32_t ) pathSize;
+	header->namesSize      = ( uint32_t ) namesSize;
+
+	char *path = ( char * ) ( buffer + sizeof( SnapshotHeader ) );
+	strcpy( path, package->path );
+
+	SnapshotRecord *records = ( SnapshotRecord * ) ( path + pathSize );
+	char           *names   = ( char * ) ( records + package->numFiles );
+
+	uint32_t nameOffset = 0;
+	for ( unsigned int i = 0; i < package->numFiles; ++i )
+	{
+		const QmFsPackageFile *pi = &package->files[ i ];
+
+		records[ i ].offset          = pi->offset;
+		records[ i ].size            = pi->size;
+		records[ i ].compressedSize  = pi->compressedSize;
+		records[ i ].compressionType = ( uint32_t ) pi->compressionType;
+		records[ i ].name            = nameOffset;
+
+		size_t length = strlen( pi->name ) + 1;
+		memcpy( names + nameOffset, pi->name, length );
+		nameOffset += ( uint32_t ) length;
+	}
+
+	/* unique to this save, so concurrent saves of the same
+	 * snapshot, from this process or another, don't collide */
+	char tmpPath[ sizeof( PLPath ) + 32 ];
+	int  r = snprintf( tmpPath, sizeof( tmpPath ), "%s.%lu.%u.tmp", snapshotPath, ( unsigned long ) SNAPSHOT_GETPID(), atomic_fetch_add( &numSnapshotSaves, 1 ) );
+	if ( r > 0 && ( size_t ) r < sizeof( tmpPath ) && PlWriteFile( tmpPath, buffer, size ) )
+	{
+		r = rename( tmpPath, snapshotPath );
+		if ( r != 0 )
+		{
+			/* windows won't replace an existing file on rename */
+			qm_fs_delete_file( snapshotPath );
+			r = rename( tmpPath, snapshotPath );
+		}
+
+		if ( r != 0 )
+		{
+			qm_fs_delete_file( tmpPath );
+		}
+	}
+
+	qm_os_memory_free( buffer );
+}
+
+/**
+ * Deletes the snapshot for the given package path, if there is one.
+ */
+void PlDeletePackageSnapshot( const char *path )
+{
+	if ( *snapshotDirectory == '\0' )
+	{
+		return;
+	}
+
+	PLPath snapshotPath;
+	if ( get_snapshot_path( path, snapshotPath, sizeof( snapshotPath ) ) && qm_fs_check_local_file_exists( snapshotPath ) )
+	{
+		qm_fs_delete_file( snapshotPath );
+	}
+}
@@ -0,0 +1,335 @@
+// SPDX-License-Identifier: MIT
+// Hei Platform Library
+// Copyright © 2017-2026 Quartermind Games, Mark E. Sowden <markelswo@gmail.com>
+// Purpose: Streaming of package entries, decompressing as they're read.
+
+#include "package_private.h"
+#include "filesystem_private.h"
+
+#define MINIZ_NO_ARCHIVE_APIS
+#include "../3rdparty/miniz/miniz.h"
+#include "../3rdparty/blast/blast.h"
+#include "qmos/public/qm_os_memory.h"
+
+/* amount of compressed data pulled in at a time */
+#define STREAM_WINDOW_SIZE 65536
+
+typedef struct PackageStream
+{
+	QmFsStream base;
+
+	PLCompressionType compressionType;
+	PLPath            name;
+
+	/* where the compressed data is pulled from; either our own
+	 * handle onto the package, or the package's mapping */
+	QmFsFile      *file;
+	QmFsMapping   *mapping;
+	const uint8_t *mapped;
+	uint64_t       offset;
+	size_t         compressedSize;
+	size_t         consumed;
+	uint8_t       *in;
+
+	bool finished;
+	bool failed;
+
+	/* deflate */
+	mz_stream z;
+
+	/* implode; decompressed a window at a time, as it's read */
+	struct blast_stream *implode;
+	unsigned char       *window;
+	unsigned int         windowLength;
+	unsigned int         windowPos;
+} PackageStream;
+
+/**
+ * Fetches the next chunk of compressed data,
+ * returning 0 once it's all been consumed.
+ */
+static size_t pull_input( PackageStream *self, const uint8_t **data )
+{
+	size_t n = QM_OS_MIN( self->compressedSize - self->consumed, ( size_t ) UINT32_MAX );
+	if ( n == 0 )
+	{
+		return 0;
+	}
+
+	if ( self->mapped != nullptr )
+	{
+		*data = self->mapped + self->offset + self->consumed;
+	}
+	else
+	{
+		n     = qm_fs_file_read_at( self->file, self->in, QM_OS_MIN( n, STREAM_WINDOW_SIZE ), ( PLFileOffset ) ( self->offset + self->consumed ) );
+		*data = self->in;
+	}
+
+	self->consumed += n;
+	return n;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Stored
+/////////////////////////////////////////////////////////////////////////////////////
+
+static size_t stored_read( QmFsStream *base, void *dest, size_t size )
+{
+	PackageStream *self = ( PackageStream * ) base;
+
+	size = QM_OS_MIN( size, self->compressedSize - self->consumed );
+	if ( size == 0 )
+	{
+		return 0;
+	}
+
+	size_t r = qm_fs_file_read_at( self->file, dest, size, ( PLFileOffset ) ( self->offset + self->consumed ) );
+	self->consumed += r;
+	return r;
+}
+
+static bool stored_restart( QmFsStream *base )
+{
+	PackageStream *self = ( PackageStream * ) base;
+	self->consumed      = 0;
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Deflate
+/////////////////////////////////////////////////////////////////////////////////////
+
+static size_t inflate_read( QmFsStream *base, void *dest, size_t size )
+{
+	PackageStream *self = ( PackageStream * ) base;
+
+	size_t numRead = 0;
+	while ( numRead < size && !self->finished && !self->failed )
+	{
+		if ( self->z.avail_in == 0 )
+		{
+			const uint8_t *data;
+			size_t         n = pull_input( self, &data );
+			if ( n == 0 )
+			{
+				PlReportErrorF( PL_RESULT_FILEREAD, "ran out of input before completing decompression (%s)", self->name );
+				self->failed = true;
+				break;
+			}
+
+			self->z.next_in  = data;
+			self->z.avail_in = ( unsigned int ) n;
+		}
+
+		size_t chunkSize  = QM_OS_MIN( size - numRead, ( size_t ) UINT32_MAX );
+		self->z.next_out  = ( uint8_t * ) dest + numRead;
+		self->z.avail_out = ( unsigned int ) chunkSize;
+
+		int status = mz_inflate( &self->z, MZ_SYNC_FLUSH );
+		numRead += chunkSize - self->z.avail_out;
+		if ( status == MZ_STREAM_END )
+		{
+			self->finished = true;
+		}
+		else if ( status != MZ_OK && status != MZ_BUF_ERROR )
+		{
+			PlReportErrorF( PL_RESULT_FILEERR, "failed to decompress %s (%s)", self->name, zError( status ) );
+			self->failed = true;
+		}
+	}
+
+	return numRead;
+}
+
+static bool inflate_restart( QmFsStream *base )
+{
+	PackageStream *self = ( PackageStream * ) base;
+
+	if ( mz_inflateReset( &self->z ) != MZ_OK )
+	{
+		return false;
+	}
+
+	self->z.avail_in = 0;
+	self->consumed   = 0;
+	self->finished   = false;
+	self->failed     = false;
+
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Implode
+/////////////////////////////////////////////////////////////////////////////////////
+
+static unsigned int implode_in( void *how, unsigned char **buf )
+{
+	const uint8_t *data;
+	size_t         n = pull_input( how, &data );
+	*buf             = ( unsigned char * ) data;
+	return ( unsigned int ) n;
+}
+
+static size_t implode_read( QmFsStream *base, void *dest, size_t size )
+{
+	PackageStream *self = ( PackageStream * ) base;
+
+	size_t numRead = 0;
+	while ( numRead < size && !self->finished && !self->failed )
+	{
+		if ( self->windowPos == self->windowLength )
+		{
+			self->windowPos = 0;
+
+			int status = blast_stream_next( self->implode, &self->window, &self->windowLength );
+			if ( status != 0 )
+			{
+				PlReportErrorF( PL_RESULT_FILEREAD, "failed to decompress %s (%d)", self->name, status );
+				self->failed = true;
+				break;
+			}
+
+			if ( self->windowLength == 0 )
+			{
+				self->finished = true;
+				break;
+			}
+		}
+
+		size_t n = QM_OS_MIN( size - numRead, ( size_t ) ( self->windowLength - self->windowPos ) );
+		memcpy( ( uint8_t * ) dest + numRead, self->window + self->windowPos, n );
+		self->windowPos += ( unsigned int ) n;
+		numRead += n;
+	}
+
+	return numRead;
+}
+
+static bool implode_restart( QmFsStream *base )
+{
+	PackageStream *self = ( PackageStream * ) base;
+
+	blast_stream_init( self->implode, implode_in, self );
+
+	self->window       = nullptr;
+	self->windowLength = 0;
+	self->windowPos    = 0;
+	self->consumed     = 0;
+	self->finished     = false;
+	self->failed       = false;
+
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+static void stream_destroy( QmFsStream *base )
+{
+	PackageStream *self = ( PackageStream * ) base;
+
+	switch ( self->compressionType )
+	{
+		default:
+			break;
+		case PL_COMPRESSION_DEFLATE:
+		case PL_COMPRESSION_GZIP:
+			mz_inflateEnd( &self->z );
+			break;
+		case PL_COMPRESSION_IMPLODE:
+			qm_os_memory_free( self->implode );
+			break;
+	}
+
+	PlCloseFile( self->file );
+	qm_fs_mapping_release( self->mapping );
+
+	qm_os_memory_free( self->in );
+	qm_os_memory_free( self );
+}
+
+QmFsFile *qm_fs_package_open_stream_( QmFsPackage *package, unsigned int index )
+{
+	const QmFsPackageFile *pi = &package->files[ index ];
+
+	PackageStream *self       = QM_OS_MEMORY_NEW( PackageStream );
+	self->base.destroy        = stream_destroy;
+	self->compressionType     = pi->compressionType;
+	snprintf( self->name, sizeof( self->name ), "%s", pi->name );
+	self->offset              = pi->offset;
+	self->compressedSize      = ( pi->compressionType != PL_COMPRESSION_NONE ) ? pi->compressedSize : pi->size;
+
+	if ( package->internal.mapping != nullptr )
+	{
+		size_t mappingSize = qm_fs_mapping_get_size( package->internal.mapping );
+		if ( pi->offset > mappingSize || self->compressedSize > mappingSize - pi->offset )
+		{
+			PlReportErrorF( PL_RESULT_FILESIZE, "entry lies outside of package (%s)", pi->name );
+			qm_os_memory_free( self );
+			return nullptr;
+		}
+
+		self->mapping = qm_fs_mapping_acquire( package->internal.mapping );
+		self->mapped  = qm_fs_mapping_get_data( self->mapping );
+	}
+	else
+	{
+		/* the stream gets its own handle, so it can outlive the package;
+		 * it's only read by offset, so there's no need for read-ahead */
+		self->file = qm_fs_file_open_unbuffered_( package->path );
+		if ( self->file == nullptr )
+		{
+			qm_os_memory_free( self );
+			return nullptr;
+		}
+	}
+
+	switch ( pi->compressionType )
+	{
+		default:
+		{
+			PlReportErrorF( PL_RESULT_UNSUPPORTED, "compression type can't be streamed" );
+			stream_destroy( &self->base );
+			return nullptr;
+		}
+		case PL_COMPRESSION_NONE:
+		{
+			self->base.read    = stored_read;
+			self->base.restart = stored_restart;
+			break;
+		}
+		case PL_COMPRESSION_DEFLATE:
+		case PL_COMPRESSION_GZIP:
+		{
+			int status = mz_inflateInit2( &self->z, ( pi->compressionType == PL_COMPRESSION_GZIP ) ? -MZ_DEFAULT_WINDOW_BITS : MZ_DEFAULT_WINDOW_BITS );
+			if ( status != MZ_OK )
+			{
+				PlReportErrorF( PL_RESULT_FILEERR, "failed to initialize decompression (%s)", zError( status ) );
+				self->compressionType = PL_COMPRESSION_NONE;
+				stream_destroy( &self->base );
+				return nullptr;
+			}
+
+			self->base.read    = inflate_read;
+			self->base.restart = inflate_restart;
+			break;
+		}
+		case PL_COMPRESSION_IMPLODE:
+		{
+			self->implode = QM_OS_MEMORY_NEW( struct blast_stream );
+			blast_stream_init( self->implode, implode_in, self );
+
+			self->base.read    = implode_read;
+			self->base.restart = implode_restart;
+			break;
+		}
+	}
+
+	if ( self->mapped == nullptr && pi->compressionType != PL_COMPRESSION_NONE )
+	{
+		self->in = QM_OS_MEMORY_NEW_( uint8_t, STREAM_WINDOW_SIZE );
+	}
+
+	return qm_fs_file_from_stream( pi->name, &self->base, pi->size );
+}
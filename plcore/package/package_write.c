@@ -1,14 +1,24 @@
 // SPDX-License-Identifier: MIT
 // Copyright © 2017-2023 Mark E Sowden <hogsy@oldtimes-software.com>
 
+#include <stdatomic.h>
+
 #include <plcore/pl_hashtable.h>
 
 #include "package_private.h"
+#include "filesystem_private.h"
+
+#define MINIZ_NO_ARCHIVE_APIS
+#include "../3rdparty/miniz/miniz.h"
+#include "qmos/public/qm_os_memory.h"
+#include "qmos/public/qm_os_thread.h"
 
 #if defined( PL_PACKAGE_WRITE_ENABLED )
 
 static PLHashTable *packageWriteFormats = NULL;//PackageWriter
 
+static unsigned int packageWriteThreads = 0;
+
 void PlRegisterPackageWriter( const char *formatTag, PLWritePackageFunction writeFunction ) {
 	if ( packageWriteFormats == NULL ) {
 		packageWriteFormats = PlCreateHashTable();
@@ -25,11 +35,12 @@ void PlRegisterStandardPackageWriters( unsigned int flags ) {
 	} PackageWriter;
 
 	static const PackageWriter writers[] = {
-	        {PL_PACKAGE_WRITE_FORMAT_BIN_FRESH, PL_PACKAGE_FORMAT_TAG_BIN_FRESH, NULL},
+	        {PL_PACKAGE_WRITE_FORMAT_ZIP,       PL_PACKAGE_FORMAT_TAG_ZIP,       PlWriteZipPackage_},
+	        {PL_PACKAGE_WRITE_FORMAT_PAK_QUAKE, PL_PACKAGE_FORMAT_TAG_PAK_QUAKE, PlWritePakPackage_},
 	};
 
 	for ( unsigned int i = 0; i < QM_OS_ARRAY_ELEMENTS( writers ); ++i ) {
-		if ( flags != PL_PACKAGE_LOAD_FORMAT_ALL && !( flags & writers[ i ].flag ) ) {
+		if ( flags != PL_PACKAGE_WRITE_FORMAT_ALL && !( flags & writers[ i ].flag ) ) {
 			continue;
 		}
 
@@ -39,18 +50,32 @@ void PlRegisterStandardPackageWriters( unsigned int flags ) {
 
 void PlClearPackageWriters( void ) {
 	PlDestroyHashTable( packageWriteFormats );
+	packageWriteFormats = NULL;
+}
+
+/**
+ * Sets the number of threads used to compress entries
+ * when writing a package; 0 uses as many as are available.
+ */
+void PlSetPackageWriterThreads( unsigned int numThreads ) {
+	packageWriteThreads = numThreads;
 }
 
 QmFsPackageFile *PlAppendPackageFromFile( QmFsPackage *package, const char *source, const char *filename, PLCompressionType compressionType ) {
 	if ( package->numFiles >= package->maxFiles ) {
 		static const unsigned int INC = 64;
 		unsigned int newMaxSize = package->maxFiles + INC;
-		package->files = qm_os_memory_realloc( package->files, newMaxSize );
+		package->files = qm_os_memory_realloc( package->files, sizeof( QmFsPackageFile ) * newMaxSize );
 		package->maxFiles = newMaxSize;
 	}
 
+	/* the table's changed, so any index we had is stale */
+	qm_fs_package_destroy_index_( package );
+
 	QmFsPackageFile *index = &package->files[ package->numFiles ];
-	strncpy( index->name, filename, sizeof( index->name ) - 1 );
+	memset( index, 0, sizeof( QmFsPackageFile ) );
+	snprintf( index->sourcePath, sizeof( index->sourcePath ), "%s", source );
+	snprintf( index->name, sizeof( index->name ), "%s", filename );
 	index->compressionType = compressionType;
 
 	package->numFiles++;
@@ -65,10 +90,237 @@ bool PlWritePackage( QmFsPackage *package, const char *path, const char *formatT
 
 	PLWritePackageFunction writeFunction = PlLookupHashTableUserData( packageWriteFormats, formatTag, strlen( formatTag ) );
 	if ( writeFunction == NULL ) {
+		PlReportErrorF( PL_RESULT_UNSUPPORTED, "no package writer registered for \"%s\"", formatTag );
+		return false;
+	}
+
+	/* written out aside and only moved into place once complete,
+	 * so a failure never leaves a truncated archive behind, nor
+	 * takes out whatever was there before */
+	char tmpPath[ PL_SYSTEM_MAX_PATH + 8 ];
+	int r = snprintf( tmpPath, sizeof( tmpPath ), "%s.tmp", path );
+	if ( r < 0 || ( size_t ) r >= sizeof( tmpPath ) ) {
+		PlReportErrorF( PL_RESULT_FILEPATH, "path is too long, %s", path );
+		return false;
+	}
+
+	if ( !writeFunction( package, tmpPath ) ) {
+		qm_fs_delete_file( tmpPath );
+		return false;
+	}
+
+	if ( rename( tmpPath, path ) != 0 ) {
+		/* windows won't replace an existing file on rename */
+		qm_fs_delete_file( path );
+		if ( rename( tmpPath, path ) != 0 ) {
+			PlReportErrorF( PL_RESULT_FILEWRITE, "failed to move %s into place", path );
+			qm_fs_delete_file( tmpPath );
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/****************************************
+ * Write Pipeline
+ *
+ * Sources are loaded and compressed by a pool of workers, while the
+ * calling thread hands each finished entry to the format's writer in
+ * table order, so the archive is written out in a single sequential
+ * pass. Workers only run so far ahead of the writer, which keeps the
+ * number of entries held in memory bounded.
+ ****************************************/
+
+/* how many entries each worker may have ready ahead of the writer */
+#define WRITE_WINDOW_PER_THREAD 4
+
+typedef struct PackageWriteQueue {
+	QmFsPackage *package;
+	bool allowCompression;
+
+	QmFsPackageWriteEntry *entries;
+	unsigned int window;
+
+	atomic_uint next;
+	atomic_bool cancelled;
+
+	QmOsMutex *mutex;
+	QmOsCondition *condition;
+	unsigned int numWritten;
+} PackageWriteQueue;
+
+/**
+ * ZIP wants raw deflate, so the zlib header and
+ * trailing checksum are stripped off what we get back.
+ */
+static void *DeflateEntry( const void *src, size_t srcLength, size_t *dstLength ) {
+	size_t length;
+	uint8_t *data = PlCompress_Deflate( src, srcLength, &length );
+	if ( data == NULL ) {
+		return NULL;
+	}
+
+	if ( length < 6 ) {
+		qm_os_memory_free( data );
+		return NULL;
+	}
+
+	*dstLength = length - 6;
+	memmove( data, data + 2, *dstLength );
+	return data;
+}
+
+static bool PrepareWriteEntry( PackageWriteQueue *queue, unsigned int index ) {
+	const QmFsPackageFile *pi = &queue->package->files[ index ];
+	QmFsPackageWriteEntry *entry = &queue->entries[ index ];
+
+	QmFsFile *file = qm_fs_file_open( pi->sourcePath, true );
+	if ( file == NULL ) {
+		return false;
+	}
+
+	size_t size = qm_fs_file_get_size( file );
+	const void *src = qm_fs_file_get_data( file );
+	if ( src == NULL && size > 0 ) {
+		PlReportErrorF( PL_RESULT_FILEREAD, "failed to load %s", pi->sourcePath );
+		PlCloseFile( file );
 		return false;
 	}
 
-	return writeFunction( package, path );
+	entry->size = size;
+	entry->crc = ( uint32_t ) mz_crc32( MZ_CRC32_INIT, src, size );
+
+	bool deflate = queue->allowCompression && size > 0 &&
+	               ( pi->compressionType == PL_COMPRESSION_DEFLATE || pi->compressionType == PL_COMPRESSION_GZIP );
+	if ( deflate ) {
+		entry->data = DeflateEntry( src, size, &entry->compressedSize );
+		if ( entry->data == NULL ) {
+			PlCloseFile( file );
+			return false;
+		}
+
+		/* not worth it, so just store it */
+		if ( entry->compressedSize >= size ) {
+			qm_os_memory_free( entry->data );
+			entry->data = NULL;
+		} else {
+			entry->deflated = true;
+		}
+	}
+
+	if ( !entry->deflated ) {
+		entry->data = QM_OS_MEMORY_NEW_( uint8_t, size + 1 );
+		memcpy( entry->data, src, size );
+		entry->compressedSize = size;
+	}
+
+	PlCloseFile( file );
+
+	return true;
+}
+
+static void FinishQueuedEntry( PackageWriteQueue *queue, unsigned int index ) {
+	bool status = !atomic_load( &queue->cancelled ) && PrepareWriteEntry( queue, index );
+
+	qm_os_mutex_lock( queue->mutex );
+	queue->entries[ index ].status = status;
+	queue->entries[ index ].done = true;
+	qm_os_condition_broadcast( queue->condition );
+	qm_os_mutex_unlock( queue->mutex );
+}
+
+static void WriteQueueJob( void *userData ) {
+	PackageWriteQueue *queue = userData;
+
+	unsigned int index;
+	while ( ( index = atomic_fetch_add( &queue->next, 1 ) ) < queue->package->numFiles ) {
+		/* don't get too far ahead of the writer */
+		qm_os_mutex_lock( queue->mutex );
+		while ( index >= queue->numWritten + queue->window && !atomic_load( &queue->cancelled ) ) {
+			qm_os_condition_wait( queue->condition, queue->mutex );
+		}
+		qm_os_mutex_unlock( queue->mutex );
+
+		FinishQueuedEntry( queue, index );
+	}
+}
+
+bool qm_fs_package_write_entries_( QmFsPackage *package, bool allowCompression, QmFsPackageWriteFunction function, void *userData ) {
+	if ( package->numFiles == 0 ) {
+		return true;
+	}
+
+	unsigned int numThreads = ( packageWriteThreads != 0 ) ? packageWriteThreads : qm_os_thread_get_available();
+	numThreads = QM_OS_MIN( QM_OS_MAX( numThreads, 1U ), package->numFiles );
+
+	PackageWriteQueue queue = {
+	        .package = package,
+	        .allowCompression = allowCompression,
+	        .window = numThreads * WRITE_WINDOW_PER_THREAD,
+	};
+	atomic_init( &queue.next, 0 );
+	atomic_init( &queue.cancelled, false );
+
+	queue.entries = QM_OS_MEMORY_NEW_( QmFsPackageWriteEntry, package->numFiles );
+	queue.mutex = qm_os_mutex_create();
+	queue.condition = qm_os_condition_create();
+
+	QmWorkerGroup *group = qm_worker_group_start_( WriteQueueJob, &queue, numThreads - 1 );
+
+	bool status = true;
+	for ( unsigned int i = 0; i < package->numFiles; ++i ) {
+		QmFsPackageWriteEntry *entry = &queue.entries[ i ];
+
+		qm_os_mutex_lock( queue.mutex );
+		while ( !entry->done ) {
+			/* rather than sit idle, or wait on workers that may not be free
+			 * to start (or that we don't have), prepare the next one here */
+			unsigned int next = atomic_load( &queue.next );
+			if ( next < package->numFiles && next < queue.numWritten + queue.window &&
+			     atomic_compare_exchange_strong( &queue.next, &next, next + 1 ) ) {
+				qm_os_mutex_unlock( queue.mutex );
+				FinishQueuedEntry( &queue, next );
+				qm_os_mutex_lock( queue.mutex );
+				continue;
+			}
+
+			qm_os_condition_wait( queue.condition, queue.mutex );
+		}
+		qm_os_mutex_unlock( queue.mutex );
+
+		if ( !entry->status || !function( package, i, entry, userData ) ) {
+			status = false;
+		}
+
+		qm_os_memory_free( entry->data );
+		entry->data = NULL;
+
+		qm_os_mutex_lock( queue.mutex );
+		if ( !status ) {
+			atomic_store( &queue.cancelled, true );
+		}
+		queue.numWritten++;
+		qm_os_condition_broadcast( queue.condition );
+		qm_os_mutex_unlock( queue.mutex );
+
+		if ( !status ) {
+			break;
+		}
+	}
+
+	/* waits on anything still in flight */
+	qm_worker_group_wait_( group );
+
+	for ( unsigned int i = 0; i < package->numFiles; ++i ) {
+		qm_os_memory_free( queue.entries[ i ].data );
+	}
+
+	qm_os_memory_free( queue.condition );
+	qm_os_memory_free( queue.mutex );
+	qm_os_memory_free( queue.entries );
+
+	return status;
 }
 
 #endif
@@ -112,7 +112,12 @@ const char *PlGetCommandLineArgumentValueByIndex( unsigned int index ) {
 }
 
 void PlShutdown( void ) {
+	qm_fs_request_shutdown();
+	qm_workers_shutdown_();
 	qm_fs_clear_mounted_locations();
+	qm_fs_watch_shutdown();
+	PlClearFileAliases();
+	PlShutdownPackageSubSystem();
 }
 
 /*-------------------------------------------------------------------
@@ -122,8 +127,7 @@ void PlShutdown( void ) {
 #if defined( _WIN32 )
 
 const char *GetLastError_strerror( uint32_t errnum ) {
-	/* TODO: Make this buffer per-thread */
-	static char buf[ 1024 ] = { '\0' };
+	static thread_local char buf[ 1024 ] = { '\0' };
 
 	if ( !FormatMessage(
 	             FORMAT_MESSAGE_FROM_SYSTEM,
@@ -162,11 +166,11 @@ const char *GetLastError_strerror( int errnum ) {
 #define MAX_FUNCTION_LENGTH 64
 #define MAX_ERROR_LENGTH    2048
 
-char
-        loc_error[ MAX_ERROR_LENGTH ] = { '\0' },
-                                    loc_function[ MAX_FUNCTION_LENGTH ] = { '\0' };
+/* per-thread, so loads on worker threads don't trample each other */
+static thread_local char loc_error[ MAX_ERROR_LENGTH ]       = { '\0' };
+static thread_local char loc_function[ MAX_FUNCTION_LENGTH ] = { '\0' };
 
-PLFunctionResult global_result = PL_RESULT_SUCCESS;
+static thread_local PLFunctionResult global_result = PL_RESULT_SUCCESS;
 
 // Returns locally generated error message.
 const char *PlGetError( void ) {
@@ -19,9 +19,14 @@
 
 #include "pl_private.h"
 
+#include "qmos/public/qm_os_endian.h"
 #include "qmos/public/qm_os_linked_list.h"
 #include "qmos/public/qm_os_memory.h"
 #include "qmos/public/qm_os_string.h"
+#include "qmos/public/qm_os_thread.h"
+#include "qmparse/public/qm_parse.h"
+
+#include <plcore/pl_hashtable.h>
 
 #if defined( _WIN32 )
 
@@ -45,8 +50,12 @@
 #		include "3rdparty/portable_endian.h"
 #	endif
 #	include <pwd.h>
+#	include <fcntl.h>
+#	include <sys/mman.h>
 #endif
 
+#include <stdatomic.h>
+
 /////////////////////////////////////////////////////////////////////////////////////
 // Low Level API
 /////////////////////////////////////////////////////////////////////////////////////
@@ -217,6 +226,7 @@ typedef struct QmFsMount
 {
 	QmFsMountType       type;
 	QmOsLinkedListNode *listNode;
+	unsigned int        layer;/* position in the mount order, lower takes priority */
 	union
 	{
 		QmFsPackage *pkg;  /* PL_FS_MOUNT_PACKAGE */
@@ -226,14 +236,835 @@ typedef struct QmFsMount
 
 static QmOsLinkedList *mounts;
 
-static constexpr char VFS_LOCAL_HINT[] = "local://";
-#define VFS_MAX_HINT 16
-#define VFS_MAX_PATH ( ( PL_SYSTEM_MAX_PATH + VFS_MAX_HINT ) + 1 )
+static constexpr char VFS_LOCAL_HINT[] = "local://";
+#define VFS_MAX_HINT 16
+#define VFS_MAX_PATH ( ( PL_SYSTEM_MAX_PATH + VFS_MAX_HINT ) + 1 )
+
+PL_STATIC_ASSERT( sizeof( VFS_LOCAL_HINT ) < VFS_MAX_HINT, "Local hint is larger than maximum hint length, please adjust limit!" );
+
+/** VFS Index **/
+/* Maps every path provided by the mounted locations onto the mount that
+ * serves it, so resolving a path doesn't mean walking every mount (and
+ * hitting the disk for each directory mount). Mounts are indexed in
+ * mount order and a path is only ever claimed by the first mount that
+ * provides it, which keeps the same priority as the old linear search.
+ * Lookups trust the index, so it's kept current by the watcher, or an
+ * explicit rescan, rather than going back to the disk each time.
+ *
+ * Each directory also keeps a list of what's visible beneath it, so the
+ * index doubles as a merged tree of everything mounted. In overlay mode
+ * that tree is treated as the whole truth; later mounts are layers below
+ * earlier ones, which can hide what's beneath them with whiteouts, and
+ * lookups and scans never go near the individual mounts. */
+
+#define VFS_MAX_DEPTH       64
+#define VFS_WHITEOUT_PREFIX ".wh."
+#define VFS_OPAQUE_MARKER   ".wh..wh..opq"
+
+enum
+{
+	QM_OS_BIT_FLAG( VFS_ENTRY_DIRECTORY, 0 ),
+	QM_OS_BIT_FLAG( VFS_ENTRY_WHITEOUT, 1 ),/* hides the path in any later mount */
+	QM_OS_BIT_FLAG( VFS_ENTRY_OPAQUE, 2 ),  /* hides the directory's contents in any later mount */
+};
+
+typedef struct QmFsIndexEntry
+{
+	QmFsMount             *mount;
+	int                    index;/* package table index, or -1 for directories and local files */
+	unsigned int           flags;
+	QmFsMount             *opaqueMount;/* mount that marked the directory as opaque */
+	struct QmFsIndexEntry *children;
+	struct QmFsIndexEntry *next;
+	char                   path[];
+} QmFsIndexEntry;
+
+static PLHashTable    *vfsIndex;
+static QmFsIndexEntry *vfsRoot;/* top level of the merged tree */
+static unsigned int    vfsNumLayers;
+static bool            vfsOverlay;
+
+/**
+ * Produce the key used for the index; slashes are normalized and any
+ * leading './' or '/' is dropped, as are duplicate and trailing slashes.
+ */
+static size_t vfs_index_normalize_path( const char *path, char *dst, size_t dstSize )
+{
+	while ( *path != '\0' )
+	{
+		if ( *path == '/' || *path == '\\' )
+		{
+			path++;
+		}
+		else if ( *path == '.' && ( path[ 1 ] == '/' || path[ 1 ] == '\\' ) )
+		{
+			path += 2;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	size_t length = 0;
+	for ( ; *path != '\0' && length < dstSize - 1; ++path )
+	{
+		char c = ( *path == '\\' ) ? '/' : *path;
+		if ( c == '/' && ( length == 0 || dst[ length - 1 ] == '/' ) )
+		{
+			continue;
+		}
+
+		dst[ length++ ] = c;
+	}
+
+	if ( length > 0 && dst[ length - 1 ] == '/' )
+	{
+		length--;
+	}
+
+	dst[ length ] = '\0';
+	return length;
+}
+
+/**
+ * Truncates the key to its parent directory, returning the new length.
+ */
+static size_t vfs_index_parent( char *key, size_t keyLength )
+{
+	while ( keyLength > 0 && key[ keyLength - 1 ] != '/' )
+	{
+		keyLength--;
+	}
+	if ( keyLength > 0 )
+	{
+		keyLength--;
+	}
+
+	key[ keyLength ] = '\0';
+	return keyLength;
+}
+
+static const QmFsIndexEntry *vfs_index_lookup( const char *path )
+{
+	if ( vfsIndex == nullptr )
+	{
+		return nullptr;
+	}
+
+	char   key[ VFS_MAX_PATH ];
+	size_t keyLength = vfs_index_normalize_path( path, key, sizeof( key ) );
+	if ( keyLength == 0 )
+	{
+		return nullptr;
+	}
+
+	return PlLookupHashTableUserData( vfsIndex, key, keyLength );
+}
+
+/**
+ * Checks whether anything claimed by an earlier mount hides the given
+ * path from this one; that's a whiteout or opaque directory above it,
+ * or a file standing where this mount has a directory.
+ */
+static bool vfs_index_is_hidden( const QmFsMount *mount, const char *key, size_t keyLength )
+{
+	char parent[ VFS_MAX_PATH ];
+	memcpy( parent, key, keyLength + 1 );
+
+	while ( ( keyLength = vfs_index_parent( parent, keyLength ) ) > 0 )
+	{
+		const QmFsIndexEntry *entry = PlLookupHashTableUserData( vfsIndex, parent, keyLength );
+		if ( entry == nullptr )
+		{
+			continue;
+		}
+
+		if ( ( entry->flags & VFS_ENTRY_OPAQUE ) && entry->opaqueMount != mount )
+		{
+			return true;
+		}
+
+		/* a mount never hides anything from itself */
+		if ( entry->mount == mount )
+		{
+			continue;
+		}
+
+		if ( ( entry->flags & VFS_ENTRY_WHITEOUT ) || !( entry->flags & VFS_ENTRY_DIRECTORY ) )
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static QmFsIndexEntry *vfs_index_create_entry( QmFsMount *mount, const char *key, size_t keyLength, int index, unsigned int flags )
+{
+	QmFsIndexEntry *entry = QM_OS_MEMORY_MALLOC_( sizeof( QmFsIndexEntry ) + keyLength + 1 );
+	if ( entry == nullptr )
+	{
+		return nullptr;
+	}
+
+	entry->mount = mount;
+	entry->index = index;
+	entry->flags = flags;
+	if ( flags & VFS_ENTRY_OPAQUE )
+	{
+		entry->opaqueMount = mount;
+	}
+	memcpy( entry->path, key, keyLength + 1 );
+
+	if ( PlInsertHashTableNode( vfsIndex, key, keyLength, entry ) == nullptr )
+	{
+		qm_os_memory_free( entry );
+		return nullptr;
+	}
+
+	return entry;
+}
+
+/**
+ * Links the entry into the tree under its parent directory. Parents
+ * that haven't been claimed yet are claimed by the same mount, so
+ * lookups against a directory resolve the same way they do for files.
+ */
+static void vfs_index_link( QmFsMount *mount, QmFsIndexEntry *entry )
+{
+	char   key[ VFS_MAX_PATH ];
+	size_t keyLength = strlen( entry->path );
+	memcpy( key, entry->path, keyLength + 1 );
+
+	while ( entry != nullptr )
+	{
+		if ( ( keyLength = vfs_index_parent( key, keyLength ) ) == 0 )
+		{
+			entry->next = vfsRoot;
+			vfsRoot     = entry;
+			break;
+		}
+
+		QmFsIndexEntry *parent = PlLookupHashTableUserData( vfsIndex, key, keyLength );
+		if ( parent == nullptr )
+		{
+			parent = vfs_index_create_entry( mount, key, keyLength, -1, VFS_ENTRY_DIRECTORY );
+			if ( parent == nullptr )
+			{
+				break;
+			}
+
+			entry->next      = nullptr;
+			parent->children = entry;
+			entry            = parent;
+			continue;
+		}
+
+		if ( ( parent->flags & VFS_ENTRY_WHITEOUT ) && parent->mount == mount )
+		{
+			/* the mount provides what it whited out, so it's not hidden after all */
+			parent->flags    = VFS_ENTRY_DIRECTORY;
+			entry->next      = nullptr;
+			parent->children = entry;
+			entry            = parent;
+			continue;
+		}
+
+		/* if the parent's a file from an earlier mount, there's
+		 * nowhere for this to go, but it can still be opened */
+		if ( ( parent->flags & VFS_ENTRY_DIRECTORY ) && !( parent->flags & VFS_ENTRY_WHITEOUT ) )
+		{
+			entry->next      = parent->children;
+			parent->children = entry;
+		}
+		break;
+	}
+}
+
+/**
+ * Claims the given path for the mount, unless an earlier mount already
+ * provides it, or, in overlay mode, hides it. Returns false if hidden.
+ */
+static bool vfs_index_insert( QmFsMount *mount, const char *path, int index, unsigned int flags )
+{
+	char   key[ VFS_MAX_PATH ];
+	size_t keyLength = vfs_index_normalize_path( path, key, sizeof( key ) );
+	if ( keyLength == 0 )
+	{
+		return false;
+	}
+
+	if ( vfsOverlay )
+	{
+		/* whiteouts are recorded against the path they hide */
+		size_t nameStart = keyLength;
+		while ( nameStart > 0 && key[ nameStart - 1 ] != '/' )
+		{
+			nameStart--;
+		}
+
+		char        *name         = &key[ nameStart ];
+		const size_t prefixLength = sizeof( VFS_WHITEOUT_PREFIX ) - 1;
+		if ( strcmp( name, VFS_OPAQUE_MARKER ) == 0 )
+		{
+			if ( nameStart == 0 )
+			{
+				return false;
+			}
+
+			keyLength = vfs_index_parent( key, keyLength );
+			index     = -1;
+			flags     = VFS_ENTRY_DIRECTORY | VFS_ENTRY_OPAQUE;
+		}
+		else if ( strncmp( name, VFS_WHITEOUT_PREFIX, prefixLength ) == 0 && name[ prefixLength ] != '\0' )
+		{
+			memmove( name, name + prefixLength, keyLength - nameStart - prefixLength + 1 );
+			keyLength -= prefixLength;
+			index = -1;
+			flags = VFS_ENTRY_WHITEOUT;
+		}
+
+		if ( vfs_index_is_hidden( mount, key, keyLength ) )
+		{
+			return false;
+		}
+	}
+
+	QmFsIndexEntry *entry = PlLookupHashTableUserData( vfsIndex, key, keyLength );
+	if ( entry == nullptr )
+	{
+		entry = vfs_index_create_entry( mount, key, keyLength, index, flags );
+		if ( entry != nullptr && !( flags & VFS_ENTRY_WHITEOUT ) )
+		{
+			vfs_index_link( mount, entry );
+		}
+
+		return true;
+	}
+
+	if ( ( flags & VFS_ENTRY_OPAQUE ) && ( entry->flags & VFS_ENTRY_DIRECTORY ) && !( entry->flags & VFS_ENTRY_OPAQUE ) )
+	{
+		entry->flags |= VFS_ENTRY_OPAQUE;
+		entry->opaqueMount = mount;
+	}
+	else if ( ( entry->flags & VFS_ENTRY_WHITEOUT ) && entry->mount == mount && !( flags & VFS_ENTRY_WHITEOUT ) )
+	{
+		/* the mount provides what it whited out, so it's not hidden after all */
+		entry->flags = flags;
+		entry->index = index;
+		vfs_index_link( mount, entry );
+	}
+
+	/* nothing beneath something an earlier mount has hidden or
+	 * replaced with a file can be seen, so don't bother looking */
+	return !( vfsOverlay && entry->mount != mount && ( ( entry->flags & VFS_ENTRY_WHITEOUT ) || !( entry->flags & VFS_ENTRY_DIRECTORY ) ) );
+}
+
+/**
+ * Walks the directory, indexing everything beneath it. Linked directories
+ * aren't followed, so a link back up the tree can't send us round forever,
+ * and nothing deeper than VFS_MAX_DEPTH is indexed.
+ */
+static void vfs_index_local_directory( QmFsMount *mount, char *path, size_t pathLength, size_t rootLength, unsigned int depth )
+{
+	if ( depth >= VFS_MAX_DEPTH )
+	{
+		return;
+	}
+
+#if !defined( _MSC_VER )
+	DIR *directory = opendir( path );
+	if ( directory == nullptr )
+	{
+		return;
+	}
+
+	struct dirent *entry;
+	while ( ( entry = readdir( directory ) ) != nullptr )
+	{
+		if ( strcmp( entry->d_name, "." ) == 0 || strcmp( entry->d_name, ".." ) == 0 )
+		{
+			continue;
+		}
+
+		int length = snprintf( &path[ pathLength ], VFS_MAX_PATH - pathLength, "/%s", entry->d_name );
+		if ( length < 0 || pathLength + length >= VFS_MAX_PATH )
+		{
+			continue;
+		}
+
+		bool isDirectory;
+		bool isLink;
+#	if defined( _DIRENT_HAVE_D_TYPE ) || defined( DT_DIR )
+		if ( entry->d_type != DT_UNKNOWN )
+		{
+			isDirectory = ( entry->d_type == DT_DIR );
+			isLink      = ( entry->d_type == DT_LNK );
+		}
+		else
+#	endif
+		{
+			struct stat st;
+			if ( lstat( path, &st ) != 0 )
+			{
+				continue;
+			}
+			isDirectory = S_ISDIR( st.st_mode );
+			isLink      = S_ISLNK( st.st_mode );
+		}
+
+		/* linked files are fine, but linked directories are skipped */
+		if ( isLink )
+		{
+			struct stat st;
+			if ( stat( path, &st ) != 0 || S_ISDIR( st.st_mode ) )
+			{
+				continue;
+			}
+		}
+
+		if ( vfs_index_insert( mount, &path[ rootLength + 1 ], -1, isDirectory ? VFS_ENTRY_DIRECTORY : 0 ) && isDirectory )
+		{
+			vfs_index_local_directory( mount, path, pathLength + length, rootLength, depth + 1 );
+		}
+	}
+
+	path[ pathLength ] = '\0';
+
+	closedir( directory );
+#else
+	char selectorPath[ VFS_MAX_PATH ];
+	snprintf( selectorPath, sizeof( selectorPath ), "%s/*", path );
+
+	WIN32_FIND_DATA ffd;
+	HANDLE          find = FindFirstFile( selectorPath, &ffd );
+	if ( find == INVALID_HANDLE_VALUE )
+	{
+		return;
+	}
+
+	do
+	{
+		if ( strcmp( ffd.cFileName, "." ) == 0 || strcmp( ffd.cFileName, ".." ) == 0 )
+		{
+			continue;
+		}
+
+		int length = snprintf( &path[ pathLength ], VFS_MAX_PATH - pathLength, "/%s", ffd.cFileName );
+		if ( length < 0 || pathLength + length >= VFS_MAX_PATH )
+		{
+			continue;
+		}
+
+		bool isDirectory = ( ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY );
+		if ( isDirectory && ( ffd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT ) )
+		{
+			continue;
+		}
+
+		if ( vfs_index_insert( mount, &path[ rootLength + 1 ], -1, isDirectory ? VFS_ENTRY_DIRECTORY : 0 ) && isDirectory )
+		{
+			vfs_index_local_directory( mount, path, pathLength + length, rootLength, depth + 1 );
+		}
+	} while ( FindNextFile( find, &ffd ) != FALSE );
+
+	path[ pathLength ] = '\0';
+
+	FindClose( find );
+#endif
+}
+
+static void vfs_index_mount( QmFsMount *mount )
+{
+	mount->layer = vfsNumLayers++;
+
+	if ( vfsIndex == nullptr )
+	{
+		vfsIndex = PlCreateHashTable();
+		if ( vfsIndex == nullptr )
+		{
+			return;
+		}
+	}
+
+	if ( mount->type == QM_FS_MOUNT_TYPE_PACKAGE )
+	{
+		for ( unsigned int i = 0; i < mount->pkg->numFiles; ++i )
+		{
+			vfs_index_insert( mount, mount->pkg->files[ i ].name, ( int ) i, 0 );
+		}
+		return;
+	}
+
+	char   path[ VFS_MAX_PATH ];
+	size_t length = ( size_t ) snprintf( path, sizeof( path ), "%s", mount->path );
+	if ( length >= sizeof( path ) )
+	{
+		return;
+	}
+
+	vfs_index_local_directory( mount, path, length, length, 0 );
+}
+
+static void vfs_index_clear( void )
+{
+	PlDestroyHashTableEx( vfsIndex, qm_os_memory_free );
+	vfsIndex     = nullptr;
+	vfsRoot      = nullptr;
+	vfsNumLayers = 0;
+}
+
+/**
+ * Throw away the index and build it again from what's currently mounted,
+ * so paths that were claimed by a removed mount fall back to the next
+ * mount in line that provides them.
+ */
+static void vfs_index_rebuild( void )
+{
+	vfs_index_clear();
+
+	if ( mounts == nullptr )
+	{
+		return;
+	}
+
+	QmFsMount *mount;
+	QM_OS_LINKED_LIST_ITERATE( mount, mounts, i )
+	{
+		vfs_index_mount( mount );
+	}
+}
+
+/**
+ * Enables or disables overlay mode. In overlay mode, everything mounted
+ * is merged into a single view up front, and lookups and scans are
+ * served entirely from that, so anything added to a mounted directory
+ * afterwards won't be seen until the mounts change. Mounts act as layers,
+ * with the earliest on top; a '.wh.<name>' entry hides that name in any
+ * later mount, and a '.wh..wh..opq' entry hides the rest of its directory.
+ */
+void qm_fs_set_overlay_enabled( bool enabled )
+{
+	if ( vfsOverlay == enabled )
+	{
+		return;
+	}
+
+	vfsOverlay = enabled;
+	vfs_index_rebuild();
+}
+
+bool qm_fs_is_overlay_enabled( void )
+{
+	return vfsOverlay;
+}
+
+/**
+ * Removes a file from the index, and the tree.
+ */
+static void vfs_index_remove( QmFsIndexEntry *entry )
+{
+	char   key[ VFS_MAX_PATH ];
+	size_t keyLength = strlen( entry->path );
+	memcpy( key, entry->path, keyLength + 1 );
+
+	PlDestroyHashTableNode( PlLookupHashTableNode( vfsIndex, key, keyLength ) );
+
+	QmFsIndexEntry **list = &vfsRoot;
+	if ( ( keyLength = vfs_index_parent( key, keyLength ) ) > 0 )
+	{
+		QmFsIndexEntry *parent = PlLookupHashTableUserData( vfsIndex, key, keyLength );
+		list                   = ( parent != nullptr ) ? &parent->children : nullptr;
+	}
+
+	for ( ; list != nullptr && *list != nullptr; list = &( *list )->next )
+	{
+		if ( *list == entry )
+		{
+			*list = entry->next;
+			break;
+		}
+	}
+
+	qm_os_memory_free( entry );
+}
+
+/**
+ * Finds the next mount in line after the given one that provides
+ * the path, so it can take over once the path's gone from the first.
+ */
+static QmFsMount *vfs_index_find_provider( const QmFsMount *after, const char *key, size_t keyLength, int *index )
+{
+	QmFsMount *mount;
+	QM_OS_LINKED_LIST_ITERATE( mount, mounts, i )
+	{
+		if ( mount->layer <= after->layer || ( vfsOverlay && vfs_index_is_hidden( mount, key, keyLength ) ) )
+		{
+			continue;
+		}
+
+		if ( mount->type == QM_FS_MOUNT_TYPE_PACKAGE )
+		{
+			if ( ( *index = PlGetPackageTableIndex( mount->pkg, key ) ) >= 0 )
+			{
+				return mount;
+			}
+			continue;
+		}
+
+		char path[ VFS_MAX_PATH * 2 ];
+		snprintf( path, sizeof( path ), "%s/%s", mount->path, key );
+		if ( qm_fs_check_local_file_exists( path ) )
+		{
+			*index = -1;
+			return mount;
+		}
+	}
+
+	return nullptr;
+}
+
+static int vfs_index_compare_length( const void *a, const void *b )
+{
+	/* longest first, so everything beneath a directory comes before it */
+	size_t la = strlen( ( *( const QmFsIndexEntry ** ) a )->path );
+	size_t lb = strlen( ( *( const QmFsIndexEntry ** ) b )->path );
+	return ( lb > la ) - ( lb < la );
+}
+
+/**
+ * Drops everything the mount claimed from the index, handing each path on
+ * to the next mount in line that provides it, so only what the departing
+ * mount provided is looked at. Returns false if that can't be done in
+ * place, in which case the index needs rebuilding; that's always so in
+ * overlay mode, as whatever the mount hid has to come back.
+ */
+static bool vfs_index_unmount( QmFsMount *mount )
+{
+	if ( vfsIndex == nullptr )
+	{
+		return true;
+	}
+
+	if ( vfsOverlay )
+	{
+		return false;
+	}
+
+	QmFsIndexEntry **claimed = QM_OS_MEMORY_NEW_( QmFsIndexEntry *, PlGetNumHashTableNodes( vfsIndex ) + 1 );
+	if ( claimed == nullptr )
+	{
+		return false;
+	}
+
+	unsigned int numClaimed = 0;
+	for ( PLHashTableNode *node = PlGetFirstHashTableNode( vfsIndex ); node != nullptr; node = PlGetNextHashTableNode( node ) )
+	{
+		QmFsIndexEntry *entry = PlGetHashTableNodeUserData( node );
+		if ( entry->mount == mount )
+		{
+			claimed[ numClaimed++ ] = entry;
+		}
+	}
+
+	qsort( claimed, numClaimed, sizeof( QmFsIndexEntry * ), vfs_index_compare_length );
+
+	bool updated = true;
+	for ( unsigned int i = 0; i < numClaimed && updated; ++i )
+	{
+		QmFsIndexEntry *entry     = claimed[ i ];
+		size_t          keyLength = strlen( entry->path );
+
+		int        index;
+		QmFsMount *provider;
+		if ( entry->flags & VFS_ENTRY_DIRECTORY )
+		{
+			/* anything left beneath it comes from later mounts, so the
+			 * directory goes to whichever of those takes priority */
+			provider = nullptr;
+			for ( const QmFsIndexEntry *child = entry->children; child != nullptr; child = child->next )
+			{
+				if ( provider == nullptr || child->mount->layer < provider->layer )
+				{
+					provider = child->mount;
+				}
+			}
+
+			if ( provider != nullptr )
+			{
+				entry->mount = provider;
+				continue;
+			}
+
+			/* can't tell an empty directory from a file, so start over */
+			if ( vfs_index_find_provider( mount, entry->path, keyLength, &index ) != nullptr )
+			{
+				updated = false;
+				continue;
+			}
+
+			vfs_index_remove( entry );
+			continue;
+		}
+
+		provider = vfs_index_find_provider( mount, entry->path, keyLength, &index );
+		if ( provider == nullptr )
+		{
+			vfs_index_remove( entry );
+			continue;
+		}
+
+		/* what the file hid may be a whole directory in the next mount, and
+		 * anything beneath it was never linked in, so that needs a rebuild */
+		if ( provider->type == QM_FS_MOUNT_TYPE_DIR )
+		{
+			char path[ VFS_MAX_PATH * 2 ];
+			snprintf( path, sizeof( path ), "%s/%s", provider->path, entry->path );
+			if ( PlLocalPathExists( path ) )
+			{
+				updated = false;
+				continue;
+			}
+		}
+
+		entry->mount = provider;
+		entry->index = index;
+	}
+
+	qm_os_memory_free( claimed );
+
+	return updated;
+}
+
+QmFsWatchEventType qm_fs_index_apply_change_( QmFsMount *mount, const char *path, QmFsWatchEventType type, bool *rebuild )
+{
+	char   key[ VFS_MAX_PATH ];
+	size_t keyLength = vfs_index_normalize_path( path, key, sizeof( key ) );
+	if ( keyLength == 0 )
+	{
+		return QM_FS_WATCH_EVENT_NONE;
+	}
+
+	if ( vfsIndex == nullptr )
+	{
+		*rebuild = true;
+		return type;
+	}
+
+	/* whiteouts change what's visible beneath them,
+	 * so it's simplest to just start over */
+	const char *name = strrchr( key, '/' );
+	name             = ( name != nullptr ) ? name + 1 : key;
+	if ( vfsOverlay && strncmp( name, VFS_WHITEOUT_PREFIX, sizeof( VFS_WHITEOUT_PREFIX ) - 1 ) == 0 )
+	{
+		*rebuild = true;
+		return type;
+	}
+
+	QmFsIndexEntry *entry = PlLookupHashTableUserData( vfsIndex, key, keyLength );
+	if ( type == QM_FS_WATCH_EVENT_REMOVED )
+	{
+		if ( entry == nullptr || entry->mount != mount || ( entry->flags & VFS_ENTRY_WHITEOUT ) )
+		{
+			return QM_FS_WATCH_EVENT_NONE;
+		}
+
+		if ( entry->flags & VFS_ENTRY_DIRECTORY )
+		{
+			*rebuild = true;
+			return QM_FS_WATCH_EVENT_REMOVED;
+		}
+
+		/* if another mount provides it, it's just changed as far as we're concerned */
+		int        index;
+		QmFsMount *provider = vfs_index_find_provider( mount, key, keyLength, &index );
+		if ( provider != nullptr )
+		{
+			entry->mount = provider;
+			entry->index = index;
+			return QM_FS_WATCH_EVENT_MODIFIED;
+		}
+
+		vfs_index_remove( entry );
+		return QM_FS_WATCH_EVENT_REMOVED;
+	}
+
+	if ( entry == nullptr || ( entry->mount == mount && ( entry->flags & VFS_ENTRY_WHITEOUT ) ) )
+	{
+		if ( vfsOverlay && vfs_index_is_hidden( mount, key, keyLength ) )
+		{
+			return QM_FS_WATCH_EVENT_NONE;
+		}
+
+		vfs_index_insert( mount, key, -1, 0 );
+		return QM_FS_WATCH_EVENT_ADDED;
+	}
+
+	if ( entry->mount == mount )
+	{
+		return QM_FS_WATCH_EVENT_MODIFIED;
+	}
+
+	/* an earlier mount still takes priority */
+	if ( ( entry->flags & VFS_ENTRY_WHITEOUT ) || entry->mount->layer < mount->layer )
+	{
+		return QM_FS_WATCH_EVENT_NONE;
+	}
+
+	if ( entry->flags & VFS_ENTRY_DIRECTORY )
+	{
+		*rebuild = true;
+		return QM_FS_WATCH_EVENT_MODIFIED;
+	}
+
+	entry->mount = mount;
+	entry->index = -1;
+	return QM_FS_WATCH_EVENT_MODIFIED;
+}
+
+void qm_fs_index_rebuild_( void )
+{
+	vfs_index_rebuild();
+}
+
+static void vfs_index_enumerate( const QmFsMount *mount, const QmFsIndexEntry *entry, void ( *callback )( const char *path, void *userData ), void *userData )
+{
+	for ( ; entry != nullptr; entry = entry->next )
+	{
+		if ( entry->flags & VFS_ENTRY_DIRECTORY )
+		{
+			vfs_index_enumerate( mount, entry->children, callback, userData );
+		}
+		else if ( entry->mount == mount )
+		{
+			callback( entry->path, userData );
+		}
+	}
+}
+
+void qm_fs_index_enumerate_( const QmFsMount *mount, const char *path, void ( *callback )( const char *path, void *userData ), void *userData )
+{
+	const QmFsIndexEntry *entry = vfs_index_lookup( path );
+	if ( entry == nullptr )
+	{
+		return;
+	}
 
-PL_STATIC_ASSERT( sizeof( VFS_LOCAL_HINT ) < VFS_MAX_HINT, "Local hint is larger than maximum hint length, please adjust limit!" );
+	if ( entry->flags & VFS_ENTRY_DIRECTORY )
+	{
+		vfs_index_enumerate( mount, entry->children, callback, userData );
+	}
+	else if ( entry->mount == mount )
+	{
+		callback( entry->path, userData );
+	}
+}
 
-void PlClearMountedLocation( QmFsMount *location )
+static void clear_mounted_location( QmFsMount *location )
 {
+	qm_fs_mount_unwatch( location );
+
 	if ( location->type == QM_FS_MOUNT_TYPE_PACKAGE )
 	{
 		PlDestroyPackage( location->pkg );
@@ -248,8 +1079,28 @@ void PlClearMountedLocation( QmFsMount *location )
 	qm_os_memory_free( location );
 }
 
+void PlClearMountedLocation( QmFsMount *location )
+{
+	/* only what the mount provided needs to be looked at again */
+	bool updated = vfs_index_unmount( location );
+
+	clear_mounted_location( location );
+
+	if ( !updated )
+	{
+		vfs_index_rebuild();
+	}
+}
+
+void qm_fs_rescan_mounted_locations( void )
+{
+	vfs_index_rebuild();
+}
+
 void qm_fs_clear_mounted_locations()
 {
+	vfs_index_clear();
+
 	if ( mounts == nullptr )
 	{
 		return;
@@ -258,7 +1109,7 @@ void qm_fs_clear_mounted_locations()
 	QmFsMount *mount;
 	QM_OS_LINKED_LIST_ITERATE( mount, mounts, i )
 	{
-		PlClearMountedLocation( mount );
+		clear_mounted_location( mount );
 	}
 
 	qm_os_memory_free( mounts );
@@ -295,7 +1146,9 @@ QmFsMount *qm_fs_mount_local_location( const char *path )
 		}
 
 		location->path = qm_os_string_alloc( "%s", path );
-		qm_fs_normalize_path( location->path, sizeof( location->path ) );
+		qm_fs_normalize_path( location->path, strlen( location->path ) + 1 );
+
+		vfs_index_mount( location );
 
 		return location;
 	}
@@ -318,6 +1171,8 @@ QmFsMount *qm_fs_mount_local_location( const char *path )
 		location->type = QM_FS_MOUNT_TYPE_PACKAGE;
 		location->pkg  = pkg;
 
+		vfs_index_mount( location );
+
 		return location;
 
 	ABORT:
@@ -552,103 +1407,241 @@ bool PlPathEndsInSlash( const char *p )
 	return l > 0 && ( p[ l - 1 ] == '/' || p[ l - 1 ] == '\\' );
 }
 
-typedef struct FSScanInstance
+/****************************************
+ * Directory Scanning
+ *
+ * Each scan carries its own state, so subdirectories can be handed off
+ * to a pool of workers. Results are checked against a hash of what's
+ * already been passed back, so that where several mounted directories
+ * hold the same file, only the first is reported. The callback is
+ * never invoked from more than one thread at a time.
+ ****************************************/
+
+typedef struct FSScanJob
+{
+	PLPath            path;
+	struct FSScanJob *next;
+} FSScanJob;
+
+typedef struct FSScan
+{
+	const QmFsMount *mount;
+	size_t           mountPathLength;
+
+	const char *extension;
+	size_t      extensionLength;
+	bool        recursive;
+
+	void ( *Function )( const char *, void * );
+	void *userData;
+
+	PLHashTable *seen;// paths already passed back, if scanning mounts
+
+	/* only set if the scan is spread across threads */
+	QmOsMutex     *mutex;
+	QmOsCondition *condition;// signalled as directories are queued, and once it's all done
+	FSScanJob     *pending;  // directories waiting to be scanned
+	unsigned int   numBusy;
+	unsigned int   numWorkers;
+
+	/* errors are per-thread, so the first one raised by a
+	 * worker is kept here, to be passed on once we're done */
+	PLFunctionResult result;
+	char            *error;
+} FSScan;
+
+static void scan_local_directory( FSScan *scan, const char *path );
+
+static bool scan_match_extension( const FSScan *scan, const char *name )
+{
+	if ( scan->extension == nullptr )
+	{
+		return true;
+	}
+
+	// We used to just compare against the end of the name relative to '.',
+	// but an extension could be made up of multiple parts (.world.n),
+	// so we'll do this instead
+	size_t fl = strlen( name );
+	return ( scan->extensionLength < fl ) && ( pl_strncasecmp( &name[ fl - scan->extensionLength ], scan->extension, scan->extensionLength ) == 0 );
+}
+
+static void scan_fail( FSScan *scan )
+{
+	if ( scan->mutex == nullptr )
+	{
+		return;
+	}
+
+	qm_os_mutex_lock( scan->mutex );
+	if ( scan->error == nullptr )
+	{
+		scan->result = PlGetFunctionResult();
+		scan->error  = qm_os_string_alloc( "%s", PlGetError() );
+	}
+	qm_os_mutex_unlock( scan->mutex );
+}
+
+/**
+ * Passes the name back, unless scanning mounts and
+ * an earlier one has already passed back the same.
+ */
+static void scan_emit_name( FSScan *scan, const char *name )
+{
+	if ( scan->mutex != nullptr )
+	{
+		qm_os_mutex_lock( scan->mutex );
+	}
+
+	if ( scan->seen == nullptr )
+	{
+		scan->Function( name, scan->userData );
+	}
+	else
+	{
+		size_t length = strlen( name );
+
+		// Ensure it's not already been passed back
+		if ( PlLookupHashTableNode( scan->seen, name, length ) == nullptr )
+		{
+			PlInsertHashTableNode( scan->seen, name, length, ( void * ) 1 );
+			scan->Function( name, scan->userData );
+		}
+	}
+
+	if ( scan->mutex != nullptr )
+	{
+		qm_os_mutex_unlock( scan->mutex );
+	}
+}
+
+static void scan_emit( FSScan *scan, const char *path )
+{
+	scan_emit_name( scan, ( scan->mount != nullptr ) ? &path[ scan->mountPathLength + 1 ] : path );
+}
+
+/**
+ * Works through queued directories until there are none left,
+ * and nobody else is still scanning one that might add more.
+ */
+static void scan_worker( void *userData )
+{
+	FSScan *scan = userData;
+
+	qm_os_mutex_lock( scan->mutex );
+	for ( ;; )
+	{
+		while ( scan->pending == nullptr && scan->numBusy > 0 )
+		{
+			qm_os_condition_wait( scan->condition, scan->mutex );
+		}
+
+		FSScanJob *job = scan->pending;
+		if ( job == nullptr )
+		{
+			break;
+		}
+
+		scan->pending = job->next;
+		scan->numBusy++;
+		qm_os_mutex_unlock( scan->mutex );
+
+		scan_local_directory( scan, job->path );
+		qm_os_memory_free( job );
+
+		qm_os_mutex_lock( scan->mutex );
+		if ( --scan->numBusy == 0 && scan->pending == nullptr )
+		{
+			qm_os_condition_broadcast( scan->condition );
+		}
+	}
+	qm_os_mutex_unlock( scan->mutex );
+}
+
+static void scan_descend( FSScan *scan, const char *path )
 {
-	char                   path[ PL_SYSTEM_MAX_PATH ];
-	struct FSScanInstance *next;
-} FSScanInstance;
+	if ( scan->mutex == nullptr )
+	{
+		scan_local_directory( scan, path );
+		return;
+	}
 
-static void scan_local_directory( const QmFsMount *mount, FSScanInstance **fileList, const char *path,
-                                  const char *extension, void ( *Function )( const char *, void * ), bool recursive, void *userData )
+	FSScanJob *job = QM_OS_MEMORY_NEW( FSScanJob );
+	snprintf( job->path, sizeof( job->path ), "%s", path );
+
+	qm_os_mutex_lock( scan->mutex );
+	job->next     = scan->pending;
+	scan->pending = job;
+	qm_os_condition_signal( scan->condition );
+	qm_os_mutex_unlock( scan->mutex );
+}
+
+static void scan_local_directory( FSScan *scan, const char *path )
 {
 #if !defined( _MSC_VER )
 	DIR *directory = opendir( path );
-	if ( directory )
+	if ( directory == nullptr )
+	{
+		PlReportErrorF( PL_RESULT_FILEPATH, "opendir failed: %s", GetLastError_strerror( GetLastError() ) );
+		scan_fail( scan );
+		return;
+	}
+
+	struct dirent *entry;
+	while ( ( entry = readdir( directory ) ) )
 	{
-		struct dirent *entry;
-		while ( ( entry = readdir( directory ) ) )
+		if ( strcmp( entry->d_name, "." ) == 0 || strcmp( entry->d_name, ".." ) == 0 )
 		{
-			if ( strcmp( entry->d_name, "." ) == 0 || strcmp( entry->d_name, ".." ) == 0 )
-			{
-				continue;
-			}
+			continue;
+		}
 
-			char filestring[ PL_SYSTEM_MAX_PATH + 1 ];
-			snprintf( filestring, sizeof( filestring ), PlPathEndsInSlash( path ) ? "%s%s" : "%s/%s", path, entry->d_name );
+		char filestring[ PL_SYSTEM_MAX_PATH + 1 ];
+		snprintf( filestring, sizeof( filestring ), PlPathEndsInSlash( path ) ? "%s%s" : "%s/%s", path, entry->d_name );
 
+		/* most filesystems tell us the type up front, so we only
+		 * need to stat when they don't, or it's a link to follow */
+		bool isFile, isDirectory;
+#	if defined( _DIRENT_HAVE_D_TYPE ) || defined( DT_UNKNOWN )
+		if ( entry->d_type != DT_UNKNOWN && entry->d_type != DT_LNK )
+		{
+			isFile      = ( entry->d_type == DT_REG );
+			isDirectory = ( entry->d_type == DT_DIR );
+		}
+		else
+#	endif
+		{
 			struct stat st;
-			if ( stat( filestring, &st ) == 0 )
+#	if defined( _WIN32 )
+			if ( stat( filestring, &st ) != 0 )
+#	else
+			if ( fstatat( dirfd( directory ), entry->d_name, &st, 0 ) != 0 )
+#	endif
 			{
-				if ( S_ISREG( st.st_mode ) )
-				{
-					// We used to just compare against the end of the name relative to '.',
-					// but an extension could be made up of multiple parts (.world.n),
-					// so we'll do this instead
-					bool match = false;
-					if ( extension != nullptr )
-					{
-						size_t el = strlen( extension );
-						size_t fl = strlen( entry->d_name );
-						match     = ( el < fl ) && ( pl_strncasecmp( &entry->d_name[ fl - el ], extension, el ) == 0 );
-					}
-
-					if ( extension == nullptr || match )
-					{
-						if ( mount == nullptr )
-						{
-							Function( filestring, userData );
-							continue;
-						}
-
-						size_t      pos      = strlen( mount->path ) + 1;
-						const char *filePath = &filestring[ pos ];
-
-						// Ensure it's not already in the list
-						FSScanInstance *cur = *fileList;
-						while ( cur != nullptr )
-						{
-							if ( strcmp( filePath, cur->path ) == 0 )
-							{
-								// File was already passed back
-								break;
-							}
-
-							cur = cur->next;
-						}
-
-						// Jumped the list early, so abort here
-						if ( cur != nullptr )
-						{
-							continue;
-						}
-
-						Function( filePath, userData );
-
-						// Tack it onto the list
-						cur = QM_OS_MEMORY_NEW( FSScanInstance );
-						strncpy( cur->path, filePath, sizeof( cur->path ) );
-						cur->next = *fileList;
-						*fileList = cur;
-					}
-				}
-				else if ( S_ISDIR( st.st_mode ) && recursive )
-				{
-					scan_local_directory( mount, fileList, filestring, extension, Function, recursive, userData );
-				}
+				continue;
 			}
+
+			isFile      = S_ISREG( st.st_mode );
+			isDirectory = S_ISDIR( st.st_mode );
 		}
 
-		closedir( directory );
-	}
-	else
-	{
-		PlReportErrorF( PL_RESULT_FILEPATH, "opendir failed: %s", GetLastError_strerror( GetLastError() ) );
+		if ( isFile ? !scan_match_extension( scan, entry->d_name ) : !( isDirectory && scan->recursive ) )
+		{
+			continue;
+		}
+
+		if ( isFile )
+		{
+			scan_emit( scan, filestring );
+		}
+		else
+		{
+			scan_descend( scan, filestring );
+		}
 	}
+
+	closedir( directory );
 #else /* assumed win32 impl */
-	if ( extension == nullptr )
-	{
-		extension = "*";
-	}
+	const char *extension = ( scan->extension != nullptr ) ? scan->extension : "*";
 
 	char selectorPath[ PL_SYSTEM_MAX_PATH ];
 	snprintf( selectorPath, sizeof( selectorPath ), PlPathEndsInSlash( path ) ? "%s*.%s" : "%s/*.%s", path, extension );
@@ -660,36 +1653,108 @@ static void scan_local_directory( const QmFsMount *mount, FSScanInstance **fileL
 		return;
 	}
 
-	size_t ml;
-	if ( mount != nullptr )
-		ml = strlen( mount->path );
-
 	do
 	{
 		snprintf( selectorPath, sizeof( selectorPath ), PlPathEndsInSlash( path ) ? "%s%s" : "%s/%s", path, ffd.cFileName );
 
 		if ( ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY )
 		{
-			if ( recursive && !( strcmp( ffd.cFileName, "." ) == 0 || strcmp( ffd.cFileName, ".." ) == 0 ) )
+			if ( scan->recursive && !( strcmp( ffd.cFileName, "." ) == 0 || strcmp( ffd.cFileName, ".." ) == 0 ) )
 			{
-				scan_local_directory( mount, fileList, selectorPath, extension, Function, recursive, userData );
+				scan_descend( scan, selectorPath );
 			}
 			continue;
 		}
 
-		const char *rp = selectorPath;
-		if ( mount != nullptr )
-		{
-			rp = &selectorPath[ ml + 1 ];
-		}
-
-		Function( rp, userData );
+		scan_emit( scan, selectorPath );
 	} while ( FindNextFile( find, &ffd ) != FALSE );
 
 	FindClose( find );
 #endif
 }
 
+/**
+ * Scans the given local directory, and, if recursive, everything
+ * beneath it, waiting on any workers before returning.
+ */
+static void scan_local_location( FSScan *scan, const char *path )
+{
+	scan->mountPathLength = ( scan->mount != nullptr ) ? strlen( scan->mount->path ) : 0;
+
+	if ( scan->mutex == nullptr )
+	{
+		scan_local_directory( scan, path );
+		return;
+	}
+
+	scan_descend( scan, path );
+
+	QmWorkerGroup *group = qm_worker_group_start_( scan_worker, scan, scan->numWorkers );
+	scan_worker( scan );
+	qm_worker_group_wait_( group );
+}
+
+/**
+ * Walks the merged tree, rather than each mount in turn.
+ */
+static void scan_index_directory( FSScan *scan, const QmFsIndexEntry *entry )
+{
+	for ( ; entry != nullptr; entry = entry->next )
+	{
+		if ( entry->flags & VFS_ENTRY_DIRECTORY )
+		{
+			if ( scan->recursive )
+			{
+				scan_index_directory( scan, entry->children );
+			}
+			continue;
+		}
+
+		const char *name = strrchr( entry->path, '/' );
+		if ( scan_match_extension( scan, ( name != nullptr ) ? name + 1 : entry->path ) )
+		{
+			scan->Function( entry->path, scan->userData );
+		}
+	}
+}
+
+typedef struct FSScanPackage
+{
+	FSScan *scan;
+	size_t  prefixLength;
+} FSScanPackage;
+
+static void scan_package_file( const QmFsPackage *package, unsigned int index, void *userData )
+{
+	const FSScanPackage *packageScan = userData;
+
+	/* the prefix has to end on a directory, so 'maps' doesn't
+	 * also turn up what's under 'mapsrc', and unless we're
+	 * recursing, nothing should lie further beneath it */
+	const char *name = package->files[ index ].name;
+	const char *c    = name + packageScan->prefixLength;
+	if ( packageScan->prefixLength > 0 && name[ packageScan->prefixLength - 1 ] != '/' )
+	{
+		if ( *c != '/' )
+		{
+			return;
+		}
+		c++;
+	}
+
+	if ( !packageScan->scan->recursive && strchr( c, '/' ) != nullptr )
+	{
+		return;
+	}
+
+	if ( !scan_match_extension( packageScan->scan, name ) )
+	{
+		return;
+	}
+
+	scan_emit_name( packageScan->scan, name );
+}
+
 /**
  * Scans the given directory.
  *
@@ -699,37 +1764,80 @@ static void scan_local_directory( const QmFsMount *mount, FSScanInstance **fileL
  * @param recursive if true, also scans the contents of each sub-directory.
  */
 void PlScanDirectory( const char *path, const char *extension, void ( *Function )( const char *, void * ), bool recursive, void *userData )
+{
+	PlScanDirectoryEx( path, extension, Function, recursive, 1, userData );
+}
+
+/**
+ * Same as PlScanDirectory, but local subdirectories are spread across
+ * the given number of threads, or every available thread if 0. The
+ * callback is never invoked concurrently, but once more than one thread
+ * is involved, files won't be passed back in any particular order.
+ */
+void PlScanDirectoryEx( const char *path, const char *extension, void ( *Function )( const char *, void * ), bool recursive, unsigned int numThreads, void *userData )
 {
 	PlClearError();
 
+	FSScan scan = {
+	        .extension       = extension,
+	        .extensionLength = ( extension != nullptr ) ? strlen( extension ) : 0,
+	        .recursive       = recursive,
+	        .Function        = Function,
+	        .userData        = userData,
+	};
+
+	/* the merged view is already in memory, so there's nothing to gain */
+	bool fromIndex = ( vfsOverlay && mounts != nullptr );
+	if ( numThreads != 1 && recursive && !fromIndex )
+	{
+		scan.mutex      = qm_os_mutex_create();
+		scan.condition  = qm_os_condition_create();
+		scan.numWorkers = ( numThreads != 0 ) ? numThreads - 1 : qm_os_thread_get_available();
+	}
+
 	size_t hintSize = strlen( VFS_LOCAL_HINT );
 	if ( strncmp( VFS_LOCAL_HINT, path, hintSize ) == 0 )
 	{
 		const char *c = path + hintSize;
 		if ( *c == ':' ) c++;
-		scan_local_directory( nullptr, nullptr, c, extension, Function, recursive, userData );
-		return;
+		scan_local_location( &scan, c );
 	}
-
 	// If no mounted locations, assume local scan
-	if ( mounts == nullptr )
+	else if ( mounts == nullptr )
 	{
-		scan_local_directory( nullptr, nullptr, path, extension, Function, recursive, userData );
-		return;
+		scan_local_location( &scan, path );
+	}
+	else if ( vfsOverlay )
+	{
+		char   key[ VFS_MAX_PATH ];
+		size_t keyLength = vfs_index_normalize_path( path, key, sizeof( key ) );
+		if ( keyLength == 0 )
+		{
+			scan_index_directory( &scan, vfsRoot );
+		}
+		else
+		{
+			const QmFsIndexEntry *entry = vfs_index_lookup( key );
+			if ( entry != nullptr && ( entry->flags & VFS_ENTRY_DIRECTORY ) )
+			{
+				scan_index_directory( &scan, entry->children );
+			}
+		}
 	}
+	else
+	{
+		PLPath normPath;
+		snprintf( normPath, sizeof( normPath ), "%s", path );
+		qm_fs_normalize_path( normPath, sizeof( normPath ) );
 
-	PLPath normPath;
-	snprintf( normPath, sizeof( normPath ), "%s", path );
-	qm_fs_normalize_path( normPath, sizeof( normPath ) );
+		scan.seen = PlCreateHashTable();
 
-	FSScanInstance *fileList = nullptr;
-	QmFsMount      *location;
-	QM_OS_LINKED_LIST_ITERATE( location, mounts, i )
-	{
-		if ( location->type == QM_FS_MOUNT_TYPE_PACKAGE )
+		/* mounts are visited one after another, so
+		 * earlier ones always take priority */
+		QmFsMount *location;
+		QM_OS_LINKED_LIST_ITERATE( location, mounts, i )
 		{
-			QmFsPackage *package = location->pkg;
-			for ( unsigned int j = 0; j < package->numFiles; ++j )
+			if ( location->type == QM_FS_MOUNT_TYPE_PACKAGE )
 			{
 				//HACK: urgh, packages don't have the concept of '.' or './', so let's work around that
 
@@ -743,37 +1851,93 @@ void PlScanDirectory( const char *path, const char *extension, void ( *Function
 					subPath = path;
 				}
 
-				size_t l = strlen( subPath );
-				if ( strncmp( package->files[ j ].name, subPath, l ) != 0 )
-				{
-					continue;
-				}
-
-				const char *indexExtension = PlGetFileExtension( package->files[ j ].name );
-				if ( indexExtension == nullptr || strcmp( indexExtension, extension ) != 0 )
-				{
-					continue;
-				}
+				FSScanPackage packageScan = {
+				        .scan         = &scan,
+				        .prefixLength = strlen( subPath ),
+				};
+				PlEnumeratePackageFiles( location->pkg, subPath, scan_package_file, &packageScan );
+			}
+			else if ( location->type == QM_FS_MOUNT_TYPE_DIR )
+			{
+				char mounted_path[ PL_SYSTEM_MAX_PATH * 2 ];
+				snprintf( mounted_path, sizeof( mounted_path ), "%s/%s", location->path, normPath );
 
-				Function( package->files[ j ].name, userData );
+				scan.mount = location;
+				scan_local_location( &scan, mounted_path );
 			}
 		}
-		else if ( location->type == QM_FS_MOUNT_TYPE_DIR )
-		{
-			char mounted_path[ PL_SYSTEM_MAX_PATH * 2 ];
-			snprintf( mounted_path, sizeof( mounted_path ), "%s/%s", location->path, normPath );
-			scan_local_directory( location, &fileList, mounted_path, extension, Function, recursive, userData );
-		}
+
+		PlDestroyHashTable( scan.seen );
+	}
+
+	/* nothing should be left in flight by this point */
+	qm_os_memory_free( scan.condition );
+	qm_os_memory_free( scan.mutex );
+
+	if ( scan.error != nullptr )
+	{
+		PlReportErrorF( scan.result, "%s", scan.error );
+		qm_os_memory_free( scan.error );
+	}
+}
+
+typedef struct FSScanArray
+{
+	char        *strings;
+	size_t       stringsSize;
+	size_t       maxStringsSize;
+	unsigned int numPaths;
+} FSScanArray;
+
+static void scan_array_append( const char *path, void *userData )
+{
+	FSScanArray *array  = userData;
+	size_t       length = strlen( path ) + 1;
+	if ( array->stringsSize + length > array->maxStringsSize )
+	{
+		array->maxStringsSize = QM_OS_MAX( array->maxStringsSize * 2, array->stringsSize + length );
+		array->strings        = qm_os_memory_realloc( array->strings, array->maxStringsSize );
+	}
+
+	memcpy( array->strings + array->stringsSize, path, length );
+	array->stringsSize += length;
+	array->numPaths++;
+}
+
+/**
+ * Scans the given directory, collecting everything found into a null
+ * terminated array. The array and its strings are a single allocation,
+ * to be freed with qm_os_memory_free.
+ */
+char **PlScanDirectoryToArray( const char *path, const char *extension, bool recursive, unsigned int numThreads, unsigned int *numPaths )
+{
+	FSScanArray array = {};
+	PlScanDirectoryEx( path, extension, scan_array_append, recursive, numThreads, &array );
+
+	size_t pointersSize = sizeof( char * ) * ( array.numPaths + 1 );
+	char **paths        = QM_OS_MEMORY_MALLOC_( pointersSize + array.stringsSize );
+
+	char *strings = ( char * ) paths + pointersSize;
+	if ( array.stringsSize > 0 )
+	{
+		memcpy( strings, array.strings, array.stringsSize );
+	}
+
+	for ( unsigned int i = 0; i < array.numPaths; ++i )
+	{
+		paths[ i ] = strings;
+		strings += strlen( strings ) + 1;
 	}
+	paths[ array.numPaths ] = nullptr;
+
+	qm_os_memory_free( array.strings );
 
-	// Clean up the list
-	FSScanInstance *current = fileList;
-	while ( current != nullptr )
+	if ( numPaths != nullptr )
 	{
-		FSScanInstance *prev = current;
-		current              = current->next;
-		qm_os_memory_free( prev );
+		*numPaths = array.numPaths;
 	}
+
+	return paths;
 }
 
 const char *PlGetWorkingDirectory( void )
@@ -853,59 +2017,66 @@ const char *PlGetExecutableDirectory( char *out, size_t outSize )
 /**
  * Transform the given path to the direct path
  * relative to anything mounted under the VFS.
+ * If the path resolves to a package entry, its
+ * table index is returned via 'index'.
+ */
+static const char *PlVirtualToLocalPath_( QmFsMount *mount, const char *path, char *dest, size_t size );
+
+/**
+ * Resolves the path to the mount that serves it, via the index alone.
+ * Anything the index doesn't know about is treated as a local path.
+ * The index is only as current as the last change it was told about, so
+ * changes made to a mounted directory afterwards aren't seen unless the
+ * mount is watched, or qm_fs_rescan_mounted_locations is called.
  */
-static QmFsMount *PlGetMountLocationForPath_( const char *path )
+static QmFsMount *PlGetMountLocationForPath_( const char *path, int *index )
 {
-	if ( PlLocalPathExists( path ) || qm_fs_check_local_file_exists( path ) )
+	if ( index != nullptr )
 	{
-		return nullptr;
+		*index = -1;
 	}
 
-#if 0
-	if ( strncmp( VFS_LOCAL_HINT, path, sizeof( VFS_LOCAL_HINT ) ) == 0 ) {
+	const QmFsIndexEntry *entry = vfs_index_lookup( path );
+	if ( entry == nullptr || ( entry->flags & VFS_ENTRY_WHITEOUT ) )
+	{
 		return nullptr;
 	}
-#endif
 
-	size_t sl = strlen( path );
-	if ( mounts != nullptr )
+	if ( index != nullptr )
 	{
-		QmFsMount *location;
-		QM_OS_LINKED_LIST_ITERATE( location, mounts, i )
+		*index = entry->index;
+	}
+
+	return entry->mount;
+}
+
+QmFsPackage *qm_fs_resolve_path_( const char *path, unsigned int *index, char *localPath, size_t localPathSize )
+{
+	const char *p = PlGetPathForAlias( path );
+	if ( p != nullptr )
+	{
+		path = p;
+	}
+
+	int        i;
+	QmFsMount *mount = PlGetMountLocationForPath_( path, &i );
+	if ( mount == nullptr || mount->type != QM_FS_MOUNT_TYPE_PACKAGE )
+	{
+		if ( localPath != nullptr )
 		{
-			switch ( location->type )
-			{
-				default:
-				{
-					/* todo: don't allow path to search outside of mounted path */
-					char buf[ VFS_MAX_PATH ];
-					snprintf( buf, sizeof( buf ), "%s/%s", location->path, path );
-					if ( PlLocalPathExists( buf ) || qm_fs_check_local_file_exists( buf ) )
-					{
-						return location;
-					}
-					break;
-				}
-				case QM_FS_MOUNT_TYPE_PACKAGE:
-				{
-					for ( unsigned int i = 0; i < location->pkg->numFiles; ++i )
-					{
-						/* packages don't necessarily have the concept of a directory
-						 * the way we might expect (take Unreal packages for example),
-						 * so down the line we might want to allow this to be handled
-						 * by the specific package API (i.e. call to GetPackageDirectory?). */
-						if ( strncmp( path, location->pkg->files[ i ].name, sl ) == 0 )
-						{
-							return location;
-						}
-					}
-					break;
-				}
-			}
+			PlVirtualToLocalPath_( mount, path, localPath, localPathSize );
 		}
+
+		return nullptr;
 	}
 
-	return nullptr;
+	if ( i < 0 && ( i = PlGetPackageTableIndex( mount->pkg, path ) ) < 0 )
+	{
+		return nullptr;
+	}
+
+	*index = ( unsigned int ) i;
+	return mount->pkg;
 }
 
 static const char *PlVirtualToLocalPath_( QmFsMount *mount, const char *path, char *dest, size_t size )
@@ -940,7 +2111,7 @@ const char *qm_fs_resolve_virtual_path( const char *path, char *dest, size_t siz
 		return path;
 	}
 
-	QmFsMount *mount = PlGetMountLocationForPath_( path );
+	QmFsMount *mount = PlGetMountLocationForPath_( path, nullptr );
 	if ( mount == nullptr || mount->type == QM_FS_MOUNT_TYPE_PACKAGE )
 	{
 		return path;
@@ -998,7 +2169,7 @@ bool PlLocalPathExists( const char *path )
 
 bool PlPathExists( const char *path )
 {
-	QmFsMount *mount = PlGetMountLocationForPath_( path );
+	QmFsMount *mount = PlGetMountLocationForPath_( path, nullptr );
 	if ( mount == nullptr )
 		return PlLocalPathExists( path );
 
@@ -1122,12 +2293,408 @@ QmFsFile *qm_fs_file_from_memory( const char *path, void *buf, size_t bufSize, Q
 			file->isUnmanaged = true;
 		}
 
-		file->data = buf;
+		file->data = buf;
+	}
+
+	file->pos  = file->data;
+	file->size = bufSize;
+	file->path = qm_os_string_alloc( "%s", path );
+
+	return file;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Mapping
+/////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct QmFsMapping
+{
+	atomic_int refs;
+	void      *data;
+	size_t     size;
+#if defined( _WIN32 )
+	HANDLE mapHandle;
+#endif
+} QmFsMapping;
+
+QmFsMapping *qm_fs_mapping_open( const char *path )
+{
+	void  *data = nullptr;
+	size_t size = 0;
+
+#if defined( _WIN32 )
+	HANDLE fileHandle = CreateFileA( path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+	if ( fileHandle == INVALID_HANDLE_VALUE )
+	{
+		PlReportErrorF( PL_RESULT_FILEREAD, "failed to open %s (%lu)", path, GetLastError() );
+		return nullptr;
+	}
+
+	LARGE_INTEGER fileSize;
+	if ( !GetFileSizeEx( fileHandle, &fileSize ) || fileSize.QuadPart == 0 )
+	{
+		CloseHandle( fileHandle );
+		PlReportErrorF( PL_RESULT_FILESIZE, "failed to get a valid size for %s", path );
+		return nullptr;
+	}
+
+	size = ( size_t ) fileSize.QuadPart;
+
+	/* the view holds its own reference on the mapping, which in turn holds the file */
+	HANDLE mapHandle = CreateFileMappingA( fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr );
+	CloseHandle( fileHandle );
+	if ( mapHandle == nullptr )
+	{
+		PlReportErrorF( PL_RESULT_FILEREAD, "failed to map %s (%lu)", path, GetLastError() );
+		return nullptr;
+	}
+
+	data = MapViewOfFile( mapHandle, FILE_MAP_READ, 0, 0, 0 );
+	if ( data == nullptr )
+	{
+		CloseHandle( mapHandle );
+		PlReportErrorF( PL_RESULT_FILEREAD, "failed to map %s (%lu)", path, GetLastError() );
+		return nullptr;
+	}
+#else
+	int fd = open( path, O_RDONLY );
+	if ( fd == -1 )
+	{
+		PlReportErrorF( PL_RESULT_FILEREAD, "failed to open %s (%s)", path, strerror( errno ) );
+		return nullptr;
+	}
+
+	struct stat buf;
+	if ( fstat( fd, &buf ) != 0 || buf.st_size <= 0 )
+	{
+		close( fd );
+		PlReportErrorF( PL_RESULT_FILESIZE, "failed to get a valid size for %s", path );
+		return nullptr;
+	}
+
+	size = ( size_t ) buf.st_size;
+
+	/* the mapping remains valid after the descriptor is closed */
+	data = mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if ( data == MAP_FAILED )
+	{
+		PlReportErrorF( PL_RESULT_FILEREAD, "failed to map %s (%s)", path, strerror( errno ) );
+		return nullptr;
+	}
+#endif
+
+	QmFsMapping *mapping = QM_OS_MEMORY_NEW( QmFsMapping );
+	atomic_init( &mapping->refs, 1 );
+	mapping->data = data;
+	mapping->size = size;
+#if defined( _WIN32 )
+	mapping->mapHandle = mapHandle;
+#endif
+
+	return mapping;
+}
+
+QmFsMapping *qm_fs_mapping_acquire( QmFsMapping *self )
+{
+	atomic_fetch_add_explicit( &self->refs, 1, memory_order_relaxed );
+	return self;
+}
+
+void qm_fs_mapping_release( QmFsMapping *self )
+{
+	if ( self == nullptr )
+	{
+		return;
+	}
+
+	if ( atomic_fetch_sub_explicit( &self->refs, 1, memory_order_acq_rel ) != 1 )
+	{
+		return;
+	}
+
+#if defined( _WIN32 )
+	UnmapViewOfFile( self->data );
+	CloseHandle( self->mapHandle );
+#else
+	munmap( self->data, self->size );
+#endif
+
+	qm_os_memory_free( self );
+}
+
+const void *qm_fs_mapping_get_data( const QmFsMapping *self )
+{
+	return self->data;
+}
+
+size_t qm_fs_mapping_get_size( const QmFsMapping *self )
+{
+	return self->size;
+}
+
+/**
+ * Creates a file pointing directly into the given mapping,
+ * which is kept alive until the file is closed.
+ */
+QmFsFile *qm_fs_file_from_mapping( const char *path, QmFsMapping *mapping, size_t offset, size_t size )
+{
+	QmFsFile *file = qm_fs_file_from_memory( path, ( uint8_t * ) mapping->data + offset, size, QM_FS_FILE_OWNERSHIP_TYPE_UNMANAGED );
+	if ( file == nullptr )
+	{
+		return nullptr;
+	}
+
+	file->mapping = qm_fs_mapping_acquire( mapping );
+
+	return file;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Buffering
+/////////////////////////////////////////////////////////////////////////////////////
+
+static size_t defaultBufferSize = QM_FS_FILE_DEFAULT_BUFFER_SIZE;
+
+void qm_fs_set_default_buffer_size( size_t size )
+{
+	defaultBufferSize = size;
+}
+
+/**
+ * Allocates the buffer, falling back to reading
+ * via stdio directly if that isn't possible.
+ */
+static void file_setup_buffer( QmFsFile *self, size_t size )
+{
+	qm_os_memory_free( self->buffer );
+	self->buffer       = nullptr;
+	self->bufferSize   = 0;
+	self->bufferLength = 0;
+	self->bufferPos    = 0;
+
+	if ( size == 0 )
+	{
+		return;
+	}
+
+	self->buffer = QM_OS_MEMORY_NEW_( uint8_t, size );
+	if ( self->buffer != nullptr )
+	{
+		self->bufferSize = size;
+	}
+}
+
+/**
+ * Whether the file is read from stdio or a stream,
+ * rather than from memory.
+ */
+static inline bool file_is_streamed( const QmFsFile *self )
+{
+	return self->fptr != nullptr || self->stream != nullptr;
+}
+
+static inline bool file_is_buffered( const QmFsFile *self )
+{
+	return file_is_streamed( self ) && self->bufferSize > 0;
+}
+
+static size_t file_read_source( QmFsFile *self, void *dest, size_t size )
+{
+	if ( self->stream != nullptr )
+	{
+		return self->stream->read( self->stream, dest, size );
+	}
+
+	return fread( dest, sizeof( uint8_t ), size, self->fptr );
+}
+
+/**
+ * Moves the source to the given offset. Streams can only go
+ * forward, so they're skipped along, restarting them first
+ * if need be. Must be called before the buffer is reset.
+ */
+static bool file_seek_source( QmFsFile *self, uint64_t offset )
+{
+	if ( self->stream == nullptr )
+	{
+		return ( qm_fs_fseek( self->fptr, offset, QM_FS_SEEK_SET ) == 0 );
+	}
+
+	if ( offset > self->size )
+	{
+		return false;
+	}
+
+	uint64_t position = self->bufferOffset + self->bufferLength;
+	if ( offset < position )
+	{
+		if ( !self->stream->restart( self->stream ) )
+		{
+			return false;
+		}
+
+		position = 0;
+	}
+
+	while ( position < offset )
+	{
+		size_t r = file_read_source( self, self->buffer, ( size_t ) QM_OS_MIN( offset - position, self->bufferSize ) );
+		if ( r == 0 )
+		{
+			return false;
+		}
+
+		position += r;
+	}
+
+	return true;
+}
+
+/**
+ * Throws away whatever is left in the buffer, moving
+ * the stdio cursor back to where we're reading from.
+ */
+static bool file_drop_buffer( QmFsFile *self )
+{
+	uint64_t offset = self->bufferOffset + self->bufferPos;
+	if ( self->bufferPos != self->bufferLength && !file_seek_source( self, offset ) )
+	{
+		PlReportErrorF( PL_RESULT_FILEREAD, "failed to seek file (%s)", GetLastError_strerror( GetLastError() ) );
+		return false;
+	}
+
+	self->bufferOffset = offset;
+	self->bufferLength = 0;
+	self->bufferPos    = 0;
+	return true;
+}
+
+/**
+ * Reads the next block in, once the buffer has been used up.
+ */
+static bool file_fill_buffer( QmFsFile *self )
+{
+	self->bufferOffset += self->bufferLength;
+	self->bufferPos    = 0;
+	self->bufferLength = file_read_source( self, self->buffer, self->bufferSize );
+
+	return self->bufferLength > 0;
+}
+
+static size_t file_read_buffered( QmFsFile *self, void *dest, size_t size )
+{
+	size_t numRead = 0;
+	while ( numRead < size )
+	{
+		size_t available = self->bufferLength - self->bufferPos;
+		if ( available > 0 )
+		{
+			size_t n = QM_OS_MIN( available, size - numRead );
+			memcpy( ( uint8_t * ) dest + numRead, self->buffer + self->bufferPos, n );
+			self->bufferPos += n;
+			numRead += n;
+			continue;
+		}
+
+		/* anything at least as big as the buffer skips it */
+		size_t remaining = size - numRead;
+		if ( remaining >= self->bufferSize )
+		{
+			self->bufferOffset += self->bufferLength;
+			self->bufferLength = 0;
+			self->bufferPos    = 0;
+
+			size_t r = file_read_source( self, ( uint8_t * ) dest + numRead, remaining );
+			self->bufferOffset += r;
+			numRead += r;
+			break;
+		}
+
+		if ( !file_fill_buffer( self ) )
+		{
+			break;
+		}
+	}
+
+	return numRead;
+}
+
+bool qm_fs_file_set_buffer_size( QmFsFile *self, size_t size )
+{
+	if ( !file_is_streamed( self ) )
+	{
+		return true;
+	}
+
+	/* streams are always read through the buffer */
+	if ( self->stream != nullptr && size == 0 )
+	{
+		PlReportBasicError( PL_RESULT_INVALID_PARM2 );
+		return false;
+	}
+
+	if ( self->bufferSize == 0 )
+	{
+		self->bufferOffset = qm_fs_ftell( self->fptr );
+	}
+	else if ( !file_drop_buffer( self ) )
+	{
+		return false;
+	}
+
+	file_setup_buffer( self, size );
+
+	return true;
+}
+
+/**
+ * Reads small values without going through qm_file_read,
+ * when they're already in memory or in the buffer.
+ */
+static inline bool file_read_value( QmFsFile *self, void *dest, size_t size )
+{
+	if ( !file_is_streamed( self ) )
+	{
+		if ( ( size_t ) ( ( uint8_t * ) self->pos - ( uint8_t * ) self->data ) + size <= self->size )
+		{
+			memcpy( dest, self->pos, size );
+			self->pos = ( uint8_t * ) self->pos + size;
+			return true;
+		}
+	}
+	else if ( self->bufferLength - self->bufferPos >= size )
+	{
+		memcpy( dest, self->buffer + self->bufferPos, size );
+		self->bufferPos += size;
+		return true;
+	}
+
+	return qm_file_read( self, dest, size, 1 ) == 1;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+
+QmFsFile *qm_fs_file_from_stream( const char *path, QmFsStream *stream, size_t size )
+{
+	QmFsFile *file = QM_OS_MEMORY_NEW( QmFsFile );
+	if ( file == nullptr )
+	{
+		stream->destroy( stream );
+		return nullptr;
 	}
 
-	file->pos  = file->data;
-	file->size = bufSize;
-	file->path = qm_os_string_alloc( "%s", path );
+	file->stream = stream;
+	file->size   = size;
+	file->path   = qm_os_string_alloc( "%s", path );
+
+	/* streams are always read through the buffer */
+	file_setup_buffer( file, ( defaultBufferSize > 0 ) ? defaultBufferSize : QM_FS_FILE_DEFAULT_BUFFER_SIZE );
+	if ( file->bufferSize == 0 )
+	{
+		PlCloseFile( file );
+		return nullptr;
+	}
 
 	return file;
 }
@@ -1154,8 +2721,10 @@ QmFsFile *qm_fs_file_from_stdio( FILE *stdio, const char *source )
 		return nullptr;
 	}
 
-	file->size = size;
-	file->fptr = stdio;
+	file->size         = size;
+	file->fptr         = stdio;
+	file->bufferOffset = offset;
+	file_setup_buffer( file, defaultBufferSize );
 
 	if ( source != nullptr )
 	{
@@ -1165,7 +2734,7 @@ QmFsFile *qm_fs_file_from_stdio( FILE *stdio, const char *source )
 	return file;
 }
 
-QmFsFile *qm_fs_file_open_local( const char *path, bool cache )
+static QmFsFile *open_local_file( const char *path, bool cache, size_t bufferSize )
 {
 	FILE *sysFile = fopen( path, "rb" );
 	if ( sysFile == nullptr )
@@ -1198,6 +2767,7 @@ QmFsFile *qm_fs_file_open_local( const char *path, bool cache )
 	else
 	{
 		file->fptr = sysFile;
+		file_setup_buffer( file, bufferSize );
 	}
 
 	file->timeStamp = qm_fs_get_local_file_timestamp( path );
@@ -1205,7 +2775,39 @@ QmFsFile *qm_fs_file_open_local( const char *path, bool cache )
 	return file;
 }
 
-QmFsFile *qm_fs_file_open( const char *path, bool cache )
+QmFsFile *qm_fs_file_open_local( const char *path, bool cache )
+{
+	return open_local_file( path, cache, defaultBufferSize );
+}
+
+QmFsFile *qm_fs_file_open_local_mapped( const char *path )
+{
+	/* empty files can't be mapped, but there's also nothing to map */
+	if ( qm_fs_get_local_file_size( path ) == 0 )
+	{
+		return qm_fs_file_open_local( path, true );
+	}
+
+	QmFsMapping *mapping = qm_fs_mapping_open( path );
+	if ( mapping == nullptr )
+	{
+		return nullptr;
+	}
+
+	QmFsFile *file = qm_fs_file_from_mapping( path, mapping, 0, mapping->size );
+	/* the file holds its own reference */
+	qm_fs_mapping_release( mapping );
+	if ( file == nullptr )
+	{
+		return nullptr;
+	}
+
+	file->timeStamp = qm_fs_get_local_file_timestamp( path );
+
+	return file;
+}
+
+static QmFsFile *open_file( const char *path, bool cache, bool map, size_t bufferSize )
 {
 	const char *p = PlGetPathForAlias( path );
 	if ( p != nullptr )
@@ -1213,16 +2815,42 @@ QmFsFile *qm_fs_file_open( const char *path, bool cache )
 		path = p;
 	}
 
-	QmFsMount *mount = PlGetMountLocationForPath_( path );
+	int        index;
+	QmFsMount *mount = PlGetMountLocationForPath_( path, &index );
 	if ( mount != nullptr && mount->type == QM_FS_MOUNT_TYPE_PACKAGE )
 	{
+		if ( index >= 0 )
+		{
+			return PlLoadPackageFileByIndex( mount->pkg, ( unsigned int ) index );
+		}
+
 		return PlLoadPackageFile( mount->pkg, path );
 	}
 
 	char buf[ PL_SYSTEM_MAX_PATH ];
 	PlVirtualToLocalPath_( mount, path, buf, sizeof( buf ) );
 
-	return qm_fs_file_open_local( buf, cache );
+	if ( map )
+	{
+		return qm_fs_file_open_local_mapped( buf );
+	}
+
+	return open_local_file( buf, cache, bufferSize );
+}
+
+QmFsFile *qm_fs_file_open( const char *path, bool cache )
+{
+	return open_file( path, cache, false, defaultBufferSize );
+}
+
+QmFsFile *qm_fs_file_open_mapped( const char *path )
+{
+	return open_file( path, false, true, defaultBufferSize );
+}
+
+QmFsFile *qm_fs_file_open_unbuffered_( const char *path )
+{
+	return open_file( path, false, false, 0 );
 }
 
 void PlCloseFile( QmFsFile *ptr )
@@ -1240,6 +2868,15 @@ void PlCloseFile( QmFsFile *ptr )
 	}
 
 	qm_fs_fclose( &ptr->fptr );
+	qm_fs_mapping_release( ptr->mapping );
+
+	if ( ptr->stream != nullptr )
+	{
+		ptr->stream->destroy( ptr->stream );
+	}
+
+	qm_fs_cache_entry_release_( ptr->cacheEntry );
+	qm_os_memory_free( ptr->buffer );
 
 	qm_os_memory_free( ptr );
 }
@@ -1261,7 +2898,11 @@ size_t qm_fs_file_get_size( const QmFsFile *ptr )
 
 int64_t qm_fs_file_get_offset( const QmFsFile *self )
 {
-	if ( self->fptr != nullptr )
+	if ( file_is_buffered( self ) )
+	{
+		return ( int64_t ) ( self->bufferOffset + self->bufferPos );
+	}
+	else if ( self->fptr != nullptr )
 	{
 		return qm_fs_ftell( self->fptr );
 	}
@@ -1278,9 +2919,18 @@ size_t qm_file_read( QmFsFile *ptr, void *dest, size_t size, size_t count )
 		return 0;
 	}
 
-	if ( ptr->fptr != nullptr )
+	if ( file_is_streamed( ptr ) )
 	{
-		size_t r = fread( dest, size, count, ptr->fptr );
+		size_t r;
+		if ( ptr->bufferSize > 0 )
+		{
+			r = file_read_buffered( ptr, dest, size * count ) / size;
+		}
+		else
+		{
+			r = fread( dest, size, count, ptr->fptr );
+		}
+
 		if ( r != count )
 		{
 			PlReportErrorF( PL_RESULT_FILEREAD, "read failed on %u (%u read)", count, r );
@@ -1302,6 +2952,76 @@ size_t qm_file_read( QmFsFile *ptr, void *dest, size_t size, size_t count )
 	return length / size;
 }
 
+size_t qm_fs_file_read_at( QmFsFile *self, void *dest, size_t size, PLFileOffset offset )
+{
+	if ( offset < 0 || ( size_t ) offset >= self->size )
+	{
+		PlReportBasicError( PL_RESULT_INVALID_PARM4 );
+		return 0;
+	}
+
+	if ( size > self->size - ( size_t ) offset )
+	{
+		size = self->size - ( size_t ) offset;
+	}
+
+	if ( self->stream != nullptr )
+	{
+		PlReportErrorF( PL_RESULT_UNSUPPORTED, "streams can only be read sequentially" );
+		return 0;
+	}
+	else if ( self->fptr == nullptr )
+	{
+		memcpy( dest, ( uint8_t * ) self->data + offset, size );
+		return size;
+	}
+
+	/* go straight to the descriptor, as the stdio cursor is shared */
+	size_t numRead = 0;
+#if defined( _WIN32 )
+	HANDLE handle = ( HANDLE ) _get_osfhandle( _fileno( self->fptr ) );
+	while ( numRead < size )
+	{
+		DWORD      chunkSize  = ( DWORD ) QM_OS_MIN( size - numRead, ( size_t ) UINT32_MAX );
+		uint64_t   chunkStart = ( uint64_t ) offset + numRead;
+		OVERLAPPED overlapped = {};
+		overlapped.Offset     = ( DWORD ) ( chunkStart & 0xFFFFFFFF );
+		overlapped.OffsetHigh = ( DWORD ) ( chunkStart >> 32 );
+
+		DWORD r;
+		if ( !ReadFile( handle, ( uint8_t * ) dest + numRead, chunkSize, &r, &overlapped ) || r == 0 )
+		{
+			break;
+		}
+
+		numRead += r;
+	}
+#else
+	int fd = fileno( self->fptr );
+	while ( numRead < size )
+	{
+		ssize_t r = pread( fd, ( uint8_t * ) dest + numRead, size - numRead, ( off_t ) ( offset + numRead ) );
+		if ( r < 0 && errno == EINTR )
+		{
+			continue;
+		}
+		else if ( r <= 0 )
+		{
+			break;
+		}
+
+		numRead += ( size_t ) r;
+	}
+#endif
+
+	if ( numRead != size )
+	{
+		PlReportErrorF( PL_RESULT_FILEREAD, "read failed at %lld (%zu of %zu read)", ( long long ) offset, numRead, size );
+	}
+
+	return numRead;
+}
+
 int8_t qm_fs_file_read_int8( QmFsFile *self, bool *status )
 {
 	if ( ( size_t ) qm_fs_file_get_offset( self ) >= self->size )
@@ -1318,7 +3038,20 @@ int8_t qm_fs_file_read_int8( QmFsFile *self, bool *status )
 		*status = true;
 	}
 
-	if ( self->fptr != nullptr )
+	if ( file_is_buffered( self ) )
+	{
+		if ( self->bufferPos == self->bufferLength && !file_fill_buffer( self ) )
+		{
+			if ( status != nullptr )
+			{
+				*status = false;
+			}
+			return 0;
+		}
+
+		return ( int8_t ) self->buffer[ self->bufferPos++ ];
+	}
+	else if ( self->fptr != nullptr )
 	{
 		return ( int8_t ) fgetc( self->fptr );
 	}
@@ -1330,8 +3063,9 @@ int8_t qm_fs_file_read_int8( QmFsFile *self, bool *status )
 
 static int64_t file_read_sized_int( QmFsFile *ptr, size_t size, bool big_endian, bool *status )
 {
-	int64_t n;
-	if ( qm_file_read( ptr, &n, size, 1 ) != 1 )
+	int64_t n = 0;
+
+	if ( !file_read_value( ptr, &n, size ) )
 	{
 		if ( status != nullptr )
 		{
@@ -1381,7 +3115,7 @@ int64_t qm_fs_file_read_int64( QmFsFile *self, bool big_endian, bool *status )
 float qm_fs_file_read_float( QmFsFile *ptr, bool big_endian, bool *status )
 {
 	float f;
-	if ( qm_file_read( ptr, &f, sizeof( float ), 1 ) != 1 )
+	if ( !file_read_value( ptr, &f, sizeof( float ) ) )
 	{
 		if ( status != nullptr ) *status = false;
 		return 0.0f;
@@ -1401,7 +3135,7 @@ float qm_fs_file_read_float( QmFsFile *ptr, bool big_endian, bool *status )
 double qm_fs_file_read_double( QmFsFile *ptr, bool big_endian, bool *status )
 {
 	double d;
-	if ( qm_file_read( ptr, &d, sizeof( double ), 1 ) != 1 )
+	if ( !file_read_value( ptr, &d, sizeof( double ) ) )
 	{
 		if ( status != nullptr ) *status = false;
 		return 0.0;
@@ -1418,6 +3152,57 @@ double qm_fs_file_read_double( QmFsFile *ptr, bool big_endian, bool *status )
 	return d;
 }
 
+size_t qm_fs_file_read_int16_array( QmFsFile *self, int16_t *dest, size_t count, bool big_endian )
+{
+	size_t r = qm_file_read( self, dest, sizeof( int16_t ), count );
+	if ( big_endian )
+	{
+		qm_os_endian_from_big16( dest, r );
+	}
+	else
+	{
+		qm_os_endian_from_little16( dest, r );
+	}
+
+	return r;
+}
+
+size_t qm_fs_file_read_int32_array( QmFsFile *self, int32_t *dest, size_t count, bool big_endian )
+{
+	size_t r = qm_file_read( self, dest, sizeof( int32_t ), count );
+	if ( big_endian )
+	{
+		qm_os_endian_from_big32( dest, r );
+	}
+	else
+	{
+		qm_os_endian_from_little32( dest, r );
+	}
+
+	return r;
+}
+
+size_t qm_fs_file_read_int64_array( QmFsFile *self, int64_t *dest, size_t count, bool big_endian )
+{
+	size_t r = qm_file_read( self, dest, sizeof( int64_t ), count );
+	if ( big_endian )
+	{
+		qm_os_endian_from_big64( dest, r );
+	}
+	else
+	{
+		qm_os_endian_from_little64( dest, r );
+	}
+
+	return r;
+}
+
+size_t qm_fs_file_read_float_array( QmFsFile *self, float *dest, size_t count, bool big_endian )
+{
+	PL_STATIC_ASSERT( sizeof( float ) == sizeof( int32_t ), "Unexpected float size!" );
+	return qm_fs_file_read_int32_array( self, ( int32_t * ) dest, count, big_endian );
+}
+
 char *qm_fs_file_read_string( QmFsFile *ptr, char *str, size_t size )
 {
 	if ( size == 0 )
@@ -1427,7 +3212,44 @@ char *qm_fs_file_read_string( QmFsFile *ptr, char *str, size_t size )
 	}
 
 	char *result;
-	if ( ptr->fptr != nullptr )
+	if ( file_is_buffered( ptr ) )
+	{
+		size_t length = 0;
+		while ( length + 1 < size )
+		{
+			if ( ptr->bufferPos == ptr->bufferLength && !file_fill_buffer( ptr ) )
+			{
+				break;
+			}
+
+			uint8_t *start = ptr->buffer + ptr->bufferPos;
+			size_t   n     = QM_OS_MIN( ptr->bufferLength - ptr->bufferPos, size - 1 - length );
+			uint8_t *nl    = memchr( start, '\n', n );
+			if ( nl != nullptr )
+			{
+				n = ( size_t ) ( nl - start ) + 1;
+			}
+
+			memcpy( str + length, start, n );
+			ptr->bufferPos += n;
+			length += n;
+
+			if ( nl != nullptr )
+			{
+				break;
+			}
+		}
+
+		/* same as fgets, nothing read means we hit the end */
+		if ( length == 0 )
+		{
+			return nullptr;
+		}
+
+		str[ length ] = '\0';
+		result        = str;
+	}
+	else if ( ptr->fptr != nullptr )
 	{
 		result = fgets( str, ( int ) size, ptr->fptr );
 	}
@@ -1463,15 +3285,60 @@ char *qm_fs_file_read_string( QmFsFile *ptr, char *str, size_t size )
 
 bool qm_fs_file_seek( QmFsFile *ptr, PLFileOffset pos, QmFsSeek seek )
 {
-	if ( ptr->fptr != nullptr )
+	int64_t target = pos;
+	if ( file_is_buffered( ptr ) && seek != QM_FS_SEEK_END )
+	{
+		if ( seek == QM_FS_SEEK_CUR )
+		{
+			/* the stdio cursor is ahead of us, so make it absolute */
+			target = ( int64_t ) ( ptr->bufferOffset + ptr->bufferPos ) + pos;
+			seek   = QM_FS_SEEK_SET;
+		}
+
+		/* anything landing within the buffer doesn't need to touch the file */
+		if ( target >= ( int64_t ) ptr->bufferOffset && target <= ( int64_t ) ( ptr->bufferOffset + ptr->bufferLength ) )
+		{
+			ptr->bufferPos = ( size_t ) ( target - ( int64_t ) ptr->bufferOffset );
+			return true;
+		}
+	}
+
+	if ( ptr->stream != nullptr )
+	{
+		/* streams behave like memory, so the end is counted backwards */
+		if ( seek == QM_FS_SEEK_END )
+		{
+			target = ( int64_t ) ptr->size - pos;
+		}
+
+		if ( target < 0 || !file_seek_source( ptr, ( uint64_t ) target ) )
+		{
+			PlReportBasicError( PL_RESULT_INVALID_PARM2 );
+			return false;
+		}
+
+		ptr->bufferOffset = ( uint64_t ) target;
+		ptr->bufferLength = 0;
+		ptr->bufferPos    = 0;
+
+		return true;
+	}
+	else if ( ptr->fptr != nullptr )
 	{
-		int err = qm_fs_fseek( ptr->fptr, pos, seek );
+		int err = ( seek == QM_FS_SEEK_SET && target < 0 ) ? -1 : qm_fs_fseek( ptr->fptr, target, seek );
 		if ( err != 0 )
 		{
 			PlReportErrorF( PL_RESULT_FILEREAD, "failed to seek file (%s)", GetLastError_strerror( GetLastError() ) );
 			return false;
 		}
 
+		if ( ptr->bufferSize > 0 )
+		{
+			ptr->bufferOffset = qm_fs_ftell( ptr->fptr );
+			ptr->bufferLength = 0;
+			ptr->bufferPos    = 0;
+		}
+
 		return true;
 	}
 
@@ -1515,7 +3382,12 @@ bool qm_fs_file_seek( QmFsFile *ptr, PLFileOffset pos, QmFsSeek seek )
 
 void qm_fs_file_rewind( QmFsFile *ptr )
 {
-	if ( ptr->fptr != nullptr )
+	if ( file_is_buffered( ptr ) )
+	{
+		qm_fs_file_seek( ptr, 0, QM_FS_SEEK_SET );
+		return;
+	}
+	else if ( ptr->fptr != nullptr )
 	{
 		rewind( ptr->fptr );
 		return;
@@ -1534,7 +3406,7 @@ void qm_fs_file_rewind( QmFsFile *ptr )
 const void *PlCacheFile( QmFsFile *file )
 {
 	/* make sure it's not already cached */
-	if ( file->fptr == nullptr )
+	if ( !file_is_streamed( file ) )
 	{
 		return nullptr;
 	}
@@ -1552,11 +3424,19 @@ const void *PlCacheFile( QmFsFile *file )
 		/* seek back and restore where we were */
 		qm_fs_file_seek( file, ( long ) p, QM_FS_SEEK_SET );
 		qm_os_memory_free( file->data );
+		file->data = nullptr;
 		return nullptr;
 	}
 
-	/* close the original file handle we had */
+	/* close the original file handle (or stream) we had */
 	qm_fs_fclose( &file->fptr );
+	if ( file->stream != nullptr )
+	{
+		file->stream->destroy( file->stream );
+		file->stream = nullptr;
+	}
+
+	file_setup_buffer( file, 0 );
 
 	/* match pos with where we originally were, so it's like nothing changed */
 	file->pos = ( char * ) file->data + p;
@@ -1570,45 +3450,104 @@ const void *PlCacheFile( QmFsFile *file )
  * different file in it's place. Useful when dealing with older titles that
  * didn't utilise full paths and just single file names instead (i.e. mapping
  * between a WAD and local file).
+ *
+ * Aliases live in an open-addressed table, probed linearly, which is grown
+ * once it's more than 3/4 full. Every open goes through here, so a lookup
+ * should cost next to nothing when there's no alias for the path.
  ****************************************/
 
-#define MAX_ALIASES 4096
+#define MIN_ALIAS_SLOTS 256
 
 typedef struct FileAlias
 {
-	PLPath   alias;
-	PLPath   target;
-	uint32_t hash;
+	uint64_t hash;
+	char    *alias;// alias and target share the one allocation
+	char    *target;
 } FileAlias;
-static FileAlias    fileAliases[ MAX_ALIASES ];
+static FileAlias   *fileAliases    = nullptr;
+static unsigned int numAliasSlots  = 0;// always a power of two
 static unsigned int numFileAliases = 0;
 
 void PlClearFileAliases( void )
 {
+	for ( unsigned int i = 0; i < numAliasSlots; ++i )
+	{
+		qm_os_memory_free( fileAliases[ i ].alias );
+	}
+
+	qm_os_memory_free( fileAliases );
+	fileAliases    = nullptr;
+	numAliasSlots  = 0;
 	numFileAliases = 0;
 }
 
+static FileAlias *find_alias_slot( FileAlias *slots, unsigned int numSlots, uint64_t hash, const char *alias )
+{
+	unsigned int mask = numSlots - 1;
+	for ( unsigned int i = ( unsigned int ) hash & mask;; i = ( i + 1 ) & mask )
+	{
+		FileAlias *slot = &slots[ i ];
+		if ( slot->alias == nullptr || ( slot->hash == hash && strcmp( slot->alias, alias ) == 0 ) )
+		{
+			return slot;
+		}
+	}
+}
+
+static bool grow_alias_table( void )
+{
+	unsigned int numSlots = ( numAliasSlots > 0 ) ? numAliasSlots * 2 : MIN_ALIAS_SLOTS;
+	FileAlias   *slots    = QM_OS_MEMORY_NEW_( FileAlias, numSlots );
+	if ( slots == nullptr )
+	{
+		return false;
+	}
+
+	for ( unsigned int i = 0; i < numAliasSlots; ++i )
+	{
+		if ( fileAliases[ i ].alias == nullptr )
+		{
+			continue;
+		}
+
+		*find_alias_slot( slots, numSlots, fileAliases[ i ].hash, fileAliases[ i ].alias ) = fileAliases[ i ];
+	}
+
+	qm_os_memory_free( fileAliases );
+	fileAliases   = slots;
+	numAliasSlots = numSlots;
+
+	return true;
+}
+
 /**
  * Adds a new alias to the list.
  */
 void PlAddFileAlias( const char *alias, const char *target )
 {
-	if ( numFileAliases >= MAX_ALIASES )
+	if ( ( numFileAliases + 1 ) * 4 > numAliasSlots * 3 && !grow_alias_table() )
 	{
 		PlReportBasicError( PL_RESULT_MEMORY_EOA );
 		return;
 	}
 
-	const char *p = PlGetPathForAlias( alias );
-	if ( p != nullptr )
+	size_t     aliasLength = strlen( alias );
+	uint64_t   hash        = PlGenerateHashFNV1( alias, aliasLength );
+	FileAlias *slot        = find_alias_slot( fileAliases, numAliasSlots, hash, alias );
+	if ( slot->alias != nullptr )
 	{
 		PlReportErrorF( PL_RESULT_INVALID_PARM1, "duplicate alias" );
 		return;
 	}
 
-	snprintf( fileAliases[ numFileAliases ].alias, sizeof( PLPath ), "%s", alias );
-	fileAliases[ numFileAliases ].hash = PlGenerateHashSDBM( fileAliases[ numFileAliases ].alias );
-	snprintf( fileAliases[ numFileAliases ].target, sizeof( PLPath ), "%s", target );
+	size_t targetLength = strlen( target );
+
+	slot->hash   = hash;
+	slot->alias  = QM_OS_MEMORY_NEW_( char, aliasLength + targetLength + 2 );
+	slot->target = slot->alias + aliasLength + 1;
+	memcpy( slot->alias, alias, aliasLength + 1 );
+	memcpy( slot->target, target, targetLength + 1 );
+
 	numFileAliases++;
 }
 
@@ -1619,18 +3558,80 @@ const char *PlGetPathForAlias( const char *alias )
 		return nullptr;
 	}
 
-	uint32_t hash = PlGenerateHashSDBM( alias );
-	for ( unsigned int i = 0; i < numFileAliases; ++i )
+	const FileAlias *slot = find_alias_slot( fileAliases, numAliasSlots, PlGenerateHashFNV1( alias, strlen( alias ) ), alias );
+	return slot->target;
+}
+
+unsigned int PlGetNumFileAliases( void )
+{
+	return numFileAliases;
+}
+
+/**
+ * Adds every alias listed in the given manifest, one per line, as the
+ * alias followed by its target. Either can be quoted if it contains
+ * spaces, and lines starting with '#' or '//' are ignored. Returns the
+ * number of aliases that were added.
+ */
+unsigned int PlLoadFileAliases( const char *path )
+{
+	QmFsFile *file = qm_fs_file_open( path, false );
+	if ( file == nullptr )
+	{
+		return 0;
+	}
+
+	size_t size = qm_fs_file_get_size( file );
+	char  *buf  = QM_OS_MEMORY_NEW_( char, size + 1 );
+	size        = qm_file_read( file, buf, sizeof( char ), size );
+	buf[ size ] = '\0';
+
+	PlCloseFile( file );
+
+	unsigned int numAdded = 0;
+	char        *line     = buf;
+	while ( *line != '\0' )
 	{
-		if ( hash != fileAliases[ i ].hash )
+		/* each line is parsed on its own, so a missing target
+		 * can't be picked up from the start of the next one */
+		char *end = line;
+		while ( QM_PARSE_NOT_TERMINATING_CHAR( *end ) )
 		{
-			continue;
+			end++;
+		}
+
+		char terminator = *end;
+		*end            = '\0';
+
+		const char *p = line;
+		qm_parse_skip_whitespace( &p );
+		if ( *p != '\0' && *p != '#' && !( p[ 0 ] == '/' && p[ 1 ] == '/' ) )
+		{
+			PLPath alias, target;
+			qm_parse_enclosed( &p, alias, sizeof( alias ) );
+			qm_parse_enclosed( &p, target, sizeof( target ) );
+			if ( *alias == '\0' || *target == '\0' )
+			{
+				PlReportErrorF( PL_RESULT_FILEERR, "invalid alias in %s", path );
+			}
+			else
+			{
+				unsigned int numAliases = numFileAliases;
+				PlAddFileAlias( alias, target );
+				numAdded += numFileAliases - numAliases;
+			}
 		}
 
-		return fileAliases[ i ].target;
+		*end = terminator;
+
+		p = end;
+		qm_parse_skip_line( &p );
+		line = buf + ( p - buf );
 	}
 
-	return nullptr;
+	qm_os_memory_free( buf );
+
+	return numAdded;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////
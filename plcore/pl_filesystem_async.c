@@ -0,0 +1,696 @@
+// SPDX-License-Identifier: MIT
+// Hei Platform Library
+// Copyright © 2017-2026 Quartermind Games, Mark E. Sowden <markelswo@gmail.com>
+// Purpose: Asynchronous loading via the VFS.
+
+#include <stdatomic.h>
+
+#include "filesystem_private.h"
+#include "pl_private.h"
+#include "package/package_private.h"
+
+#include "qmos/public/qm_os_memory.h"
+#include "qmos/public/qm_os_string.h"
+#include "qmos/public/qm_os_thread.h"
+
+#if defined( PL_IO_URING )
+#	include <fcntl.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+/* minimum number of package entries handed to a single job,
+ * so large batches still get spread across the workers */
+#define REQUEST_MIN_JOB_SIZE 16
+
+/* entries from the same package closer together than this are read in
+ * one go, as reading through the gap is cheaper than another request */
+#define REQUEST_MAX_SPAN_GAP  ( 64 * 1024 )
+#define REQUEST_MAX_SPAN_SIZE ( 8 * 1024 * 1024 )
+
+typedef struct QmFsRequest
+{
+	char               *path;
+	QmFsRequestCallback callback;
+	void               *userData;
+
+	/* resolved up front by the submitting thread, as the
+	 * workers can't safely touch the VFS index or aliases */
+	QmFsPackage *package;// set if the file resides within a package
+	unsigned int index;
+	char        *localPath;// otherwise where it resides locally
+	uint64_t     rawOffset;// where the entry's raw data starts, if it can be read directly
+
+	QmFsFile        *file;
+	char            *error;// set by the worker if the load failed
+	PLFunctionResult result;
+
+	/* local files being read via io_uring */
+	int    fd;
+	time_t timeStamp;
+
+	atomic_bool done;
+	atomic_int  refs;
+} QmFsRequest;
+
+typedef struct QmFsRequestJob
+{
+	QmFsRequest **requests;
+	unsigned int  numRequests;
+} QmFsRequestJob;
+
+typedef struct QmFsRequestSpan
+{
+	QmFsRequest **requests;// run of requests within the job
+	unsigned int  numRequests;
+
+	int      fd;// -1 if the data can't be read directly
+	uint64_t offset;
+	size_t   size;
+} QmFsRequestSpan;
+
+static atomic_bool     requestReady;
+static QmOsThreadPool *requestPool;
+static QmOsMutex      *requestMutex;
+static QmOsCondition  *requestCondition;// signalled whenever a request completes
+
+/* guards setting up and tearing down the pool; this one is never
+ * freed, so that anyone racing to initialize can safely block on it */
+static _Atomic( QmOsMutex * ) requestInitMutex;
+
+static QmOsMutex *request_get_init_mutex( void )
+{
+	QmOsMutex *mutex = atomic_load( &requestInitMutex );
+	if ( mutex != nullptr )
+	{
+		return mutex;
+	}
+
+	QmOsMutex *newMutex = qm_os_mutex_create();
+	if ( !atomic_compare_exchange_strong( &requestInitMutex, &mutex, newMutex ) )
+	{
+		/* someone else got here first, so use theirs */
+		qm_os_memory_free( newMutex );
+		return mutex;
+	}
+
+	return newMutex;
+}
+
+static bool request_initialize( void )
+{
+	if ( atomic_load( &requestReady ) )
+	{
+		return true;
+	}
+
+	QmOsMutex *initMutex = request_get_init_mutex();
+	qm_os_mutex_lock( initMutex );
+
+	if ( !atomic_load( &requestReady ) )
+	{
+		requestMutex     = qm_os_mutex_create();
+		requestCondition = qm_os_condition_create();
+		requestPool      = qm_os_thread_pool_create( qm_os_thread_get_available() );
+		if ( requestPool == nullptr )
+		{
+			qm_os_memory_free( requestCondition );
+			qm_os_memory_free( requestMutex );
+			requestCondition = nullptr;
+			requestMutex     = nullptr;
+
+			qm_os_mutex_unlock( initMutex );
+			PlReportErrorF( PL_RESULT_SYSERR, "failed to create worker threads" );
+			return false;
+		}
+
+		atomic_store( &requestReady, true );
+	}
+
+	qm_os_mutex_unlock( initMutex );
+
+	return true;
+}
+
+void qm_fs_request_shutdown( void )
+{
+	if ( !atomic_load( &requestReady ) )
+	{
+		return;
+	}
+
+	QmOsMutex *initMutex = request_get_init_mutex();
+	qm_os_mutex_lock( initMutex );
+
+	if ( atomic_load( &requestReady ) )
+	{
+		/* destroying the pool will finish off anything still queued */
+		qm_os_memory_free( requestPool );
+#if defined( PL_IO_URING )
+		qm_fs_uring_shutdown();
+#endif
+		qm_os_memory_free( requestCondition );
+		qm_os_memory_free( requestMutex );
+
+		requestPool      = nullptr;
+		requestCondition = nullptr;
+		requestMutex     = nullptr;
+
+		atomic_store( &requestReady, false );
+	}
+
+	qm_os_mutex_unlock( initMutex );
+}
+
+void qm_fs_request_flush( void )
+{
+	if ( !atomic_load( &requestReady ) )
+	{
+		return;
+	}
+
+	qm_os_thread_pool_wait( requestPool );
+}
+
+void qm_fs_request_release( QmFsRequest *self )
+{
+	if ( self == nullptr )
+	{
+		return;
+	}
+
+	if ( atomic_fetch_sub( &self->refs, 1 ) != 1 )
+	{
+		return;
+	}
+
+	PlCloseFile( self->file );
+
+	qm_os_memory_free( self->error );
+	qm_os_memory_free( self->localPath );
+	qm_os_memory_free( self->path );
+	qm_os_memory_free( self );
+}
+
+bool qm_fs_request_is_done( const QmFsRequest *self )
+{
+	return atomic_load( &self->done );
+}
+
+QmFsFile *qm_fs_request_wait( QmFsRequest *self )
+{
+	if ( !atomic_load( &self->done ) )
+	{
+		qm_os_mutex_lock( requestMutex );
+		while ( !atomic_load( &self->done ) )
+		{
+			qm_os_condition_wait( requestCondition, requestMutex );
+		}
+		qm_os_mutex_unlock( requestMutex );
+	}
+
+	/* errors are per-thread, so pass on whatever the worker hit */
+	if ( self->error != nullptr )
+	{
+		PlReportErrorF( self->result, "%s", self->error );
+	}
+
+	QmFsFile *file = self->file;
+	self->file     = nullptr;
+
+	return file;
+}
+
+static QmFsFile *load_request( QmFsRequest *request )
+{
+	if ( request->package != nullptr )
+	{
+		return PlLoadPackageFileByIndex( request->package, request->index );
+	}
+
+	if ( request->localPath == nullptr )
+	{
+		PlReportErrorF( PL_RESULT_FILEREAD, "failed to open package for %s", request->path );
+		return nullptr;
+	}
+
+	return qm_fs_file_open_local( request->localPath, true );
+}
+
+static void finish_request( QmFsRequest *request, QmFsFile *file )
+{
+	if ( file == nullptr )
+	{
+		request->result = PlGetFunctionResult();
+		request->error  = qm_os_string_alloc( "%s", PlGetError() );
+	}
+
+	if ( request->callback != nullptr )
+	{
+		request->callback( request->path, file, request->userData );
+		file = nullptr;
+	}
+
+	request->file = file;
+
+	qm_os_mutex_lock( requestMutex );
+	atomic_store( &request->done, true );
+	qm_os_condition_broadcast( requestCondition );
+	qm_os_mutex_unlock( requestMutex );
+
+	qm_fs_request_release( request );
+}
+
+/**
+ * Copies out, or inflates, each of the entries that were
+ * read in one go as part of the given span.
+ */
+static void split_span( QmFsRequestSpan *span, const uint8_t *data )
+{
+	for ( unsigned int i = 0; i < span->numRequests; ++i )
+	{
+		QmFsRequest           *request = span->requests[ i ];
+		const QmFsPackageFile *pi      = &request->package->files[ request->index ];
+		const uint8_t         *raw     = data + ( request->rawOffset - span->offset );
+
+		QmFsFile *file = nullptr;
+		if ( pi->compressionType == PL_COMPRESSION_NONE )
+		{
+			uint8_t *buffer = QM_OS_MEMORY_NEW_( uint8_t, pi->size );
+			memcpy( buffer, raw, pi->size );
+			file = qm_fs_file_from_memory( pi->name, buffer, pi->size, QM_FS_FILE_OWNERSHIP_TYPE_OWNER );
+		}
+		else
+		{
+			void *dataPtr = qm_fs_package_decompress_entry_( pi, raw );
+			if ( dataPtr != nullptr )
+			{
+				file = qm_fs_package_cache_insert_( request->package, request->index, dataPtr );
+			}
+		}
+
+		finish_request( request, file );
+	}
+}
+
+static void load_span( QmFsRequestSpan *span )
+{
+	for ( unsigned int i = 0; i < span->numRequests; ++i )
+	{
+		finish_request( span->requests[ i ], load_request( span->requests[ i ] ) );
+	}
+}
+
+/**
+ * Groups the job's requests into spans, where entries that sit close
+ * together in the same package are read in one go. Entries that are
+ * already in the package cache are finished off here, and anything
+ * that can't be read directly ends up in a span of its own.
+ */
+static unsigned int build_spans( QmFsRequestJob *job, QmFsRequestSpan *spans )
+{
+	unsigned int     numSpans    = 0;
+	unsigned int     numRequests = 0;
+	QmFsRequestSpan *span        = nullptr;
+	for ( unsigned int i = 0; i < job->numRequests; ++i )
+	{
+		QmFsRequest *request = job->requests[ i ];
+
+		int    fd   = -1;
+		size_t size = 0;
+		if ( request->package != nullptr )
+		{
+			QmFsFile *cached;
+			if ( request->package->files[ request->index ].compressionType != PL_COMPRESSION_NONE &&
+			     ( cached = qm_fs_package_cache_find_( request->package, request->index ) ) != nullptr )
+			{
+				finish_request( request, cached );
+				continue;
+			}
+
+			if ( !qm_fs_package_get_raw_entry_( request->package, request->index, &fd, &request->rawOffset, &size ) )
+			{
+				fd = -1;
+			}
+		}
+
+		/* requests are sorted by offset, so only need to look at the last span */
+		job->requests[ numRequests ] = request;
+		if ( span != nullptr && span->fd != -1 && fd != -1 && span->requests[ 0 ]->package == request->package )
+		{
+			uint64_t end = span->offset + span->size;
+			if ( request->rawOffset >= end && request->rawOffset - end <= REQUEST_MAX_SPAN_GAP &&
+			     request->rawOffset + size - span->offset <= REQUEST_MAX_SPAN_SIZE )
+			{
+				span->size = ( size_t ) ( request->rawOffset + size - span->offset );
+				span->numRequests++;
+				numRequests++;
+				continue;
+			}
+		}
+
+		span              = &spans[ numSpans++ ];
+		span->requests    = &job->requests[ numRequests++ ];
+		span->numRequests = 1;
+		span->fd          = fd;
+		span->offset      = request->rawOffset;
+		span->size        = size;
+	}
+
+	return numSpans;
+}
+
+static void read_span( QmFsRequestSpan *span )
+{
+	if ( span->numRequests > 1 )
+	{
+		QmFsFile *handle = span->requests[ 0 ]->package->internal.file;
+		uint8_t  *data   = QM_OS_MEMORY_NEW_( uint8_t, span->size );
+		if ( qm_fs_file_read_at( handle, data, span->size, ( PLFileOffset ) span->offset ) == span->size )
+		{
+			split_span( span, data );
+			qm_os_memory_free( data );
+			return;
+		}
+
+		/* if the read itself failed, give each entry another go the usual way */
+		qm_os_memory_free( data );
+	}
+
+	load_span( span );
+}
+
+#if defined( PL_IO_URING )
+
+/**
+ * Sets up the read for the given span, if it's something that can
+ * go via io_uring, i.e. a local file or entries the generic loader
+ * would read from a package.
+ */
+static bool prepare_uring_read( QmFsRequestSpan *span, QmFsUringRead *read )
+{
+	read->userData = span;
+
+	QmFsRequest *request = span->requests[ 0 ];
+	if ( span->fd != -1 )
+	{
+		read->fd     = span->fd;
+		read->offset = span->offset;
+		read->size   = span->size;
+
+		/* a lone stored entry goes straight into its final buffer,
+		 * anything else gets staged, ready to be split up or inflated */
+		if ( span->numRequests == 1 && request->package->files[ request->index ].compressionType == PL_COMPRESSION_NONE )
+		{
+			read->dest = QM_OS_MEMORY_NEW_( uint8_t, read->size );
+		}
+		else
+		{
+			read->dest = nullptr;
+		}
+
+		return true;
+	}
+
+	if ( request->package != nullptr )
+	{
+		return false;
+	}
+
+	int fd = open( request->localPath, O_RDONLY | O_CLOEXEC );
+	if ( fd == -1 )
+	{
+		return false;
+	}
+
+	struct stat buf;
+	if ( fstat( fd, &buf ) != 0 || !S_ISREG( buf.st_mode ) )
+	{
+		close( fd );
+		return false;
+	}
+
+	request->fd        = fd;
+	request->timeStamp = buf.st_mtime;
+
+	read->fd     = fd;
+	read->offset = 0;
+	read->size   = ( size_t ) buf.st_size;
+	read->dest   = QM_OS_MEMORY_NEW_( uint8_t, read->size );
+
+	return true;
+}
+
+static void uring_read_complete( QmFsUringRead *read, const void *data, bool status )
+{
+	QmFsRequestSpan *span = read->userData;
+	if ( span->numRequests > 1 )
+	{
+		if ( status )
+		{
+			split_span( span, data );
+		}
+		else
+		{
+			load_span( span );
+		}
+
+		return;
+	}
+
+	QmFsRequest *request = span->requests[ 0 ];
+
+	QmFsFile *file = nullptr;
+	if ( status && request->package != nullptr )
+	{
+		const QmFsPackageFile *pi = &request->package->files[ request->index ];
+		if ( read->dest != nullptr )
+		{
+			file = qm_fs_file_from_memory( pi->name, read->dest, pi->size, QM_FS_FILE_OWNERSHIP_TYPE_OWNER );
+		}
+		else
+		{
+			void *dataPtr = qm_fs_package_decompress_entry_( pi, data );
+			if ( dataPtr != nullptr )
+			{
+				file = qm_fs_package_cache_insert_( request->package, request->index, dataPtr );
+			}
+		}
+	}
+	else if ( status )
+	{
+		file = qm_fs_file_from_memory( request->localPath, read->dest, read->size, QM_FS_FILE_OWNERSHIP_TYPE_OWNER );
+		if ( file != nullptr )
+		{
+			file->timeStamp = request->timeStamp;
+		}
+	}
+	else
+	{
+		qm_os_memory_free( read->dest );
+	}
+
+	if ( request->fd != -1 )
+	{
+		close( request->fd );
+		request->fd = -1;
+	}
+
+	/* if the read itself failed, give it another go the usual way */
+	if ( !status )
+	{
+		file = load_request( request );
+	}
+
+	finish_request( request, file );
+}
+
+static void request_job_uring( QmFsUring *ring, QmFsRequestSpan *spans, unsigned int numSpans )
+{
+	QmFsUringRead *reads    = QM_OS_MEMORY_NEW_( QmFsUringRead, numSpans );
+	unsigned int   numReads = 0;
+	for ( unsigned int i = 0; i < numSpans; ++i )
+	{
+		if ( !prepare_uring_read( &spans[ i ], &reads[ numReads ] ) )
+		{
+			load_span( &spans[ i ] );
+			continue;
+		}
+
+		numReads++;
+	}
+
+	if ( numReads > 0 )
+	{
+		qm_fs_uring_read( ring, reads, numReads, uring_read_complete );
+	}
+
+	qm_os_memory_free( reads );
+}
+
+#endif
+
+static void request_job( void *userData )
+{
+	QmFsRequestJob *job = userData;
+
+	QmFsRequestSpan *spans    = QM_OS_MEMORY_NEW_( QmFsRequestSpan, job->numRequests );
+	unsigned int     numSpans = build_spans( job, spans );
+
+#if defined( PL_IO_URING )
+	QmFsUring *ring = qm_fs_uring_get();
+	if ( ring != nullptr )
+	{
+		request_job_uring( ring, spans, numSpans );
+	}
+	else
+#endif
+	{
+		for ( unsigned int i = 0; i < numSpans; ++i )
+		{
+			read_span( &spans[ i ] );
+		}
+	}
+
+	qm_os_memory_free( spans );
+	qm_os_memory_free( job->requests );
+	qm_os_memory_free( job );
+}
+
+/**
+ * Sorts requests so entries from the same package sit together,
+ * in the order they're stored, with everything else at the end.
+ */
+static int compare_requests( const void *a, const void *b )
+{
+	const QmFsRequest *ra = *( const QmFsRequest ** ) a;
+	const QmFsRequest *rb = *( const QmFsRequest ** ) b;
+
+	if ( ra->package != rb->package )
+	{
+		if ( ra->package == nullptr )
+		{
+			return 1;
+		}
+		if ( rb->package == nullptr )
+		{
+			return -1;
+		}
+
+		return ( ( uintptr_t ) ra->package < ( uintptr_t ) rb->package ) ? -1 : 1;
+	}
+
+	if ( ra->package == nullptr )
+	{
+		return 0;
+	}
+
+	/* entries not yet resolved point at their header instead, which
+	 * still sits in the same order */
+	uint64_t oa = ra->package->files[ ra->index ].offset & ~PL_PACKAGE_OFFSET_UNRESOLVED;
+	uint64_t ob = rb->package->files[ rb->index ].offset & ~PL_PACKAGE_OFFSET_UNRESOLVED;
+	return ( oa < ob ) ? -1 : ( oa > ob );
+}
+
+static void push_request_job( QmFsRequest **requests, unsigned int numRequests, int priority )
+{
+	QmFsRequestJob *job = QM_OS_MEMORY_NEW( QmFsRequestJob );
+	job->requests       = QM_OS_MEMORY_NEW_( QmFsRequest *, numRequests );
+	job->numRequests    = numRequests;
+	memcpy( job->requests, requests, sizeof( QmFsRequest * ) * numRequests );
+
+	qm_os_thread_pool_push( requestPool, request_job, job, priority );
+}
+
+bool qm_fs_request_files( const char **paths, unsigned int numPaths, int priority, QmFsRequestCallback callback, void *userData, QmFsRequest **requests )
+{
+	if ( numPaths == 0 )
+	{
+		PlReportBasicError( PL_RESULT_INVALID_PARM2 );
+		return false;
+	}
+
+	if ( !request_initialize() )
+	{
+		return false;
+	}
+
+	QmFsRequest **batch = QM_OS_MEMORY_NEW_( QmFsRequest *, numPaths );
+	for ( unsigned int i = 0; i < numPaths; ++i )
+	{
+		QmFsRequest *request = QM_OS_MEMORY_NEW( QmFsRequest );
+		request->path        = qm_os_string_alloc( "%s", paths[ i ] );
+		request->callback    = callback;
+		request->userData    = userData;
+		request->fd          = -1;
+
+		/* one reference for the worker, and another for the caller */
+		atomic_init( &request->done, false );
+		atomic_init( &request->refs, ( requests != nullptr ) ? 2 : 1 );
+
+		/* work out where it lives here, as the index and aliases can change
+		 * under the workers, and get the package handle ready, so they can
+		 * all safely read from it */
+		char localPath[ PL_SYSTEM_MAX_PATH ];
+		snprintf( localPath, sizeof( localPath ), "%s", request->path );
+		request->package = qm_fs_resolve_path_( request->path, &request->index, localPath, sizeof( localPath ) );
+		if ( request->package == nullptr )
+		{
+			request->localPath = qm_os_string_alloc( "%s", localPath );
+		}
+		else if ( !qm_fs_package_open_handle_( request->package ) )
+		{
+			/* opening it again on the worker would mean going via the VFS */
+			request->package = nullptr;
+		}
+
+		batch[ i ] = request;
+		if ( requests != nullptr )
+		{
+			requests[ i ] = request;
+		}
+	}
+
+	qsort( batch, numPaths, sizeof( QmFsRequest * ), compare_requests );
+
+	unsigned int numThreads = qm_os_thread_pool_get_num_threads( requestPool );
+	for ( unsigned int i = 0; i < numPaths; )
+	{
+		/* keep runs from the same package together, so they're read in
+		 * order and neighbours can be merged into a single read; local
+		 * files are just split evenly across the workers */
+		unsigned int j = i + 1;
+		while ( j < numPaths && batch[ j ]->package == batch[ i ]->package )
+		{
+			j++;
+		}
+
+		unsigned int jobSize = ( j - i + numThreads - 1 ) / numThreads;
+		if ( batch[ i ]->package != nullptr )
+		{
+			jobSize = QM_OS_MAX( jobSize, REQUEST_MIN_JOB_SIZE );
+		}
+
+		for ( unsigned int k = i; k < j; k += jobSize )
+		{
+			push_request_job( &batch[ k ], QM_OS_MIN( jobSize, j - k ), priority );
+		}
+
+		i = j;
+	}
+
+	qm_os_memory_free( batch );
+
+	return true;
+}
+
+QmFsRequest *qm_fs_request_file( const char *path, int priority, QmFsRequestCallback callback, void *userData )
+{
+	QmFsRequest *request;
+	if ( !qm_fs_request_files( &path, 1, priority, callback, userData, &request ) )
+	{
+		return nullptr;
+	}
+
+	return request;
+}
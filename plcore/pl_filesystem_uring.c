@@ -0,0 +1,547 @@
+// SPDX-License-Identifier: MIT
+// Hei Platform Library
+// Copyright © 2017-2026 Quartermind Games, Mark E. Sowden <markelswo@gmail.com>
+// Purpose: io_uring read engine, used by the asynchronous loader on Linux.
+
+#include "filesystem_private.h"
+#include "pl_private.h"
+
+#include "qmos/public/qm_os_memory.h"
+
+#if defined( PL_IO_URING )
+
+#	include <linux/io_uring.h>
+#	include <sys/mman.h>
+#	include <sys/syscall.h>
+#	include <sys/uio.h>
+#	include <unistd.h>
+#	include <errno.h>
+#	include <stdatomic.h>
+
+/* each ring stages reads that don't have a destination (i.e. compressed
+ * data that's about to be inflated) in registered buffers, so the kernel
+ * doesn't need to map in pages for every read */
+#	define URING_QUEUE_DEPTH  64
+#	define URING_NUM_SLOTS    32
+#	define URING_SLOT_SIZE    ( 128 * 1024 )
+#	define URING_FIXED_FILES  64
+#	define URING_MAX_CHUNK    ( 1U << 30 )
+#	define URING_MAX_RINGS    256
+
+typedef struct QmFsUring
+{
+	int fd;
+
+	void  *sqRing;
+	size_t sqRingSize;
+	void  *cqRing;
+	size_t cqRingSize;
+
+	struct io_uring_sqe *sqes;
+	size_t               sqesSize;
+
+	unsigned int *sqHead, *sqTail, *sqMask, *sqArray;
+	unsigned int *cqHead, *cqTail, *cqMask;
+
+	struct io_uring_cqe *cqes;
+
+	uint8_t *staging;
+	bool     registeredBuffers;
+	uint32_t freeSlots;// bit per staging slot
+
+	bool fixedFiles;
+	int  files[ URING_FIXED_FILES ];
+} QmFsUring;
+
+typedef struct QmFsUringOp
+{
+	QmFsUringRead *read;
+	uint8_t       *buffer;
+	size_t         done;
+	int            slot;     // staging slot, or -1
+	int            fileIndex;// fixed file index, or -1
+	bool           ownsBuffer;
+} QmFsUringOp;
+
+static QmFsUring  *rings[ URING_MAX_RINGS ];
+static atomic_uint numRings;
+static atomic_bool unavailable;
+
+static thread_local QmFsUring *threadRing;
+
+static int uring_setup( unsigned int entries, struct io_uring_params *params )
+{
+	return ( int ) syscall( __NR_io_uring_setup, entries, params );
+}
+
+static int uring_enter( int fd, unsigned int toSubmit, unsigned int minComplete, unsigned int flags )
+{
+	return ( int ) syscall( __NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0 );
+}
+
+static int uring_register( int fd, unsigned int opcode, const void *arg, unsigned int numArgs )
+{
+	return ( int ) syscall( __NR_io_uring_register, fd, opcode, arg, numArgs );
+}
+
+static void uring_destroy( QmFsUring *self )
+{
+	if ( self->sqes != nullptr && self->sqes != MAP_FAILED )
+	{
+		munmap( self->sqes, self->sqesSize );
+	}
+	if ( self->cqRing != nullptr && self->cqRing != MAP_FAILED && self->cqRing != self->sqRing )
+	{
+		munmap( self->cqRing, self->cqRingSize );
+	}
+	if ( self->sqRing != nullptr && self->sqRing != MAP_FAILED )
+	{
+		munmap( self->sqRing, self->sqRingSize );
+	}
+
+	close( self->fd );
+
+	qm_os_memory_free( self->staging );
+	qm_os_memory_free( self );
+}
+
+static QmFsUring *uring_create( void )
+{
+	struct io_uring_params params = {};
+
+	int fd = uring_setup( URING_QUEUE_DEPTH, &params );
+	if ( fd < 0 )
+	{
+		return nullptr;
+	}
+
+	QmFsUring *self = QM_OS_MEMORY_NEW( QmFsUring );
+	self->fd        = fd;
+
+	self->sqRingSize = params.sq_off.array + params.sq_entries * sizeof( unsigned int );
+	self->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof( struct io_uring_cqe );
+	if ( params.features & IORING_FEAT_SINGLE_MMAP )
+	{
+		self->sqRingSize = self->cqRingSize = QM_OS_MAX( self->sqRingSize, self->cqRingSize );
+	}
+
+	self->sqRing = mmap( nullptr, self->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING );
+	if ( self->sqRing == MAP_FAILED )
+	{
+		uring_destroy( self );
+		return nullptr;
+	}
+
+	if ( params.features & IORING_FEAT_SINGLE_MMAP )
+	{
+		self->cqRing = self->sqRing;
+	}
+	else
+	{
+		self->cqRing = mmap( nullptr, self->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING );
+		if ( self->cqRing == MAP_FAILED )
+		{
+			uring_destroy( self );
+			return nullptr;
+		}
+	}
+
+	self->sqesSize = params.sq_entries * sizeof( struct io_uring_sqe );
+	self->sqes     = mmap( nullptr, self->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES );
+	if ( self->sqes == MAP_FAILED )
+	{
+		uring_destroy( self );
+		return nullptr;
+	}
+
+	uint8_t *sq   = self->sqRing;
+	self->sqHead  = ( unsigned int * ) ( sq + params.sq_off.head );
+	self->sqTail  = ( unsigned int * ) ( sq + params.sq_off.tail );
+	self->sqMask  = ( unsigned int * ) ( sq + params.sq_off.ring_mask );
+	self->sqArray = ( unsigned int * ) ( sq + params.sq_off.array );
+
+	uint8_t *cq  = self->cqRing;
+	self->cqHead = ( unsigned int * ) ( cq + params.cq_off.head );
+	self->cqTail = ( unsigned int * ) ( cq + params.cq_off.tail );
+	self->cqMask = ( unsigned int * ) ( cq + params.cq_off.ring_mask );
+	self->cqes   = ( struct io_uring_cqe * ) ( cq + params.cq_off.cqes );
+
+	/* neither of these are essential, so carry on without them if the kernel refuses */
+	self->staging   = QM_OS_MEMORY_NEW_( uint8_t, URING_NUM_SLOTS * URING_SLOT_SIZE );
+	self->freeSlots = ( uint32_t ) ( ( 1ULL << URING_NUM_SLOTS ) - 1 );
+
+	struct iovec iov[ URING_NUM_SLOTS ];
+	for ( unsigned int i = 0; i < URING_NUM_SLOTS; ++i )
+	{
+		iov[ i ].iov_base = self->staging + i * URING_SLOT_SIZE;
+		iov[ i ].iov_len  = URING_SLOT_SIZE;
+	}
+	self->registeredBuffers = ( uring_register( fd, IORING_REGISTER_BUFFERS, iov, URING_NUM_SLOTS ) == 0 );
+
+	for ( unsigned int i = 0; i < URING_FIXED_FILES; ++i )
+	{
+		self->files[ i ] = -1;
+	}
+	self->fixedFiles = ( uring_register( fd, IORING_REGISTER_FILES, self->files, URING_FIXED_FILES ) == 0 );
+
+	return self;
+}
+
+QmFsUring *qm_fs_uring_get( void )
+{
+	if ( threadRing != nullptr )
+	{
+		return threadRing;
+	}
+
+	if ( atomic_load( &unavailable ) )
+	{
+		return nullptr;
+	}
+
+	unsigned int slot = atomic_fetch_add( &numRings, 1 );
+	if ( slot >= URING_MAX_RINGS )
+	{
+		atomic_fetch_sub( &numRings, 1 );
+		return nullptr;
+	}
+
+	rings[ slot ] = threadRing = uring_create();
+	if ( threadRing == nullptr )
+	{
+		/* most likely an old kernel, or blocked by seccomp */
+		atomic_store( &unavailable, true );
+	}
+
+	return threadRing;
+}
+
+void qm_fs_uring_shutdown( void )
+{
+	/* the workers are gone by now, so nothing else is touching these */
+	unsigned int num = QM_OS_MIN( atomic_load( &numRings ), URING_MAX_RINGS );
+	for ( unsigned int i = 0; i < num; ++i )
+	{
+		if ( rings[ i ] != nullptr )
+		{
+			uring_destroy( rings[ i ] );
+			rings[ i ] = nullptr;
+		}
+	}
+
+	atomic_store( &numRings, 0 );
+}
+
+/**
+ * Maps the descriptors used by the batch onto the fixed file table,
+ * so the kernel can skip looking them up for every read.
+ */
+static void uring_update_files( QmFsUring *self, QmFsUringOp *ops, unsigned int numOps )
+{
+	for ( unsigned int i = 0; i < numOps; ++i )
+	{
+		ops[ i ].fileIndex = -1;
+	}
+
+	if ( !self->fixedFiles )
+	{
+		return;
+	}
+
+	int          files[ URING_FIXED_FILES ];
+	unsigned int numFiles = 0;
+	for ( unsigned int i = 0; i < numOps; ++i )
+	{
+		unsigned int j;
+		for ( j = 0; j < numFiles; ++j )
+		{
+			if ( files[ j ] == ops[ i ].read->fd )
+			{
+				break;
+			}
+		}
+
+		if ( j == numFiles )
+		{
+			if ( numFiles == URING_FIXED_FILES )
+			{
+				continue;
+			}
+
+			files[ numFiles++ ] = ops[ i ].read->fd;
+		}
+
+		ops[ i ].fileIndex = ( int ) j;
+	}
+
+	if ( numFiles == 0 )
+	{
+		return;
+	}
+
+	struct io_uring_files_update update = {
+	        .offset = 0,
+	        .fds    = ( uint64_t ) ( uintptr_t ) files,
+	};
+	if ( uring_register( self->fd, IORING_REGISTER_FILES_UPDATE, &update, numFiles ) != ( int ) numFiles )
+	{
+		for ( unsigned int i = 0; i < numOps; ++i )
+		{
+			ops[ i ].fileIndex = -1;
+		}
+	}
+}
+
+static void uring_queue_op( QmFsUring *self, QmFsUringOp *op, uint64_t index )
+{
+	unsigned int tail = *self->sqTail;
+	unsigned int mask = *self->sqMask;
+
+	struct io_uring_sqe *sqe = &self->sqes[ tail & mask ];
+	memset( sqe, 0, sizeof( struct io_uring_sqe ) );
+
+	size_t remaining = op->read->size - op->done;
+
+	sqe->opcode    = IORING_OP_READ;
+	sqe->fd        = op->read->fd;
+	sqe->off       = op->read->offset + op->done;
+	sqe->addr      = ( uint64_t ) ( uintptr_t ) ( op->buffer + op->done );
+	sqe->len       = ( uint32_t ) QM_OS_MIN( remaining, ( size_t ) URING_MAX_CHUNK );
+	sqe->user_data = index;
+
+	if ( op->slot >= 0 && self->registeredBuffers )
+	{
+		sqe->opcode    = IORING_OP_READ_FIXED;
+		sqe->buf_index = ( uint16_t ) op->slot;
+	}
+
+	if ( op->fileIndex >= 0 )
+	{
+		sqe->fd = op->fileIndex;
+		sqe->flags |= IOSQE_FIXED_FILE;
+	}
+
+	self->sqArray[ tail & mask ] = tail & mask;
+	__atomic_store_n( self->sqTail, tail + 1, __ATOMIC_RELEASE );
+}
+
+static void uring_finish_op( QmFsUring *self, QmFsUringOp *op, bool status, QmFsUringCallback callback )
+{
+	callback( op->read, op->buffer, status );
+
+	if ( op->slot >= 0 )
+	{
+		self->freeSlots |= ( 1U << op->slot );
+	}
+	else if ( op->ownsBuffer )
+	{
+		qm_os_memory_free( op->buffer );
+	}
+}
+
+/**
+ * Picks out where the data for the read is going to land.
+ * Returns false if it needs a staging slot, but none are free.
+ */
+static bool uring_prepare_op( QmFsUring *self, QmFsUringOp *op )
+{
+	op->slot       = -1;
+	op->ownsBuffer = false;
+
+	if ( op->read->dest != nullptr )
+	{
+		op->buffer = op->read->dest;
+		return true;
+	}
+
+	if ( op->read->size > URING_SLOT_SIZE )
+	{
+		op->buffer     = QM_OS_MEMORY_NEW_( uint8_t, op->read->size );
+		op->ownsBuffer = true;
+		return true;
+	}
+
+	if ( self->freeSlots == 0 )
+	{
+		return false;
+	}
+
+	for ( int i = 0; i < URING_NUM_SLOTS; ++i )
+	{
+		if ( self->freeSlots & ( 1U << i ) )
+		{
+			self->freeSlots &= ~( 1U << i );
+			op->slot   = i;
+			op->buffer = self->staging + i * URING_SLOT_SIZE;
+			break;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Pulls back anything queued that the kernel hasn't picked up yet,
+ * failing each of those reads.
+ */
+static unsigned int uring_withdraw_ops( QmFsUring *self, QmFsUringOp *ops, QmFsUringCallback callback )
+{
+	unsigned int head = __atomic_load_n( self->sqHead, __ATOMIC_ACQUIRE );
+	unsigned int tail = *self->sqTail;
+	unsigned int mask = *self->sqMask;
+
+	unsigned int numWithdrawn = 0;
+	for ( unsigned int i = head; i != tail; ++i )
+	{
+		const struct io_uring_sqe *sqe = &self->sqes[ self->sqArray[ i & mask ] ];
+		uring_finish_op( self, &ops[ sqe->user_data ], false, callback );
+		numWithdrawn++;
+	}
+
+	__atomic_store_n( self->sqTail, head, __ATOMIC_RELEASE );
+
+	return numWithdrawn;
+}
+
+void qm_fs_uring_read( QmFsUring *self, QmFsUringRead *reads, unsigned int numReads, QmFsUringCallback callback )
+{
+	QmFsUringOp *ops = QM_OS_MEMORY_NEW_( QmFsUringOp, numReads );
+	for ( unsigned int i = 0; i < numReads; ++i )
+	{
+		ops[ i ].read = &reads[ i ];
+	}
+
+	uring_update_files( self, ops, numReads );
+
+	unsigned int next = 0, numInFlight = 0, numQueued = 0, numDone = 0;
+	bool         broken = false;
+	while ( numDone < numReads )
+	{
+		if ( broken )
+		{
+			/* fail anything that never made it to the kernel, so the caller can fall back */
+			for ( ; next < numReads; ++next, ++numDone )
+			{
+				callback( ops[ next ].read, nullptr, false );
+			}
+
+			if ( numInFlight == 0 )
+			{
+				break;
+			}
+		}
+
+		while ( !broken && next < numReads && numInFlight < URING_QUEUE_DEPTH )
+		{
+			QmFsUringOp *op = &ops[ next ];
+			if ( !uring_prepare_op( self, op ) )
+			{
+				break;
+			}
+
+			next++;
+
+			if ( op->read->size == 0 )
+			{
+				uring_finish_op( self, op, true, callback );
+				numDone++;
+				continue;
+			}
+
+			uring_queue_op( self, op, next - 1 );
+			numInFlight++;
+			numQueued++;
+		}
+
+		if ( numInFlight == 0 )
+		{
+			continue;
+		}
+
+		int numSubmitted = uring_enter( self->fd, numQueued, 1, IORING_ENTER_GETEVENTS );
+		if ( numSubmitted < 0 && ( errno == EAGAIN || errno == EBUSY ) )
+		{
+			/* the kernel's out of room, so make some by reaping what's done; if
+			 * it's got nothing of ours to complete, all we can do is try again */
+			if ( numInFlight == numQueued )
+			{
+				continue;
+			}
+
+			numSubmitted = uring_enter( self->fd, 0, 1, IORING_ENTER_GETEVENTS );
+		}
+
+		if ( numSubmitted < 0 )
+		{
+			if ( errno == EINTR || errno == EAGAIN || errno == EBUSY )
+			{
+				continue;
+			}
+
+			/* the ring is no good, so stop submitting and wait on whatever's already in flight */
+			unsigned int numWithdrawn = uring_withdraw_ops( self, ops, callback );
+			numInFlight -= numWithdrawn;
+			numDone += numWithdrawn;
+			numQueued = 0;
+
+			if ( broken )
+			{
+				/* can't even wait, so there's nothing more we can do */
+				break;
+			}
+
+			broken = true;
+			continue;
+		}
+
+		/* the kernel may not take everything in one go, in
+		 * which case the rest stay queued for the next round */
+		numQueued -= ( unsigned int ) numSubmitted;
+
+		unsigned int head = *self->cqHead;
+		unsigned int tail = __atomic_load_n( self->cqTail, __ATOMIC_ACQUIRE );
+		for ( ; head != tail; ++head )
+		{
+			const struct io_uring_cqe *cqe = &self->cqes[ head & *self->cqMask ];
+			QmFsUringOp               *op  = &ops[ cqe->user_data ];
+
+			if ( cqe->res == -EINTR || cqe->res == -EAGAIN )
+			{
+				uring_queue_op( self, op, cqe->user_data );
+				numQueued++;
+				continue;
+			}
+
+			if ( cqe->res > 0 )
+			{
+				op->done += ( size_t ) cqe->res;
+				if ( op->done < op->read->size )
+				{
+					/* short read, so queue up the rest */
+					uring_queue_op( self, op, cqe->user_data );
+					numQueued++;
+					continue;
+				}
+			}
+
+			uring_finish_op( self, op, ( cqe->res > 0 ), callback );
+			numInFlight--;
+			numDone++;
+		}
+		__atomic_store_n( self->cqHead, head, __ATOMIC_RELEASE );
+	}
+
+	/* registered files hold a reference, so let go of them */
+	if ( self->fixedFiles )
+	{
+		struct io_uring_files_update update = {
+		        .offset = 0,
+		        .fds    = ( uint64_t ) ( uintptr_t ) self->files,
+		};
+		uring_register( self->fd, IORING_REGISTER_FILES_UPDATE, &update, URING_FIXED_FILES );
+	}
+
+	qm_os_memory_free( ops );
+}
+
+#endif
@@ -0,0 +1,669 @@
+// SPDX-License-Identifier: MIT
+// Hei Platform Library
+// Copyright © 2017-2026 Quartermind Games, Mark E. Sowden <markelswo@gmail.com>
+// Purpose: Change notification for directory mounts.
+
+#include "filesystem_private.h"
+#include "pl_private.h"
+
+#include "qmos/public/qm_os_memory.h"
+#include "qmos/public/qm_os_string.h"
+
+#include <plcore/pl_hashtable.h>
+
+#if defined( __linux__ )
+#	include <sys/inotify.h>
+#	include <sys/stat.h>
+#	include <dirent.h>
+#	include <errno.h>
+#	include <unistd.h>
+#endif
+
+typedef struct QmFsWatch
+{
+	char             *prefix;// normalized, empty for everything
+	size_t            prefixLength;
+	QmFsWatchCallback callback;
+	void             *userData;
+	struct QmFsWatch *next;
+} QmFsWatch;
+
+static QmFsWatch *subscribers;
+
+/**
+ * Normalizes the path the same way the VFS index does, so
+ * prefixes and event paths can be compared directly.
+ */
+static size_t normalize_path( const char *path, char *dst, size_t dstSize )
+{
+	while ( *path == '/' || *path == '\\' || ( *path == '.' && ( path[ 1 ] == '/' || path[ 1 ] == '\\' ) ) )
+	{
+		path += ( *path == '.' ) ? 2 : 1;
+	}
+
+	size_t length = 0;
+	for ( ; *path != '\0' && length < dstSize - 1; ++path )
+	{
+		char c = ( *path == '\\' ) ? '/' : *path;
+		if ( c == '/' && ( length == 0 || dst[ length - 1 ] == '/' ) )
+		{
+			continue;
+		}
+
+		dst[ length++ ] = c;
+	}
+
+	if ( length > 0 && dst[ length - 1 ] == '/' )
+	{
+		length--;
+	}
+
+	dst[ length ] = '\0';
+	return length;
+}
+
+QmFsWatch *qm_fs_watch_subscribe( const char *prefix, QmFsWatchCallback callback, void *userData )
+{
+	PLPath normPrefix = "";
+	if ( prefix != nullptr )
+	{
+		normalize_path( prefix, normPrefix, sizeof( normPrefix ) );
+	}
+
+	QmFsWatch *self    = QM_OS_MEMORY_NEW( QmFsWatch );
+	self->prefix       = qm_os_string_alloc( "%s", normPrefix );
+	self->prefixLength = strlen( self->prefix );
+	self->callback     = callback;
+	self->userData     = userData;
+
+	self->next  = subscribers;
+	subscribers = self;
+
+	return self;
+}
+
+void qm_fs_watch_unsubscribe( QmFsWatch *self )
+{
+	for ( QmFsWatch **i = &subscribers; *i != nullptr; i = &( *i )->next )
+	{
+		if ( *i == self )
+		{
+			*i = self->next;
+			break;
+		}
+	}
+
+	qm_os_memory_free( self->prefix );
+	qm_os_memory_free( self );
+}
+
+static bool is_under_prefix( const QmFsWatch *watch, const char *path )
+{
+	if ( watch->prefixLength == 0 )
+	{
+		return true;
+	}
+
+	return ( strncmp( path, watch->prefix, watch->prefixLength ) == 0 &&
+	         ( path[ watch->prefixLength ] == '\0' || path[ watch->prefixLength ] == '/' ) );
+}
+
+static void dispatch_events( const QmFsWatchEvent *events, unsigned int numEvents )
+{
+	if ( numEvents == 0 )
+	{
+		return;
+	}
+
+	QmFsWatchEvent *filtered = QM_OS_MEMORY_NEW_( QmFsWatchEvent, numEvents );
+
+	/* subscribers may unsubscribe from within their callback */
+	QmFsWatch *next;
+	for ( QmFsWatch *watch = subscribers; watch != nullptr; watch = next )
+	{
+		next = watch->next;
+
+		unsigned int numFiltered = 0;
+		for ( unsigned int i = 0; i < numEvents; ++i )
+		{
+			if ( events[ i ].type == QM_FS_WATCH_EVENT_OVERFLOW || is_under_prefix( watch, events[ i ].path ) )
+			{
+				filtered[ numFiltered++ ] = events[ i ];
+			}
+		}
+
+		if ( numFiltered > 0 )
+		{
+			watch->callback( filtered, numFiltered, watch->userData );
+		}
+	}
+
+	qm_os_memory_free( filtered );
+}
+
+#if defined( __linux__ )
+
+/****************************************
+ * inotify
+ *
+ * Every directory beneath a watched mount gets a watch of its own, as
+ * inotify isn't recursive. Raw events are gathered up per path, where
+ * only the last one counts, and then applied to the VFS index in the
+ * order they first turned up, to work out what they mean for the VFS.
+ *
+ * inotify hands back the same watch for a directory however many times
+ * it's added, so where a directory is seen through more than one mount,
+ * each of them holds a reference on it, and events are passed on to all.
+ ****************************************/
+
+#	define WATCH_MASK ( IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_ONLYDIR )
+
+typedef struct WatchReference
+{
+	QmFsMount *mount;
+	char      *path;// relative to the mount, empty for its root
+} WatchReference;
+
+typedef struct WatchDirectory
+{
+	int             wd;
+	WatchReference *references;
+	unsigned int    numReferences;
+} WatchDirectory;
+
+typedef struct PendingChange
+{
+	QmFsMount         *mount;
+	QmFsWatchEventType type;
+	char              *path;
+} PendingChange;
+
+static int          watchFd = -1;
+static PLHashTable *watchDirectories;// wd -> WatchDirectory
+
+static PendingChange *pendingChanges;
+static unsigned int   numPendingChanges;
+static unsigned int   maxPendingChanges;
+static PLHashTable   *pendingLookup;// mount + path -> index + 1
+
+static size_t generate_pending_key( const QmFsMount *mount, const char *path, char *dst, size_t dstSize )
+{
+	memcpy( dst, &mount, sizeof( mount ) );
+	return sizeof( mount ) + normalize_path( path, dst + sizeof( mount ), dstSize - sizeof( mount ) );
+}
+
+/**
+ * Queues up a change, replacing any earlier change to the same path.
+ */
+static void queue_change( QmFsMount *mount, const char *path, QmFsWatchEventType type )
+{
+	if ( pendingLookup == nullptr )
+	{
+		pendingLookup = PlCreateHashTable();
+	}
+
+	char   key[ sizeof( QmFsMount * ) + PL_SYSTEM_MAX_PATH ];
+	size_t keySize = generate_pending_key( mount, path, key, sizeof( key ) );
+
+	uintptr_t i = ( uintptr_t ) PlLookupHashTableUserData( pendingLookup, key, keySize );
+	if ( i != 0 )
+	{
+		pendingChanges[ i - 1 ].type = type;
+		return;
+	}
+
+	if ( numPendingChanges >= maxPendingChanges )
+	{
+		maxPendingChanges = ( maxPendingChanges > 0 ) ? maxPendingChanges * 2 : 64;
+		pendingChanges    = qm_os_memory_realloc( pendingChanges, sizeof( PendingChange ) * maxPendingChanges );
+	}
+
+	PendingChange *change = &pendingChanges[ numPendingChanges++ ];
+	change->mount         = mount;
+	change->type          = type;
+	change->path          = qm_os_string_alloc( "%s", key + sizeof( mount ) );
+
+	PlInsertHashTableNode( pendingLookup, key, keySize, ( void * ) ( uintptr_t ) numPendingChanges );
+}
+
+static void clear_pending_changes( void )
+{
+	for ( unsigned int i = 0; i < numPendingChanges; ++i )
+	{
+		qm_os_memory_free( pendingChanges[ i ].path );
+	}
+
+	numPendingChanges = 0;
+	if ( pendingLookup != nullptr )
+	{
+		PlClearHashTable( pendingLookup );
+	}
+}
+
+static WatchDirectory *find_directory( int wd )
+{
+	if ( watchDirectories == nullptr )
+	{
+		return nullptr;
+	}
+
+	return PlLookupHashTableUserData( watchDirectories, &wd, sizeof( wd ) );
+}
+
+static void free_directory( void *userData )
+{
+	WatchDirectory *directory = userData;
+	for ( unsigned int i = 0; i < directory->numReferences; ++i )
+	{
+		qm_os_memory_free( directory->references[ i ].path );
+	}
+
+	qm_os_memory_free( directory->references );
+	qm_os_memory_free( directory );
+}
+
+static void remove_directory( WatchDirectory *directory, bool removeWatch )
+{
+	if ( removeWatch )
+	{
+		inotify_rm_watch( watchFd, directory->wd );
+	}
+
+	PlDestroyHashTableNode( PlLookupHashTableNode( watchDirectories, &directory->wd, sizeof( directory->wd ) ) );
+	free_directory( directory );
+}
+
+/**
+ * Adds a watch to the given directory, and everything beneath it. If
+ * announce is set, files found along the way are queued up as changes,
+ * as they'll have turned up before we had a chance to watch for them.
+ */
+static void watch_directory( QmFsMount *mount, const char *path, bool announce )
+{
+	const char *mountPath = qm_fs_mount_get_path( mount );
+
+	PLPath fullPath;
+	if ( *path != '\0' )
+	{
+		snprintf( fullPath, sizeof( fullPath ), "%s/%s", mountPath, path );
+	}
+	else
+	{
+		snprintf( fullPath, sizeof( fullPath ), "%s", mountPath );
+	}
+
+	int wd = inotify_add_watch( watchFd, fullPath, WATCH_MASK );
+	if ( wd < 0 )
+	{
+		PlReportErrorF( PL_RESULT_SYSERR, "failed to watch %s: %s", fullPath, strerror( errno ) );
+		return;
+	}
+
+	WatchDirectory *directory = find_directory( wd );
+	if ( directory == nullptr )
+	{
+		directory     = QM_OS_MEMORY_NEW( WatchDirectory );
+		directory->wd = wd;
+		PlInsertHashTableNode( watchDirectories, &directory->wd, sizeof( directory->wd ), directory );
+	}
+	else
+	{
+		/* already seen through this mount, i.e. via a link back up the tree */
+		for ( unsigned int i = 0; i < directory->numReferences; ++i )
+		{
+			if ( directory->references[ i ].mount == mount )
+			{
+				return;
+			}
+		}
+	}
+
+	directory->references = qm_os_memory_realloc( directory->references, sizeof( WatchReference ) * ( directory->numReferences + 1 ) );
+	directory->references[ directory->numReferences++ ] = ( WatchReference ){
+	        .mount = mount,
+	        .path  = qm_os_string_alloc( "%s", path ),
+	};
+
+	DIR *dir = opendir( fullPath );
+	if ( dir == nullptr )
+	{
+		return;
+	}
+
+	struct dirent *entry;
+	while ( ( entry = readdir( dir ) ) != nullptr )
+	{
+		if ( strcmp( entry->d_name, "." ) == 0 || strcmp( entry->d_name, ".." ) == 0 )
+		{
+			continue;
+		}
+
+		bool isDirectory = ( entry->d_type == DT_DIR );
+		if ( entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK )
+		{
+			struct stat st;
+			if ( fstatat( dirfd( dir ), entry->d_name, &st, 0 ) != 0 )
+			{
+				continue;
+			}
+			isDirectory = S_ISDIR( st.st_mode );
+		}
+
+		PLPath childPath;
+		snprintf( childPath, sizeof( childPath ), ( *path != '\0' ) ? "%s/%s" : "%s%s", path, entry->d_name );
+		if ( isDirectory )
+		{
+			watch_directory( mount, childPath, announce );
+		}
+		else if ( announce )
+		{
+			queue_change( mount, childPath, QM_FS_WATCH_EVENT_MODIFIED );
+		}
+	}
+
+	closedir( dir );
+}
+
+/**
+ * Stops watching anything at or beneath the given path,
+ * i.e. because the directory has been moved away.
+ */
+static void unwatch_path( const QmFsMount *mount, const char *path )
+{
+	size_t pathLength = strlen( path );
+
+	PLHashTableNode *node = PlGetFirstHashTableNode( watchDirectories );
+	while ( node != nullptr )
+	{
+		WatchDirectory *directory = PlGetHashTableNodeUserData( node );
+		node                      = PlGetNextHashTableNode( node );
+
+		for ( unsigned int i = 0; i < directory->numReferences; )
+		{
+			const WatchReference *reference = &directory->references[ i ];
+			if ( reference->mount != mount || strncmp( reference->path, path, pathLength ) != 0 ||
+			     ( pathLength > 0 && reference->path[ pathLength ] != '\0' && reference->path[ pathLength ] != '/' ) )
+			{
+				++i;
+				continue;
+			}
+
+			qm_os_memory_free( reference->path );
+			directory->references[ i ] = directory->references[ --directory->numReferences ];
+		}
+
+		/* only stop watching once nothing else is looking at it */
+		if ( directory->numReferences == 0 )
+		{
+			remove_directory( directory, true );
+		}
+	}
+}
+
+bool qm_fs_mount_watch( QmFsMount *mount )
+{
+	if ( qm_fs_mount_get_type( mount ) != QM_FS_MOUNT_TYPE_DIR )
+	{
+		PlReportErrorF( PL_RESULT_UNSUPPORTED, "only directory mounts can be watched" );
+		return false;
+	}
+
+	if ( watchFd < 0 )
+	{
+		watchFd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+		if ( watchFd < 0 )
+		{
+			PlReportErrorF( PL_RESULT_SYSERR, "failed to initialize inotify: %s", strerror( errno ) );
+			return false;
+		}
+
+		watchDirectories = PlCreateHashTable();
+	}
+
+	watch_directory( mount, "", false );
+	return true;
+}
+
+void qm_fs_mount_unwatch( QmFsMount *mount )
+{
+	if ( watchDirectories == nullptr )
+	{
+		return;
+	}
+
+	unwatch_path( mount, "" );
+
+	/* anything still to come is no use now */
+	for ( unsigned int i = 0; i < numPendingChanges; ++i )
+	{
+		if ( pendingChanges[ i ].mount == mount )
+		{
+			pendingChanges[ i ].type = QM_FS_WATCH_EVENT_NONE;
+		}
+	}
+
+	if ( PlGetNumHashTableNodes( watchDirectories ) == 0 )
+	{
+		qm_fs_watch_shutdown();
+	}
+}
+
+typedef struct RemovedDirectory
+{
+	QmFsMount *mount;
+} RemovedDirectory;
+
+static void queue_removed_file( const char *path, void *userData )
+{
+	queue_change( ( ( RemovedDirectory * ) userData )->mount, path, QM_FS_WATCH_EVENT_REMOVED );
+}
+
+/**
+ * Queues up whatever the event means for the given mount,
+ * where the directory it came from is at the given path.
+ */
+static void read_change( const struct inotify_event *event, QmFsMount *mount, const char *directoryPath, bool *rebuild )
+{
+	PLPath path;
+	snprintf( path, sizeof( path ), ( *directoryPath != '\0' ) ? "%s/%s" : "%s%s", directoryPath, event->name );
+
+	if ( event->mask & IN_ISDIR )
+	{
+		if ( event->mask & ( IN_CREATE | IN_MOVED_TO ) )
+		{
+			watch_directory( mount, path, true );
+		}
+		else if ( event->mask & ( IN_DELETE | IN_MOVED_FROM ) )
+		{
+			RemovedDirectory removed = { .mount = mount };
+			qm_fs_index_enumerate_( mount, path, queue_removed_file, &removed );
+			unwatch_path( mount, path );
+			*rebuild = true;
+		}
+		return;
+	}
+
+	/* files are only reported once they've been written,
+	 * so there's no need to do anything on create */
+	if ( event->mask & ( IN_CLOSE_WRITE | IN_MOVED_TO ) )
+	{
+		queue_change( mount, path, QM_FS_WATCH_EVENT_MODIFIED );
+	}
+	else if ( event->mask & ( IN_DELETE | IN_MOVED_FROM ) )
+	{
+		queue_change( mount, path, QM_FS_WATCH_EVENT_REMOVED );
+	}
+}
+
+/**
+ * Reads everything inotify has for us, returning true if it's
+ * had to drop anything, in which case we've no idea what's changed.
+ */
+static bool read_changes( bool *rebuild )
+{
+	union
+	{
+		struct inotify_event event;
+		char                 buf[ 16384 ];
+	} u;
+
+	bool overflow = false;
+	for ( ;; )
+	{
+		ssize_t length = read( watchFd, u.buf, sizeof( u.buf ) );
+		if ( length <= 0 )
+		{
+			break;
+		}
+
+		for ( char *p = u.buf; p < u.buf + length; )
+		{
+			const struct inotify_event *event = ( const struct inotify_event * ) p;
+			p += sizeof( struct inotify_event ) + event->len;
+
+			if ( event->mask & IN_Q_OVERFLOW )
+			{
+				overflow = true;
+				continue;
+			}
+
+			WatchDirectory *directory = find_directory( event->wd );
+			if ( directory == nullptr )
+			{
+				continue;
+			}
+
+			if ( event->mask & IN_IGNORED )
+			{
+				remove_directory( directory, false );
+				continue;
+			}
+
+			if ( event->len == 0 && !( event->mask & IN_DELETE_SELF ) )
+			{
+				continue;
+			}
+
+			for ( unsigned int i = 0; i < directory->numReferences; ++i )
+			{
+				/* the references can change as we go, so take a copy */
+				QmFsMount *mount = directory->references[ i ].mount;
+				PLPath     directoryPath;
+				snprintf( directoryPath, sizeof( directoryPath ), "%s", directory->references[ i ].path );
+
+				if ( event->mask & IN_DELETE_SELF )
+				{
+					/* the rest is taken care of by the parent */
+					if ( *directoryPath == '\0' )
+					{
+						*rebuild = true;
+					}
+					continue;
+				}
+
+				read_change( event, mount, directoryPath, rebuild );
+			}
+		}
+	}
+
+	return overflow;
+}
+
+unsigned int qm_fs_watch_poll( void )
+{
+	if ( watchFd < 0 )
+	{
+		return 0;
+	}
+
+	bool rebuild  = false;
+	bool overflow = read_changes( &rebuild );
+	if ( numPendingChanges == 0 && !overflow && !rebuild )
+	{
+		return 0;
+	}
+
+	QmFsWatchEvent *events    = QM_OS_MEMORY_NEW_( QmFsWatchEvent, numPendingChanges + 1 );
+	unsigned int    numEvents = 0;
+	for ( unsigned int i = 0; i < numPendingChanges; ++i )
+	{
+		const PendingChange *change = &pendingChanges[ i ];
+		if ( change->type == QM_FS_WATCH_EVENT_NONE )
+		{
+			continue;
+		}
+
+		QmFsWatchEventType type = qm_fs_index_apply_change_( change->mount, change->path, change->type, &rebuild );
+		if ( type == QM_FS_WATCH_EVENT_NONE )
+		{
+			continue;
+		}
+
+		events[ numEvents++ ] = ( QmFsWatchEvent ){
+		        .type  = type,
+		        .path  = change->path,
+		        .mount = change->mount,
+		};
+	}
+
+	if ( rebuild || overflow )
+	{
+		qm_fs_index_rebuild_();
+	}
+
+	if ( overflow )
+	{
+		events[ numEvents++ ] = ( QmFsWatchEvent ){
+		        .type = QM_FS_WATCH_EVENT_OVERFLOW,
+		        .path = "",
+		};
+	}
+
+	dispatch_events( events, numEvents );
+
+	qm_os_memory_free( events );
+	clear_pending_changes();
+
+	return numEvents;
+}
+
+void qm_fs_watch_shutdown( void )
+{
+	if ( watchDirectories != nullptr )
+	{
+		PlDestroyHashTableEx( watchDirectories, free_directory );
+		watchDirectories = nullptr;
+	}
+
+	if ( watchFd >= 0 )
+	{
+		close( watchFd );
+		watchFd = -1;
+	}
+
+	clear_pending_changes();
+	PlDestroyHashTable( pendingLookup );
+	pendingLookup = nullptr;
+	qm_os_memory_free( pendingChanges );
+	pendingChanges    = nullptr;
+	maxPendingChanges = 0;
+}
+
+#else
+
+bool qm_fs_mount_watch( QmFsMount *mount )
+{
+	PlReportErrorF( PL_RESULT_UNSUPPORTED, "change notification isn't supported on this platform" );
+	return false;
+}
+
+void qm_fs_mount_unwatch( QmFsMount *mount ) {}
+
+unsigned int qm_fs_watch_poll( void )
+{
+	return 0;
+}
+
+void qm_fs_watch_shutdown( void ) {}
+
+#endif
@@ -5,6 +5,8 @@
 
 #include <plcore/pl_hashtable.h>
 
+/* initial number of buckets; the table doubles in size whenever
+ * the number of nodes exceeds the number of buckets */
 #define HASH_TABLE_SIZE 1024U
 
 typedef struct PLHashTableNode {
@@ -17,12 +19,25 @@ typedef struct PLHashTableNode {
 } PLHashTableNode;
 
 typedef struct PLHashTable {
-	PLHashTableNode *nodes[ HASH_TABLE_SIZE ];
+	PLHashTableNode **nodes;
+	unsigned int numBuckets;
 	unsigned int numNodes;
 } PLHashTable;
 
 PLHashTable *PlCreateHashTable( void ) {
-	return QM_OS_MEMORY_NEW( PLHashTable );
+	PLHashTable *hashTable = QM_OS_MEMORY_NEW( PLHashTable );
+	if ( hashTable == NULL ) {
+		return NULL;
+	}
+
+	hashTable->numBuckets = HASH_TABLE_SIZE;
+	hashTable->nodes = QM_OS_MEMORY_NEW_( PLHashTableNode *, hashTable->numBuckets );
+	if ( hashTable->nodes == NULL ) {
+		qm_os_memory_free( hashTable );
+		return NULL;
+	}
+
+	return hashTable;
 }
 
 void PlDestroyHashTable( PLHashTable *hashTable ) {
@@ -32,6 +47,7 @@ void PlDestroyHashTable( PLHashTable *hashTable ) {
 
 	PlClearHashTable( hashTable );
 
+	qm_os_memory_free( hashTable->nodes );
 	qm_os_memory_free( hashTable );
 }
 
@@ -40,7 +56,7 @@ void PlDestroyHashTableEx( PLHashTable *hashTable, void ( *elementDeleter )( voi
 		return;
 	}
 
-	for ( size_t i = 0; i < HASH_TABLE_SIZE; ++i ) {
+	for ( size_t i = 0; i < hashTable->numBuckets; ++i ) {
 		PLHashTableNode *child = hashTable->nodes[ i ];
 		while ( child != NULL ) {
 			PLHashTableNode *next = child->next;
@@ -53,17 +69,18 @@ void PlDestroyHashTableEx( PLHashTable *hashTable, void ( *elementDeleter )( voi
 		}
 	}
 
+	qm_os_memory_free( hashTable->nodes );
 	qm_os_memory_free( hashTable );
 }
 
-#define GET_INDEX( HASH ) ( unsigned int ) ( ( HASH ) % HASH_TABLE_SIZE )
+#define GET_INDEX( TABLE, HASH ) ( unsigned int ) ( ( HASH ) % ( TABLE )->numBuckets )
 
 void PlClearHashTable( PLHashTable *hashTable ) {
 	if ( hashTable->numNodes == 0 ) {
 		return;
 	}
 
-	for ( size_t i = 0; i < HASH_TABLE_SIZE; ++i ) {
+	for ( size_t i = 0; i < hashTable->numBuckets; ++i ) {
 		PLHashTableNode *child = hashTable->nodes[ i ];
 		while ( child != NULL ) {
 			PLHashTableNode *next = child->next;
@@ -83,7 +100,7 @@ PLHashTableNode *PlLookupHashTableNode( const PLHashTable *hashTable, const void
 	}
 
 	uint64_t hash = PlGenerateHashFNV1( key, keySize );
-	unsigned int index = GET_INDEX( hash );
+	unsigned int index = GET_INDEX( hashTable, hash );
 	for ( PLHashTableNode *node = hashTable->nodes[ index ]; node != NULL; node = node->next ) {
 		if ( keySize == node->keySize && memcmp( key, node->key, keySize ) == 0 ) {
 			return node;
@@ -102,6 +119,38 @@ void *PlLookupHashTableUserData( const PLHashTable *hashTable, const void *key,
 	return node->value;
 }
 
+/**
+ * Doubles the number of buckets and redistributes the existing
+ * nodes, so chains stay short as the table fills up.
+ */
+static void GrowHashTable( PLHashTable *hashTable ) {
+	unsigned int numBuckets = hashTable->numBuckets * 2;
+	PLHashTableNode **nodes = QM_OS_MEMORY_NEW_( PLHashTableNode *, numBuckets );
+	if ( nodes == NULL ) {
+		/* not fatal, we'll just end up with longer chains */
+		return;
+	}
+
+	PLHashTableNode **oldNodes = hashTable->nodes;
+	unsigned int oldNumBuckets = hashTable->numBuckets;
+
+	hashTable->nodes = nodes;
+	hashTable->numBuckets = numBuckets;
+
+	for ( size_t i = 0; i < oldNumBuckets; ++i ) {
+		PLHashTableNode *child = oldNodes[ i ];
+		while ( child != NULL ) {
+			PLHashTableNode *next = child->next;
+			unsigned int index = GET_INDEX( hashTable, child->hash );
+			child->next = hashTable->nodes[ index ];
+			hashTable->nodes[ index ] = child;
+			child = next;
+		}
+	}
+
+	qm_os_memory_free( oldNodes );
+}
+
 PLHashTableNode *PlInsertHashTableNode( PLHashTable *hashTable, const void *key, size_t keySize, void *value ) {
 	assert( key != NULL && keySize != 0 );
 	if ( key == NULL || keySize == 0 ) {
@@ -123,7 +172,11 @@ PLHashTableNode *PlInsertHashTableNode( PLHashTable *hashTable, const void *key,
 	node->key = QM_OS_MEMORY_NEW_( char, keySize + 1 );
 	memcpy( node->key, key, node->keySize );
 
-	unsigned int index = GET_INDEX( node->hash );
+	if ( hashTable->numNodes >= hashTable->numBuckets ) {
+		GrowHashTable( hashTable );
+	}
+
+	unsigned int index = GET_INDEX( hashTable, node->hash );
 	node->next = hashTable->nodes[ index ];
 	hashTable->nodes[ index ] = node;
 	hashTable->numNodes++;
@@ -137,7 +190,7 @@ void PlDestroyHashTableNode( PLHashTableNode *hashTableNode ) {
 	}
 
 	PLHashTable *hashTable = hashTableNode->table;
-	unsigned int index = GET_INDEX( hashTableNode->hash );
+	unsigned int index = GET_INDEX( hashTable, hashTableNode->hash );
 
 	PLHashTableNode **pptr = &( hashTable->nodes[ index ] );
 	while ( *pptr != hashTableNode ) {
@@ -159,7 +212,7 @@ unsigned int PlGetNumHashTableNodes( const PLHashTable *hashTable ) {
 /* iterator */
 
 PLHashTableNode *PlGetFirstHashTableNode( PLHashTable *hashTable ) {
-	for ( size_t i = 0; i < HASH_TABLE_SIZE; ++i ) {
+	for ( size_t i = 0; i < hashTable->numBuckets; ++i ) {
 		PLHashTableNode *child = hashTable->nodes[ i ];
 		if ( child != NULL ) {
 			return child;
@@ -175,9 +228,9 @@ PLHashTableNode *PlGetNextHashTableNode( PLHashTableNode *hashTableNode ) {
 		return child;
 	}
 
-	unsigned int index = GET_INDEX( hashTableNode->hash ) + 1;
+	unsigned int index = GET_INDEX( hashTableNode->table, hashTableNode->hash ) + 1;
 	while ( child == NULL ) {
-		if ( index >= HASH_TABLE_SIZE ) {
+		if ( index >= hashTableNode->table->numBuckets ) {
 			break;
 		}
 
@@ -41,6 +41,27 @@ void PlShutdownFileSystem( void );
 PLFunctionResult PlInitConsole( void );
 
 void PlInitPackageSubSystem( void );
+void PlShutdownPackageSubSystem( void );
+
+/* * * * * * * * * * * * * * * * * * * */
+/* Shared Workers                      */
+
+typedef struct QmWorkerGroup QmWorkerGroup;
+
+/**
+ * Runs the given function on up to numWorkers of the shared worker
+ * threads, which are created on first use. The caller is expected to
+ * run the function too, before calling qm_worker_group_wait_, so work
+ * should be pulled from a shared counter or queue; workers that haven't
+ * started by then are skipped. Returns null if there are no workers.
+ */
+QmWorkerGroup *qm_worker_group_start_( void ( *function )( void *userData ), void *userData, unsigned int numWorkers );
+
+/**
+ * Waits on any workers in the group that have started, then frees it.
+ */
+void qm_worker_group_wait_( QmWorkerGroup *self );
+void qm_workers_shutdown_( void );
 
 /* * * * * * * * * * * * * * * * * * * */
 
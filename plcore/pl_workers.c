@@ -0,0 +1,148 @@
+// SPDX-License-Identifier: MIT
+// Hei Platform Library
+// Copyright © 2017-2026 Quartermind Games, Mark E. Sowden <markelswo@gmail.com>
+// Purpose: Worker threads shared between everything that splits up its work.
+
+#include <stdatomic.h>
+
+#include "pl_private.h"
+
+#include "qmos/public/qm_os_memory.h"
+#include "qmos/public/qm_os_thread.h"
+
+struct QmWorkerGroup
+{
+	void ( *function )( void *userData );
+	void *userData;
+
+	QmOsMutex     *mutex;
+	QmOsCondition *condition;
+	unsigned int   numActive;
+	bool           closed;// set once the caller is waiting, after which nothing new starts
+
+	atomic_uint refs;
+};
+
+static _Atomic( QmOsThreadPool * ) workerPool;
+
+/**
+ * Fetches the shared pool, creating it the first time round.
+ */
+static QmOsThreadPool *get_worker_pool( void )
+{
+	QmOsThreadPool *pool = atomic_load( &workerPool );
+	if ( pool != nullptr )
+	{
+		return pool;
+	}
+
+	QmOsThreadPool *newPool = qm_os_thread_pool_create( qm_os_thread_get_available() );
+	if ( newPool == nullptr )
+	{
+		return nullptr;
+	}
+
+	if ( !atomic_compare_exchange_strong( &workerPool, &pool, newPool ) )
+	{
+		/* someone else got here first, so use theirs */
+		qm_os_memory_free( newPool );
+		return pool;
+	}
+
+	return newPool;
+}
+
+static void worker_group_release( QmWorkerGroup *self )
+{
+	if ( atomic_fetch_sub( &self->refs, 1 ) != 1 )
+	{
+		return;
+	}
+
+	qm_os_memory_free( self->condition );
+	qm_os_memory_free( self->mutex );
+	qm_os_memory_free( self );
+}
+
+static void worker_group_job( void *userData )
+{
+	QmWorkerGroup *self = userData;
+
+	qm_os_mutex_lock( self->mutex );
+	if ( self->closed )
+	{
+		/* the caller has already moved on */
+		qm_os_mutex_unlock( self->mutex );
+		worker_group_release( self );
+		return;
+	}
+	self->numActive++;
+	qm_os_mutex_unlock( self->mutex );
+
+	self->function( self->userData );
+
+	qm_os_mutex_lock( self->mutex );
+	if ( --self->numActive == 0 )
+	{
+		qm_os_condition_broadcast( self->condition );
+	}
+	qm_os_mutex_unlock( self->mutex );
+
+	worker_group_release( self );
+}
+
+QmWorkerGroup *qm_worker_group_start_( void ( *function )( void *userData ), void *userData, unsigned int numWorkers )
+{
+	if ( numWorkers == 0 )
+	{
+		return nullptr;
+	}
+
+	QmOsThreadPool *pool = get_worker_pool();
+	if ( pool == nullptr )
+	{
+		return nullptr;
+	}
+
+	numWorkers = QM_OS_MIN( numWorkers, qm_os_thread_pool_get_num_threads( pool ) );
+
+	QmWorkerGroup *self = QM_OS_MEMORY_NEW( QmWorkerGroup );
+	self->function      = function;
+	self->userData      = userData;
+	self->mutex         = qm_os_mutex_create();
+	self->condition     = qm_os_condition_create();
+
+	/* one for each of the workers, and another for the caller */
+	atomic_init( &self->refs, numWorkers + 1 );
+
+	for ( unsigned int i = 0; i < numWorkers; ++i )
+	{
+		qm_os_thread_pool_push( pool, worker_group_job, self, 0 );
+	}
+
+	return self;
+}
+
+void qm_worker_group_wait_( QmWorkerGroup *self )
+{
+	if ( self == nullptr )
+	{
+		return;
+	}
+
+	qm_os_mutex_lock( self->mutex );
+	self->closed = true;
+	while ( self->numActive > 0 )
+	{
+		qm_os_condition_wait( self->condition, self->mutex );
+	}
+	qm_os_mutex_unlock( self->mutex );
+
+	worker_group_release( self );
+}
+
+void qm_workers_shutdown_( void )
+{
+	/* destroying the pool will finish off anything still queued */
+	qm_os_memory_free( atomic_exchange( &workerPool, nullptr ) );
+}
@@ -0,0 +1,348 @@
+// SPDX-License-Identifier: MIT
+// Hei Platform Library
+// Copyright © 2017-2026 Quartermind Games, Mark E. Sowden <markelswo@gmail.com>
+// Purpose: Tests for the filesystem API.
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <plcore/pl.h>
+#include <plcore/pl_filesystem.h>
+#include <plcore/pl_package.h>
+
+#include "qmos/public/qm_os_memory.h"
+#include "qmtest/public/qm_test.h"
+
+typedef struct WatchResult
+{
+	QmFsWatchEventType type;
+	QmFsMount         *mount;
+	unsigned int       numEvents;
+} WatchResult;
+
+static void watch_callback( const QmFsWatchEvent *events, unsigned int numEvents, void *userData )
+{
+	WatchResult *result = userData;
+	for ( unsigned int i = 0; i < numEvents; ++i )
+	{
+		if ( strcmp( events[ i ].path, "test.txt" ) != 0 )
+		{
+			continue;
+		}
+
+		result->type  = events[ i ].type;
+		result->mount = events[ i ].mount;
+		result->numEvents++;
+	}
+}
+
+/**
+ * Polls until something turns up, as there's no telling
+ * quite when the kernel will get round to letting us know.
+ */
+static void watch_wait( WatchResult *result )
+{
+	*result = ( WatchResult ){};
+	for ( unsigned int i = 0; i < 100 && result->numEvents == 0; ++i )
+	{
+		qm_fs_watch_poll();
+		usleep( 10000 );
+	}
+}
+
+QM_TEST_FUNC( watch )
+{
+	char directory[] = "/tmp/pl_watch_XXXXXX";
+	QM_TEST_ASSERT( mkdtemp( directory ) != nullptr );
+
+	char path[ 64 ];
+	snprintf( path, sizeof( path ), "%s/test.txt", directory );
+
+	// the same directory mounted twice, so they share the one watch
+	QmFsMount *lower = qm_fs_mount_local_location( directory );
+	QmFsMount *upper = qm_fs_mount_local_location( directory );
+	QM_TEST_ASSERT( lower != nullptr && upper != nullptr );
+	if ( !qm_fs_mount_watch( lower ) || !qm_fs_mount_watch( upper ) )
+	{
+		printf( "unsupported, skipping... " );
+		qm_fs_clear_mounted_locations();
+		rmdir( directory );
+		return TEST_RETURN_SUCCESS;
+	}
+
+	WatchResult result;
+	QmFsWatch  *watch = qm_fs_watch_subscribe( "", watch_callback, &result );
+	QM_TEST_ASSERT( watch != nullptr );
+
+	// dropping one mount shouldn't stop the other hearing about changes
+	qm_fs_mount_unwatch( lower );
+
+	FILE *file = fopen( path, "w" );
+	QM_TEST_ASSERT( file != nullptr );
+	fputs( "Hello!", file );
+	fclose( file );
+
+	watch_wait( &result );
+	QM_TEST_ASSERT( result.numEvents == 1 );
+	QM_TEST_ASSERT( result.type == QM_FS_WATCH_EVENT_ADDED );
+	QM_TEST_ASSERT( result.mount == upper );
+	QM_TEST_ASSERT( qm_fs_check_file_exists( "test.txt" ) );
+
+	remove( path );
+
+	watch_wait( &result );
+	QM_TEST_ASSERT( result.numEvents == 1 );
+	QM_TEST_ASSERT( result.type == QM_FS_WATCH_EVENT_REMOVED );
+	QM_TEST_ASSERT( !qm_fs_check_file_exists( "test.txt" ) );
+
+	qm_fs_watch_unsubscribe( watch );
+	qm_fs_mount_unwatch( upper );
+	qm_fs_clear_mounted_locations();
+	rmdir( directory );
+}
+QM_TEST_FUNC_END()
+
+static bool write_file( const char *directory, const char *name )
+{
+	char path[ 128 ];
+	snprintf( path, sizeof( path ), "%s/%s", directory, name );
+	*strrchr( path, '/' ) = '\0';
+	if ( !PlCreatePath( path ) )
+	{
+		return false;
+	}
+	snprintf( path, sizeof( path ), "%s/%s", directory, name );
+
+	FILE *file = fopen( path, "w" );
+	if ( file == nullptr )
+	{
+		return false;
+	}
+
+	fputs( name, file );
+	fclose( file );
+	return true;
+}
+
+/**
+ * Writes out a Quake PAK holding the given names, each with no data.
+ */
+static bool write_pak( const char *path, const char **names, unsigned int numNames )
+{
+	FILE *file = fopen( path, "wb" );
+	if ( file == nullptr )
+	{
+		return false;
+	}
+
+	int32_t header[ 2 ] = { 12, ( int32_t ) ( numNames * 64 ) };
+	fwrite( "PACK", 1, 4, file );
+	fwrite( header, sizeof( header ), 1, file );
+	for ( unsigned int i = 0; i < numNames; ++i )
+	{
+		char name[ 56 ] = {};
+		strncpy( name, names[ i ], sizeof( name ) - 1 );
+		fwrite( name, 1, sizeof( name ), file );
+		int32_t entry[ 2 ] = { 12, 0 };
+		fwrite( entry, sizeof( entry ), 1, file );
+	}
+
+	fclose( file );
+	return true;
+}
+
+static unsigned int scan_count( const char *path, const char *extension, bool recursive, bool *unique )
+{
+	unsigned int numPaths;
+	char       **paths = PlScanDirectoryToArray( path, extension, recursive, 1, &numPaths );
+
+	*unique = true;
+	for ( unsigned int i = 0; i < numPaths; ++i )
+	{
+		for ( unsigned int j = i + 1; j < numPaths; ++j )
+		{
+			if ( strcmp( paths[ i ], paths[ j ] ) == 0 )
+			{
+				*unique = false;
+			}
+		}
+	}
+
+	qm_os_memory_free( paths );
+	return numPaths;
+}
+
+QM_TEST_FUNC( scan )
+{
+	char directory[] = "/tmp/pl_scan_XXXXXX";
+	QM_TEST_ASSERT( mkdtemp( directory ) != nullptr );
+
+	char local[ 64 ];
+	snprintf( local, sizeof( local ), "%s/local", directory );
+	QM_TEST_ASSERT( write_file( local, "maps/a.bsp" ) );
+	QM_TEST_ASSERT( write_file( local, "maps/B.BSP" ) );
+	QM_TEST_ASSERT( write_file( local, "maps/sub/c.bsp" ) );
+	QM_TEST_ASSERT( write_file( local, "maps/readme.txt" ) );
+
+	// shares a.bsp with the directory, and has a neighbour that only shares the prefix
+	static const char *names[] = { "maps/a.bsp", "maps/d.BSP", "maps/sub/e.bsp", "mapsrc/f.bsp" };
+	char               pak[ 64 ];
+	snprintf( pak, sizeof( pak ), "%s/test.pak", directory );
+	QM_TEST_ASSERT( write_pak( pak, names, QM_OS_ARRAY_ELEMENTS( names ) ) );
+
+	QM_TEST_ASSERT( qm_fs_mount_local_location( local ) != nullptr );
+	QM_TEST_ASSERT( qm_fs_mount_local_location( pak ) != nullptr );
+
+	bool unique;
+	QM_TEST_ASSERT( scan_count( "maps", "bsp", false, &unique ) == 3 && unique );
+	QM_TEST_ASSERT( scan_count( "maps", "bsp", true, &unique ) == 5 && unique );
+	QM_TEST_ASSERT( scan_count( "maps", nullptr, true, &unique ) == 6 && unique );
+
+	qm_fs_clear_mounted_locations();
+
+	char command[ 128 ];
+	snprintf( command, sizeof( command ), "rm -rf %s", directory );
+	QM_TEST_ASSERT( system( command ) == 0 );
+}
+QM_TEST_FUNC_END()
+
+QM_TEST_FUNC( aliases )
+{
+	PlClearFileAliases();
+
+	// more than the old fixed table could hold
+	for ( unsigned int i = 0; i < 5000; ++i )
+	{
+		char alias[ 32 ], target[ 32 ];
+		snprintf( alias, sizeof( alias ), "alias%u", i );
+		snprintf( target, sizeof( target ), "target%u", i );
+		PlAddFileAlias( alias, target );
+	}
+	QM_TEST_ASSERT( PlGetNumFileAliases() == 5000 );
+	QM_TEST_ASSERT( strcmp( PlGetPathForAlias( "alias0" ), "target0" ) == 0 );
+	QM_TEST_ASSERT( strcmp( PlGetPathForAlias( "alias4999" ), "target4999" ) == 0 );
+	QM_TEST_ASSERT( PlGetPathForAlias( "alias5000" ) == nullptr );
+
+	PlAddFileAlias( "alias10", "elsewhere" );
+	QM_TEST_ASSERT( PlGetNumFileAliases() == 5000 );
+	QM_TEST_ASSERT( strcmp( PlGetPathForAlias( "alias10" ), "target10" ) == 0 );
+
+	PlClearFileAliases();
+	QM_TEST_ASSERT( PlGetNumFileAliases() == 0 && PlGetPathForAlias( "alias0" ) == nullptr );
+
+	char directory[] = "/tmp/pl_alias_XXXXXX";
+	QM_TEST_ASSERT( mkdtemp( directory ) != nullptr );
+	QM_TEST_ASSERT( write_file( directory, "real.txt" ) );
+
+	char manifest[ 64 ];
+	snprintf( manifest, sizeof( manifest ), "%s/aliases.txt", directory );
+	FILE *file = fopen( manifest, "w" );
+	QM_TEST_ASSERT( file != nullptr );
+	fprintf( file, "# comment\n// another\nvirtual.txt %s/real.txt\n\"with space\" \"target two\"\nmissing\n", directory );
+	fclose( file );
+
+	QM_TEST_ASSERT( PlLoadFileAliases( manifest ) == 2 );
+	QM_TEST_ASSERT( strcmp( PlGetPathForAlias( "with space" ), "target two" ) == 0 );
+	QM_TEST_ASSERT( PlGetPathForAlias( "missing" ) == nullptr );
+
+	// and opening the alias gets the target
+	QmFsFile *aliased = qm_fs_file_open( "virtual.txt", false );
+	QM_TEST_ASSERT( aliased != nullptr && qm_fs_file_get_size( aliased ) == strlen( "real.txt" ) );
+	PlCloseFile( aliased );
+
+	PlClearFileAliases();
+
+	char command[ 128 ];
+	snprintf( command, sizeof( command ), "rm -rf %s", directory );
+	QM_TEST_ASSERT( system( command ) == 0 );
+}
+QM_TEST_FUNC_END()
+
+static bool check_resolves_to( const char *path, const char *directory, const char *expected )
+{
+	char buf[ 256 ], target[ 256 ];
+	snprintf( target, sizeof( target ), "%s/%s", directory, expected );
+	return qm_fs_check_file_exists( path ) &&
+	       qm_fs_resolve_virtual_path( path, buf, sizeof( buf ) ) != nullptr &&
+	       strcmp( buf, target ) == 0;
+}
+
+QM_TEST_FUNC( overlay )
+{
+	char directory[] = "/tmp/pl_overlay_XXXXXX";
+	QM_TEST_ASSERT( mkdtemp( directory ) != nullptr );
+
+	// 'upper' hides x/2.txt and all of z, 'middle' hides the rest of x beneath it
+	static const char *files[] = {
+	        "upper/x/1.txt",
+	        "upper/x/.wh.2.txt",
+	        "upper/.wh.z",
+	        "middle/x/1.txt",
+	        "middle/x/2.txt",
+	        "middle/x/3.txt",
+	        "middle/x/.wh..wh..opq",
+	        "middle/z/4.txt",
+	        "lower/x/5.txt",
+	        "lower/q/6.txt",
+	};
+	for ( unsigned int i = 0; i < QM_OS_ARRAY_ELEMENTS( files ); ++i )
+	{
+		QM_TEST_ASSERT( write_file( directory, files[ i ] ) );
+	}
+
+	qm_fs_set_overlay_enabled( true );
+
+	static const char *layers[] = { "upper", "middle", "lower" };
+	for ( unsigned int i = 0; i < QM_OS_ARRAY_ELEMENTS( layers ); ++i )
+	{
+		char path[ 64 ];
+		snprintf( path, sizeof( path ), "%s/%s", directory, layers[ i ] );
+		QM_TEST_ASSERT( qm_fs_mount_local_location( path ) != nullptr );
+	}
+
+	QM_TEST_ASSERT( check_resolves_to( "x/1.txt", directory, "upper/x/1.txt" ) );
+	QM_TEST_ASSERT( check_resolves_to( "x/3.txt", directory, "middle/x/3.txt" ) );
+	QM_TEST_ASSERT( check_resolves_to( "q/6.txt", directory, "lower/q/6.txt" ) );
+	QM_TEST_ASSERT( !qm_fs_check_file_exists( "x/2.txt" ) );
+	QM_TEST_ASSERT( !qm_fs_check_file_exists( "x/5.txt" ) );
+	QM_TEST_ASSERT( !qm_fs_check_file_exists( "z/4.txt" ) );
+	QM_TEST_ASSERT( !qm_fs_check_file_exists( "x/.wh.2.txt" ) );
+
+	// whiteouts and markers never turn up in the merged view
+	bool unique;
+	QM_TEST_ASSERT( scan_count( "", "txt", true, &unique ) == 3 && unique );
+	QM_TEST_ASSERT( scan_count( "x", nullptr, true, &unique ) == 2 && unique );
+
+	// and dropping the top layer brings back what it hid
+	qm_fs_clear_mounted_locations();
+	for ( unsigned int i = 1; i < QM_OS_ARRAY_ELEMENTS( layers ); ++i )
+	{
+		char path[ 64 ];
+		snprintf( path, sizeof( path ), "%s/%s", directory, layers[ i ] );
+		QM_TEST_ASSERT( qm_fs_mount_local_location( path ) != nullptr );
+	}
+	QM_TEST_ASSERT( check_resolves_to( "x/1.txt", directory, "middle/x/1.txt" ) );
+	QM_TEST_ASSERT( check_resolves_to( "z/4.txt", directory, "middle/z/4.txt" ) );
+
+	qm_fs_clear_mounted_locations();
+	qm_fs_set_overlay_enabled( false );
+
+	char command[ 128 ];
+	snprintf( command, sizeof( command ), "rm -rf %s", directory );
+	QM_TEST_ASSERT( system( command ) == 0 );
+}
+QM_TEST_FUNC_END()
+
+int main( int argc, char **argv )
+{
+	PlInitialize( argc, argv );
+	PlRegisterStandardPackageLoaders( PL_PACKAGE_LOAD_FORMAT_PAK_QUAKE );
+
+	TEST_RUN_INIT
+	CALL_FUNC_TEST( watch )
+	CALL_FUNC_TEST( scan )
+	CALL_FUNC_TEST( aliases )
+	CALL_FUNC_TEST( overlay )
+	PlShutdown();
+	TEST_RUN_END
+}
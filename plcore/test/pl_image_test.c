@@ -0,0 +1,602 @@
+// SPDX-License-Identifier: MIT
+// Hei Platform Library
+// Copyright © 2017-2026 Quartermind Games, Mark E. Sowden <markelswo@gmail.com>
+// Purpose: Tests for the image API.
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <plcore/pl.h>
+#include <plcore/pl_filesystem.h>
+#include <plcore/pl_image.h>
+
+#include "qmtest/public/qm_test.h"
+
+#include <math.h>
+
+// scalar reference decoder, from 3rdparty/decompress.c
+void DecompressBlockBC1( uint32_t x, uint32_t y, uint32_t stride, const uint8_t *blockStorage, unsigned char *image );
+void DecompressBlockBC2( uint32_t x, uint32_t y, uint32_t stride, const uint8_t *blockStorage, unsigned char *image );
+void DecompressBlockBC3( uint32_t x, uint32_t y, uint32_t stride, const uint8_t *blockStorage, unsigned char *image );
+void DecompressBlockBC4( uint32_t x, uint32_t y, uint32_t stride, int mode, const uint8_t *blockStorage, unsigned char *image );
+
+static char testDirectory[] = "/tmp/pl_image_XXXXXX";
+
+static uint32_t test_random( uint32_t *seed )
+{
+	*seed = *seed * 1664525u + 1013904223u;
+	return *seed >> 8;
+}
+
+/**
+ * Fills the blocks with noise, then forces every few blocks into the
+ * modes that are easy to get wrong: equal or swapped endpoints, so DXT1
+ * and DXT3 drop into three colour mode, and DXT5 alpha endpoints in
+ * the order that gives the six entry palette.
+ */
+static void make_blocks( uint8_t *blocks, unsigned int numBlocks, unsigned int blockSize, uint32_t seed )
+{
+	for ( size_t i = 0; i < ( size_t ) numBlocks * blockSize; ++i )
+	{
+		blocks[ i ] = ( uint8_t ) test_random( &seed );
+	}
+
+	for ( unsigned int i = 0; i < numBlocks; ++i )
+	{
+		uint8_t *block  = blocks + ( size_t ) i * blockSize;
+		uint8_t *colour = block + blockSize - 8;
+		switch ( i % 4 )
+		{
+			case 0:// colour0 <= colour1, three colour mode
+				if ( ( colour[ 0 ] | colour[ 1 ] << 8 ) > ( colour[ 2 ] | colour[ 3 ] << 8 ) )
+				{
+					uint8_t t[ 2 ] = { colour[ 0 ], colour[ 1 ] };
+					memcpy( colour, colour + 2, 2 );
+					memcpy( colour + 2, t, 2 );
+				}
+				break;
+			case 1:// equal endpoints
+				memcpy( colour + 2, colour, 2 );
+				break;
+			case 2:// alpha0 <= alpha1, six alpha mode
+				if ( blockSize == 16 && block[ 0 ] > block[ 1 ] )
+				{
+					uint8_t t  = block[ 0 ];
+					block[ 0 ] = block[ 1 ];
+					block[ 1 ] = t;
+				}
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+static bool check_format( PLImageFormat format, unsigned int width, unsigned int height, uint32_t seed )
+{
+	unsigned int blockSize = ( format == PL_IMAGEFORMAT_RGBA_DXT1 ) ? 8 : 16;
+	unsigned int bw        = ( width + 3 ) / 4;
+	unsigned int bh        = ( height + 3 ) / 4;
+
+	uint8_t *blocks    = malloc( ( size_t ) bw * bh * blockSize );
+	uint8_t *reference = malloc( ( size_t ) bw * bh * 16 * 4 );
+	uint8_t *expected  = malloc( ( size_t ) width * height * 4 );
+	uint8_t *output    = malloc( ( size_t ) width * height * 4 );
+	make_blocks( blocks, bw * bh, blockSize, seed );
+
+	// decode into a buffer padded out to whole blocks, then crop
+	uint32_t stride = bw * 4 * 4;
+	for ( unsigned int y = 0; y < bh; ++y )
+	{
+		for ( unsigned int x = 0; x < bw; ++x )
+		{
+			const uint8_t *block = blocks + ( ( size_t ) y * bw + x ) * blockSize;
+			switch ( format )
+			{
+				case PL_IMAGEFORMAT_RGBA_DXT1:
+					DecompressBlockBC1( x * 4, y * 4, stride, block, reference );
+					break;
+				case PL_IMAGEFORMAT_RGBA_DXT3:
+					DecompressBlockBC2( x * 4, y * 4, stride, block, reference );
+					break;
+				default:
+					DecompressBlockBC3( x * 4, y * 4, stride, block, reference );
+					break;
+			}
+		}
+	}
+	for ( unsigned int y = 0; y < height; ++y )
+	{
+		memcpy( expected + ( size_t ) y * width * 4, reference + ( size_t ) y * stride, ( size_t ) width * 4 );
+	}
+
+	// once on the calling thread, then again shared out between the workers
+	bool match = true;
+	for ( unsigned int numThreads = 1; numThreads <= 4 && match; numThreads += 3 )
+	{
+		memset( output, 0xCD, ( size_t ) width * height * 4 );
+		match = qm_image_decompress_blocks( format, width, height, blocks, output, numThreads ) &&
+		        memcmp( output, expected, ( size_t ) width * height * 4 ) == 0;
+		if ( !match )
+		{
+			printf( "mismatch for format %d at %ux%u with %u threads\n", format, width, height, numThreads );
+		}
+	}
+
+	free( blocks );
+	free( reference );
+	free( expected );
+	free( output );
+
+	return match;
+}
+
+QM_TEST_FUNC( s3tc )
+{
+	// opaque black in three colour mode, rather than transparent
+	static const uint8_t punchThrough[ 8 ] = { 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+	uint8_t pixels[ 4 * 4 * 4 ];
+	QM_TEST_ASSERT( qm_image_decompress_blocks( PL_IMAGEFORMAT_RGBA_DXT1, 4, 4, punchThrough, pixels, 1 ) );
+	for ( unsigned int i = 0; i < 16; ++i )
+	{
+		QM_TEST_ASSERT( pixels[ i * 4 ] == 0 && pixels[ i * 4 + 1 ] == 0 && pixels[ i * 4 + 2 ] == 0 && pixels[ i * 4 + 3 ] == 255 );
+	}
+
+	static const unsigned int sizes[][ 2 ] = {
+	        {1,   1  },
+	        { 3,   5  },
+	        { 4,   4  },
+	        { 13,  7  },
+	        { 64,  64 },
+	        { 517, 261},
+	};
+
+	static const PLImageFormat formats[] = {
+	        PL_IMAGEFORMAT_RGBA_DXT1,
+	        PL_IMAGEFORMAT_RGBA_DXT3,
+	        PL_IMAGEFORMAT_RGBA_DXT5,
+	};
+
+	for ( unsigned int i = 0; i < QM_OS_ARRAY_ELEMENTS( formats ); ++i )
+	{
+		for ( unsigned int j = 0; j < QM_OS_ARRAY_ELEMENTS( sizes ); ++j )
+		{
+			QM_TEST_ASSERT( check_format( formats[ i ], sizes[ j ][ 0 ], sizes[ j ][ 1 ], i * 31 + j ) );
+		}
+	}
+}
+QM_TEST_FUNC_END()
+
+static uint8_t *make_pixels( unsigned int width, unsigned int height, uint32_t seed )
+{
+	uint8_t *pixels = malloc( ( size_t ) width * height * 4 );
+	for ( size_t i = 0; i < ( size_t ) width * height * 4; ++i )
+	{
+		pixels[ i ] = ( uint8_t ) test_random( &seed );
+	}
+
+	return pixels;
+}
+
+QM_TEST_FUNC( convert )
+{
+	// odd, so the vector paths have a tail to deal with
+	enum
+	{
+		NUM_PIXELS = 1003
+	};
+
+	uint8_t *src      = make_pixels( NUM_PIXELS, 1, 3 );
+	uint8_t *bulk     = malloc( NUM_PIXELS * 16 );
+	uint8_t *single   = malloc( NUM_PIXELS * 16 );
+	uint8_t *restored = malloc( NUM_PIXELS * 4 );
+
+	for ( PLImageFormat format = PL_IMAGEFORMAT_R8; format <= PL_IMAGEFORMAT_RGBA32F; ++format )
+	{
+		unsigned int pixelSize = PlGetImageFormatPixelSize( format );
+		QM_TEST_ASSERT( pixelSize > 0 && pixelSize <= 16 );
+
+		// converting in bulk has to match converting a pixel at a time
+		QM_TEST_ASSERT( qm_image_convert_pixels( src, PL_IMAGEFORMAT_RGBA8, bulk, format, NUM_PIXELS ) );
+		for ( unsigned int i = 0; i < NUM_PIXELS; ++i )
+		{
+			QM_TEST_ASSERT( qm_image_convert_pixels( src + i * 4, PL_IMAGEFORMAT_RGBA8, single + i * pixelSize, format, 1 ) );
+		}
+		QM_TEST_ASSERT( memcmp( bulk, single, ( size_t ) NUM_PIXELS * pixelSize ) == 0 );
+
+		QM_TEST_ASSERT( qm_image_convert_pixels( bulk, format, restored, PL_IMAGEFORMAT_RGBA8, NUM_PIXELS ) );
+		for ( unsigned int i = 0; i < NUM_PIXELS; ++i )
+		{
+			QM_TEST_ASSERT( qm_image_convert_pixels( bulk + i * pixelSize, format, single + i * 4, PL_IMAGEFORMAT_RGBA8, 1 ) );
+		}
+		QM_TEST_ASSERT( memcmp( restored, single, NUM_PIXELS * 4 ) == 0 );
+
+		// anything with at least 8 bits a channel comes back as it went in
+		bool hasAlpha = ( format == PL_IMAGEFORMAT_RGBA8 || format == PL_IMAGEFORMAT_BGRA8 || format == PL_IMAGEFORMAT_RGBA12 ||
+		                  format == PL_IMAGEFORMAT_RGBA16 || format == PL_IMAGEFORMAT_RGBA16F || format == PL_IMAGEFORMAT_RGBA32F );
+		bool hasColour = hasAlpha || format == PL_IMAGEFORMAT_RGB8 || format == PL_IMAGEFORMAT_BGR8 || format == PL_IMAGEFORMAT_BGRX8 ||
+		                 format == PL_IMAGEFORMAT_RGB16F || format == PL_IMAGEFORMAT_RGB32F;
+		if ( !hasColour )
+		{
+			continue;
+		}
+
+		for ( unsigned int i = 0; i < NUM_PIXELS; ++i )
+		{
+			QM_TEST_ASSERT( memcmp( restored + i * 4, src + i * 4, 3 ) == 0 );
+			QM_TEST_ASSERT( restored[ i * 4 + 3 ] == ( hasAlpha ? src[ i * 4 + 3 ] : 255 ) );
+		}
+	}
+
+	// and the same for a whole image, which swaps its data over
+	QmImage *image = PlCreateImage( src, 17, 59, 0, PL_COLOURFORMAT_RGBA, PL_IMAGEFORMAT_RGBA8 );
+	QM_TEST_ASSERT( image != nullptr );
+	QM_TEST_ASSERT( PlConvertPixelFormat( image, PL_IMAGEFORMAT_BGRA8 ) );
+	QM_TEST_ASSERT( image->data[ 0 ][ 0 ] == src[ 2 ] && image->data[ 0 ][ 2 ] == src[ 0 ] );
+	QM_TEST_ASSERT( PlConvertPixelFormat( image, PL_IMAGEFORMAT_RGBA32F ) && image->size == 17 * 59 * 16 );
+	QM_TEST_ASSERT( PlConvertPixelFormat( image, PL_IMAGEFORMAT_RGBA8 ) && image->size == 17 * 59 * 4 );
+	QM_TEST_ASSERT( memcmp( image->data[ 0 ], src, 17 * 59 * 4 ) == 0 );
+	PlDestroyImage( image );
+
+	free( src );
+	free( bulk );
+	free( single );
+	free( restored );
+}
+QM_TEST_FUNC_END()
+
+/**
+ * Gradients and a soft wave, roughly what the block encoders see in
+ * practice; noise would only tell us how badly they do on noise.
+ */
+static uint8_t *make_smooth_pixels( unsigned int width, unsigned int height )
+{
+	uint8_t *pixels = malloc( ( size_t ) width * height * 4 );
+	for ( unsigned int y = 0; y < height; ++y )
+	{
+		for ( unsigned int x = 0; x < width; ++x )
+		{
+			uint8_t *pixel = pixels + ( ( size_t ) y * width + x ) * 4;
+			pixel[ 0 ]     = ( uint8_t ) ( x * 255 / ( width - 1 ) );
+			pixel[ 1 ]     = ( uint8_t ) ( y * 255 / ( height - 1 ) );
+			pixel[ 2 ]     = ( uint8_t ) ( 128 + 100 * sin( x * 0.1 + y * 0.07 ) );
+			pixel[ 3 ]     = ( uint8_t ) ( 200 + x % 7 );
+		}
+	}
+
+	return pixels;
+}
+
+static double get_psnr( const uint8_t *a, const uint8_t *b, size_t numPixels, unsigned int numChannels )
+{
+	double error = 0.0;
+	for ( size_t i = 0; i < numPixels; ++i )
+	{
+		for ( unsigned int j = 0; j < numChannels; ++j )
+		{
+			double d = ( double ) a[ i * 4 + j ] - b[ i * 4 + j ];
+			error += d * d;
+		}
+	}
+
+	error /= ( double ) numPixels * numChannels;
+	return ( error == 0.0 ) ? 99.0 : 10.0 * log10( 255.0 * 255.0 / error );
+}
+
+QM_TEST_FUNC( compress )
+{
+	enum
+	{
+		WIDTH  = 61,
+		HEIGHT = 45,
+	};
+
+	uint8_t *src    = make_smooth_pixels( WIDTH, HEIGHT );
+	uint8_t *blocks = malloc( PlGetImageSize( PL_IMAGEFORMAT_RGBA_DXT5, WIDTH, HEIGHT ) );
+	uint8_t *output = malloc( WIDTH * HEIGHT * 4 );
+
+	for ( QmImageCompressQuality quality = QM_IMAGE_COMPRESS_QUALITY_FAST; quality <= QM_IMAGE_COMPRESS_QUALITY_HIGH; ++quality )
+	{
+		// colour only for DXT1, alpha as well for DXT5
+		QM_TEST_ASSERT( qm_image_compress_pixels( src, WIDTH, HEIGHT, PL_IMAGEFORMAT_RGB_DXT1, blocks, quality, 0 ) );
+		QM_TEST_ASSERT( qm_image_decompress_blocks( PL_IMAGEFORMAT_RGB_DXT1, WIDTH, HEIGHT, blocks, output, 1 ) );
+		QM_TEST_ASSERT( get_psnr( src, output, WIDTH * HEIGHT, 3 ) >= 30.0 );
+
+		QM_TEST_ASSERT( qm_image_compress_pixels( src, WIDTH, HEIGHT, PL_IMAGEFORMAT_RGBA_DXT5, blocks, quality, 0 ) );
+		QM_TEST_ASSERT( qm_image_decompress_blocks( PL_IMAGEFORMAT_RGBA_DXT5, WIDTH, HEIGHT, blocks, output, 1 ) );
+		QM_TEST_ASSERT( get_psnr( src, output, WIDTH * HEIGHT, 4 ) >= 30.0 );
+
+		// there's no BC4 decoder of our own, so go through the reference
+		QM_TEST_ASSERT( qm_image_compress_pixels( src, WIDTH, HEIGHT, PL_IMAGEFORMAT_R_BC4, blocks, quality, 0 ) );
+		double error = 0.0;
+		for ( unsigned int y = 0; y < HEIGHT; y += 4 )
+		{
+			for ( unsigned int x = 0; x < WIDTH; x += 4 )
+			{
+				float texels[ 16 ];
+				DecompressBlockBC4( 0, 0, 4 * sizeof( float ), 0, blocks + ( ( y / 4 ) * ( ( WIDTH + 3 ) / 4 ) + x / 4 ) * 8, ( unsigned char * ) texels );
+				for ( unsigned int i = 0; i < 16; ++i )
+				{
+					if ( x + i % 4 >= WIDTH || y + i / 4 >= HEIGHT )
+					{
+						continue;
+					}
+
+					double d = texels[ i ] * 255.0 - src[ ( ( y + i / 4 ) * WIDTH + x + i % 4 ) * 4 ];
+					error += d * d;
+				}
+			}
+		}
+		QM_TEST_ASSERT( 10.0 * log10( 255.0 * 255.0 / ( error / ( WIDTH * HEIGHT ) ) ) >= 40.0 );
+	}
+
+	// punch through alpha has to survive, whatever happens to the colour;
+	// the decoder reads the last entry as black, so check the block itself
+	uint8_t pixels[ 4 * 4 * 4 ];
+	for ( unsigned int i = 0; i < 16; ++i )
+	{
+		pixels[ i * 4 ]     = ( uint8_t ) ( i * 16 );
+		pixels[ i * 4 + 1 ] = 100;
+		pixels[ i * 4 + 2 ] = 50;
+		pixels[ i * 4 + 3 ] = ( i % 3 ) ? 255 : 0;
+	}
+	QM_TEST_ASSERT( qm_image_compress_pixels( pixels, 4, 4, PL_IMAGEFORMAT_RGBA_DXT1, blocks, QM_IMAGE_COMPRESS_QUALITY_NORMAL, 1 ) );
+	QM_TEST_ASSERT( ( blocks[ 0 ] | blocks[ 1 ] << 8 ) <= ( blocks[ 2 ] | blocks[ 3 ] << 8 ) );
+	uint32_t codes = blocks[ 4 ] | blocks[ 5 ] << 8 | blocks[ 6 ] << 16 | ( uint32_t ) blocks[ 7 ] << 24;
+	for ( unsigned int i = 0; i < 16; ++i )
+	{
+		QM_TEST_ASSERT( ( ( ( codes >> ( i * 2 ) ) & 3 ) == 3 ) == ( pixels[ i * 4 + 3 ] == 0 ) );
+	}
+
+	free( src );
+	free( blocks );
+	free( output );
+
+	// and a compressed image has to come back out of a DDS as it went in
+	static const PLImageFormat formats[] = {
+	        PL_IMAGEFORMAT_RGBA_DXT5,
+	        PL_IMAGEFORMAT_RGBA_BC7,
+	};
+
+	char path[ PL_SYSTEM_MAX_PATH ];
+	snprintf( path, sizeof( path ), "%s/compressed.dds", testDirectory );
+	for ( unsigned int i = 0; i < QM_OS_ARRAY_ELEMENTS( formats ); ++i )
+	{
+		uint8_t *pixels = make_smooth_pixels( 64, 32 );
+		QmImage *image  = PlCreateImage( pixels, 64, 32, 0, PL_COLOURFORMAT_RGBA, PL_IMAGEFORMAT_RGBA8 );
+		free( pixels );
+		QM_TEST_ASSERT( image != nullptr );
+		QM_TEST_ASSERT( qm_image_compress( image, formats[ i ], QM_IMAGE_COMPRESS_QUALITY_NORMAL, 0 ) );
+		QM_TEST_ASSERT( image->format == formats[ i ] );
+		QM_TEST_ASSERT( qm_image_write( image, path, 0 ) );
+
+		QmImage *loaded = qm_image_load( path );
+		QM_TEST_ASSERT( loaded != nullptr );
+		QM_TEST_ASSERT( loaded->format == image->format && loaded->width == image->width && loaded->height == image->height );
+		QM_TEST_ASSERT( loaded->size == image->size && memcmp( loaded->data[ 0 ], image->data[ 0 ], image->size ) == 0 );
+
+		PlDestroyImage( loaded );
+		PlDestroyImage( image );
+	}
+	remove( path );
+}
+QM_TEST_FUNC_END()
+
+static QmImage *make_image( unsigned int width, unsigned int height, PLImageFormat format, uint32_t seed )
+{
+	QmImage *image = PlCreateImage( nullptr, width, height, 0, PL_COLOURFORMAT_RGBA, format );
+	if ( image == nullptr )
+	{
+		return nullptr;
+	}
+
+	for ( size_t i = 0; i < image->size; ++i )
+	{
+		image->data[ 0 ][ i ] = ( uint8_t ) ( seed != 0 ? test_random( &seed ) : 77 );
+	}
+
+	return image;
+}
+
+static double get_alpha_coverage( const uint8_t *pixels, size_t numPixels, float cutoff )
+{
+	size_t numCovered = 0;
+	for ( size_t i = 0; i < numPixels; ++i )
+	{
+		numCovered += ( pixels[ i * 4 + 3 ] >= cutoff * 255.0f );
+	}
+
+	return ( double ) numCovered / numPixels;
+}
+
+QM_TEST_FUNC( mipmaps )
+{
+	static const struct
+	{
+		unsigned int  width, height;
+		PLImageFormat format;
+		unsigned int  levels;
+	} chains[] = {
+	        {64,   48,  PL_IMAGEFORMAT_RGBA8, 7},
+	        { 33,  17,  PL_IMAGEFORMAT_RGB8,  6},
+	        { 300, 211, PL_IMAGEFORMAT_RGBA8, 9},
+	        { 1,   9,   PL_IMAGEFORMAT_R8,    4},
+	        { 1,   1,   PL_IMAGEFORMAT_RGBA8, 1},
+	};
+
+	// every level halves, rounding down, until both sides are one
+	for ( unsigned int i = 0; i < QM_OS_ARRAY_ELEMENTS( chains ); ++i )
+	{
+		QmImage *image = make_image( chains[ i ].width, chains[ i ].height, chains[ i ].format, i + 1 );
+		QM_TEST_ASSERT( image != nullptr );
+		QM_TEST_ASSERT( qm_image_generate_mipmaps( image, QM_IMAGE_MIPMAP_FILTER_BOX, 0, 0.0f, 0 ) );
+		QM_TEST_ASSERT( image->levels == chains[ i ].levels );
+		QM_TEST_ASSERT( ( ( chains[ i ].width | chains[ i ].height ) >> ( image->levels - 1 ) ) == 1 );
+		for ( unsigned int j = 0; j < image->levels; ++j )
+		{
+			QM_TEST_ASSERT( PlGetImageData( image, 0, j ) != nullptr );
+		}
+		QM_TEST_ASSERT( PlGetImageData( image, 0, image->levels ) == nullptr );
+		PlDestroyImage( image );
+	}
+
+	static const QmImageMipmapFilter filters[] = {
+	        QM_IMAGE_MIPMAP_FILTER_BOX,
+	        QM_IMAGE_MIPMAP_FILTER_KAISER,
+	        QM_IMAGE_MIPMAP_FILTER_LANCZOS,
+	};
+
+	for ( unsigned int i = 0; i < QM_OS_ARRAY_ELEMENTS( filters ); ++i )
+	{
+		// a flat image has nothing for the filter to ring on
+		QmImage *image = make_image( 33, 17, PL_IMAGEFORMAT_RGB8, 0 );
+		QM_TEST_ASSERT( image != nullptr );
+		QM_TEST_ASSERT( qm_image_generate_mipmaps( image, filters[ i ], QM_IMAGE_MIPMAP_SRGB, 0.0f, 0 ) );
+		for ( unsigned int j = 0; j < image->levels; ++j )
+		{
+			unsigned int width  = ( 33 >> j ) ? ( 33 >> j ) : 1;
+			unsigned int height = ( 17 >> j ) ? ( 17 >> j ) : 1;
+			for ( size_t k = 0; k < ( size_t ) width * height * 3; ++k )
+			{
+				QM_TEST_ASSERT( image->data[ j ][ k ] == 77 );
+			}
+		}
+		PlDestroyImage( image );
+
+		// how the rows are shared out mustn't change the result
+		QmImage *single = make_image( 300, 211, PL_IMAGEFORMAT_RGBA8, 5 );
+		QmImage *shared = make_image( 300, 211, PL_IMAGEFORMAT_RGBA8, 5 );
+		QM_TEST_ASSERT( single != nullptr && shared != nullptr );
+		QM_TEST_ASSERT( qm_image_generate_mipmaps( single, filters[ i ], QM_IMAGE_MIPMAP_SRGB, 0.5f, 1 ) );
+		QM_TEST_ASSERT( qm_image_generate_mipmaps( shared, filters[ i ], QM_IMAGE_MIPMAP_SRGB, 0.5f, 4 ) );
+		QM_TEST_ASSERT( single->levels == shared->levels );
+		for ( unsigned int j = 0; j < single->levels; ++j )
+		{
+			unsigned int width  = ( 300 >> j ) ? ( 300 >> j ) : 1;
+			unsigned int height = ( 211 >> j ) ? ( 211 >> j ) : 1;
+			QM_TEST_ASSERT( memcmp( single->data[ j ], shared->data[ j ], ( size_t ) width * height * 4 ) == 0 );
+		}
+		PlDestroyImage( single );
+		PlDestroyImage( shared );
+	}
+
+	// alpha tested foliage shouldn't thin out with distance
+	QmImage *image = make_image( 256, 256, PL_IMAGEFORMAT_RGBA8, 9 );
+	QM_TEST_ASSERT( image != nullptr );
+	double coverage = get_alpha_coverage( image->data[ 0 ], 256 * 256, 0.7f );
+	QM_TEST_ASSERT( qm_image_generate_mipmaps( image, QM_IMAGE_MIPMAP_FILTER_LANCZOS, 0, 0.7f, 0 ) );
+	// down to 8x8, past which one texel is more than the tolerance
+	for ( unsigned int i = 1; i < 6; ++i )
+	{
+		QM_TEST_ASSERT( fabs( get_alpha_coverage( image->data[ i ], ( size_t ) ( 256 >> i ) * ( 256 >> i ), 0.7f ) - coverage ) < 0.05 );
+	}
+	PlDestroyImage( image );
+}
+QM_TEST_FUNC_END()
+
+static bool check_pixels( const QmImage *image, const uint8_t *pixels, unsigned int width, unsigned int height )
+{
+	if ( image == nullptr || image->width != width || image->height != height || image->format != PL_IMAGEFORMAT_RGBA8 )
+	{
+		return false;
+	}
+
+	return memcmp( image->data[ 0 ], pixels, ( size_t ) width * height * 4 ) == 0;
+}
+
+QM_TEST_FUNC( load )
+{
+	enum
+	{
+		WIDTH  = 37,
+		HEIGHT = 23,
+	};
+
+	// bmp is written out as 24 bit, with alpha blended into the colour
+	static const struct
+	{
+		const char *extension;
+		bool        hasAlpha;
+	} formats[] = {
+	        {"png",  true },
+	        { "tga", true },
+	        { "qoi", true },
+	        { "bmp", false},
+	};
+
+	uint8_t *pixels = make_pixels( WIDTH, HEIGHT, 11 );
+	uint8_t *opaque = make_pixels( WIDTH, HEIGHT, 11 );
+	for ( unsigned int i = 0; i < WIDTH * HEIGHT; ++i )
+	{
+		opaque[ i * 4 + 3 ] = 255;
+	}
+
+	for ( unsigned int i = 0; i < QM_OS_ARRAY_ELEMENTS( formats ); ++i )
+	{
+		const uint8_t *expected = formats[ i ].hasAlpha ? pixels : opaque;
+		QmImage       *source   = PlCreateImage( expected, WIDTH, HEIGHT, 0, PL_COLOURFORMAT_RGBA, PL_IMAGEFORMAT_RGBA8 );
+		QM_TEST_ASSERT( source != nullptr );
+
+		char path[ PL_SYSTEM_MAX_PATH ];
+		snprintf( path, sizeof( path ), "%s/load.%s", testDirectory, formats[ i ].extension );
+		QM_TEST_ASSERT( qm_image_write( source, path, 0 ) );
+		PlDestroyImage( source );
+
+		// mapped, which is how a load by path goes
+		QmImage *image = qm_image_load( path );
+		QM_TEST_ASSERT( check_pixels( image, expected, WIDTH, HEIGHT ) );
+		PlDestroyImage( image );
+
+		// read through the file as it goes
+		QmFsFile *file = qm_fs_file_open( path, false );
+		QM_TEST_ASSERT( file != nullptr );
+		image = qm_image_parse( file );
+		PlCloseFile( file );
+		QM_TEST_ASSERT( check_pixels( image, expected, WIDTH, HEIGHT ) );
+		PlDestroyImage( image );
+
+		// and from a buffer somebody else owns
+		file = qm_fs_file_open( path, true );
+		QM_TEST_ASSERT( file != nullptr );
+		size_t   size = qm_fs_file_get_size( file );
+		uint8_t *data = malloc( size );
+		QM_TEST_ASSERT( qm_fs_file_read_at( file, data, size, 0 ) == size );
+		PlCloseFile( file );
+
+		file = qm_fs_file_from_memory( path, data, size, QM_FS_FILE_OWNERSHIP_TYPE_UNMANAGED );
+		QM_TEST_ASSERT( file != nullptr );
+		image = qm_image_parse( file );
+		PlCloseFile( file );
+		free( data );
+		QM_TEST_ASSERT( check_pixels( image, expected, WIDTH, HEIGHT ) );
+		PlDestroyImage( image );
+
+		remove( path );
+	}
+
+	free( pixels );
+	free( opaque );
+}
+QM_TEST_FUNC_END()
+
+int main( int argc, char **argv )
+{
+	if ( mkdtemp( testDirectory ) == nullptr )
+	{
+		return EXIT_FAILURE;
+	}
+
+	PlInitialize( argc, argv );
+	PlRegisterStandardImageLoaders( PL_IMAGE_FILEFORMAT_ALL );
+
+	TEST_RUN_INIT
+	CALL_FUNC_TEST( s3tc )
+	CALL_FUNC_TEST( convert )
+	CALL_FUNC_TEST( compress )
+	CALL_FUNC_TEST( mipmaps )
+	CALL_FUNC_TEST( load )
+	PlShutdown();
+	rmdir( testDirectory );
+	TEST_RUN_END
+}
@@ -0,0 +1,604 @@
+// SPDX-License-Identifier: MIT
+// Hei Platform Library
+// Copyright © 2017-2026 Quartermind Games, Mark E. Sowden <markelswo@gmail.com>
+// Purpose: Tests for the package API.
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include <plcore/pl.h>
+#include <plcore/pl_package.h>
+
+#include "qmtest/public/qm_test.h"
+
+static char testDirectory[] = "/tmp/pl_package_XXXXXX";
+
+static void count_callback( const QmFsPackage *, unsigned int, void *userData )
+{
+	( *( unsigned int * ) userData )++;
+}
+
+/**
+ * Writes out a Duke Nukem 3D GRP holding the given names,
+ * each with a single byte of data.
+ */
+static bool write_grp( const char *path, const char **names, unsigned int numNames )
+{
+	FILE *file = fopen( path, "wb" );
+	if ( file == nullptr )
+	{
+		return false;
+	}
+
+	fwrite( "KenSilverman", 1, 12, file );
+	uint32_t count = numNames;
+	fwrite( &count, sizeof( count ), 1, file );
+	for ( unsigned int i = 0; i < numNames; ++i )
+	{
+		char name[ 12 ] = {};
+		strncpy( name, names[ i ], sizeof( name ) );
+		fwrite( name, 1, sizeof( name ), file );
+		uint32_t size = 1;
+		fwrite( &size, sizeof( size ), 1, file );
+	}
+	for ( unsigned int i = 0; i < numNames; ++i )
+	{
+		fputc( 'A' + ( int ) i, file );
+	}
+
+	fclose( file );
+	return true;
+}
+
+QM_TEST_FUNC( lookup )
+{
+	static const char *names[] = { "MAPS/E1L1.MAP", "MAPS/E1L2.MAP", "TILES000.ART", "GAME.CON" };
+
+	char path[ 64 ];
+	snprintf( path, sizeof( path ), "%s/test.grp", testDirectory );
+	QM_TEST_ASSERT( write_grp( path, names, QM_OS_ARRAY_ELEMENTS( names ) ) );
+
+	QmFsPackage *package = PlLoadPackage( path );
+	QM_TEST_ASSERT( package != nullptr );
+
+	// exact unless asked otherwise
+	QM_TEST_ASSERT( PlGetPackageTableIndex( package, "GAME.CON" ) == 3 );
+	QM_TEST_ASSERT( PlGetPackageTableIndex( package, "game.con" ) == -1 );
+
+	unsigned int numVisited = 0;
+	QM_TEST_ASSERT( PlEnumeratePackageFiles( package, "MAPS/", count_callback, &numVisited ) == 2 && numVisited == 2 );
+	QM_TEST_ASSERT( PlEnumeratePackageFiles( package, "maps/", count_callback, &numVisited ) == 0 );
+
+	PlSetPackageCaseInsensitive( package, true );
+	QM_TEST_ASSERT( PlGetPackageTableIndex( package, "game.con" ) == 3 );
+	QM_TEST_ASSERT( PlGetPackageTableIndex( package, "Tiles000.art" ) == 2 );
+	QM_TEST_ASSERT( PlEnumeratePackageFiles( package, "maps/e1", count_callback, &numVisited ) == 2 );
+	QM_TEST_ASSERT( PlEnumeratePackageFiles( package, "", count_callback, &numVisited ) == 4 );
+
+	PlSetPackageCaseInsensitive( package, false );
+	QM_TEST_ASSERT( PlGetPackageTableIndex( package, "game.con" ) == -1 );
+
+	// and again without an index, which falls back to a linear search
+	QmFsPackage *handle = PlCreatePackageHandle( path, 2, nullptr );
+	snprintf( handle->files[ 0 ].name, sizeof( handle->files[ 0 ].name ), "Sounds/Boom.wav" );
+	snprintf( handle->files[ 1 ].name, sizeof( handle->files[ 1 ].name ), "sounds/click.wav" );
+	QM_TEST_ASSERT( PlGetPackageTableIndex( handle, "sounds/boom.wav" ) == -1 );
+	QM_TEST_ASSERT( PlEnumeratePackageFiles( handle, "sounds/", count_callback, &numVisited ) == 1 );
+	handle->internal.caseInsensitive = true;
+	QM_TEST_ASSERT( PlGetPackageTableIndex( handle, "sounds/boom.wav" ) == 0 );
+	QM_TEST_ASSERT( PlEnumeratePackageFiles( handle, "SOUNDS/", count_callback, &numVisited ) == 2 );
+
+	PlDestroyPackage( handle );
+	PlDestroyPackage( package );
+	remove( path );
+}
+QM_TEST_FUNC_END()
+
+static void put_u16( uint8_t *p, uint16_t v )
+{
+	p[ 0 ] = ( uint8_t ) v;
+	p[ 1 ] = ( uint8_t ) ( v >> 8 );
+}
+
+static void put_u32( uint8_t *p, uint32_t v )
+{
+	put_u16( p, ( uint16_t ) v );
+	put_u16( p + 2, ( uint16_t ) ( v >> 16 ) );
+}
+
+typedef struct RawZipEntry
+{
+	const char    *name;
+	uint16_t       method;
+	const uint8_t *data;
+	uint32_t       dataSize;
+	uint32_t       size;
+	uint32_t       crc;
+} RawZipEntry;
+
+/**
+ * Writes out a zip by hand, for what the writer won't produce.
+ */
+static bool write_raw_zip( const char *path, const RawZipEntry *entries, unsigned int numEntries )
+{
+	FILE *file = fopen( path, "wb" );
+	if ( file == nullptr )
+	{
+		return false;
+	}
+
+	// local headers, then the central directory and end record
+	uint8_t  header[ 46 ];
+	uint32_t offset = 0;
+	for ( unsigned int i = 0; i < numEntries; ++i )
+	{
+		memset( header, 0, sizeof( header ) );
+		put_u32( header, 0x04034B50 );
+		put_u16( header + 4, 20 );
+		put_u16( header + 8, entries[ i ].method );
+		put_u32( header + 14, entries[ i ].crc );
+		put_u32( header + 18, entries[ i ].dataSize );
+		put_u32( header + 22, entries[ i ].size );
+		put_u16( header + 26, ( uint16_t ) strlen( entries[ i ].name ) );
+		fwrite( header, 1, 30, file );
+		fwrite( entries[ i ].name, 1, strlen( entries[ i ].name ), file );
+		fwrite( entries[ i ].data, 1, entries[ i ].dataSize, file );
+	}
+
+	uint32_t directoryOffset = ( uint32_t ) ftell( file );
+	for ( unsigned int i = 0; i < numEntries; ++i )
+	{
+		memset( header, 0, sizeof( header ) );
+		put_u32( header, 0x02014B50 );
+		put_u16( header + 4, 20 );
+		put_u16( header + 6, 20 );
+		put_u16( header + 10, entries[ i ].method );
+		put_u32( header + 16, entries[ i ].crc );
+		put_u32( header + 20, entries[ i ].dataSize );
+		put_u32( header + 24, entries[ i ].size );
+		put_u16( header + 28, ( uint16_t ) strlen( entries[ i ].name ) );
+		put_u32( header + 42, offset );
+		fwrite( header, 1, 46, file );
+		fwrite( entries[ i ].name, 1, strlen( entries[ i ].name ), file );
+		offset += 30 + ( uint32_t ) strlen( entries[ i ].name ) + entries[ i ].dataSize;
+	}
+
+	uint32_t directorySize = ( uint32_t ) ftell( file ) - directoryOffset;
+	memset( header, 0, sizeof( header ) );
+	put_u32( header, 0x06054B50 );
+	put_u16( header + 8, ( uint16_t ) numEntries );
+	put_u16( header + 10, ( uint16_t ) numEntries );
+	put_u32( header + 12, directorySize );
+	put_u32( header + 16, directoryOffset );
+	fwrite( header, 1, 22, file );
+
+	fclose( file );
+	return true;
+}
+
+QM_TEST_FUNC( zip_directories )
+{
+	static const RawZipEntry entries[] = {
+	        { .name = "maps/" },
+	        { .name = "sounds/" },
+	};
+
+	char path[ 64 ];
+	snprintf( path, sizeof( path ), "%s/directories.zip", testDirectory );
+	QM_TEST_ASSERT( write_raw_zip( path, entries, QM_OS_ARRAY_ELEMENTS( entries ) ) );
+
+	// nothing in it, but nothing wrong with it either
+	QmFsPackage *package = PlLoadPackage( path );
+	QM_TEST_ASSERT( package != nullptr );
+	QM_TEST_ASSERT( PlGetPackageTableSize( package ) == 0 );
+	QM_TEST_ASSERT( PlGetPackageTableIndex( package, "maps/" ) == -1 );
+
+	PlDestroyPackage( package );
+	remove( path );
+}
+QM_TEST_FUNC_END()
+
+static bool write_text( const char *path, char c, size_t size )
+{
+	FILE *file = fopen( path, "wb" );
+	if ( file == nullptr )
+	{
+		return false;
+	}
+
+	for ( size_t i = 0; i < size; ++i )
+	{
+		fputc( c, file );
+	}
+
+	fclose( file );
+	return true;
+}
+
+/**
+ * Writes a zip holding one.txt and two.txt, deflated,
+ * filled with the given characters.
+ */
+static bool write_zip( const char *path, char one, char two )
+{
+	char sources[ 2 ][ 64 ];
+	snprintf( sources[ 0 ], sizeof( sources[ 0 ] ), "%s/one.txt", testDirectory );
+	snprintf( sources[ 1 ], sizeof( sources[ 1 ] ), "%s/two.txt", testDirectory );
+	if ( !write_text( sources[ 0 ], one, 1000 ) || !write_text( sources[ 1 ], two, 1000 ) )
+	{
+		return false;
+	}
+
+	QmFsPackage *package = PlCreatePackageHandle( "", 0, nullptr );
+	PlAppendPackageFromFile( package, sources[ 0 ], "one.txt", PL_COMPRESSION_DEFLATE );
+	PlAppendPackageFromFile( package, sources[ 1 ], "two.txt", PL_COMPRESSION_DEFLATE );
+	bool status = PlWritePackage( package, path, PL_PACKAGE_FORMAT_TAG_ZIP );
+	PlDestroyPackage( package );
+
+	remove( sources[ 0 ] );
+	remove( sources[ 1 ] );
+	return status;
+}
+
+/**
+ * Returns the first byte of the entry, or 0 on failure.
+ */
+static char load_entry( QmFsPackage *package, const char *name )
+{
+	QmFsFile *file = PlLoadPackageFile( package, name );
+	if ( file == nullptr )
+	{
+		return 0;
+	}
+
+	char c = 0;
+	if ( qm_fs_file_get_size( file ) != 1000 || qm_file_read( file, &c, 1, 1 ) != 1 )
+	{
+		c = 0;
+	}
+
+	PlCloseFile( file );
+	return c;
+}
+
+QM_TEST_FUNC( cache )
+{
+	char path[ 64 ];
+	snprintf( path, sizeof( path ), "%s/cache.zip", testDirectory );
+	QM_TEST_ASSERT( write_zip( path, 'A', 'B' ) );
+
+	PlClearPackageCache();
+	PlSetPackageCacheBudget( 2500 );
+
+	PLPackageCacheStats base = PlGetPackageCacheStats();
+
+	QmFsPackage *package = PlLoadPackage( path );
+	QM_TEST_ASSERT( package != nullptr );
+	QM_TEST_ASSERT( load_entry( package, "one.txt" ) == 'A' );
+	QM_TEST_ASSERT( load_entry( package, "one.txt" ) == 'A' );
+	QM_TEST_ASSERT( load_entry( package, "two.txt" ) == 'B' );
+
+	PLPackageCacheStats stats = PlGetPackageCacheStats();
+	QM_TEST_ASSERT( stats.misses - base.misses == 2 && stats.hits - base.hits == 1 );
+	QM_TEST_ASSERT( stats.numEntries == 2 && stats.numBytes == 2000 );
+
+	// one.txt was used least recently, so goes first
+	PlSetPackageCacheBudget( 1500 );
+	stats = PlGetPackageCacheStats();
+	QM_TEST_ASSERT( stats.evictions - base.evictions == 1 && stats.numEntries == 1 );
+	QM_TEST_ASSERT( load_entry( package, "two.txt" ) == 'B' );
+	QM_TEST_ASSERT( PlGetPackageCacheStats().hits - base.hits == 2 );
+
+	PlSetPackageCacheBudget( 2500 );
+	QM_TEST_ASSERT( load_entry( package, "one.txt" ) == 'A' );
+
+	// replaced at the same path and time, so only the handle tells them apart
+	struct stat attributes;
+	QM_TEST_ASSERT( stat( path, &attributes ) == 0 );
+	QM_TEST_ASSERT( write_zip( path, 'C', 'D' ) );
+	struct utimbuf times = { .actime = attributes.st_atime, .modtime = attributes.st_mtime };
+	QM_TEST_ASSERT( utime( path, &times ) == 0 );
+
+	QmFsPackage *replaced = PlLoadPackage( path );
+	QM_TEST_ASSERT( replaced != nullptr );
+	QM_TEST_ASSERT( load_entry( replaced, "one.txt" ) == 'C' );
+
+	// and whatever's left of the first goes with it
+	PlDestroyPackage( package );
+	QM_TEST_ASSERT( PlGetPackageCacheStats().numEntries == 1 );
+	PlDestroyPackage( replaced );
+	QM_TEST_ASSERT( PlGetPackageCacheStats().numEntries == 0 );
+
+	PlSetPackageCacheBudget( 64U * 1024U * 1024U );
+	remove( path );
+}
+QM_TEST_FUNC_END()
+
+QM_TEST_FUNC( write )
+{
+	static const char *formats[] = { PL_PACKAGE_FORMAT_TAG_ZIP, PL_PACKAGE_FORMAT_TAG_PAK_QUAKE };
+
+	char source[ 64 ], missing[ 64 ];
+	snprintf( source, sizeof( source ), "%s/source.txt", testDirectory );
+	snprintf( missing, sizeof( missing ), "%s/missing.txt", testDirectory );
+	QM_TEST_ASSERT( write_text( source, 'E', 1000 ) );
+
+	for ( unsigned int i = 0; i < QM_OS_ARRAY_ELEMENTS( formats ); ++i )
+	{
+		char path[ 64 ], tmpPath[ 64 ];
+		snprintf( path, sizeof( path ), "%s/write.%s", testDirectory, formats[ i ] );
+		snprintf( tmpPath, sizeof( tmpPath ), "%s.tmp", path );
+
+		QmFsPackage *package = PlCreatePackageHandle( "", 0, nullptr );
+		PlAppendPackageFromFile( package, source, "stored.txt", PL_COMPRESSION_NONE );
+		PlAppendPackageFromFile( package, source, "deflated.txt", PL_COMPRESSION_DEFLATE );
+		QM_TEST_ASSERT( PlWritePackage( package, path, formats[ i ] ) );
+		QM_TEST_ASSERT( !qm_fs_check_file_exists( tmpPath ) );
+
+		QmFsPackage *written = PlLoadPackage( path );
+		QM_TEST_ASSERT( written != nullptr && PlGetPackageTableSize( written ) == 2 );
+		QM_TEST_ASSERT( load_entry( written, "stored.txt" ) == 'E' );
+		QM_TEST_ASSERT( load_entry( written, "deflated.txt" ) == 'E' );
+		PlDestroyPackage( written );
+
+		// a source that's gone missing fails the write, leaving what was there alone
+		size_t size = qm_fs_get_local_file_size( path );
+		PlAppendPackageFromFile( package, missing, "missing.txt", PL_COMPRESSION_NONE );
+		QM_TEST_ASSERT( !PlWritePackage( package, path, formats[ i ] ) );
+		QM_TEST_ASSERT( !qm_fs_check_file_exists( tmpPath ) );
+		QM_TEST_ASSERT( qm_fs_get_local_file_size( path ) == size );
+
+		PlDestroyPackage( package );
+		remove( path );
+	}
+
+	remove( source );
+}
+QM_TEST_FUNC_END()
+
+/**
+ * Reads the entry through a stream, in awkwardly sized chunks,
+ * and compares it against the same entry loaded in one go.
+ */
+static bool compare_stream( QmFsPackage *package, const char *name, size_t expectedSize )
+{
+	QmFsFile *whole  = PlLoadPackageFile( package, name );
+	QmFsFile *stream = PlStreamPackageFile( package, name );
+	bool      status = ( whole != nullptr && stream != nullptr && qm_fs_file_get_size( whole ) == expectedSize );
+
+	uint8_t *expected = malloc( expectedSize + 1 );
+	if ( status )
+	{
+		status = ( qm_file_read( whole, expected, 1, expectedSize ) == expectedSize );
+	}
+
+	size_t numRead = 0;
+	while ( status )
+	{
+		uint8_t chunk[ 777 ];
+		size_t  size = qm_file_read( stream, chunk, 1, sizeof( chunk ) );
+		if ( size == 0 )
+		{
+			break;
+		}
+
+		status  = ( numRead + size <= expectedSize && memcmp( chunk, expected + numRead, size ) == 0 );
+		numRead += size;
+	}
+
+	free( expected );
+	PlCloseFile( stream );
+	PlCloseFile( whole );
+
+	return status && numRead == expectedSize;
+}
+
+QM_TEST_FUNC( stream )
+{
+	// a PKWARE DCL stream, with coded literals and a 4K dictionary
+	static const uint8_t imploded[] = {
+	        0x01, 0x06, 0x80, 0xC2, 0x01, 0x64, 0xE2, 0x88, 0x07, 0x7F, 0x0A, 0x40,
+	        0x9C, 0x2A, 0xE9, 0x17, 0x8B, 0x43, 0x34, 0x87, 0x89, 0x94, 0x44, 0xCC,
+	        0x3F, 0xC0, 0x15, 0xE0, 0xDF, 0x55, 0x88, 0xFA, 0xD6, 0xEB, 0x19, 0x8B,
+	        0x8E, 0x68, 0x5D, 0x20, 0x79, 0x5D, 0x08, 0x04, 0x9A, 0x9B, 0x13, 0xD1,
+	        0x49, 0x41, 0x62, 0xB6, 0xC4, 0x09, 0x83, 0x2A, 0xA6, 0x36, 0x16, 0x9A,
+	        0x18, 0x88, 0x38, 0x1A, 0x08, 0x94, 0xA1, 0x69, 0x2B, 0x61, 0x20, 0x21,
+	        0xEA, 0x7A, 0x53, 0x78, 0xE2, 0x2F, 0x44, 0x65, 0x3D, 0x00, 0x91, 0x8B,
+	        0x06, 0x02, 0x6D, 0x36, 0xA2, 0x71, 0x26, 0xAC, 0x24, 0xC0, 0xDF, 0x2A,
+	        0x03, 0x81, 0x4C, 0x3C, 0x10, 0x98, 0x85, 0xD3, 0xE5, 0x04, 0xC2, 0x8A,
+	        0xC8, 0xDD, 0x03, 0x10, 0x95, 0x78, 0xBC, 0x22, 0xC0, 0x1F, 0x47, 0x0F,
+	        0xE5, 0x4E, 0xD4, 0x01, 0x74, 0x80, 0x7C, 0xB1, 0xE7, 0x00, 0x44, 0xEC,
+	        0x15, 0xE0, 0xAF, 0xF6, 0x07, 0x8E, 0x23, 0x26, 0xC9, 0xBB, 0x03, 0xF6,
+	        0x5F, 0x2B, 0x43, 0x14, 0x25, 0x04, 0x20, 0xBA, 0x7C, 0x20, 0x30, 0xDF,
+	        0x87, 0xE7, 0xEF, 0x3E, 0x43, 0xDF, 0x43, 0x14, 0xCE, 0x0D, 0x40, 0x04,
+	        0xC7, 0x02, 0xFC, 0x1D, 0x37, 0xC0, 0x3F, 0xD3, 0x03, 0x34, 0x0A, 0x02,
+	        0x10, 0xE9, 0x6F, 0x88, 0x12, 0xC5, 0x84, 0xD8, 0x86, 0x28, 0x38, 0x99,
+	        0xC0, 0xD9, 0x11, 0x79, 0x5A, 0x82, 0xA3, 0x85, 0x28, 0xF7, 0x0E, 0x40,
+	        0x44, 0xE7, 0xF7, 0x9A, 0x88, 0x62, 0x1A, 0x80, 0x48, 0x71, 0x02, 0x81,
+	        0xF0, 0x7D, 0xC0, 0x3F,
+	};
+
+	static const RawZipEntry entries[] = {
+	        { .name = "imploded.bin", .method = 6, .data = imploded, .dataSize = sizeof( imploded ), .size = 9062, .crc = 0x89319764 },
+	};
+
+	char path[ 64 ];
+	snprintf( path, sizeof( path ), "%s/imploded.zip", testDirectory );
+	QM_TEST_ASSERT( write_raw_zip( path, entries, QM_OS_ARRAY_ELEMENTS( entries ) ) );
+
+	QmFsPackage *package = PlLoadPackage( path );
+	QM_TEST_ASSERT( package != nullptr );
+	QM_TEST_ASSERT( compare_stream( package, "imploded.bin", 9062 ) );
+	PlDestroyPackage( package );
+	remove( path );
+
+	// large enough that neither fits in a single read
+	char source[ 64 ];
+	snprintf( source, sizeof( source ), "%s/source.bin", testDirectory );
+	FILE *file = fopen( source, "wb" );
+	QM_TEST_ASSERT( file != nullptr );
+	uint32_t seed = 1;
+	for ( unsigned int i = 0; i < 300000; ++i )
+	{
+		seed = seed * 1664525u + 1013904223u;
+		fputc( "heiplatform"[ ( seed >> 16 ) % 11 ], file );
+	}
+	fclose( file );
+
+	snprintf( path, sizeof( path ), "%s/stream.zip", testDirectory );
+	package = PlCreatePackageHandle( "", 0, nullptr );
+	PlAppendPackageFromFile( package, source, "stored.bin", PL_COMPRESSION_NONE );
+	PlAppendPackageFromFile( package, source, "deflated.bin", PL_COMPRESSION_DEFLATE );
+	QM_TEST_ASSERT( PlWritePackage( package, path, PL_PACKAGE_FORMAT_TAG_ZIP ) );
+	PlDestroyPackage( package );
+
+	package = PlLoadPackage( path );
+	QM_TEST_ASSERT( package != nullptr );
+	const QmFsPackageFile *deflated = &package->files[ PlGetPackageTableIndex( package, "deflated.bin" ) ];
+	QM_TEST_ASSERT( deflated->compressionType != PL_COMPRESSION_NONE && deflated->compressedSize < deflated->size );
+	QM_TEST_ASSERT( compare_stream( package, "stored.bin", 300000 ) );
+	QM_TEST_ASSERT( compare_stream( package, "deflated.bin", 300000 ) );
+	PlDestroyPackage( package );
+
+	remove( path );
+	remove( source );
+}
+QM_TEST_FUNC_END()
+
+QM_TEST_FUNC( zip64 )
+{
+	// enough entries that the count no longer fits the classic end record
+	static const unsigned int numEntries = 65540;
+
+	char sources[ 4 ][ 64 ];
+	for ( unsigned int i = 0; i < 4; ++i )
+	{
+		snprintf( sources[ i ], sizeof( sources[ i ] ), "%s/source%u.txt", testDirectory, i );
+		QM_TEST_ASSERT( write_text( sources[ i ], ( char ) ( 'A' + i ), 1000 ) );
+	}
+
+	QmFsPackage *package = PlCreatePackageHandle( "", 0, nullptr );
+	for ( unsigned int i = 0; i < numEntries; ++i )
+	{
+		char name[ 32 ];
+		snprintf( name, sizeof( name ), "%05u.txt", i );
+		PlAppendPackageFromFile( package, sources[ i % 4 ], name, ( i & 1 ) ? PL_COMPRESSION_DEFLATE : PL_COMPRESSION_NONE );
+	}
+
+	char path[ 64 ];
+	snprintf( path, sizeof( path ), "%s/zip64.zip", testDirectory );
+	QM_TEST_ASSERT( PlWritePackage( package, path, PL_PACKAGE_FORMAT_TAG_ZIP ) );
+	PlDestroyPackage( package );
+
+	package = PlLoadPackage( path );
+	QM_TEST_ASSERT( package != nullptr && PlGetPackageTableSize( package ) == numEntries );
+
+	// offsets point at the local headers, flagged in the top bit, until first used
+	int index = PlGetPackageTableIndex( package, "65539.txt" );
+	QM_TEST_ASSERT( index == 65539 && ( package->files[ index ].offset >> 63 ) != 0 );
+	QM_TEST_ASSERT( load_entry( package, "65539.txt" ) == 'D' );
+	QM_TEST_ASSERT( ( package->files[ index ].offset >> 63 ) == 0 );
+	QM_TEST_ASSERT( load_entry( package, "00000.txt" ) == 'A' );
+	QM_TEST_ASSERT( load_entry( package, "32770.txt" ) == 'C' );
+
+	PlDestroyPackage( package );
+	remove( path );
+	for ( unsigned int i = 0; i < 4; ++i )
+	{
+		remove( sources[ i ] );
+	}
+}
+QM_TEST_FUNC_END()
+
+static unsigned int count_directory( const char *path )
+{
+	DIR *directory = opendir( path );
+	if ( directory == nullptr )
+	{
+		return 0;
+	}
+
+	unsigned int   numEntries = 0;
+	struct dirent *entry;
+	while ( ( entry = readdir( directory ) ) != nullptr )
+	{
+		if ( *entry->d_name != '.' )
+		{
+			numEntries++;
+		}
+	}
+
+	closedir( directory );
+	return numEntries;
+}
+
+QM_TEST_FUNC( snapshot )
+{
+	char directory[ 64 ];
+	snprintf( directory, sizeof( directory ), "%s/snapshots", testDirectory );
+	QM_TEST_ASSERT( PlCreateDirectory( directory ) );
+	PlSetPackageSnapshotDirectory( directory );
+
+	char path[ 64 ];
+	snprintf( path, sizeof( path ), "%s/snapshot.zip", testDirectory );
+	QM_TEST_ASSERT( write_zip( path, 'A', 'B' ) );
+
+	// parsed the first time round, and pulled from the snapshot after
+	QmFsPackage *parsed = PlLoadPackage( path );
+	QM_TEST_ASSERT( parsed != nullptr );
+	QM_TEST_ASSERT( count_directory( directory ) == 1 );
+	QmFsPackage *restored = PlLoadPackage( path );
+	QM_TEST_ASSERT( restored != nullptr );
+
+	QM_TEST_ASSERT( PlGetPackageTableSize( parsed ) == PlGetPackageTableSize( restored ) );
+	for ( unsigned int i = 0; i < PlGetPackageTableSize( parsed ); ++i )
+	{
+		const QmFsPackageFile *a = &parsed->files[ i ];
+		const QmFsPackageFile *b = &restored->files[ i ];
+		QM_TEST_ASSERT( strcmp( a->name, b->name ) == 0 );
+		QM_TEST_ASSERT( a->offset == b->offset && a->size == b->size && a->compressedSize == b->compressedSize );
+		QM_TEST_ASSERT( a->compressionType == b->compressionType );
+		QM_TEST_ASSERT( PlGetPackageTableIndex( restored, a->name ) == ( int ) i );
+	}
+
+	QM_TEST_ASSERT( load_entry( restored, "one.txt" ) == 'A' );
+	QM_TEST_ASSERT( load_entry( restored, "two.txt" ) == 'B' );
+
+	PlDestroyPackage( restored );
+	PlDestroyPackage( parsed );
+
+	PlDeletePackageSnapshot( path );
+	QM_TEST_ASSERT( count_directory( directory ) == 0 );
+
+	PlSetPackageSnapshotDirectory( "" );
+	rmdir( directory );
+	remove( path );
+}
+QM_TEST_FUNC_END()
+
+int main( int argc, char **argv )
+{
+	if ( mkdtemp( testDirectory ) == nullptr )
+	{
+		return EXIT_FAILURE;
+	}
+
+	PlInitialize( argc, argv );
+	PlRegisterStandardPackageLoaders( PL_PACKAGE_LOAD_FORMAT_ALL );
+	PlRegisterStandardPackageWriters( PL_PACKAGE_WRITE_FORMAT_ALL );
+
+	TEST_RUN_INIT
+	CALL_FUNC_TEST( lookup )
+	CALL_FUNC_TEST( zip_directories )
+	CALL_FUNC_TEST( zip64 )
+	CALL_FUNC_TEST( cache )
+	CALL_FUNC_TEST( write )
+	CALL_FUNC_TEST( stream )
+	CALL_FUNC_TEST( snapshot )
+	PlShutdown();
+	rmdir( testDirectory );
+	TEST_RUN_END
+}
@@ -581,6 +581,13 @@ static unsigned int xgl_translate_image_format( PLImageFormat format )
 
 		case PL_IMAGEFORMAT_RGB_FXT1:
 			return GL_COMPRESSED_RGB_FXT1_3DFX;
+
+		case PL_IMAGEFORMAT_R_BC4:
+			return GL_COMPRESSED_RED_RGTC1;
+		case PL_IMAGEFORMAT_RG_BC5:
+			return GL_COMPRESSED_RG_RGTC2;
+		case PL_IMAGEFORMAT_RGBA_BC7:
+			return GL_COMPRESSED_RGBA_BPTC_UNORM;
 	}
 }
 
@@ -626,6 +633,12 @@ static unsigned int xgl_get_storage_format_for_image_format( PLImageFormat forma
 			return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
 		case PL_IMAGEFORMAT_RGB_FXT1:
 			return GL_COMPRESSED_RGB_FXT1_3DFX;
+		case PL_IMAGEFORMAT_R_BC4:
+			return GL_COMPRESSED_RED_RGTC1;
+		case PL_IMAGEFORMAT_RG_BC5:
+			return GL_COMPRESSED_RG_RGTC2;
+		case PL_IMAGEFORMAT_RGBA_BC7:
+			return GL_COMPRESSED_RGBA_BPTC_UNORM;
 	}
 }
 
@@ -707,6 +720,9 @@ static bool xgl_is_compressed_image_format( PLImageFormat format )
 		case PL_IMAGEFORMAT_RGBA_DXT5:
 		case PL_IMAGEFORMAT_RGB_DXT1:
 		case PL_IMAGEFORMAT_RGB_FXT1:
+		case PL_IMAGEFORMAT_R_BC4:
+		case PL_IMAGEFORMAT_RG_BC5:
+		case PL_IMAGEFORMAT_RGBA_BC7:
 			return true;
 	}
 }
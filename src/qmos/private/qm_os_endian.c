@@ -0,0 +1,255 @@
+// Copyright © 2017-2026 Quartermind Games, Mark E. Sowden <markelswo@gmail.com>
+// Purpose: Bulk byte-swapping.
+// Author:  Mark E. Sowden
+
+#include <string.h>
+
+#include "qmos/public/qm_os_endian.h"
+
+#if QM_OS_HARDWARE_CPU == QM_OS_HARDWARE_CPU_X64 || defined( __SSE2__ )
+#	include <emmintrin.h>
+#	define QM_OS_ENDIAN_SSE2
+// avx2 is picked at runtime, so it doesn't need to be enabled for the whole build
+#	if defined( __GNUC__ ) && !defined( _MSC_VER )
+#		include <immintrin.h>
+#		define QM_OS_ENDIAN_AVX2
+#	endif
+#elif QM_OS_HARDWARE_CPU == QM_OS_HARDWARE_CPU_ARM64 || defined( __ARM_NEON )
+#	include <arm_neon.h>
+#	define QM_OS_ENDIAN_NEON
+#endif
+
+#if defined( _MSC_VER )
+#	include <stdlib.h>
+#	define BSWAP16( A ) _byteswap_ushort( A )
+#	define BSWAP32( A ) _byteswap_ulong( A )
+#	define BSWAP64( A ) _byteswap_uint64( A )
+#else
+#	define BSWAP16( A ) __builtin_bswap16( A )
+#	define BSWAP32( A ) __builtin_bswap32( A )
+#	define BSWAP64( A ) __builtin_bswap64( A )
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Scalar
+/////////////////////////////////////////////////////////////////////////////////////
+
+// memcpy is used for loads/stores, as the arrays aren't guaranteed to be aligned
+
+static void swap16_scalar( uint8_t *data, size_t count )
+{
+	for ( size_t i = 0; i < count; ++i, data += sizeof( uint16_t ) )
+	{
+		uint16_t v;
+		memcpy( &v, data, sizeof( v ) );
+		v = BSWAP16( v );
+		memcpy( data, &v, sizeof( v ) );
+	}
+}
+
+static void swap32_scalar( uint8_t *data, size_t count )
+{
+	for ( size_t i = 0; i < count; ++i, data += sizeof( uint32_t ) )
+	{
+		uint32_t v;
+		memcpy( &v, data, sizeof( v ) );
+		v = BSWAP32( v );
+		memcpy( data, &v, sizeof( v ) );
+	}
+}
+
+static void swap64_scalar( uint8_t *data, size_t count )
+{
+	for ( size_t i = 0; i < count; ++i, data += sizeof( uint64_t ) )
+	{
+		uint64_t v;
+		memcpy( &v, data, sizeof( v ) );
+		v = BSWAP64( v );
+		memcpy( data, &v, sizeof( v ) );
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// AVX2
+/////////////////////////////////////////////////////////////////////////////////////
+
+#if defined( QM_OS_ENDIAN_AVX2 )
+
+static bool has_avx2( void )
+{
+	static int supported = -1;
+	if ( supported < 0 )
+	{
+		__builtin_cpu_init();
+		supported = __builtin_cpu_supports( "avx2" ) ? 1 : 0;
+	}
+
+	return supported;
+}
+
+/**
+ * Swaps 32 bytes at a time using the given shuffle,
+ * returning how many bytes were processed.
+ */
+__attribute__( ( target( "avx2" ) ) ) static size_t swap_avx2( uint8_t *data, size_t size, const uint8_t *order )
+{
+	__m128i lane = _mm_loadu_si128( ( const __m128i * ) order );
+	__m256i mask = _mm256_broadcastsi128_si256( lane );
+
+	size_t i = 0;
+	for ( ; i + 32 <= size; i += 32 )
+	{
+		__m256i v = _mm256_loadu_si256( ( const __m256i * ) ( data + i ) );
+		_mm256_storeu_si256( ( __m256i * ) ( data + i ), _mm256_shuffle_epi8( v, mask ) );
+	}
+
+	return i;
+}
+
+static const uint8_t SWAP16_ORDER[ 16 ] = { 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 };
+static const uint8_t SWAP32_ORDER[ 16 ] = { 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 };
+static const uint8_t SWAP64_ORDER[ 16 ] = { 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8 };
+
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////
+// SSE2
+// There's no byte shuffle before SSSE3, so 32/64-bit values have their
+// 16-bit words reordered first and then the bytes within those swapped.
+/////////////////////////////////////////////////////////////////////////////////////
+
+#if defined( QM_OS_ENDIAN_SSE2 )
+
+static inline __m128i swap16_sse2( __m128i v )
+{
+	return _mm_or_si128( _mm_slli_epi16( v, 8 ), _mm_srli_epi16( v, 8 ) );
+}
+
+static size_t swap16_simd( uint8_t *data, size_t size )
+{
+	size_t i = 0;
+#	if defined( QM_OS_ENDIAN_AVX2 )
+	if ( has_avx2() )
+	{
+		i = swap_avx2( data, size, SWAP16_ORDER );
+	}
+#	endif
+
+	for ( ; i + 16 <= size; i += 16 )
+	{
+		__m128i v = _mm_loadu_si128( ( const __m128i * ) ( data + i ) );
+		_mm_storeu_si128( ( __m128i * ) ( data + i ), swap16_sse2( v ) );
+	}
+
+	return i;
+}
+
+static size_t swap32_simd( uint8_t *data, size_t size )
+{
+	size_t i = 0;
+#	if defined( QM_OS_ENDIAN_AVX2 )
+	if ( has_avx2() )
+	{
+		i = swap_avx2( data, size, SWAP32_ORDER );
+	}
+#	endif
+
+	for ( ; i + 16 <= size; i += 16 )
+	{
+		__m128i v = _mm_loadu_si128( ( const __m128i * ) ( data + i ) );
+		v         = _mm_shufflelo_epi16( v, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+		v         = _mm_shufflehi_epi16( v, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+		_mm_storeu_si128( ( __m128i * ) ( data + i ), swap16_sse2( v ) );
+	}
+
+	return i;
+}
+
+static size_t swap64_simd( uint8_t *data, size_t size )
+{
+	size_t i = 0;
+#	if defined( QM_OS_ENDIAN_AVX2 )
+	if ( has_avx2() )
+	{
+		i = swap_avx2( data, size, SWAP64_ORDER );
+	}
+#	endif
+
+	for ( ; i + 16 <= size; i += 16 )
+	{
+		__m128i v = _mm_loadu_si128( ( const __m128i * ) ( data + i ) );
+		v         = _mm_shufflelo_epi16( v, _MM_SHUFFLE( 0, 1, 2, 3 ) );
+		v         = _mm_shufflehi_epi16( v, _MM_SHUFFLE( 0, 1, 2, 3 ) );
+		_mm_storeu_si128( ( __m128i * ) ( data + i ), swap16_sse2( v ) );
+	}
+
+	return i;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// NEON
+/////////////////////////////////////////////////////////////////////////////////////
+
+#elif defined( QM_OS_ENDIAN_NEON )
+
+static size_t swap16_simd( uint8_t *data, size_t size )
+{
+	size_t i = 0;
+	for ( ; i + 16 <= size; i += 16 )
+	{
+		vst1q_u8( data + i, vrev16q_u8( vld1q_u8( data + i ) ) );
+	}
+
+	return i;
+}
+
+static size_t swap32_simd( uint8_t *data, size_t size )
+{
+	size_t i = 0;
+	for ( ; i + 16 <= size; i += 16 )
+	{
+		vst1q_u8( data + i, vrev32q_u8( vld1q_u8( data + i ) ) );
+	}
+
+	return i;
+}
+
+static size_t swap64_simd( uint8_t *data, size_t size )
+{
+	size_t i = 0;
+	for ( ; i + 16 <= size; i += 16 )
+	{
+		vst1q_u8( data + i, vrev64q_u8( vld1q_u8( data + i ) ) );
+	}
+
+	return i;
+}
+
+#else
+
+static size_t swap16_simd( uint8_t *, size_t ) { return 0; }
+static size_t swap32_simd( uint8_t *, size_t ) { return 0; }
+static size_t swap64_simd( uint8_t *, size_t ) { return 0; }
+
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+void qm_os_endian_swap16( void *data, size_t count )
+{
+	size_t done = swap16_simd( data, count * sizeof( uint16_t ) );
+	swap16_scalar( ( uint8_t * ) data + done, count - done / sizeof( uint16_t ) );
+}
+
+void qm_os_endian_swap32( void *data, size_t count )
+{
+	size_t done = swap32_simd( data, count * sizeof( uint32_t ) );
+	swap32_scalar( ( uint8_t * ) data + done, count - done / sizeof( uint32_t ) );
+}
+
+void qm_os_endian_swap64( void *data, size_t count )
+{
+	size_t done = swap64_simd( data, count * sizeof( uint64_t ) );
+	swap64_scalar( ( uint8_t * ) data + done, count - done / sizeof( uint64_t ) );
+}
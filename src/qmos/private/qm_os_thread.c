@@ -2,17 +2,474 @@
 // Purpose: API for dealing with threads.
 // Author:  Mark E. Sowden
 
-#include "qmos/public/qm_os.h"
+#include <assert.h>
 
-#if ( QM_OS_SYSTEM == QM_OS_SYSTEM_LINUX )
+#include "qmos/public/qm_os_thread.h"
+#include "qmos/public/qm_os_memory.h"
+
+#if ( QM_OS_SYSTEM == QM_OS_SYSTEM_LINUX ) || ( QM_OS_SYSTEM == QM_OS_SYSTEM_MACOS )
 #	include <unistd.h>
+#	include <pthread.h>
+#elif ( QM_OS_SYSTEM == QM_OS_SYSTEM_WINDOWS )
+#	define WIN32_LEAN_AND_MEAN
+#	include <windows.h>
 #endif
 
 unsigned int qm_os_thread_get_available()
 {
-#if ( QM_OS_SYSTEM == QM_OS_SYSTEM_LINUX )
-	return sysconf( _SC_NPROCESSORS_ONLN );
+#if ( QM_OS_SYSTEM == QM_OS_SYSTEM_LINUX ) || ( QM_OS_SYSTEM == QM_OS_SYSTEM_MACOS )
+	long n = sysconf( _SC_NPROCESSORS_ONLN );
+	return ( n > 0 ) ? ( unsigned int ) n : 1;
+#elif ( QM_OS_SYSTEM == QM_OS_SYSTEM_WINDOWS )
+	SYSTEM_INFO info;
+	GetSystemInfo( &info );
+	return info.dwNumberOfProcessors;
 #else
 #	error "Unimplemented!"
 #endif
 }
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Mutex / Condition
+/////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct QmOsMutex
+{
+#if ( QM_OS_SYSTEM == QM_OS_SYSTEM_WINDOWS )
+	SRWLOCK lock;
+#else
+	pthread_mutex_t mutex;
+#endif
+} QmOsMutex;
+
+typedef struct QmOsCondition
+{
+#if ( QM_OS_SYSTEM == QM_OS_SYSTEM_WINDOWS )
+	CONDITION_VARIABLE condition;
+#else
+	pthread_cond_t condition;
+#endif
+} QmOsCondition;
+
+static void mutex_init( QmOsMutex *self )
+{
+#if ( QM_OS_SYSTEM == QM_OS_SYSTEM_WINDOWS )
+	InitializeSRWLock( &self->lock );
+#else
+	pthread_mutex_init( &self->mutex, nullptr );
+#endif
+}
+
+static void mutex_destructor( void *ptr )
+{
+#if ( QM_OS_SYSTEM != QM_OS_SYSTEM_WINDOWS )
+	QmOsMutex *self = ptr;
+	pthread_mutex_destroy( &self->mutex );
+#endif
+}
+
+static void condition_init( QmOsCondition *self )
+{
+#if ( QM_OS_SYSTEM == QM_OS_SYSTEM_WINDOWS )
+	InitializeConditionVariable( &self->condition );
+#else
+	pthread_cond_init( &self->condition, nullptr );
+#endif
+}
+
+static void condition_destructor( void *ptr )
+{
+#if ( QM_OS_SYSTEM != QM_OS_SYSTEM_WINDOWS )
+	QmOsCondition *self = ptr;
+	pthread_cond_destroy( &self->condition );
+#endif
+}
+
+QmOsMutex *qm_os_mutex_create()
+{
+	QmOsMutex *self = QM_OS_MEMORY_NEW_D( QmOsMutex, mutex_destructor );
+	if ( self == nullptr )
+	{
+		return nullptr;
+	}
+
+	mutex_init( self );
+	return self;
+}
+
+void qm_os_mutex_lock( QmOsMutex *self )
+{
+#if ( QM_OS_SYSTEM == QM_OS_SYSTEM_WINDOWS )
+	AcquireSRWLockExclusive( &self->lock );
+#else
+	pthread_mutex_lock( &self->mutex );
+#endif
+}
+
+void qm_os_mutex_unlock( QmOsMutex *self )
+{
+#if ( QM_OS_SYSTEM == QM_OS_SYSTEM_WINDOWS )
+	ReleaseSRWLockExclusive( &self->lock );
+#else
+	pthread_mutex_unlock( &self->mutex );
+#endif
+}
+
+QmOsCondition *qm_os_condition_create()
+{
+	QmOsCondition *self = QM_OS_MEMORY_NEW_D( QmOsCondition, condition_destructor );
+	if ( self == nullptr )
+	{
+		return nullptr;
+	}
+
+	condition_init( self );
+	return self;
+}
+
+void qm_os_condition_wait( QmOsCondition *self, QmOsMutex *mutex )
+{
+#if ( QM_OS_SYSTEM == QM_OS_SYSTEM_WINDOWS )
+	SleepConditionVariableSRW( &self->condition, &mutex->lock, INFINITE, 0 );
+#else
+	pthread_cond_wait( &self->condition, &mutex->mutex );
+#endif
+}
+
+void qm_os_condition_signal( QmOsCondition *self )
+{
+#if ( QM_OS_SYSTEM == QM_OS_SYSTEM_WINDOWS )
+	WakeConditionVariable( &self->condition );
+#else
+	pthread_cond_signal( &self->condition );
+#endif
+}
+
+void qm_os_condition_broadcast( QmOsCondition *self )
+{
+#if ( QM_OS_SYSTEM == QM_OS_SYSTEM_WINDOWS )
+	WakeAllConditionVariable( &self->condition );
+#else
+	pthread_cond_broadcast( &self->condition );
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Thread
+/////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct QmOsThread
+{
+	void ( *function )( void *userData );
+	void *userData;
+#if ( QM_OS_SYSTEM == QM_OS_SYSTEM_WINDOWS )
+	HANDLE handle;
+#else
+	pthread_t handle;
+#endif
+} QmOsThread;
+
+#if ( QM_OS_SYSTEM == QM_OS_SYSTEM_WINDOWS )
+static DWORD WINAPI thread_entry( LPVOID ptr )
+{
+	QmOsThread *self = ptr;
+	self->function( self->userData );
+	return 0;
+}
+#else
+static void *thread_entry( void *ptr )
+{
+	QmOsThread *self = ptr;
+	self->function( self->userData );
+	return nullptr;
+}
+#endif
+
+QmOsThread *qm_os_thread_create( void ( *function )( void *userData ), void *userData )
+{
+	QmOsThread *self = QM_OS_MEMORY_NEW( QmOsThread );
+	if ( self == nullptr )
+	{
+		return nullptr;
+	}
+
+	self->function = function;
+	self->userData = userData;
+
+#if ( QM_OS_SYSTEM == QM_OS_SYSTEM_WINDOWS )
+	self->handle = CreateThread( nullptr, 0, thread_entry, self, 0, nullptr );
+	if ( self->handle == nullptr )
+	{
+		qm_os_memory_free( self );
+		return nullptr;
+	}
+#else
+	if ( pthread_create( &self->handle, nullptr, thread_entry, self ) != 0 )
+	{
+		qm_os_memory_free( self );
+		return nullptr;
+	}
+#endif
+
+	return self;
+}
+
+void qm_os_thread_join( QmOsThread *self )
+{
+	if ( self == nullptr )
+	{
+		return;
+	}
+
+#if ( QM_OS_SYSTEM == QM_OS_SYSTEM_WINDOWS )
+	WaitForSingleObject( self->handle, INFINITE );
+	CloseHandle( self->handle );
+#else
+	pthread_join( self->handle, nullptr );
+#endif
+
+	qm_os_memory_free( self );
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Thread Pool
+/////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct QmOsThreadPoolJob
+{
+	void ( *function )( void *userData );
+	void    *userData;
+	int      priority;
+	uint64_t sequence;// keeps jobs of the same priority in order
+} QmOsThreadPoolJob;
+
+typedef struct QmOsThreadPool
+{
+	QmOsThread **threads;
+	unsigned int numThreads;
+
+	/* jobs are kept in a binary heap, so the next job
+	 * is always at the front */
+	QmOsThreadPoolJob *jobs;
+	size_t             numJobs;
+	size_t             maxJobs;
+	uint64_t           nextSequence;
+	unsigned int       numActive;
+
+	QmOsMutex     mutex;
+	QmOsCondition jobCondition; // signalled when a job is queued
+	QmOsCondition idleCondition;// signalled when the pool runs dry
+	bool          shutdown;
+} QmOsThreadPool;
+
+static bool thread_pool_job_before( const QmOsThreadPoolJob *a, const QmOsThreadPoolJob *b )
+{
+	if ( a->priority != b->priority )
+	{
+		return a->priority > b->priority;
+	}
+
+	return a->sequence < b->sequence;
+}
+
+static bool thread_pool_heap_push( QmOsThreadPool *self, const QmOsThreadPoolJob *job )
+{
+	if ( self->numJobs >= self->maxJobs )
+	{
+		size_t             maxJobs = ( self->maxJobs == 0 ) ? 64 : self->maxJobs * 2;
+		QmOsThreadPoolJob *jobs    = qm_os_memory_realloc( self->jobs, sizeof( QmOsThreadPoolJob ) * maxJobs );
+		if ( jobs == nullptr )
+		{
+			return false;
+		}
+
+		self->jobs    = jobs;
+		self->maxJobs = maxJobs;
+	}
+
+	size_t i = self->numJobs++;
+	while ( i > 0 )
+	{
+		size_t parent = ( i - 1 ) / 2;
+		if ( !thread_pool_job_before( job, &self->jobs[ parent ] ) )
+		{
+			break;
+		}
+
+		self->jobs[ i ] = self->jobs[ parent ];
+		i               = parent;
+	}
+
+	self->jobs[ i ] = *job;
+
+	return true;
+}
+
+static QmOsThreadPoolJob thread_pool_heap_pop( QmOsThreadPool *self )
+{
+	assert( self->numJobs > 0 );
+
+	QmOsThreadPoolJob front = self->jobs[ 0 ];
+	QmOsThreadPoolJob last  = self->jobs[ --self->numJobs ];
+
+	size_t i = 0;
+	for ( ;; )
+	{
+		size_t child = i * 2 + 1;
+		if ( child >= self->numJobs )
+		{
+			break;
+		}
+
+		if ( child + 1 < self->numJobs && thread_pool_job_before( &self->jobs[ child + 1 ], &self->jobs[ child ] ) )
+		{
+			child++;
+		}
+
+		if ( !thread_pool_job_before( &self->jobs[ child ], &last ) )
+		{
+			break;
+		}
+
+		self->jobs[ i ] = self->jobs[ child ];
+		i               = child;
+	}
+
+	if ( self->numJobs > 0 )
+	{
+		self->jobs[ i ] = last;
+	}
+
+	return front;
+}
+
+static void thread_pool_worker( void *userData )
+{
+	QmOsThreadPool *self = userData;
+
+	qm_os_mutex_lock( &self->mutex );
+	for ( ;; )
+	{
+		while ( self->numJobs == 0 && !self->shutdown )
+		{
+			qm_os_condition_wait( &self->jobCondition, &self->mutex );
+		}
+
+		if ( self->numJobs == 0 )
+		{
+			break;
+		}
+
+		QmOsThreadPoolJob job = thread_pool_heap_pop( self );
+		self->numActive++;
+
+		qm_os_mutex_unlock( &self->mutex );
+		job.function( job.userData );
+		qm_os_mutex_lock( &self->mutex );
+
+		self->numActive--;
+		if ( self->numJobs == 0 && self->numActive == 0 )
+		{
+			qm_os_condition_broadcast( &self->idleCondition );
+		}
+	}
+	qm_os_mutex_unlock( &self->mutex );
+}
+
+static void thread_pool_destructor( void *ptr )
+{
+	QmOsThreadPool *self = ptr;
+
+	qm_os_mutex_lock( &self->mutex );
+	self->shutdown = true;
+	qm_os_condition_broadcast( &self->jobCondition );
+	qm_os_mutex_unlock( &self->mutex );
+
+	for ( unsigned int i = 0; i < self->numThreads; ++i )
+	{
+		qm_os_thread_join( self->threads[ i ] );
+	}
+
+	qm_os_memory_free( self->threads );
+	qm_os_memory_free( self->jobs );
+
+	condition_destructor( &self->idleCondition );
+	condition_destructor( &self->jobCondition );
+	mutex_destructor( &self->mutex );
+}
+
+QmOsThreadPool *qm_os_thread_pool_create( unsigned int numThreads )
+{
+	if ( numThreads == 0 )
+	{
+		numThreads = qm_os_thread_get_available();
+	}
+
+	QmOsThreadPool *self = QM_OS_MEMORY_NEW_D( QmOsThreadPool, thread_pool_destructor );
+	if ( self == nullptr )
+	{
+		return nullptr;
+	}
+
+	mutex_init( &self->mutex );
+	condition_init( &self->jobCondition );
+	condition_init( &self->idleCondition );
+
+	self->threads = QM_OS_MEMORY_NEW_( QmOsThread *, numThreads );
+	for ( unsigned int i = 0; i < numThreads; ++i )
+	{
+		self->threads[ i ] = qm_os_thread_create( thread_pool_worker, self );
+		if ( self->threads[ i ] == nullptr )
+		{
+			break;
+		}
+
+		self->numThreads++;
+	}
+
+	if ( self->numThreads == 0 )
+	{
+		qm_os_memory_free( self );
+		return nullptr;
+	}
+
+	return self;
+}
+
+void qm_os_thread_pool_push( QmOsThreadPool *self, void ( *function )( void *userData ), void *userData, int priority )
+{
+	qm_os_mutex_lock( &self->mutex );
+
+	const QmOsThreadPoolJob job = {
+	        .function = function,
+	        .userData = userData,
+	        .priority = priority,
+	        .sequence = self->nextSequence++,
+	};
+	if ( !thread_pool_heap_push( self, &job ) )
+	{
+		/* couldn't grow the queue, so rather than lose the job,
+		 * run it here instead */
+		qm_os_mutex_unlock( &self->mutex );
+		function( userData );
+		return;
+	}
+
+	qm_os_condition_signal( &self->jobCondition );
+	qm_os_mutex_unlock( &self->mutex );
+}
+
+void qm_os_thread_pool_wait( QmOsThreadPool *self )
+{
+	qm_os_mutex_lock( &self->mutex );
+	while ( self->numJobs > 0 || self->numActive > 0 )
+	{
+		qm_os_condition_wait( &self->idleCondition, &self->mutex );
+	}
+	qm_os_mutex_unlock( &self->mutex );
+}
+
+unsigned int qm_os_thread_pool_get_num_threads( const QmOsThreadPool *self )
+{
+	return self->numThreads;
+}
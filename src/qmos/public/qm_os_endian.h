@@ -0,0 +1,45 @@
+// Copyright © 2017-2026 Quartermind Games, Mark E. Sowden <markelswo@gmail.com>
+
+#pragma once
+
+#include "qm_os.h"
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Endian
+// Bulk byte-swapping for arrays, using SSE2/AVX2 or NEON where available.
+/////////////////////////////////////////////////////////////////////////////////////
+
+#if defined( __cplusplus )
+extern "C"
+{
+#endif
+
+	/**
+	 * Reverses the byte order of each value in the given array, in place.
+	 *
+	 * @param data Array of 16, 32 or 64-bit values.
+	 * @param count Number of values in the array.
+	 */
+	void qm_os_endian_swap16( void *data, size_t count );
+	void qm_os_endian_swap32( void *data, size_t count );
+	void qm_os_endian_swap64( void *data, size_t count );
+
+#if QM_OS_HARDWARE_ENDIANNESS == QM_OS_HARDWARE_BIG_ENDIAN
+#	define qm_os_endian_from_big16( DATA, COUNT )
+#	define qm_os_endian_from_big32( DATA, COUNT )
+#	define qm_os_endian_from_big64( DATA, COUNT )
+#	define qm_os_endian_from_little16( DATA, COUNT ) qm_os_endian_swap16( ( DATA ), ( COUNT ) )
+#	define qm_os_endian_from_little32( DATA, COUNT ) qm_os_endian_swap32( ( DATA ), ( COUNT ) )
+#	define qm_os_endian_from_little64( DATA, COUNT ) qm_os_endian_swap64( ( DATA ), ( COUNT ) )
+#else
+#	define qm_os_endian_from_big16( DATA, COUNT )    qm_os_endian_swap16( ( DATA ), ( COUNT ) )
+#	define qm_os_endian_from_big32( DATA, COUNT )    qm_os_endian_swap32( ( DATA ), ( COUNT ) )
+#	define qm_os_endian_from_big64( DATA, COUNT )    qm_os_endian_swap64( ( DATA ), ( COUNT ) )
+#	define qm_os_endian_from_little16( DATA, COUNT )
+#	define qm_os_endian_from_little32( DATA, COUNT )
+#	define qm_os_endian_from_little64( DATA, COUNT )
+#endif
+
+#if defined( __cplusplus )
+};
+#endif
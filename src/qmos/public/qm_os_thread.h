@@ -0,0 +1,101 @@
+// Copyright © 2017-2026 Quartermind Games, Mark E. Sowden <markelswo@gmail.com>
+
+#pragma once
+
+#include "qm_os.h"
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Threads
+/////////////////////////////////////////////////////////////////////////////////////
+
+#if defined( __cplusplus )
+extern "C"
+{
+#endif
+
+	/**
+	 * Returns the number of hardware threads available on the system.
+	 */
+	unsigned int qm_os_thread_get_available();
+
+	typedef struct QmOsThread QmOsThread;
+
+	/**
+	 * Spawns a new thread running the given function.
+	 * The thread must be joined via qm_os_thread_join.
+	 *
+	 * @param function Function to run on the thread.
+	 * @param userData Passed to the function.
+	 * @return A new thread instance, otherwise nullptr on fail.
+	 */
+	QmOsThread *qm_os_thread_create( void ( *function )( void *userData ), void *userData );
+
+	/**
+	 * Blocks until the given thread has finished and then frees it.
+	 * @param self Thread instance.
+	 */
+	void qm_os_thread_join( QmOsThread *self );
+
+	/////////////////////////////////////////////////////////////////////////////////////
+	// Mutex / Condition
+	// Call memory_free to destroy either.
+	/////////////////////////////////////////////////////////////////////////////////////
+
+	typedef struct QmOsMutex QmOsMutex;
+
+	QmOsMutex *qm_os_mutex_create();
+	void       qm_os_mutex_lock( QmOsMutex *self );
+	void       qm_os_mutex_unlock( QmOsMutex *self );
+
+	typedef struct QmOsCondition QmOsCondition;
+
+	QmOsCondition *qm_os_condition_create();
+
+	/**
+	 * Atomically unlocks the mutex and waits for the condition to be
+	 * signalled, relocking the mutex before returning. As with any
+	 * condition variable, this can wake spuriously.
+	 */
+	void qm_os_condition_wait( QmOsCondition *self, QmOsMutex *mutex );
+	void qm_os_condition_signal( QmOsCondition *self );
+	void qm_os_condition_broadcast( QmOsCondition *self );
+
+	/////////////////////////////////////////////////////////////////////////////////////
+	// Thread Pool
+	/////////////////////////////////////////////////////////////////////////////////////
+
+	typedef struct QmOsThreadPool QmOsThreadPool;
+
+	/**
+	 * Allocate a new pool of worker threads.
+	 * Call memory_free to destroy (will finish any queued jobs first).
+	 *
+	 * @param numThreads Number of workers, or 0 to use every available thread.
+	 * @return A new thread pool instance, otherwise nullptr on fail.
+	 */
+	QmOsThreadPool *qm_os_thread_pool_create( unsigned int numThreads );
+
+	/**
+	 * Queues up a job on the pool. Jobs with a higher priority are
+	 * picked up first, otherwise jobs are run in the order queued.
+	 * If the queue can't be grown, the job is run on the calling
+	 * thread instead.
+	 *
+	 * @param self Thread pool instance.
+	 * @param function Function to run on a worker.
+	 * @param userData Passed to the function.
+	 * @param priority Priority of the job.
+	 */
+	void qm_os_thread_pool_push( QmOsThreadPool *self, void ( *function )( void *userData ), void *userData, int priority );
+
+	/**
+	 * Blocks until all queued jobs have been completed.
+	 * @param self Thread pool instance.
+	 */
+	void qm_os_thread_pool_wait( QmOsThreadPool *self );
+
+	unsigned int qm_os_thread_pool_get_num_threads( const QmOsThreadPool *self );
+
+#if defined( __cplusplus )
+};
+#endif
@@ -3,15 +3,59 @@
 // Author:  Mark E. Sowden
 
 #include "qmos/public/qm_os.h"
+#include "qmos/public/qm_os_endian.h"
 #include "qmos/public/qm_os_memory.h"
 #include "qmos/public/qm_os_shared_ptr.h"
 #include "qmos/public/qm_os_string.h"
+#include "qmos/public/qm_os_thread.h"
 #include "qmos/public/qm_os_time.h"
 #include "qmos/public/qm_os_random.h"
 #include "qmos/public/qm_os_linked_list.h"
 
 #include "qmtest/public/qm_test.h"
 
+QM_TEST_FUNC( endian )
+{
+	// odd counts, so both the vector and scalar paths get a go
+	uint16_t a[ 37 ];
+	uint32_t b[ 37 ];
+	uint64_t c[ 37 ];
+	for ( unsigned int i = 0; i < 37; ++i )
+	{
+		a[ i ] = ( uint16_t ) ( 0x0102 + i );
+		b[ i ] = 0x01020304 + i;
+		c[ i ] = 0x0102030405060708 + i;
+	}
+
+	qm_os_endian_swap16( a, 37 );
+	qm_os_endian_swap32( b, 37 );
+	qm_os_endian_swap64( c, 37 );
+	for ( unsigned int i = 0; i < 37; ++i )
+	{
+		uint16_t ea = ( uint16_t ) ( 0x0102 + i );
+		uint32_t eb = 0x01020304 + i;
+		uint64_t ec = 0x0102030405060708 + i;
+		QM_TEST_ASSERT( a[ i ] == ( uint16_t ) ( ( ea >> 8 ) | ( ea << 8 ) ) );
+		QM_TEST_ASSERT( b[ i ] == ( ( eb >> 24 ) | ( ( eb >> 8 ) & 0xFF00 ) | ( ( eb << 8 ) & 0xFF0000 ) | ( eb << 24 ) ) );
+		QM_TEST_ASSERT( ( uint32_t ) ( c[ i ] >> 32 ) == ( ( ( uint32_t ) ec >> 24 ) | ( ( ( uint32_t ) ec >> 8 ) & 0xFF00 ) | ( ( ( uint32_t ) ec << 8 ) & 0xFF0000 ) | ( ( uint32_t ) ec << 24 ) ) );
+	}
+
+	// and back again, from an unaligned start
+	uint8_t bytes[ 67 ];
+	for ( unsigned int i = 0; i < sizeof( bytes ); ++i )
+	{
+		bytes[ i ] = ( uint8_t ) i;
+	}
+	qm_os_endian_swap32( bytes + 1, 16 );
+	QM_TEST_ASSERT( bytes[ 1 ] == 4 && bytes[ 4 ] == 1 && bytes[ 61 ] == 64 && bytes[ 64 ] == 61 );
+	qm_os_endian_swap32( bytes + 1, 16 );
+	for ( unsigned int i = 0; i < sizeof( bytes ); ++i )
+	{
+		QM_TEST_ASSERT( bytes[ i ] == i );
+	}
+}
+QM_TEST_FUNC_END()
+
 QM_TEST_FUNC( linked_list )
 {
 	QmOsLinkedList *list = qm_os_linked_list_create();
@@ -176,6 +220,78 @@ QM_TEST_FUNC( string )
 }
 QM_TEST_FUNC_END()
 
+typedef struct MyJobs
+{
+	QmOsMutex   *mutex;
+	unsigned int order[ 4 ];
+	unsigned int numDone;
+	unsigned int sum;
+} MyJobs;
+
+static MyJobs myJobs;
+
+static void block_job( void *userData )
+{
+	// holds up the only worker until everything else is queued
+	qm_os_mutex_lock( myJobs.mutex );
+	qm_os_mutex_unlock( myJobs.mutex );
+}
+
+static void order_job( void *userData )
+{
+	myJobs.order[ myJobs.numDone++ ] = ( unsigned int ) ( uintptr_t ) userData;
+}
+
+static void sum_job( void *userData )
+{
+	qm_os_mutex_lock( myJobs.mutex );
+	myJobs.sum += ( unsigned int ) ( uintptr_t ) userData;
+	qm_os_mutex_unlock( myJobs.mutex );
+}
+
+QM_TEST_FUNC( thread_pool )
+{
+	QM_TEST_ASSERT( qm_os_thread_get_available() > 0 );
+
+	myJobs.mutex = qm_os_mutex_create();
+	QM_TEST_ASSERT( myJobs.mutex != nullptr );
+
+	// single worker, so the order jobs run in is down to priority
+	QmOsThreadPool *pool = qm_os_thread_pool_create( 1 );
+	QM_TEST_ASSERT( pool != nullptr );
+	QM_TEST_ASSERT( qm_os_thread_pool_get_num_threads( pool ) == 1 );
+
+	qm_os_mutex_lock( myJobs.mutex );
+	qm_os_thread_pool_push( pool, block_job, nullptr, 100 );
+	qm_os_thread_pool_push( pool, order_job, ( void * ) 3, 0 );
+	qm_os_thread_pool_push( pool, order_job, ( void * ) 1, 10 );
+	qm_os_thread_pool_push( pool, order_job, ( void * ) 4, 0 );
+	qm_os_thread_pool_push( pool, order_job, ( void * ) 2, 5 );
+	qm_os_mutex_unlock( myJobs.mutex );
+
+	qm_os_thread_pool_wait( pool );
+	QM_TEST_ASSERT( myJobs.numDone == 4 );
+	QM_TEST_ASSERT( myJobs.order[ 0 ] == 1 && myJobs.order[ 1 ] == 2 && myJobs.order[ 2 ] == 3 && myJobs.order[ 3 ] == 4 );
+
+	qm_os_memory_free( pool );
+
+	pool = qm_os_thread_pool_create( 0 );
+	QM_TEST_ASSERT( pool != nullptr );
+	QM_TEST_ASSERT( qm_os_thread_pool_get_num_threads( pool ) == qm_os_thread_get_available() );
+
+	for ( unsigned int i = 1; i <= 1000; ++i )
+	{
+		qm_os_thread_pool_push( pool, sum_job, ( void * ) ( uintptr_t ) i, 0 );
+	}
+
+	// destroying the pool should finish off whatever is still queued
+	qm_os_memory_free( pool );
+	QM_TEST_ASSERT( myJobs.sum == 500500 );
+
+	qm_os_memory_free( myJobs.mutex );
+}
+QM_TEST_FUNC_END()
+
 QM_TEST_FUNC( time )
 {
 	const double seconds = qm_os_time_get_seconds();
@@ -189,11 +305,13 @@ QM_TEST_FUNC_END()
 int main( int, char ** )
 {
 	TEST_RUN_INIT
+	CALL_FUNC_TEST( endian )
 	CALL_FUNC_TEST( linked_list )
 	CALL_FUNC_TEST( memory )
 	CALL_FUNC_TEST( random )
 	CALL_FUNC_TEST( shared_ptr )
 	CALL_FUNC_TEST( string )
+	CALL_FUNC_TEST( thread_pool )
 	CALL_FUNC_TEST( time )
 	TEST_RUN_END
 }